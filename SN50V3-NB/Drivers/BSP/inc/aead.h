@@ -0,0 +1,23 @@
+#ifndef __AEAD_H
+#define __AEAD_H
+
+#include "common.h"
+
+#define AEAD_KEY_SIZE 16    // AES-128 key, bytes
+#define AEAD_HEADER_SIZE 8  // clear device id leading the frame, bytes
+#define AEAD_COUNTER_SIZE 4 // frame counter sent after the header, bytes
+#define AEAD_TAG_SIZE 8     // CCM tag appended to the frame, bytes
+#define AEAD_NONCE_STEP 64  // frames reserved in EEPROM at a time
+
+// Reads len characters of a hex frame from offset, returns how many it read
+typedef size_t (*Aead_Reader)(size_t offset, char *dst, size_t len);
+
+void Aead_Init(void);
+uint8_t Aead_KeySet(const uint8_t *key);
+uint8_t Aead_KeyValid(void);
+uint32_t Aead_Counter(void);
+size_t Aead_Seal(char *hex, size_t len);
+size_t Aead_SealOpen(Aead_Reader read, size_t len);
+size_t Aead_SealRead(size_t offset, char *dst, size_t len);
+
+#endif
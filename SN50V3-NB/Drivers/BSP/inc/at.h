@@ -13,7 +13,8 @@
 /* AT Command strings. Commands start with AT */
 #define AT "AT"
 #define MODEL "+MODEL"
-#define RESET "Z"
+// not RESET, which would shadow the HAL FlagStatus value
+#define AT_RESET_CMD "Z"
 #define CFGMOD "+CFGMOD"
 #define DEUI "+DEUI"
 
@@ -57,6 +58,16 @@
 #define URI2 "+URI2"
 #define URI3 "+URI3"
 #define URI4 "+URI4"
+#define LIDARACQ "+LIDARACQ"
+#define ENERGY "+ENERGY"
+#define BATCAP "+BATCAP"
+#define LPM "+LPM"
+#define AUTH "+AUTH"
+#define AEAD "+AEAD"
+#define AEADKEY "+AEADKEY"
+#define SAVE "+SAVE"
+#define COAPMOD "+COAPMOD"
+#define CONFIRM "+CONFIRM"
 /**********************************************/
 
 typedef enum {
@@ -163,11 +174,31 @@ ATEerror_t at_uri3_set(const char *param);
 ATEerror_t at_uri3_get(const char *param);
 ATEerror_t at_uri4_set(const char *param);
 ATEerror_t at_uri4_get(const char *param);
+ATEerror_t at_lidaracq_get(const char *param);
+ATEerror_t at_lidaracq_set(const char *param);
+ATEerror_t at_energy_get(const char *param);
+ATEerror_t at_energy_set(const char *param);
+ATEerror_t at_batcap_get(const char *param);
+ATEerror_t at_batcap_set(const char *param);
+ATEerror_t at_lpm_get(const char *param);
+ATEerror_t at_auth_get(const char *param);
+ATEerror_t at_auth_set(const char *param);
+ATEerror_t at_aead_get(const char *param);
+ATEerror_t at_aead_set(const char *param);
+ATEerror_t at_aeadkey_get(const char *param);
+ATEerror_t at_aeadkey_set(const char *param);
+ATEerror_t at_save_get(const char *param);
+ATEerror_t at_save_run(const char *param);
+ATEerror_t at_coapmod_get(const char *param);
+ATEerror_t at_coapmod_set(const char *param);
+ATEerror_t at_confirm_get(const char *param);
+ATEerror_t at_confirm_set(const char *param);
 /*Other*/
 char *rtrim(char *str);
 uint8_t hexDetection(char *str);
-void config_Set(void);
-void config_Get(void);
+#define AT_VALUE_MAX 220 // longest value of AT_SetValue(), bytes
+
+void AT_Init(void);
 
 struct ATCommand_s {
   const char *string; /*< command string, after the "AT" */
@@ -184,6 +215,8 @@ struct ATCommand_s {
 #endif
 };
 
+int AT_Sort(const struct ATCommand_s *table, uint8_t *index, int count);
+
 static const struct ATCommand_s ATCommand[] = {
     /** AT+MODEL **/
     {
@@ -198,10 +231,10 @@ static const struct ATCommand_s ATCommand[] = {
     },
     /** ATZ **/
     {
-        .string = AT RESET,
-        .size_string = sizeof(RESET) - 1,
+        .string = AT AT_RESET_CMD,
+        .size_string = sizeof(AT_RESET_CMD) - 1,
 #ifndef NO_HELP
-        .help_string = AT RESET "        : Trig a reset of the MCU",
+        .help_string = AT AT_RESET_CMD "        : Trig a reset of the MCU",
 #endif
         .get = at_return_error,
         .set = at_return_error,
@@ -558,7 +591,7 @@ static const struct ATCommand_s ATCommand[] = {
     /** AT+CLOCKLOG **/
     {
         .string = AT CLOCKLOG,
-        .size_string = sizeof(AT CLOCKLOG) - 1,
+        .size_string = sizeof(CLOCKLOG) - 1,
 #ifndef NO_HELP
         .help_string = AT CLOCKLOG ": Get or set SHT record time",
 #endif
@@ -569,7 +602,7 @@ static const struct ATCommand_s ATCommand[] = {
     /** AT+URI **/
     {
         .string = AT URI1,
-        .size_string = sizeof(AT URI1) - 1,
+        .size_string = sizeof(URI1) - 1,
 #ifndef NO_HELP
         .help_string = AT URI1 ": Get or set CoAP option 1",
 #endif
@@ -579,7 +612,7 @@ static const struct ATCommand_s ATCommand[] = {
     },
     {
         .string = AT URI2,
-        .size_string = sizeof(AT URI2) - 1,
+        .size_string = sizeof(URI2) - 1,
 #ifndef NO_HELP
         .help_string = AT URI2 ": Get or set CoAP option 2",
 #endif
@@ -589,7 +622,7 @@ static const struct ATCommand_s ATCommand[] = {
     },
     {
         .string = AT URI3,
-        .size_string = sizeof(AT URI3) - 1,
+        .size_string = sizeof(URI3) - 1,
 #ifndef NO_HELP
         .help_string = AT URI3 ": Get or set CoAP option 3",
 #endif
@@ -599,7 +632,7 @@ static const struct ATCommand_s ATCommand[] = {
     },
     {
         .string = AT URI4,
-        .size_string = sizeof(AT URI4) - 1,
+        .size_string = sizeof(URI4) - 1,
 #ifndef NO_HELP
         .help_string = AT URI4 ": Get or set CoAP option 4",
 #endif
@@ -607,8 +640,120 @@ static const struct ATCommand_s ATCommand[] = {
         .set = at_uri4_set,
         .run = at_return_error,
     },
+    /** AT+COAPMOD **/
+    {
+        .string = AT COAPMOD,
+        .size_string = sizeof(COAPMOD) - 1,
+#ifndef NO_HELP
+        .help_string = AT COAPMOD ": Get or Set 0 to use the CoAP stack of the module, the payload in hex text, 1 to build the messages and send them over UDP, the payload in binary, 2 for an LwM2M client",
+#endif
+        .get = at_coapmod_get,
+        .set = at_coapmod_set,
+        .run = at_return_error,
+    },
+    /** AT+CONFIRM **/
+    {
+        .string = AT CONFIRM,
+        .size_string = sizeof(CONFIRM) - 1,
+#ifndef NO_HELP
+        .help_string = AT CONFIRM ": Get or Set N to confirm one uplink in N (CoAP CON, MQTT QoS 1 or AT+MQOS), the others sent without waiting, 0 to confirm all",
+#endif
+        .get = at_confirm_get,
+        .set = at_confirm_set,
+        .run = at_return_error,
+    },
+    /** AT+LIDARACQ **/
+    {
+        .string = AT LIDARACQ,
+        .size_string = sizeof(LIDARACQ) - 1,
+#ifndef NO_HELP
+        .help_string = AT LIDARACQ ": Get or Set the LIDAR acquisition count (0:sensor default)",
+#endif
+        .get = at_lidaracq_get,
+        .set = at_lidaracq_set,
+        .run = at_return_error,
+    },
+    /** AT+ENERGY **/
+    {
+        .string = AT ENERGY,
+        .size_string = sizeof(ENERGY) - 1,
+#ifndef NO_HELP
+        .help_string = AT ENERGY ": Get the energy report, Set 0/1 to append it to uplinks or <phase>,<uA>",
+#endif
+        .get = at_energy_get,
+        .set = at_energy_set,
+        .run = at_energy_get,
+    },
+    /** AT+BATCAP **/
+    {
+        .string = AT BATCAP,
+        .size_string = sizeof(BATCAP) - 1,
+#ifndef NO_HELP
+        .help_string = AT BATCAP ": Get or Set the battery capacity in mAh (setting it restarts the used charge count)",
+#endif
+        .get = at_batcap_get,
+        .set = at_batcap_set,
+        .run = at_return_error,
+    },
+    /** AT+LPM **/
+    {
+        .string = AT LPM,
+        .size_string = sizeof(LPM) - 1,
+#ifndef NO_HELP
+        .help_string = AT LPM ": Get the low power mode, the subsystems blocking Stop and the wake-up counts",
+#endif
+        .get = at_lpm_get,
+        .set = at_return_error,
+        .run = at_lpm_get,
+    },
+    /** AT+AUTH **/
+    {
+        .string = AT AUTH,
+        .size_string = sizeof(AUTH) - 1,
+#ifndef NO_HELP
+        .help_string = AT AUTH ": Get or Set the binary frame tag length 4/8/16/32 bytes, 0 for the HMAC of the hex payload",
+#endif
+        .get = at_auth_get,
+        .set = at_auth_set,
+        .run = at_return_error,
+    },
+    /** AT+AEADKEY **/
+    {
+        .string = AT AEADKEY,
+        .size_string = sizeof(AEADKEY) - 1,
+#ifndef NO_HELP
+        .help_string = AT AEADKEY ": Get whether the payload key is set and the frame counter, Set the 16-byte key in hex",
+#endif
+        .get = at_aeadkey_get,
+        .set = at_aeadkey_set,
+        .run = at_return_error,
+    },
+    /** AT+AEAD **/
+    {
+        .string = AT AEAD,
+        .size_string = sizeof(AEAD) - 1,
+#ifndef NO_HELP
+        .help_string = AT AEAD ": Get or Set 1 to encrypt the payload with AES-128-CCM, 0 to send it in clear with the HMAC",
+#endif
+        .get = at_aead_get,
+        .set = at_aead_set,
+        .run = at_return_error,
+    },
+    /** AT+SAVE **/
+    {
+        .string = AT SAVE,
+        .size_string = sizeof(SAVE) - 1,
+#ifndef NO_HELP
+        .help_string = AT SAVE ": Write the changed settings to flash now, Get 1 while some are not written yet",
+#endif
+        .get = at_save_get,
+        .set = at_return_error,
+        .run = at_save_run,
+    },
 };
 
 ATEerror_t ATInsPro(char *at);
+ATEerror_t AT_SetValue(const char *command, const char *value, size_t len);
+void AT_GetAll(const char *param);
 
 #endif
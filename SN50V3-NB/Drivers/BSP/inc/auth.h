@@ -0,0 +1,19 @@
+#ifndef __AUTH_H
+#define __AUTH_H
+
+#include "common.h"
+
+#define AUTH_TAG_MAX 32 // HMAC-SHA256 tag length, bytes
+
+// Reads len characters of a frame from offset, returns how many it read
+typedef size_t (*Auth_Reader)(size_t offset, char *dst, size_t len);
+
+uint8_t Auth_Init(void);
+uint8_t Auth_SetKey(const uint8_t *hmacKey, size_t hmacKeyLen);
+uint8_t Auth_Tag(const uint8_t *msg, size_t len, uint8_t *tag, size_t tagLen);
+uint8_t Auth_TagHex(const char *hex, size_t len, uint8_t *tag, size_t tagLen);
+uint8_t Auth_TagRead(Auth_Reader read, size_t len, uint8_t hex, uint8_t *tag,
+                     size_t tagLen);
+uint8_t Auth_TagLenValid(uint32_t tagLen);
+
+#endif
@@ -5,6 +5,23 @@
 
 #define VREFINT_CAL ((uint16_t *)((uint32_t)0x1FF80078))
 #define VDDA_VREFINT_CAL ((uint32_t)3000)
+#define TEMP30_CAL ((uint16_t *)((uint32_t)0x1FF8007A))
+#define TEMP130_CAL ((uint16_t *)((uint32_t)0x1FF8007E))
+
+#define ADC_CAL_VDD_DRIFT_MV 100 // recalibrate when VDD moved by more
+#define ADC_CAL_TEMP_DRIFT_C 10  // recalibrate when die temp moved by more
+#define VREFINT_FILTER_SHIFT 2   // IIR weight 1/4 for the VREFINT filter
+#define ADC_CAL_CHECK_INTERVAL 3600000 // ms between two drift checks
+
+typedef struct {
+  uint8_t valid;
+  uint32_t factor;
+  uint16_t vdd_mV;
+  int16_t temp_C;
+  uint32_t checked; // TimerGetCurrentTime() of the last drift check
+} ADC_CalibCache;
+
+void HW_AdcCalibrate(void);
 
 uint16_t HW_AdcReadChannel(uint32_t Channel);
 uint16_t getVoltage(void);
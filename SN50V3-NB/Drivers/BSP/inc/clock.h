@@ -0,0 +1,23 @@
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include "common.h"
+
+/* Baud rate registers for a kernel clock of clk Hz, rounded as the HAL
+ * does: oversampling by 16 on the USARTs, 256 * clk / baud on LPUART1 */
+#define CLOCK_USART_BRR(clk, baud) (((clk) + (baud) / 2U) / (baud))
+#define CLOCK_LPUART_BRR(clk, baud)                                            \
+  ((uint32_t)(((uint64_t)(clk) * 256U + (baud) / 2U) / (baud)))
+
+typedef enum {
+  CLOCK_MSI2 = 0, // MSI 2.1 MHz, range 3: plain waits
+  CLOCK_HSI16,    // HSI16, range 2: sensor reads, 1-wire, I2C, ADC
+  CLOCK_PLL32,    // PLL 32 MHz, range 1: modem, payload and console work
+  CLOCK_PROFILES,
+} ClockProfile;
+
+uint8_t Clock_Get(void);
+uint8_t Clock_Set(uint8_t profile);
+void Clock_Wait(uint32_t ms);
+
+#endif
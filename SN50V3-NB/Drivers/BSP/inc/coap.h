@@ -0,0 +1,108 @@
+#ifndef __COAP_H
+#define __COAP_H
+
+#include "common.h"
+
+#define COAP_HEADER_SIZE 4
+#define COAP_TOKEN_MAX 8
+#define COAP_PAYLOAD_MARKER 0xFF
+
+#define COAP_CON 0 // confirmable, acknowledged by the peer
+#define COAP_NON 1 // non-confirmable
+#define COAP_ACK 2
+#define COAP_RST 3
+
+#define COAP_CODE(c, d) ((c) << 5 | (d))
+#define COAP_EMPTY COAP_CODE(0, 0)
+#define COAP_GET COAP_CODE(0, 1)
+#define COAP_POST COAP_CODE(0, 2)
+#define COAP_PUT COAP_CODE(0, 3)
+#define COAP_CREATED COAP_CODE(2, 1)
+#define COAP_CHANGED COAP_CODE(2, 4)
+#define COAP_CONTENT COAP_CODE(2, 5)
+#define COAP_CONTINUE COAP_CODE(2, 31)
+#define COAP_NOT_FOUND COAP_CODE(4, 4)
+#define COAP_NOT_ALLOWED COAP_CODE(4, 5)
+#define COAP_TOO_LARGE COAP_CODE(4, 13)
+#define COAP_UNSUPPORTED_FORMAT COAP_CODE(4, 15)
+
+#define COAP_OPTION_OBSERVE 6
+#define COAP_OPTION_LOCATION_PATH 8
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY 15
+#define COAP_OPTION_BLOCK1 27
+#define COAP_OPTION_SIZE1 60
+
+#define COAP_FORMAT_LINK 40
+#define COAP_FORMAT_OCTET_STREAM 42
+#define COAP_FORMAT_SENML_CBOR 112
+
+// Block1 option value (RFC 7959), blocks being 16 << szx bytes
+#define COAP_BLOCK(num, more, szx) ((num) << 4 | (more) << 3 | (szx))
+#define COAP_BLOCK_SIZE(szx) ((size_t)16 << (szx))
+#define COAP_SZX_MAX 6 // 1024 bytes, 7 being reserved
+
+// Transmission parameters of confirmable messages (RFC 7252 4.8)
+#define COAP_ACK_TIMEOUT 2000 // ms
+#define COAP_MAX_RETRANSMIT 4
+
+typedef struct {
+  uint8_t type;
+  uint8_t code;
+  uint16_t mid;
+  uint8_t tkl;
+  uint8_t token[COAP_TOKEN_MAX];
+  const uint8_t *options;
+  size_t options_len;
+  const uint8_t *payload;
+  size_t payload_len;
+} CoapMessage;
+
+typedef struct {
+  uint16_t number;
+  uint16_t len;
+  const uint8_t *value;
+} CoapOption;
+
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  uint16_t option; // number of the last option written
+  uint8_t payload; // the payload marker is written
+  uint8_t error;
+} CoapWriter;
+
+// A request body sent in Block1 blocks when it doesn't fit in one
+typedef struct {
+  size_t len;   // of the whole body
+  uint32_t num; // number of the block being sent
+  uint8_t szx;  // size of the blocks, COAP_BLOCK_SIZE(szx)
+  uint8_t wise; // the body goes in blocks
+} CoapBlock;
+
+// Retransmission of a confirmable message until it is answered
+typedef struct {
+  uint32_t timeout; // ms to wait for the answer
+  uint8_t count;    // retransmissions so far
+} CoapRetransmit;
+
+void Coap_Begin(CoapWriter *w, uint8_t *buf, size_t size,
+                const CoapMessage *msg);
+void Coap_Option(CoapWriter *w, uint16_t number, const void *value,
+                 size_t len);
+void Coap_OptionUint(CoapWriter *w, uint16_t number, uint32_t value);
+void Coap_Payload(CoapWriter *w, const void *data, size_t len);
+size_t Coap_End(CoapWriter *w);
+uint8_t Coap_Parse(CoapMessage *msg, const uint8_t *buf, size_t len);
+uint8_t Coap_OptionNext(const CoapMessage *msg, CoapOption *opt);
+uint32_t Coap_OptionUintValue(const CoapOption *opt);
+uint8_t Coap_Matches(const CoapMessage *rsp, const CoapMessage *req);
+void Coap_BlockStart(CoapBlock *b, size_t len, uint8_t szx);
+size_t Coap_BlockSlice(const CoapBlock *b, size_t *offset, uint8_t *more);
+uint8_t Coap_BlockAnswer(CoapBlock *b, const CoapMessage *rsp);
+void Coap_RetransmitStart(CoapRetransmit *r, uint32_t random);
+uint8_t Coap_RetransmitNext(CoapRetransmit *r);
+
+#endif
@@ -12,11 +12,22 @@
 #include "string.h"
 #include "usart.h"
 
+#include "aead.h"
 #include "at.h"
+#include "auth.h"
 #include "battery_read.h"
+#include "clock.h"
+#include "coap.h"
+#include "config.h"
+#include "confirm.h"
+#include "count.h"
+#include "downlink.h"
 #include "ds18b20.h"
+#include "energy.h"
 #include "lidar.h"
+#include "low_power_manager.h"
 #include "maxsonar.h"
+#include "sensor_power.h"
 #include "sht20.h"
 #include "sht31.h"
 #include "time_server.h"
@@ -84,6 +95,14 @@ typedef struct {
   uint8_t log_seq;
   bool clock_switch;
   uint16_t strat_time;
+  uint8_t lidar_acq;  // LIDAR-Lite acquisition count, 0 keeps the default
+  bool energy_uplink; // append the last cycle charge (uAh) to uplinks
+  uint16_t bat_cap;   // battery capacity (mAh) for the remaining life
+  uint8_t auth_tag;   // binary frame tag length (bytes), 0 for the hex tag
+  bool aead;          // encrypt the payload with the provisioned key
+  uint8_t coap_mode;  // COAP_MODEM, COAP_UDP or COAP_LWM2M
+  // AT+CONFIRM: one uplink in N confirmed, 0 for all
+  uint8_t confirm_every;
 } SYSTEM;
 
 typedef struct {
@@ -120,6 +139,9 @@ typedef struct {
   uint16_t adc2;
   uint16_t adc3;
   uint16_t distance;
+  int32_t weight;
+  uint8_t din;     // Digital input level at sampling time
+  uint8_t sampled; // Sensors read ahead of the payload build
   float GapValue;
   char *data;
   uint16_t data_len;
@@ -138,9 +160,13 @@ void reboot_information_print(void);
 void EX_GPIO_Init(uint8_t state);
 void led_on(uint16_t time);
 
+void txSensorSample(SENSOR *Sensor);
 void txPayLoadDeal(SENSOR *Sensor);
+size_t txFrameRead(size_t offset, char *dst, size_t len);
 void txPayLoadDeal2(SENSOR *Sensor);
-void rxPayLoadDeal(char *payload);
+#define UPLINK_CHECKPOINT 0xC0 // uplink record of the sequence number
+#define CONFIRM_EVERY_MAX 100  // AT+CONFIRM limit
+
 int hexToint(char *str);
 uint16_t string_touint(void);
 void StrToHex(char *pbDest, char *pszSrc, int nLen);
@@ -152,6 +178,7 @@ char *Int2String(int num, char *str);
 void BSP_sensor_Init(void);
 void shtDataINIT(void);
 void shtDataWrite(void);
+void txHistoryStore(void);
 void shtDataPrint(void);
 void shtDataClear(void);
 void DatalogPrint(void);
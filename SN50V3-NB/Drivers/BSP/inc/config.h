@@ -0,0 +1,16 @@
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+#include "common.h"
+
+#define CONFIG_SAVE_DELAY 10000 // ms without changes before they are written
+
+void config_Set(void);
+void config_Get(void);
+void config_Save(void);
+void config_Flush(void);
+void config_Task(void);
+void config_Written(void);
+bool config_Dirty(void);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __CONFIRM_H
+#define __CONFIRM_H
+
+#include "common.h"
+
+#define CONFIRM_HISTORY_MAX 32 // records of the history in EEPROM
+
+void Confirm_Start(uint8_t every, uint8_t ackPending);
+uint8_t Confirm_End(uint8_t delivered);
+uint8_t Confirm_Checkpoint(void);
+uint8_t Confirm_History(uint8_t noud);
+uint8_t Confirm_Qos(uint8_t qos);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __COUNT_H
+#define __COUNT_H
+
+#include "common.h"
+
+#define COUNT_PIN GPIO_PIN_15
+#define COUNT_LOCKOUT_DELAY 500      // ms, model7 tipping bucket debounce
+#define COUNT_WINDOW_TIME 60000      // ms, model7 intensity window
+#define COUNT_WINDOW_MAX 3600000     // ms, older windows give 0 intensity
+#define COUNT_INTENSITY_UNIT 7200000 // 0.2mm per tip, in 0.1mm/h * ms
+
+void Count_Edge(void);
+uint8_t Count_IsActive(void);
+uint8_t Count_FastWake(void);
+void Count_Sample(void);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __DOWNLINK_H
+#define __DOWNLINK_H
+
+#include "common.h"
+
+#define DOWNLINK_TLV_VERSION 0xA1   // first byte of a TLV downlink
+#define DOWNLINK_TLV_RESET 0x00     // record resetting after the others
+#define DOWNLINK_TLV_ACK 0xAC       // uplink record acknowledging one
+#define DOWNLINK_TLV_MALFORMED 0xFF // ack status of an unreadable frame
+
+/* Called for each "key":value pair of a JSON downlink, the value without
+ * its quotes and not NUL-terminated. Returns 1 when a setting changed. */
+typedef uint8_t (*Downlink_Pair)(const char *key, size_t keyLen,
+                                 const char *value, size_t len);
+
+uint8_t Downlink_JsonScan(const char *payload, Downlink_Pair pair,
+                          uint8_t *reset);
+
+void rxPayLoadDeal(char *payload);
+uint8_t rxAckPending(void);
+void rxAckDelivered(void);
+size_t rxAckWrite(char *out);
+
+#endif
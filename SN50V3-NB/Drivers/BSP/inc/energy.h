@@ -0,0 +1,63 @@
+#ifndef __ENERGY_H
+#define __ENERGY_H
+
+#include "common.h"
+
+#define ENERGY_DAY_TIME 86400000 // ms, per-day totals roll over
+#define ENERGY_TX_BYTE_TIME 1042 // us, one console byte at 9600 baud
+
+#define ENERGY_BATTERY_VALID 0x42415454 // "BATT", EEPROM total is valid
+#define ENERGY_BATTERY_CAPACITY 8500    // mAh, ER26500 Li-SOCl2 cell
+#define ENERGY_SAVE_CHARGE 1000         // uAh consumed between two saves
+#define ENERGY_RATE_MIN_TIME 3600000    // ms, before today gives a rate
+#define ENERGY_DAYS_UNKNOWN 0xFFFF
+
+/* Default currents (uA) drawn on top of the other active phases */
+#define ENERGY_STOP_CURRENT 12    // MCU Stop, modem PSM, board quiescent
+#define ENERGY_RUN_CURRENT 3500   // MCU running from the 32 MHz PLL
+#define ENERGY_HSI_CURRENT 2200   // MCU running from HSI16, range 2
+#define ENERGY_MSI_CURRENT 350    // MCU running from MSI 2.1 MHz, range 3
+#define ENERGY_ON_CURRENT 15000   // modem on, searching and attaching
+#define ENERGY_REG_CURRENT 3000   // modem registered, idle (eDRX/DRX)
+#define ENERGY_CONN_CURRENT 6000  // modem connected, averaged over TX/RX
+#define ENERGY_RAIL_CURRENT 8000  // 5V sensor rail on
+#define ENERGY_FLASH_CURRENT 3000 // flash/EEPROM erase or program
+#define ENERGY_TX_CURRENT 1500    // console TX, level shifter and BLE
+
+typedef enum {
+  ENERGY_STOP = 0,
+  ENERGY_RUN,
+  ENERGY_MODEM_ON,
+  ENERGY_MODEM_REG,
+  ENERGY_MODEM_CONN,
+  ENERGY_RAIL,
+  ENERGY_FLASH,
+  ENERGY_TX,
+  ENERGY_RUN_HSI16, // in place of ENERGY_RUN on the lower clock profiles
+  ENERGY_RUN_MSI,
+  ENERGY_PHASES,
+} EnergyPhase;
+
+typedef enum {
+  ENERGY_MODEM_OFF = 0, // off or in PSM, included in the Stop current
+  ENERGY_MODEM_ATTACH,
+  ENERGY_MODEM_REGISTERED,
+  ENERGY_MODEM_CONNECTED,
+} EnergyModemState;
+
+void Energy_Init(void);
+void Energy_Mcu(uint8_t stop);
+void Energy_Modem(uint8_t state);
+void Energy_Clock(uint8_t profile);
+void Energy_Rail(uint8_t on);
+void Energy_Flash(uint8_t on);
+void Energy_Tx(uint16_t bytes);
+void Energy_CycleEnd(void);
+uint32_t Energy_CycleuAh(void);
+uint8_t Energy_SetCurrent(uint8_t phase, uint32_t current);
+void Energy_BatteryReset(void);
+uint32_t Energy_BatteryUsed(void);
+uint16_t Energy_RemainingDays(uint16_t capacity);
+void Energy_Print(uint16_t capacity);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __EVENT_H
+#define __EVENT_H
+
+#include "common.h"
+#include "queue.h"
+
+#define EVENT_QUEUE_SIZE 16 // events, must hold a burst between two drains
+
+typedef enum {
+  EVENT_COUNT = 1,      // count edges accepted, posted once per drain
+  EVENT_COUNT_LOCKOUT,  // model7 edges rejected, arg = first gap (ms)
+  EVENT_EXTI,           // interrupt triggered an uplink, arg = pin level
+  EVENT_DNS,            // periodic DNS refresh is due
+  EVENT_UPLINK_TIMEOUT, // no reply to the uplink, arg = error count
+  EVENT_NO_SIGNAL,      // network join timed out
+} EventType;
+
+typedef enum {
+  EVENT_SIGNAL_NB = 1 << 0,     // NB task step due
+  EVENT_SIGNAL_UPLINK = 1 << 1, // uplink, sensor read or sleep request due
+  EVENT_SIGNAL_USER = 1 << 2,   // console or modem line, periodic work
+  EVENT_SIGNAL_KEY = 1 << 3,    // user key pressed
+  EVENT_SIGNAL_LOG = 1 << 4,    // events queued for Event_Process
+} EventSignal;
+
+typedef struct {
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t arg;
+} Event;
+
+void Event_Init(void);
+uint8_t Event_Post(uint8_t type, uint32_t arg);
+uint8_t Event_PostOnce(uint8_t type, uint32_t arg);
+uint8_t Event_Get(Event *event);
+bool Event_IsEmpty(void);
+void Event_Process(void);
+void Event_Signal(uint32_t signals);
+uint32_t Event_TakeSignals(void);
+uint32_t Event_PendingSignals(void);
+
+#endif
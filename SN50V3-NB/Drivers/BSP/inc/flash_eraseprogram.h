@@ -64,6 +64,13 @@ extern "C" {
 #define EEPROM_USER_START_ADD (DATA_EEPROM_BASE)
 #define EEPROM_USER_START_VER (EEPROM_USER_START_ADD)
 #define EEPROM_USER_START_FDR_FLAG (EEPROM_USER_START_VER + 0x04)
+#define EEPROM_USER_WEIGHT_TARE_FLAG (EEPROM_USER_START_FDR_FLAG + 0x04)
+#define EEPROM_USER_WEIGHT_TARE (EEPROM_USER_WEIGHT_TARE_FLAG + 0x04)
+#define EEPROM_USER_BATTERY_FLAG (EEPROM_USER_WEIGHT_TARE + 0x04)
+#define EEPROM_USER_BATTERY_USED (EEPROM_USER_BATTERY_FLAG + 0x04)
+#define EEPROM_USER_AEAD_FLAG (EEPROM_USER_BATTERY_USED + 0x04)
+#define EEPROM_USER_AEAD_COUNTER (EEPROM_USER_AEAD_FLAG + 0x04)
+#define EEPROM_USER_AEAD_KEY (EEPROM_USER_AEAD_COUNTER + 0x04)
 #define EEPROM_SHT_START_ADD (DATA_EEPROM_BANK2_BASE)
 #define EEPROM_TIME_START_ADD (EEPROM_SHT_START_ADD + 0x04 * 50)
 #define EEPROM_D1_AD0_START_ADD (EEPROM_TIME_START_ADD + 0x04 * 50)
@@ -76,6 +83,7 @@ extern "C" {
 
 void FLASH_erase(uint32_t page_address, uint8_t page);
 void FLASH_program(uint32_t add, uint32_t *data, uint8_t count);
+uint8_t EEPROM_program(uint32_t add, uint32_t *data, uint8_t count);
 uint32_t FLASH_read(uint32_t Address);
 
 #ifdef __cplusplus
@@ -3,6 +3,13 @@
 
 #include "sht20.h"
 
+#define LIDAR_ACQ_COUNT_REG 0x02
+#define LIDAR_ACQ_COUNT_DEFAULT 0x80
+/* Upper bound of the measurement time for a given acquisition count, about
+ * 1 ms per 8 acquisitions plus the fixed processing time */
+#define LIDAR_ACQ_TIME(count)                                                  \
+  (4 + (((count) == 0 ? LIDAR_ACQ_COUNT_DEFAULT : (count)) >> 3))
+
 uint16_t LidarLite(void);
 uint16_t waitbusy(uint8_t mode);
 
@@ -1,9 +1,22 @@
 #ifndef __lowpower_H
 #define __lowpower_H
 
+#include "low_power_manager.h"
 #include "usart.h"
 
-void LPM_EnterStopMode(void (*Clock_Config)(void));
-void LPM_DisableStopMode(void);
+#define LPM_RX_VETO_TIME 1000 // ms, partial UART line before Stop resumes
+
+typedef enum {
+  LPM_WAKE_SLEEP = 0, // nothing to do, back to Stop
+  LPM_WAKE_LIGHT,     // short work that runs on HSI16
+  LPM_WAKE_RUN,       // modem, sensor or payload work, PLL needed
+  LPM_WAKE_LEVELS,
+} LPM_WakeLevel;
+
+uint8_t LPM_WakeWork(void);
+void LPM_EnterStopMode(void (*Clock_Config)(void), uint8_t (*ready)(void));
+void LPM_Idle(void (*Clock_Config)(void));
+void LPM_RunClock(void (*Clock_Config)(void));
+void LPM_Print(void);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef __LWM2M_CLIENT_H
+#define __LWM2M_CLIENT_H
+
+#include "coap.h"
+
+#define LWM2M_LIFETIME 604800 // registration lifetime, s
+#define LWM2M_LOCATION_MAX 32 // Location-Path of the registration, bytes
+
+#define LWM2M_READINGS_MAX 8 // sensor values of a frame
+#define LWM2M_OBSERVE_MAX 4  // observations kept for the server
+
+#define LWM2M_GENERIC_SENSOR 3300 // IPSO objects of the readings
+#define LWM2M_TEMPERATURE 3303
+#define LWM2M_HUMIDITY 3304
+
+#define LWM2M_DELIVERED 1 // the server has the readings
+#define LWM2M_FOLLOW 2    // another uplink must be sent now
+
+#define LWM2M_MORE 1     // another notification follows the one written
+#define LWM2M_DOWNLINK 2 // the request payload is a downlink
+
+// The Sensor Value, resource 5700, of an instance of an IPSO object
+typedef struct {
+  uint16_t object;
+  uint8_t instance;
+  uint8_t tenths; // the value is in tenths of the unit
+  int32_t value;
+} Lwm2mReading;
+
+void Lwm2m_NewFrame(const Lwm2mReading *readings, uint8_t count,
+                    uint32_t time);
+uint8_t Lwm2m_Uplink(CoapWriter *w, uint8_t *buf, size_t size,
+                     CoapMessage *req);
+uint8_t Lwm2m_Answer(const CoapMessage *rsp);
+uint8_t Lwm2m_Serve(const CoapMessage *in, CoapWriter *w, uint8_t *buf,
+                    size_t size);
+
+#endif
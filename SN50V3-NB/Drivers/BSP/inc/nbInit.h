@@ -20,6 +20,10 @@ typedef enum {
 #define MQTT_PRO 0x03
 #define TCP_PRO 0x04
 
+#define COAP_MODEM 0 // CoAP session of the module, AT+QCOAP commands
+#define COAP_UDP 1   // CoAP messages built by the MCU, sent over UDP
+#define COAP_LWM2M 2 // LwM2M client over the same messages
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -336,6 +340,16 @@ NB_TaskStatus nb_UDP_close_run(const char *param);
 NB_TaskStatus nb_UDP_close_set(const char *param);
 
 NB_TaskStatus nb_UDP_uri_run(const char *param);
+void nb_UDP_send_head(void);
+
+void nb_COAP_new_uplink(void);
+NB_TaskStatus nb_COAP_udp_send_set(const char *param);
+void nb_COAP_udp_read(char *data);
+uint8_t nb_COAP_acked(void);
+uint8_t nb_COAP_follow(void);
+uint8_t nb_COAP_confirmable(void);
+uint32_t nb_COAP_timeout(void);
+uint8_t nb_COAP_retransmit(void);
 
 NB_TaskStatus nb_QSSLCFG_run(const char *param);
 NB_TaskStatus nb_QSSLCFG_set(const char *param);
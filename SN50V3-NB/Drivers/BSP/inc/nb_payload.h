@@ -4,5 +4,7 @@
 #include "nbInit.h"
 void pro_data_thingspeak(void);
 void pro_data(void);
+size_t pro_data_open(void);
+size_t pro_data_read(size_t offset, char *dst, size_t len);
 void mode_data(char *buff);
 #endif
@@ -0,0 +1,12 @@
+#ifndef __NB_STEP_H
+#define __NB_STEP_H
+
+#include "common.h"
+
+#define NB_RETRY_TIME 1000 // ms, before a failed NB step is tried again
+#define NB_BOOT_TIME 3000  // ms, for the modem to boot after AT+QRST=1
+
+void NbStep_Init(void);
+uint8_t NbStep_Run(uint8_t *task);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __SENSOR_POWER_H
+#define __SENSOR_POWER_H
+
+#include "common.h"
+
+#define SENSOR_SETTLE_TIME 500 // ms of 5V rail before a read, + power_time
+
+void Sensor_PowerOn(void);
+void Sensor_PowerOff(void);
+uint8_t Sensor_PowerIsOn(void);
+uint32_t Sensor_PowerSettle(uint32_t settle);
+
+#endif
@@ -24,9 +24,15 @@ extern "C" {
  */
 #include "utilities.h"
 
+/* Periodic timers may expire up to 1/64 of their period late, at most 60 s,
+ * so that they can share an RTC wake-up with another timer */
+#define TIMER_PERIOD_SLACK(period)                                             \
+  (((period) >> 6) < 60000 ? ((period) >> 6) : 60000)
+
 typedef struct TimerEvent_s {
   uint32_t Timestamp;        //! Expiring timer value in ticks from TimerContext
   uint32_t ReloadValue;      //! Reload Value when Timer is restarted
+  uint32_t Slack;            //! Ticks the timer may expire late to coalesce
   bool IsRunning;            //! Is the timer currently running
   void (*Callback)(void);    //! Timer IRQ callback function
   struct TimerEvent_s *Next; //! Pointer to the next Timer object.
@@ -47,8 +53,12 @@ void TimerStop(TimerEvent_t *obj);
 
 void TimerReset(TimerEvent_t *obj);
 
+bool TimerIsStarted(TimerEvent_t *obj);
+
 void TimerSetValue(TimerEvent_t *obj, uint32_t value);
 
+void TimerSetSlack(TimerEvent_t *obj, uint32_t value);
+
 TimerTime_t TimerGetCurrentTime(void);
 
 TimerTime_t TimerGetElapsedTime(TimerTime_t savedTime);
@@ -20,13 +20,19 @@ extern "C" {
  * @retval None
  */
 
+#define ULT_FRAME_SIZE 4      // 0xFF, DATA_H, DATA_L, SUM
+#define ULT_FRAMES 2          // frames averaged per distance reading
+#define ULT_TEST_TIMEOUT 3100 // ms
+#define ULT_DATA_TIMEOUT 2000 // ms
+
 void ULT_Rest(void);
 int ULT_Data_processing(void);
 void ULT_getData(void);
 void ULT_Data_Read(void);
 void ULT_Init(void (*uart_init)(void), void (*uart_485_enable)(void));
 void ULT_DeInit(void (*uart_disable)(void), void (*uart_485_disable)(void));
-void ULT_Check_Sum(void);
+uint8_t ULT_Check_Sum(void);
+uint8_t ULT_WaitFrame(uint8_t frames, uint32_t timeout);
 uint8_t ULT_Connection_Test(void);
 
 #ifdef __cplusplus
@@ -11,14 +11,16 @@
 #define WEIGHT_DOUT_CLK_ENABLE() __HAL_RCC_GPIOB_CLK_ENABLE()
 #define WEIGHT_DOUT_PORT GPIOB
 #define WEIGHT_DOUT_PIN GPIO_PIN_7
-#define HX711_SCK_0                                                            \
-  HAL_GPIO_WritePin(WEIGHT_SCK_PORT, WEIGHT_SCK_PIN, GPIO_PIN_RESET)
-#define HX711_SCK_1                                                            \
-  HAL_GPIO_WritePin(WEIGHT_SCK_PORT, WEIGHT_SCK_PIN, GPIO_PIN_SET)
+#define HX711_SCK_0 (WEIGHT_SCK_PORT->BRR = WEIGHT_SCK_PIN)
+#define HX711_SCK_1 (WEIGHT_SCK_PORT->BSRR = WEIGHT_SCK_PIN)
 #define HX711_DOUT_0                                                           \
   HAL_GPIO_WritePin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN, GPIO_PIN_RESET)
 #define HX711_DOUT_1                                                           \
   HAL_GPIO_WritePin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN, GPIO_PIN_SET)
+#define HX711_READY_TIMEOUT 2000 // ms to wait for DOUT low
+#define HX711_SAMPLES 5           // samples averaged per weight reading
+#define HX711_SAMPLES_MAX 16
+#define HX711_TARE_VALID 0x54415245 // "TARE"
 /* ---------------------------  +5v PWR OUT definition
  * -------------------------------*/
 #define PWR_OUT_PORT GPIOB
@@ -66,6 +68,11 @@ void WEIGHT_DOUT_Init(void);
 void WEIGHT_SCK_DeInit(void);
 void WEIGHT_DOUT_DeInit(void);
 uint32_t HX711_Read(void);
+uint32_t HX711_ReadFiltered(uint8_t n);
+void HX711_PowerDown(void);
+uint8_t HX711_IsWaiting(void);
+void HX711_DoutReady(void);
+uint8_t Weight_Tare_Load(void);
 void Get_Maopi(void);
 int32_t Get_Weight(void);
 void HW_GPIO_Init(GPIO_TypeDef *port, uint16_t GPIO_Pin,
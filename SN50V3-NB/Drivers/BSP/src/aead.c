@@ -0,0 +1,285 @@
+#include "aead.h"
+#include "cmox_crypto.h"
+#include "crc.h"
+#include "flash_eraseprogram.h"
+
+/* Payload encryption with AES-128-CCM, for servers that need the readings
+ * confidential without the cost of a TLS handshake. A sealed frame, sent
+ * hex-encoded like the clear one, is
+ *
+ *   header (8) | counter (4, big endian) | ciphertext | tag (8)
+ *
+ * The header is the clear device id the payload starts with. The 12-byte
+ * nonce is the header followed by the counter, so changing either fails
+ * the tag. The counter never repeats, even across key changes since the
+ * same key may be provisioned again: a block of AEAD_NONCE_STEP values is
+ * reserved in EEPROM before the first of them is used, a reset resumes
+ * after the reserved block and a new key carries on from it. */
+#define AEAD_KEY_VALID 0x4145414B // "AEAK"
+#define AEAD_NONCE_SIZE (AEAD_HEADER_SIZE + AEAD_COUNTER_SIZE)
+#define AEAD_CHUNK 16 // CCM appends are whole AES blocks until the last one
+
+static uint8_t aeadKey[AEAD_KEY_SIZE];
+static uint8_t aeadKeyValid = 0;
+static uint32_t aeadCounter = 0;
+static uint32_t aeadReserved = 0;
+
+// Returns 1 once the word reads back from EEPROM
+static uint8_t Aead_Store(uint32_t address, uint32_t value) {
+  HAL_StatusTypeDef status;
+
+  HAL_FLASHEx_DATAEEPROM_Unlock();
+  status = HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, address,
+                                          value);
+  HAL_FLASHEx_DATAEEPROM_Lock();
+  return status == HAL_OK && *(__IO uint32_t *)address == value;
+}
+
+void Aead_Init(void) {
+  if (*(__IO uint32_t *)EEPROM_USER_AEAD_FLAG != AEAD_KEY_VALID)
+    return;
+  for (int i = 0; i < AEAD_KEY_SIZE; i++)
+    aeadKey[i] = *(__IO uint8_t *)(EEPROM_USER_AEAD_KEY + i);
+  aeadCounter = *(__IO uint32_t *)EEPROM_USER_AEAD_COUNTER;
+  aeadReserved = aeadCounter;
+  aeadKeyValid = 1;
+}
+
+uint8_t Aead_KeySet(const uint8_t *key) {
+  uint32_t word;
+  uint8_t stored;
+
+  aeadKeyValid = 0;
+  stored = Aead_Store(EEPROM_USER_AEAD_FLAG, 0);
+  for (int i = 0; i < AEAD_KEY_SIZE; i += 4) {
+    memcpy(&word, &key[i], 4);
+    stored &= Aead_Store(EEPROM_USER_AEAD_KEY + i, word);
+  }
+  /* The counter is left as is: resetting it would reuse the nonces already
+   * sent if the same key were set again */
+  if (stored)
+    Aead_Store(EEPROM_USER_AEAD_FLAG, AEAD_KEY_VALID);
+  memset(aeadKey, 0, sizeof(aeadKey));
+  Aead_Init();
+  return stored && aeadKeyValid;
+}
+
+uint8_t Aead_KeyValid(void) { return aeadKeyValid; }
+
+uint32_t Aead_Counter(void) { return aeadCounter; }
+
+// Reserves the counter of the next frame, 0 when none is left
+static uint8_t Aead_Reserve(void) {
+  if (aeadCounter > 0xFFFFFFFF - AEAD_NONCE_STEP)
+    return 0;
+  if (aeadCounter >= aeadReserved) {
+    // a counter is only used once its block is in EEPROM
+    if (Aead_Store(EEPROM_USER_AEAD_COUNTER, aeadCounter + AEAD_NONCE_STEP) ==
+        0) {
+      user_main_printf("Couldn't reserve the frame counter");
+      return 0;
+    }
+    aeadReserved = aeadCounter + AEAD_NONCE_STEP;
+  }
+  return 1;
+}
+
+// Starts the encryption of payload bytes, NULL when it failed
+static cmox_cipher_handle_t *Aead_Start(cmox_ccm_handle_t *ccm,
+                                        const uint8_t *nonce, size_t payload) {
+  cmox_cipher_handle_t *cipher;
+
+  // The crypto library messes up with the CRC component, it's necessary to
+  // reset it and ensure it's on before using it
+  __HAL_CRC_DR_RESET(&hcrc);
+  cmox_initialize(NULL);
+  cipher = cmox_ccm_construct(ccm, CMOX_AESSMALL_CCM_ENC);
+  if (cipher == NULL || cmox_cipher_init(cipher) != CMOX_CIPHER_SUCCESS ||
+      cmox_cipher_setTagLen(cipher, AEAD_TAG_SIZE) != CMOX_CIPHER_SUCCESS ||
+      cmox_cipher_setPayloadLen(cipher, payload) != CMOX_CIPHER_SUCCESS ||
+      cmox_cipher_setADLen(cipher, 0) != CMOX_CIPHER_SUCCESS ||
+      cmox_cipher_setKey(cipher, aeadKey, AEAD_KEY_SIZE) !=
+          CMOX_CIPHER_SUCCESS ||
+      cmox_cipher_setIV(cipher, nonce, AEAD_NONCE_SIZE) !=
+          CMOX_CIPHER_SUCCESS) {
+    if (cipher != NULL)
+      cmox_cipher_cleanup(cipher);
+    return NULL;
+  }
+  return cipher;
+}
+
+/* Seals the hex frame of len characters in place. The buffer must hold
+ * (AEAD_COUNTER_SIZE + AEAD_TAG_SIZE) * 2 more characters and the
+ * terminator. Returns the sealed length, or 0 when no key is set or the
+ * frame could not be sealed, in which case it may be partly encrypted. */
+size_t Aead_Seal(char *hex, size_t len) {
+  const size_t start = (AEAD_HEADER_SIZE + AEAD_COUNTER_SIZE) * 2;
+  uint8_t nonce[AEAD_NONCE_SIZE];
+  uint8_t in[AEAD_CHUNK], out[AEAD_CHUNK], tag[AEAD_TAG_SIZE];
+  cmox_ccm_handle_t ccm;
+  cmox_cipher_handle_t *cipher = NULL;
+  size_t payload, pos, ret = 0;
+  char first;
+
+  if (aeadKeyValid == 0 || (len & 1) != 0 || len < AEAD_HEADER_SIZE * 2 ||
+      Aead_Reserve() == 0)
+    return 0;
+
+  // room for the counter after the header, sprintf ends it with a '\0'
+  memmove(hex + start, hex + AEAD_HEADER_SIZE * 2,
+          len - AEAD_HEADER_SIZE * 2 + 1);
+  first = hex[start];
+  sprintf(hex + AEAD_HEADER_SIZE * 2, "%.8x", aeadCounter);
+  hex[start] = first;
+  len += AEAD_COUNTER_SIZE * 2;
+  StrToHex((char *)nonce, hex, AEAD_NONCE_SIZE);
+  payload = (len - start) / 2;
+
+  cipher = Aead_Start(&ccm, nonce, payload);
+  if (cipher == NULL)
+    goto end;
+
+  // each chunk is decoded, encrypted and encoded back over itself
+  for (pos = 0; pos < payload; pos += AEAD_CHUNK) {
+    size_t n = payload - pos < AEAD_CHUNK ? payload - pos : AEAD_CHUNK;
+    char *chunk = hex + start + pos * 2;
+    char next = chunk[n * 2]; // sprintf ends the chunk with a '\0'
+
+    StrToHex((char *)in, chunk, n);
+    if (cmox_cipher_append(cipher, in, n, out, NULL) != CMOX_CIPHER_SUCCESS)
+      goto end;
+    for (size_t i = 0; i < n; i++)
+      sprintf(chunk + i * 2, "%.2x", out[i]);
+    chunk[n * 2] = next;
+  }
+  if (cmox_cipher_generateTag(cipher, tag, NULL) != CMOX_CIPHER_SUCCESS)
+    goto end;
+  for (int i = 0; i < AEAD_TAG_SIZE; i++)
+    sprintf(hex + len + i * 2, "%.2x", tag[i]);
+  ret = len + AEAD_TAG_SIZE * 2;
+  aeadCounter++;
+  user_main_debug("Sealed %d bytes, counter %u", payload, aeadCounter - 1);
+
+end:
+  if (cipher != NULL)
+    cmox_cipher_cleanup(cipher);
+  cmox_finalize(NULL);
+  if (ret == 0)
+    user_main_printf("Couldn't encrypt the payload");
+  return ret;
+}
+
+/* A frame too long for RAM is sealed as it is read: Aead_SealOpen() takes
+ * its counter and computes the tag over the clear frame given by read, and
+ * Aead_SealRead() encrypts it again from the start for each slice. */
+static Aead_Reader aeadRead;
+static size_t aeadLen; // of the sealed frame
+static uint8_t aeadNonce[AEAD_NONCE_SIZE];
+static char aeadTag[AEAD_TAG_SIZE * 2 + 1];
+
+/* Encrypts the clear frame, encoding in dst the characters of the sealed
+ * frame from offset on that fall in its ciphertext, up to len of them.
+ * The tag is kept in aeadTag when withTag is set. Returns 0 on failure. */
+static uint8_t Aead_Stream(size_t offset, char *dst, size_t len,
+                           uint8_t withTag) {
+  const size_t start = (AEAD_HEADER_SIZE + AEAD_COUNTER_SIZE) * 2;
+  const size_t payload = (aeadLen - start) / 2 - AEAD_TAG_SIZE;
+  uint8_t in[AEAD_CHUNK], out[AEAD_CHUNK], tag[AEAD_TAG_SIZE];
+  char chunk[AEAD_CHUNK * 2 + 1];
+  cmox_ccm_handle_t ccm;
+  cmox_cipher_handle_t *cipher;
+  uint8_t ret = 0;
+
+  cipher = Aead_Start(&ccm, aeadNonce, payload);
+  if (cipher == NULL)
+    goto end;
+  for (size_t pos = 0; pos < payload; pos += AEAD_CHUNK) {
+    size_t n = payload - pos < AEAD_CHUNK ? payload - pos : AEAD_CHUNK;
+    size_t at = start + pos * 2; // of the chunk in the sealed frame
+
+    if (withTag == 0 && at >= offset + len)
+      break;
+    if (aeadRead(AEAD_HEADER_SIZE * 2 + pos * 2, chunk, n * 2) != n * 2)
+      goto end;
+    StrToHex((char *)in, chunk, n);
+    if (cmox_cipher_append(cipher, in, n, out, NULL) != CMOX_CIPHER_SUCCESS)
+      goto end;
+    for (size_t i = 0; i < n; i++)
+      sprintf(chunk + i * 2, "%.2x", out[i]);
+    for (size_t i = 0; i < n * 2; i++) {
+      if (at + i >= offset && at + i < offset + len)
+        dst[at + i - offset] = chunk[i];
+    }
+  }
+  if (withTag) {
+    if (cmox_cipher_generateTag(cipher, tag, NULL) != CMOX_CIPHER_SUCCESS)
+      goto end;
+    for (int i = 0; i < AEAD_TAG_SIZE; i++)
+      sprintf(aeadTag + i * 2, "%.2x", tag[i]);
+  }
+  ret = 1;
+
+end:
+  if (cipher != NULL)
+    cmox_cipher_cleanup(cipher);
+  cmox_finalize(NULL);
+  return ret;
+}
+
+/* Seals the hex frame of len characters given by read, which must keep
+ * giving the same frame until the last Aead_SealRead(). Returns the sealed
+ * length, or 0 when no key is set or the frame could not be sealed. */
+size_t Aead_SealOpen(Aead_Reader read, size_t len) {
+  char header[AEAD_HEADER_SIZE * 2];
+
+  aeadLen = 0;
+  if (aeadKeyValid == 0 || (len & 1) != 0 || len < AEAD_HEADER_SIZE * 2 ||
+      read(0, header, sizeof(header)) != sizeof(header) || Aead_Reserve() == 0)
+    return 0;
+  StrToHex((char *)aeadNonce, header, AEAD_HEADER_SIZE);
+  for (int i = 0; i < AEAD_COUNTER_SIZE; i++)
+    aeadNonce[AEAD_HEADER_SIZE + i] = aeadCounter >> (24 - i * 8);
+  aeadRead = read;
+  aeadLen = len + (AEAD_COUNTER_SIZE + AEAD_TAG_SIZE) * 2;
+  if (Aead_Stream(0, NULL, 0, 1) == 0) {
+    aeadLen = 0;
+    user_main_printf("Couldn't encrypt the payload");
+    return 0;
+  }
+  aeadCounter++;
+  user_main_debug("Sealed %d bytes, counter %u", len / 2, aeadCounter - 1);
+  return aeadLen;
+}
+
+/* Reads len characters of the frame sealed by Aead_SealOpen() from offset
+ * into dst. Returns the number of characters read, short at the end of
+ * the frame or when the encryption failed. */
+size_t Aead_SealRead(size_t offset, char *dst, size_t len) {
+  const size_t start = (AEAD_HEADER_SIZE + AEAD_COUNTER_SIZE) * 2;
+  const size_t tagAt = aeadLen - AEAD_TAG_SIZE * 2;
+  size_t i;
+
+  if (offset >= aeadLen)
+    return 0;
+  if (len > aeadLen - offset)
+    len = aeadLen - offset;
+  if (offset + len > start && offset < tagAt &&
+      Aead_Stream(offset, dst, len, 0) == 0)
+    return 0;
+  // the header is the clear one
+  if (offset < AEAD_HEADER_SIZE * 2) {
+    i = AEAD_HEADER_SIZE * 2 - offset < len ? AEAD_HEADER_SIZE * 2 - offset
+                                            : len;
+    if (aeadRead(offset, dst, i) != i)
+      return 0;
+  }
+  for (i = offset; i < offset + len; i++) {
+    if (i >= AEAD_HEADER_SIZE * 2 && i < start)
+      dst[i - offset] = "0123456789abcdef"[aeadNonce[i / 2] >>
+                                           (i & 1 ? 0 : 4) & 0x0F];
+    if (i >= tagAt)
+      dst[i - offset] = aeadTag[i - tagAt];
+  }
+  return len;
+}
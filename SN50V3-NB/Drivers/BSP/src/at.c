@@ -1,4 +1,5 @@
 #include "at.h"
+#include "lowpower.h"
 #include "nbInit.h"
 #include "tiny_sscanf.h"
 
@@ -24,55 +25,13 @@ uint8_t getsensorvalue_flag = 0;
 extern bool at_sleep_flag;
 extern bool sleep_status;
 extern bool first_sample;
-ATEerror_t ATInsPro(char *atdata) {
-  uint8_t i = 0;
-  rtrim(atdata);
-  if (strcmp(atdata, AT) == 0)
-    return AT_OK;
-  else if (strcmp(atdata, AT "?") == 0) {
-    return at_que(atdata);
-  }
-
-  while (strstr(atdata, ATCommand[i].string) == NULL) {
-    i++;
-    if (i > (sizeof(ATCommand) / sizeof(struct ATCommand_s)) - 1) {
-      return AT_ERROR;
-    }
-  }
-
-  if (strstr(atdata, "=?")) {
-    return ATCommand[i].get(atdata);
-  } else if (strstr(atdata, "=")) {
-    ATEerror_t AT_State = ATCommand[i].set(atdata);
-    if (AT_State == AT_OK)
-      config_Set();
-    else
-      return AT_State;
-  } else if (strstr(atdata, "?")) {
-    user_main_printf("%s", ATCommand[i].help_string);
-  } else {
-    ATCommand[i].run(atdata);
-  }
-  return AT_OK;
-}
 
 /************** 			AT			 **************/
 ATEerror_t at_return_error(const char *param) { return AT_ERROR; }
 
-ATEerror_t at_que(const char *param) {
-  user_main_printf("\r\nAT+<CMD>?        : Help on <CMD>\r\n"
-                   "AT+<CMD>         : Run <CMD>\r\n"
-                   "AT+<CMD>=<value> : Set the value\r\n"
-                   "AT+<CMD>=?       : Get the value\r\n");
-  for (int i = 0; i < (sizeof(ATCommand) / sizeof(struct ATCommand_s)); i++) {
-    printf("%s\r\n", ATCommand[i].help_string);
-  }
-
-  return AT_OK;
-}
-
 /************** 			ATZ			 **************/
 ATEerror_t at_reset_run(const char *param) {
+  config_Flush();
   NVIC_SystemReset();
   return AT_OK;
 }
@@ -248,9 +207,7 @@ ATEerror_t at_fdr1_run(const char *param) {
 /************** 			AT+CFG		 **************/
 ATEerror_t at_cfg_run(const char *param) {
   keep = 1;
-  for (int i = 0; i < (sizeof(ATCommand) / sizeof(struct ATCommand_s)); i++) {
-    ATCommand[i].get(param);
-  }
+  AT_GetAll(param);
   keep = 0;
 
   return AT_OK;
@@ -497,14 +454,14 @@ ATEerror_t at_rxdl_get(const char *param) {
 /************** 			AT+WEIGHT		**************/
 ATEerror_t at_weight_reset(const char *param) {
   HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_RESET);
+  Energy_Rail(1);
   WEIGHT_SCK_Init();
   WEIGHT_DOUT_Init();
   Get_Maopi();
-  HAL_Delay(500);
-  Get_Maopi();
   WEIGHT_SCK_DeInit();
   WEIGHT_DOUT_DeInit();
   HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_SET);
+  Energy_Rail(0);
   return AT_OK;
 }
 
@@ -584,9 +541,18 @@ ATEerror_t at_ext_set(const char *param) {
 
 /************** 			AT+LDATA		**************/
 ATEerror_t at_ldata_get(const char *param) {
+  char chunk[65];
+  size_t offset = 0, n;
+
   if (keep)
     printf(AT LDATA "=");
-  printf("%s\r\n", (strlen(sensor.data) == 0) ? "NULL" : sensor.data);
+  // a streamed frame is printed as its history is read from EEPROM
+  while ((n = txFrameRead(offset, chunk, sizeof(chunk) - 1)) != 0) {
+    chunk[n] = '\0';
+    printf("%s", chunk);
+    offset += n;
+  }
+  printf("%s\r\n", offset == 0 ? "NULL" : "");
   return AT_OK;
 }
 /************** 			AT+DNSCFG		**************/
@@ -730,10 +696,12 @@ ATEerror_t at_sleep_set(const char *param) {
   if (sleep_tem > 1) {
     return AT_PARAM_ERROR;
   }
-  if (sleep_tem == 1)
+  if (sleep_tem == 1) {
     at_sleep_flag = sleep_tem;
-  else
+  } else {
+    config_Flush();
     NVIC_SystemReset();
+  }
 
   return AT_OK;
 }
@@ -895,22 +863,186 @@ ATEerror_t at_uri4_set(const char *param) {
   return AT_OK;
 }
 
-/************** 		Other		 **************/
-char *rtrim(char *str) {
-  for (int i = 0; i < strlen(str); i++) {
-    if (str[i] == '\r' || str[i] == '\n')
-      str[i] = 0;
+/************** 			AT+COAPMOD		 **************/
+ATEerror_t at_coapmod_get(const char *param) {
+  if (keep)
+    printf(AT COAPMOD "=");
+  printf("%d\r\n", sys.coap_mode);
+  return AT_OK;
+}
+
+ATEerror_t at_coapmod_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t value = atoi((param + (pos - param) + 1));
+  if (value > COAP_LWM2M) {
+    return AT_PARAM_ERROR;
   }
-  return str;
+  sys.coap_mode = value;
+  printf("Attention:Take effect after ATZ\r\n");
+  return AT_OK;
 }
 
-uint8_t hexDetection(char *str) {
-  for (int i = 0; i < strlen(str); i++) {
-    if (isxdigit(str[i]) == 0)
-      return 0;
+/************** 			AT+CONFIRM		 **************/
+ATEerror_t at_confirm_get(const char *param) {
+  if (keep)
+    printf(AT CONFIRM "=");
+  printf("%d\r\n", sys.confirm_every);
+  return AT_OK;
+}
+
+ATEerror_t at_confirm_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t value = atoi((param + (pos - param) + 1));
+  if (value > CONFIRM_EVERY_MAX) {
+    return AT_PARAM_ERROR;
+  }
+  sys.confirm_every = value;
+  return AT_OK;
+}
+
+/************** 			AT+LIDARACQ		 **************/
+ATEerror_t at_lidaracq_get(const char *param) {
+  if (keep)
+    printf(AT LIDARACQ "=");
+  printf("%d\r\n", sys.lidar_acq);
+  return AT_OK;
+}
+
+ATEerror_t at_lidaracq_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t acq = atoi((param + (pos - param) + 1));
+  if (acq > 0xFF) {
+    return AT_PARAM_ERROR;
+  }
+  sys.lidar_acq = acq;
+  return AT_OK;
+}
+
+/************** 			AT+ENERGY		 **************/
+ATEerror_t at_energy_get(const char *param) {
+  if (keep)
+    printf(AT ENERGY "=");
+  printf("%d\r\n", sys.energy_uplink);
+  Energy_Print(sys.bat_cap);
+  return AT_OK;
+}
+
+ATEerror_t at_energy_set(const char *param) {
+  char *pos = strchr(param, '=');
+  char *comma = strchr(param, ',');
+  uint32_t value = atoi((param + (pos - param) + 1));
+
+  if (comma != NULL) {
+    uint32_t current = atoi(comma + 1);
+    if (Energy_SetCurrent(value, current) == 0)
+      return AT_PARAM_ERROR;
+  } else if (value <= 1) {
+    sys.energy_uplink = value;
+  } else {
+    return AT_PARAM_ERROR;
   }
-  return 1;
+  return AT_OK;
 }
+
+/************** 			AT+BATCAP		 **************/
+ATEerror_t at_batcap_get(const char *param) {
+  if (keep)
+    printf(AT BATCAP "=");
+  printf("%d\r\n", sys.bat_cap);
+  return AT_OK;
+}
+
+ATEerror_t at_batcap_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t cap = atoi((param + (pos - param) + 1));
+  if (cap == 0 || cap > 0xFFFF) {
+    return AT_PARAM_ERROR;
+  }
+  sys.bat_cap = cap;
+  Energy_BatteryReset();
+  return AT_OK;
+}
+
+/************** 			AT+LPM		 **************/
+ATEerror_t at_lpm_get(const char *param) {
+  LPM_Print();
+  return AT_OK;
+}
+
+/************** 			AT+AUTH		 **************/
+ATEerror_t at_auth_get(const char *param) {
+  if (keep)
+    printf(AT AUTH "=");
+  printf("%d\r\n", sys.auth_tag);
+  return AT_OK;
+}
+
+ATEerror_t at_auth_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t tag = atoi((param + (pos - param) + 1));
+  if (Auth_TagLenValid(tag) == 0) {
+    return AT_PARAM_ERROR;
+  }
+  sys.auth_tag = tag;
+  return AT_OK;
+}
+
+/************** 			AT+AEAD		 **************/
+ATEerror_t at_aead_get(const char *param) {
+  if (keep)
+    printf(AT AEAD "=");
+  printf("%d\r\n", sys.aead);
+  return AT_OK;
+}
+
+ATEerror_t at_aead_set(const char *param) {
+  char *pos = strchr(param, '=');
+  uint32_t value = atoi((param + (pos - param) + 1));
+  if (value > 1 || (value == 1 && Aead_KeyValid() == 0)) {
+    return AT_PARAM_ERROR;
+  }
+  sys.aead = value;
+  return AT_OK;
+}
+
+/************** 			AT+AEADKEY		 **************/
+ATEerror_t at_aeadkey_get(const char *param) {
+  if (keep)
+    printf(AT AEADKEY "=");
+  // the key itself is never printed
+  printf("%d,%u\r\n", Aead_KeyValid(), Aead_Counter());
+  return AT_OK;
+}
+
+ATEerror_t at_aeadkey_set(const char *param) {
+  char *pos = strchr(param, '=');
+  char *hex = (char *)param + (pos - param) + 1;
+  uint8_t key[AEAD_KEY_SIZE];
+  uint8_t ret;
+
+  if (strlen(hex) != AEAD_KEY_SIZE * 2 || hexDetection(hex) == 0) {
+    return AT_PARAM_ERROR;
+  }
+  StrToHex((char *)key, hex, AEAD_KEY_SIZE);
+  ret = Aead_KeySet(key);
+  memset(key, 0, sizeof(key));
+  return ret ? AT_OK : AT_PARAM_ERROR;
+}
+
+/************** 			AT+SAVE		 **************/
+ATEerror_t at_save_get(const char *param) {
+  if (keep)
+    printf(AT SAVE "=");
+  // 1 while settings changed in RAM are not written to flash yet
+  printf("%d\r\n", config_Dirty());
+  return AT_OK;
+}
+
+ATEerror_t at_save_run(const char *param) {
+  config_Flush();
+  return AT_OK;
+}
+
 /************** 			Read and write and storage
  * **************/
 void config_Set(void) {
@@ -928,11 +1060,15 @@ void config_Set(void) {
   general_parameters[11] =
       qband_flag << 24 | sys.tr_time << 16 | noud_flags << 8 | sys.sht_noud;
   general_parameters[12] =
-      sys.platform << 24 | sys.dns_timer << 16 | sys.dns_time << 8;
+      sys.platform << 24 | sys.dns_timer << 16 | sys.dns_time << 8 |
+      sys.coap_mode;
   general_parameters[28] =
       mqtt_qos_flags << 24 | mqtt_qos << 16 | sys.cert << 8 | sys.tlsmod;
   general_parameters[29] =
       sys.clock_switch << 24 | sys.strat_time << 8 | sys.log_seq;
+  general_parameters[30] = sys.aead << 24 | sys.auth_tag << 16 |
+                           sys.energy_uplink << 8 | sys.lidar_acq;
+  general_parameters[31] = sys.confirm_every << 16 | sys.bat_cap;
 
   for (uint8_t i = 0, j = 0; i < strlen((char *)user.deui); i = i + 4, j++)
     general_parameters[7 + j] = user.deui[i + 0] << 24 |
@@ -1021,6 +1157,8 @@ void config_Set(void) {
                 sizeof(coap_parameters3) / 4);
   FLASH_program(FLASH_USER_COAP_URI4, coap_parameters4,
                 sizeof(coap_parameters4) / 4);
+
+  config_Written();
 }
 
 void config_Get(void) {
@@ -1086,6 +1224,10 @@ void config_Get(void) {
 
   sys.dns_timer = FLASH_read(add + 48) >> 16 & 0xFF;
 
+  sys.coap_mode = FLASH_read(add + 48) & 0xFF;
+  if (sys.coap_mode > COAP_LWM2M)
+    sys.coap_mode = COAP_MODEM;
+
   sys.tlsmod = FLASH_read(add + 112) & 0xFF;
 
   sys.cert = FLASH_read(add + 112) >> 8 & 0xFF;
@@ -1104,6 +1246,24 @@ void config_Get(void) {
 
   sys.platform = FLASH_read(add + 48) >> 24 & 0xFF;
 
+  sys.lidar_acq = FLASH_read(add + 120) & 0xFF;
+
+  sys.energy_uplink = FLASH_read(add + 120) >> 8 & 0x01;
+
+  sys.auth_tag = FLASH_read(add + 120) >> 16 & 0xFF;
+  if (Auth_TagLenValid(sys.auth_tag) == 0)
+    sys.auth_tag = 0;
+
+  sys.aead = FLASH_read(add + 120) >> 24 & 0x01;
+
+  sys.bat_cap = FLASH_read(add + 124) & 0xFFFF;
+  if (sys.bat_cap == 0 || sys.bat_cap == 0xFFFF)
+    sys.bat_cap = ENERGY_BATTERY_CAPACITY;
+
+  sys.confirm_every = FLASH_read(add + 124) >> 16 & 0xFF;
+  if (sys.confirm_every > CONFIRM_EVERY_MAX)
+    sys.confirm_every = 0;
+
   add = add + 28;
   for (uint8_t i = 0, j = 0; i < 4; i++, j = j + 4) {
     uint32_t temp = FLASH_read(add + i * 4);
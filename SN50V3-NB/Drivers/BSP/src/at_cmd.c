@@ -0,0 +1,147 @@
+#include "at.h"
+#include "config.h"
+
+/* The AT command interpreter over the ATCommand table of at.h: the lookup
+ * of the command token and the dispatch of its suffix to the handlers of
+ * at.c. The table is only walked here, so that it is linked once. */
+#define AT_COMMANDS ((int)(sizeof(ATCommand) / sizeof(struct ATCommand_s)))
+
+/* ATCommand entries sorted by command string, so that the command token
+ * is looked up by binary search: log2 of the table size in string
+ * compares instead of a strstr() per entry, and URI never shadows URI1.
+ * The index is built at startup by AT_Init(), which checks the order it
+ * gives: a command listed twice would leave one of its entries unreachable,
+ * whichever the search lands on. */
+static uint8_t atIndex[AT_COMMANDS];
+static uint8_t atIndexReady = 0;
+
+// positions in the table are kept in a byte
+typedef char atIndexFits[AT_COMMANDS <= 256 ? 1 : -1];
+
+/* Sorts the count entries of table into index by command string; returns
+ * the number of commands listed twice */
+int AT_Sort(const struct ATCommand_s *table, uint8_t *index, int count) {
+  int twice = 0;
+
+  for (int i = 0; i < count; i++) {
+    int j = i;
+    for (; j > 0 && strcmp(table[index[j - 1]].string, table[i].string) > 0;
+         j--)
+      index[j] = index[j - 1];
+    index[j] = i;
+  }
+  for (int i = 1; i < count; i++) {
+    if (strcmp(table[index[i - 1]].string, table[index[i]].string) == 0) {
+      printf("AT command table: %s listed twice\r\n", table[index[i]].string);
+      twice++;
+    }
+  }
+  return twice;
+}
+
+void AT_Init(void) {
+  AT_Sort(ATCommand, atIndex, AT_COMMANDS);
+  atIndexReady = 1;
+}
+
+/* Table entry of the len-character command token, or -1 */
+static int AT_Find(const char *cmd, size_t len) {
+  int low = 0, high = AT_COMMANDS - 1;
+
+  if (atIndexReady == 0)
+    AT_Init();
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    const char *string = ATCommand[atIndex[mid]].string;
+    int cmp = strncmp(string, cmd, len);
+
+    if (cmp == 0 && string[len] != '\0')
+      cmp = 1; // the token is a prefix of a longer command
+    if (cmp == 0)
+      return atIndex[mid];
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+  return -1;
+}
+
+ATEerror_t ATInsPro(char *atdata) {
+  int i;
+  rtrim(atdata);
+  if (strcmp(atdata, AT) == 0)
+    return AT_OK;
+  else if (strcmp(atdata, AT "?") == 0) {
+    return at_que(atdata);
+  }
+
+  // the command token ends at the "=", "=?" or "?" suffix
+  i = AT_Find(atdata, strcspn(atdata, "=?"));
+  if (i < 0) {
+    return AT_ERROR;
+  }
+
+  if (strstr(atdata, "=?")) {
+    return ATCommand[i].get(atdata);
+  } else if (strstr(atdata, "=")) {
+    ATEerror_t AT_State = ATCommand[i].set(atdata);
+    if (AT_State == AT_OK)
+      config_Save();
+    else
+      return AT_State;
+  } else if (strstr(atdata, "?")) {
+    user_main_printf("%s", ATCommand[i].help_string);
+  } else {
+    ATCommand[i].run(atdata);
+  }
+  return AT_OK;
+}
+
+/* Runs the setter of command as "command=value" typed on the console
+ * would, for settings received from the server */
+ATEerror_t AT_SetValue(const char *command, const char *value, size_t len) {
+  char line[AT_VALUE_MAX + 20];
+  int i = AT_Find(command, strlen(command));
+
+  if (i < 0 || len > AT_VALUE_MAX || memchr(value, '\0', len) != NULL)
+    return AT_PARAM_ERROR;
+  sprintf(line, "%s=%.*s", command, (int)len, value);
+  return ATCommand[i].set(line);
+}
+
+/* Runs every getter, for AT+CFG */
+void AT_GetAll(const char *param) {
+  for (int i = 0; i < AT_COMMANDS; i++)
+    ATCommand[i].get(param);
+}
+
+/************** 			AT?			 **************/
+ATEerror_t at_que(const char *param) {
+  user_main_printf("\r\nAT+<CMD>?        : Help on <CMD>\r\n"
+                   "AT+<CMD>         : Run <CMD>\r\n"
+                   "AT+<CMD>=<value> : Set the value\r\n"
+                   "AT+<CMD>=?       : Get the value\r\n");
+  for (int i = 0; i < AT_COMMANDS; i++) {
+    printf("%s\r\n", ATCommand[i].help_string);
+  }
+
+  return AT_OK;
+}
+
+/************** 		Other		 **************/
+char *rtrim(char *str) {
+  for (size_t i = 0; i < strlen(str); i++) {
+    if (str[i] == '\r' || str[i] == '\n')
+      str[i] = 0;
+  }
+  return str;
+}
+
+uint8_t hexDetection(char *str) {
+  for (size_t i = 0; i < strlen(str); i++) {
+    if (isxdigit(str[i]) == 0)
+      return 0;
+  }
+  return 1;
+}
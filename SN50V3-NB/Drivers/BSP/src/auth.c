@@ -0,0 +1,178 @@
+#include "auth.h"
+#include "cmox_crypto.h"
+#include "crc.h"
+
+/* HMAC-SHA256 of the uplink frames. The key only changes with the
+ * firmware, so the SHA-256 states after the ipad and opad blocks are
+ * derived once by Auth_Init() and copied for each tag: a tag then costs
+ * the message blocks plus two finalisations instead of four extra blocks
+ * and a context rebuild.
+ *
+ * Auth_TagHex() authenticates the frame as the server receives it over
+ * UDP/TCP, the hex payload decoded to binary, which hashes half the bytes
+ * of the string. Tags may be truncated to their leading bytes. */
+#define AUTH_BLOCK 64 // SHA-256 block length, bytes
+
+static const uint8_t hmac_key[] = {
+    // XXX
+};
+
+static cmox_sha256_handle_t authInner;
+static cmox_sha256_handle_t authOuter;
+static uint8_t authReady = 0;
+
+// The crypto library messes up with the CRC component, it's necessary to
+// reset it and ensure it's on before computing HMACs
+static void Auth_Open(void) {
+  __HAL_CRC_DR_RESET(&hcrc);
+  cmox_initialize(NULL);
+}
+
+static uint8_t Auth_Pad(cmox_sha256_handle_t *ctx, const uint8_t *key,
+                        uint8_t pad) {
+  uint8_t block[AUTH_BLOCK];
+  cmox_hash_handle_t *hash = cmox_sha256_construct(ctx);
+
+  for (int i = 0; i < AUTH_BLOCK; i++)
+    block[i] = key[i] ^ pad;
+  if (hash == NULL || cmox_hash_init(hash) != CMOX_HASH_SUCCESS ||
+      cmox_hash_append(hash, block, AUTH_BLOCK) != CMOX_HASH_SUCCESS)
+    return 0;
+  return 1;
+}
+
+uint8_t Auth_Init(void) { return Auth_SetKey(hmac_key, sizeof(hmac_key)); }
+
+// Derives the cached states from an HMAC key of any length
+uint8_t Auth_SetKey(const uint8_t *hmacKey, size_t hmacKeyLen) {
+  uint8_t key[AUTH_BLOCK] = {0};
+  size_t len = AUTH_TAG_MAX;
+
+  Auth_Open();
+  authReady = 0;
+  if (hmacKeyLen > AUTH_BLOCK) {
+    if (cmox_hash_compute(CMOX_SHA256_ALGO, hmacKey, hmacKeyLen, key,
+                          AUTH_TAG_MAX, &len) != CMOX_HASH_SUCCESS)
+      goto end;
+  } else if (hmacKeyLen > 0) {
+    memcpy(key, hmacKey, hmacKeyLen);
+  }
+  if (Auth_Pad(&authInner, key, 0x36) && Auth_Pad(&authOuter, key, 0x5c))
+    authReady = 1;
+
+end:
+  memset(key, 0, sizeof(key));
+  cmox_finalize(NULL);
+  if (authReady == 0)
+    user_main_printf("Couldn't derive the HMAC key");
+  return authReady;
+}
+
+static uint8_t Auth_Finish(cmox_sha256_handle_t *inner, uint8_t *tag,
+                           size_t tagLen) {
+  cmox_sha256_handle_t outer = authOuter;
+  uint8_t digest[AUTH_TAG_MAX];
+  size_t len = 0;
+
+  if (cmox_hash_generateTag(&inner->super, digest, &len) !=
+          CMOX_HASH_SUCCESS ||
+      cmox_hash_append(&outer.super, digest, len) != CMOX_HASH_SUCCESS ||
+      cmox_hash_generateTag(&outer.super, digest, &len) !=
+          CMOX_HASH_SUCCESS ||
+      len != AUTH_TAG_MAX)
+    return 0;
+  memcpy(tag, digest, tagLen);
+  return 1;
+}
+
+uint8_t Auth_Tag(const uint8_t *msg, size_t len, uint8_t *tag, size_t tagLen) {
+  cmox_sha256_handle_t inner = authInner;
+  uint8_t ret = 0;
+
+  if (authReady == 0 || tagLen > AUTH_TAG_MAX)
+    return 0;
+  Auth_Open();
+  if (cmox_hash_append(&inner.super, msg, len) == CMOX_HASH_SUCCESS)
+    ret = Auth_Finish(&inner, tag, tagLen);
+  cmox_finalize(NULL);
+  user_main_debug("HMAC of %d bytes, %d byte tag", len, tagLen);
+  return ret;
+}
+
+static uint8_t Auth_HexNibble(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  return (c | 0x20) - 'a' + 10;
+}
+
+uint8_t Auth_TagHex(const char *hex, size_t len, uint8_t *tag, size_t tagLen) {
+  cmox_sha256_handle_t inner = authInner;
+  uint8_t block[AUTH_BLOCK];
+  size_t pos = 0;
+  uint8_t ret = 0;
+
+  if (authReady == 0 || tagLen > AUTH_TAG_MAX || (len & 1) != 0)
+    return 0;
+  Auth_Open();
+  // decoded a block at a time, the frame is never held in binary
+  while (pos < len) {
+    size_t n = 0;
+    for (; n < AUTH_BLOCK && pos < len; n++, pos += 2)
+      block[n] = Auth_HexNibble(hex[pos]) << 4 | Auth_HexNibble(hex[pos + 1]);
+    if (cmox_hash_append(&inner.super, block, n) != CMOX_HASH_SUCCESS)
+      goto end;
+  }
+  ret = Auth_Finish(&inner, tag, tagLen);
+
+end:
+  cmox_finalize(NULL);
+  user_main_debug("HMAC of %d bytes, %d byte tag", len / 2, tagLen);
+  return ret;
+}
+
+/* The tag of a frame too long for RAM, len characters of it given by read
+ * a block at a time. They are hashed as is, or decoded first when hex is
+ * set, and a frame shorter than len is padded with zeros. */
+uint8_t Auth_TagRead(Auth_Reader read, size_t len, uint8_t hex, uint8_t *tag,
+                     size_t tagLen) {
+  cmox_sha256_handle_t inner = authInner;
+  char chunk[AUTH_BLOCK * 2];
+  uint8_t block[AUTH_BLOCK];
+  size_t pos = 0;
+  uint8_t ret = 0;
+
+  if (authReady == 0 || tagLen > AUTH_TAG_MAX || (hex && (len & 1) != 0))
+    return 0;
+  Auth_Open();
+  while (pos < len) {
+    size_t want = len - pos, n, got;
+
+    if (want > (hex ? sizeof(chunk) : sizeof(block)))
+      want = hex ? sizeof(chunk) : sizeof(block);
+    got = read(pos, hex ? chunk : (char *)block, want);
+    if (hex) {
+      memset(chunk + got, '0', want - got);
+      for (n = 0; n < want / 2; n++)
+        block[n] = Auth_HexNibble(chunk[n * 2]) << 4 |
+                   Auth_HexNibble(chunk[n * 2 + 1]);
+    } else {
+      memset(block + got, 0, want - got);
+      n = want;
+    }
+    if (cmox_hash_append(&inner.super, block, n) != CMOX_HASH_SUCCESS)
+      goto end;
+    pos += want;
+  }
+  ret = Auth_Finish(&inner, tag, tagLen);
+
+end:
+  cmox_finalize(NULL);
+  user_main_debug("HMAC of %d bytes, %d byte tag", hex ? len / 2 : len,
+                  tagLen);
+  return ret;
+}
+
+uint8_t Auth_TagLenValid(uint32_t tagLen) {
+  return tagLen == 0 || tagLen == 4 || tagLen == 8 || tagLen == 16 ||
+         tagLen == AUTH_TAG_MAX;
+}
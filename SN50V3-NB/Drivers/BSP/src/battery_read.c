@@ -1,28 +1,62 @@
 #include "battery_read.h"
+#include "time_server.h"
+
+/* Calibration cache: the factor is measured once at boot and written back
+ * into CALFACT on every enable. It is only re-measured when VDD or the die
+ * temperature have moved far enough from the conditions it was taken at,
+ * which is checked once every ADC_CAL_CHECK_INTERVAL. */
+static ADC_CalibCache adc_cal = {0};
+static uint32_t adc_channel_cfg = 0;
+static uint32_t vrefint_filt = 0; /* VREFINT raw << VREFINT_FILTER_SHIFT */
+
+static void HW_AdcEnable(void) {
+  uint32_t tickstart = HAL_GetTick();
+
+  __HAL_ADC_ENABLE(&hadc);
+  while (__HAL_ADC_GET_FLAG(&hadc, ADC_FLAG_RDY) == 0U) {
+    if ((HAL_GetTick() - tickstart) > 2)
+      break;
+  }
+  /* ADRDY is left set: CALFACT can only be written while it is */
+
+  if (adc_cal.valid == 0)
+    return;
+  /* CALFACT is lost in Stop: restore the cached factor and read it back, the
+   * cache being dropped so that the next read recalibrates if it did not
+   * take */
+  if (HAL_ADCEx_Calibration_SetValue(&hadc, ADC_SINGLE_ENDED,
+                                     adc_cal.factor) != HAL_OK ||
+      HAL_ADCEx_Calibration_GetValue(&hadc, ADC_SINGLE_ENDED) !=
+          adc_cal.factor) {
+    user_main_error("ADC calibration factor not restored");
+    adc_cal.valid = 0;
+  }
+}
 
-uint16_t HW_AdcReadChannel(uint32_t Channel) {
-
+static uint16_t HW_AdcConvert(uint32_t Channel) {
   ADC_ChannelConfTypeDef adcConf;
   uint16_t adcData = 0;
 
-  /* wait the the Vrefint used by adc is set */
-  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VREFINTRDY) == 0) {
-  };
-
-  __HAL_RCC_ADC1_CLK_ENABLE();
-
-  /*calibrate ADC if any calibraiton hardware*/
-  HAL_ADCEx_Calibration_Start(&hadc, ADC_SINGLE_ENDED);
-
-  /* Deselects all channels*/
-  adcConf.Channel = ADC_CHANNEL_MASK;
-  adcConf.Rank = ADC_RANK_NONE;
-  HAL_ADC_ConfigChannel(&hadc, &adcConf);
+  /* internal channels need >10us of sampling time */
+  if (Channel == ADC_CHANNEL_VREFINT || Channel == ADC_CHANNEL_TEMPSENSOR)
+    MODIFY_REG(hadc.Instance->SMPR, ADC_SMPR_SMPR, ADC_SAMPLETIME_160CYCLES_5);
+  else
+    MODIFY_REG(hadc.Instance->SMPR, ADC_SMPR_SMPR, hadc.Init.SamplingTime);
+
+  if (adc_channel_cfg != Channel) {
+    /* Deselects all channels*/
+    adcConf.Channel = ADC_CHANNEL_MASK;
+    adcConf.Rank = ADC_RANK_NONE;
+    HAL_ADC_ConfigChannel(&hadc, &adcConf);
+
+    /* configure adc channel */
+    adcConf.Channel = Channel;
+    adcConf.Rank = ADC_RANK_CHANNEL_NUMBER;
+    HAL_ADC_ConfigChannel(&hadc, &adcConf);
+    adc_channel_cfg = Channel;
+  }
 
-  /* configure adc channel */
-  adcConf.Channel = Channel;
-  adcConf.Rank = ADC_RANK_CHANNEL_NUMBER;
-  HAL_ADC_ConfigChannel(&hadc, &adcConf);
+  HW_AdcEnable();
 
   /* Start the conversion process */
   HAL_ADC_Start(&hadc);
@@ -34,16 +68,116 @@ uint16_t HW_AdcReadChannel(uint32_t Channel) {
   adcData = HAL_ADC_GetValue(&hadc);
 
   __HAL_ADC_DISABLE(&hadc);
+  while (ADC_IS_ENABLE(&hadc) != 0U) {
+  };
+
+  return adcData;
+}
+
+static uint16_t vrefint_to_mV(uint16_t vrefint) {
+  if (vrefint == 0)
+    return 0;
+  return ((uint32_t)VDDA_VREFINT_CAL * (*VREFINT_CAL)) / vrefint;
+}
+
+static int16_t temp_raw_to_C(uint16_t raw, uint16_t vdd_mV) {
+  int32_t ts = (int32_t)raw * vdd_mV / VDDA_VREFINT_CAL;
+  return (ts - (int32_t)(*TEMP30_CAL)) * (130 - 30) /
+             ((int32_t)(*TEMP130_CAL) - (int32_t)(*TEMP30_CAL)) +
+         30;
+}
+
+/* Must be called with the ADC clock on and the ADC disabled */
+static void HW_AdcRunCalibration(void) {
+  adc_cal.valid = 0;
+  if (HAL_ADCEx_Calibration_Start(&hadc, ADC_SINGLE_ENDED) != HAL_OK) {
+    user_main_error("ADC calibration failed");
+    return;
+  }
+  adc_cal.factor = HAL_ADCEx_Calibration_GetValue(&hadc, ADC_SINGLE_ENDED);
+  adc_cal.valid = 1;
+  adc_cal.checked = TimerGetCurrentTime();
+
+  uint16_t vrefint = HW_AdcConvert(ADC_CHANNEL_VREFINT);
+  adc_cal.vdd_mV = vrefint_to_mV(vrefint);
+  adc_cal.temp_C =
+      temp_raw_to_C(HW_AdcConvert(ADC_CHANNEL_TEMPSENSOR), adc_cal.vdd_mV);
+  vrefint_filt = (uint32_t)vrefint << VREFINT_FILTER_SHIFT;
+  user_main_debug("ADC calibrated: factor=%d,vdd=%dmV,temp=%dC",
+                  adc_cal.factor, adc_cal.vdd_mV, adc_cal.temp_C);
+}
+
+void HW_AdcCalibrate(void) {
+  /* wait the the Vrefint used by adc is set */
+  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VREFINTRDY) == 0) {
+  };
+
+  __HAL_RCC_ADC1_CLK_ENABLE();
+  HW_AdcRunCalibration();
+  __HAL_RCC_ADC1_CLK_DISABLE();
+}
+
+uint16_t HW_AdcReadChannel(uint32_t Channel) {
+
+  uint16_t adcData = 0;
+
+  /* wait the the Vrefint used by adc is set */
+  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VREFINTRDY) == 0) {
+  };
+
+  __HAL_RCC_ADC1_CLK_ENABLE();
+
+  /*calibrate ADC only if no factor has been cached yet*/
+  if (adc_cal.valid == 0)
+    HW_AdcRunCalibration();
+
+  adcData = HW_AdcConvert(Channel);
 
   __HAL_RCC_ADC1_CLK_DISABLE();
 
   return adcData;
 }
 
+/* Reads VDD and die temperature and re-runs the calibration when either has
+ * drifted beyond ADC_CAL_VDD_DRIFT_MV / ADC_CAL_TEMP_DRIFT_C. Returns the
+ * raw VREFINT reading. */
+static uint16_t HW_AdcCheckDrift(void) {
+  uint16_t vrefint = HW_AdcReadChannel(ADC_CHANNEL_VREFINT);
+  uint16_t vdd_mV = vrefint_to_mV(vrefint);
+  int16_t temp_C =
+      temp_raw_to_C(HW_AdcReadChannel(ADC_CHANNEL_TEMPSENSOR), vdd_mV);
+
+  adc_cal.checked = TimerGetCurrentTime();
+  if (abs((int)vdd_mV - (int)adc_cal.vdd_mV) > ADC_CAL_VDD_DRIFT_MV ||
+      abs((int)temp_C - (int)adc_cal.temp_C) > ADC_CAL_TEMP_DRIFT_C) {
+    user_main_debug("ADC drift: vdd=%dmV,temp=%dC, recalibrating", vdd_mV,
+                    temp_C);
+    HW_AdcCalibrate();
+    return vrefint_filt >> VREFINT_FILTER_SHIFT;
+  }
+  return vrefint;
+}
+
 uint16_t getVoltage(void) {
-  uint16_t measuredLevel = HW_AdcReadChannel(ADC_CHANNEL_VREFINT);
+  uint16_t measuredLevel;
+
+  /* VDD and the die temperature move slowly: the temperature is only
+   * converted for the drift check once an interval */
+  if (adc_cal.valid != 0 &&
+      TimerGetElapsedTime(adc_cal.checked) >= ADC_CAL_CHECK_INTERVAL)
+    measuredLevel = HW_AdcCheckDrift();
+  else
+    measuredLevel = HW_AdcReadChannel(ADC_CHANNEL_VREFINT);
+
+  /* first order IIR, y += (x - y) / 2^VREFINT_FILTER_SHIFT */
+  if (vrefint_filt == 0)
+    vrefint_filt = (uint32_t)measuredLevel << VREFINT_FILTER_SHIFT;
+  else
+    vrefint_filt = vrefint_filt - (vrefint_filt >> VREFINT_FILTER_SHIFT) +
+                   measuredLevel;
+
   uint16_t batteryLevel_mV =
-      (((uint32_t)VDDA_VREFINT_CAL * (*VREFINT_CAL)) / measuredLevel);
+      vrefint_to_mV(vrefint_filt >> VREFINT_FILTER_SHIFT);
 #if defined NB_NS
   uint16_t adcode = HW_AdcReadChannel(ADC_CHANNEL_1);
   batteryLevel_mV = (adcode * batteryLevel_mV / 4095 * 6);
@@ -0,0 +1,145 @@
+#include "clock.h"
+
+/* Clock profiles for the phases of an uplink cycle. The PLL is only needed
+ * by the modem and payload work; sensor reads run from HSI16 and plain
+ * waits from MSI, each at the lowest core voltage the frequency allows.
+ *
+ * USART1, USART2, LPUART1 and I2C1 take their kernel clock from HSI16,
+ * which is switched off with the MSI profile, so the UARTs are moved to
+ * SYSCLK and their baud rate registers re-derived while it is in use.
+ * I2C1 is not usable on MSI. The DS18B20 slots are timed by delay loops
+ * and GPIO calls at 32 MHz, so its transactions switch to the PLL for their
+ * duration. SysTick is re-derived by HAL_RCC_ClockConfig() on every
+ * switch. */
+extern void SystemClock_Config(void);
+
+static const uint32_t clockRange[CLOCK_PROFILES] = {
+    PWR_REGULATOR_VOLTAGE_SCALE3, PWR_REGULATOR_VOLTAGE_SCALE2,
+    PWR_REGULATOR_VOLTAGE_SCALE1};
+static const uint32_t clockLatency[CLOCK_PROFILES] = {
+    FLASH_LATENCY_0, FLASH_LATENCY_1, FLASH_LATENCY_1};
+
+static void Clock_Range(uint32_t range) {
+  if ((PWR->CR & PWR_CR_VOS) == range)
+    return;
+  __HAL_PWR_VOLTAGESCALING_CONFIG(range);
+  while (__HAL_PWR_GET_FLAG(PWR_FLAG_VOS) != RESET) {
+  }
+}
+
+static void Clock_UartRate(UART_HandleTypeDef *huart, uint32_t clk) {
+  uint32_t tickstart = HAL_GetTick();
+
+  if (huart->gState == HAL_UART_STATE_RESET)
+    return;
+  // let the current bytes through, BRR is only writable with UE cleared
+  while ((__HAL_UART_GET_FLAG(huart, UART_FLAG_TC) == RESET ||
+          __HAL_UART_GET_FLAG(huart, UART_FLAG_BUSY) != RESET) &&
+         (HAL_GetTick() - tickstart) < 2) {
+  }
+  __HAL_UART_DISABLE(huart);
+  if (huart->Instance == LPUART1)
+    huart->Instance->BRR = CLOCK_LPUART_BRR(clk, huart->Init.BaudRate);
+  else
+    huart->Instance->BRR = CLOCK_USART_BRR(clk, huart->Init.BaudRate);
+  __HAL_UART_ENABLE(huart);
+}
+
+static void Clock_UartKernel(uint8_t sysclk) {
+  uint32_t clk = sysclk ? HAL_RCC_GetSysClockFreq() : HSI_VALUE;
+
+  if (sysclk) {
+    __HAL_RCC_USART1_CONFIG(RCC_USART1CLKSOURCE_SYSCLK);
+    __HAL_RCC_USART2_CONFIG(RCC_USART2CLKSOURCE_SYSCLK);
+    __HAL_RCC_LPUART1_CONFIG(RCC_LPUART1CLKSOURCE_SYSCLK);
+  } else {
+    __HAL_RCC_USART1_CONFIG(RCC_USART1CLKSOURCE_HSI);
+    __HAL_RCC_USART2_CONFIG(RCC_USART2CLKSOURCE_HSI);
+    __HAL_RCC_LPUART1_CONFIG(RCC_LPUART1CLKSOURCE_HSI);
+  }
+  Clock_UartRate(&huart1, clk);
+  Clock_UartRate(&huart2, clk);
+  Clock_UartRate(&hlpuart1, clk);
+}
+
+uint8_t Clock_Get(void) {
+  switch (__HAL_RCC_GET_SYSCLK_SOURCE()) {
+  case RCC_SYSCLKSOURCE_STATUS_MSI:
+    return CLOCK_MSI2;
+  case RCC_SYSCLKSOURCE_STATUS_PLLCLK:
+    return CLOCK_PLL32;
+  default:
+    return CLOCK_HSI16;
+  }
+}
+
+/* Switches to profile and returns the previous one, to be restored with
+ * another call. The core voltage is raised before a faster clock is
+ * selected and lowered after a slower one is. */
+uint8_t Clock_Set(uint8_t profile) {
+  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+  uint8_t previous = Clock_Get();
+
+  if (profile >= CLOCK_PROFILES || profile == previous)
+    return previous;
+
+  if (clockRange[profile] < (PWR->CR & PWR_CR_VOS))
+    Clock_Range(clockRange[profile]);
+
+  if (profile == CLOCK_PLL32) {
+    SystemClock_Config();
+  } else {
+    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                                  RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (profile == CLOCK_HSI16) {
+      RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+      RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+      RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+      RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    } else {
+      RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
+      RCC_OscInitStruct.MSIState = RCC_MSI_ON;
+      RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+      RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_5;
+      RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_MSI;
+    }
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+    if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+      return previous;
+    if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, clockLatency[profile]) !=
+        HAL_OK)
+      return previous;
+
+    // the PLL, and HSI16 with the MSI profile, are left running otherwise
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    if (profile == CLOCK_MSI2) {
+      RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+      RCC_OscInitStruct.HSIState = RCC_HSI_OFF;
+    }
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+    HAL_RCC_OscConfig(&RCC_OscInitStruct);
+  }
+
+  if (profile == CLOCK_MSI2 || previous == CLOCK_MSI2)
+    Clock_UartKernel(profile == CLOCK_MSI2);
+  Clock_Range(clockRange[profile]);
+  Energy_Clock(profile);
+
+  return previous;
+}
+
+/* Sleeps on the MSI profile, for waits that leave the peripherals alone
+ * (sensor power settle, conversion times) */
+void Clock_Wait(uint32_t ms) {
+  uint8_t previous = Clock_Set(CLOCK_MSI2);
+  uint32_t tickstart = HAL_GetTick();
+
+  while ((HAL_GetTick() - tickstart) < ms) {
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+  }
+  Clock_Set(previous);
+}
@@ -0,0 +1,304 @@
+#include "coap.h"
+
+/* CoAP messages (RFC 7252) built and parsed on the MCU, so that an uplink
+ * is a single datagram handed to the modem instead of a CoAP session set
+ * up option by option with AT commands.
+ *
+ * A message is written with Coap_Begin(), Coap_Option() for each option
+ * in ascending number order, Coap_Payload() and Coap_End(). The writer
+ * records overflows and misordered options and Coap_End() returns 0 for
+ * them, so the calls in between need no checks. */
+
+static void Coap_Put(CoapWriter *w, const void *data, size_t len) {
+  if (w->error || len > w->size - w->len) {
+    w->error = 1;
+    return;
+  }
+  memcpy(w->buf + w->len, data, len);
+  w->len += len;
+}
+
+/* Option delta and length share the first byte as nibbles, values from
+ * 13 on being extended by one or two bytes after it */
+static uint8_t Coap_Nibble(uint16_t value, uint8_t *ext, size_t *extLen) {
+  if (value < 13) {
+    *extLen = 0;
+    return value;
+  }
+  if (value < 269) {
+    ext[0] = value - 13;
+    *extLen = 1;
+    return 13;
+  }
+  value -= 269;
+  ext[0] = value >> 8;
+  ext[1] = value & 0xFF;
+  *extLen = 2;
+  return 14;
+}
+
+void Coap_Begin(CoapWriter *w, uint8_t *buf, size_t size,
+                const CoapMessage *msg) {
+  uint8_t head[COAP_HEADER_SIZE];
+
+  w->buf = buf;
+  w->size = size;
+  w->len = 0;
+  w->option = 0;
+  w->payload = 0;
+  w->error = msg->tkl > COAP_TOKEN_MAX;
+
+  head[0] = 1 << 6 | (msg->type & 0x03) << 4 | msg->tkl;
+  head[1] = msg->code;
+  head[2] = msg->mid >> 8;
+  head[3] = msg->mid & 0xFF;
+  Coap_Put(w, head, sizeof(head));
+  Coap_Put(w, msg->token, msg->tkl);
+}
+
+void Coap_Option(CoapWriter *w, uint16_t number, const void *value,
+                 size_t len) {
+  uint8_t first;
+  uint8_t deltaExt[2], lenExt[2];
+  size_t deltaExtLen, lenExtLen;
+
+  if (number < w->option || len > 0xFFFF || w->payload) {
+    w->error = 1;
+    return;
+  }
+  first = Coap_Nibble(number - w->option, deltaExt, &deltaExtLen) << 4;
+  first |= Coap_Nibble(len, lenExt, &lenExtLen);
+  Coap_Put(w, &first, 1);
+  Coap_Put(w, deltaExt, deltaExtLen);
+  Coap_Put(w, lenExt, lenExtLen);
+  Coap_Put(w, value, len);
+  w->option = number;
+}
+
+void Coap_OptionUint(CoapWriter *w, uint16_t number, uint32_t value) {
+  uint8_t bytes[4];
+  size_t len = 0;
+
+  // big-endian without the leading zero bytes, 0 being empty
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    if (len != 0 || (value >> shift & 0xFF) != 0)
+      bytes[len++] = value >> shift & 0xFF;
+  }
+  Coap_Option(w, number, bytes, len);
+}
+
+/* Appends to the payload, the first call writing the marker. A payload
+ * may be finished outside the writer after a call with len 0, but must
+ * not be empty. */
+void Coap_Payload(CoapWriter *w, const void *data, size_t len) {
+  uint8_t marker = COAP_PAYLOAD_MARKER;
+
+  if (w->payload == 0) {
+    Coap_Put(w, &marker, 1);
+    w->payload = 1;
+  }
+  Coap_Put(w, data, len);
+}
+
+size_t Coap_End(CoapWriter *w) { return w->error ? 0 : w->len; }
+
+/* Reads an extended delta or length, returns 0 past the end of the
+ * message or for the reserved nibble 15 */
+static uint8_t Coap_ReadNibble(uint8_t nibble, const uint8_t **pos,
+                               const uint8_t *end, uint16_t *value) {
+  if (nibble < 13) {
+    *value = nibble;
+  } else if (nibble == 13) {
+    if (end - *pos < 1)
+      return 0;
+    *value = 13 + (*pos)[0];
+    *pos += 1;
+  } else if (nibble == 14) {
+    if (end - *pos < 2)
+      return 0;
+    *value = 269 + ((*pos)[0] << 8 | (*pos)[1]);
+    *pos += 2;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/* Fills msg from the datagram, the payload pointing into buf. Returns 0
+ * for anything that is not a well-formed CoAP message. */
+uint8_t Coap_Parse(CoapMessage *msg, const uint8_t *buf, size_t len) {
+  const uint8_t *pos = buf + COAP_HEADER_SIZE;
+  const uint8_t *end = buf + len;
+
+  if (len < COAP_HEADER_SIZE || buf[0] >> 6 != 1)
+    return 0;
+  msg->type = buf[0] >> 4 & 0x03;
+  msg->tkl = buf[0] & 0x0F;
+  msg->code = buf[1];
+  msg->mid = buf[2] << 8 | buf[3];
+  msg->payload = NULL;
+  msg->payload_len = 0;
+  if (msg->tkl > COAP_TOKEN_MAX || end - pos < msg->tkl)
+    return 0;
+  memcpy(msg->token, pos, msg->tkl);
+  pos += msg->tkl;
+  msg->options = pos;
+  msg->options_len = end - pos;
+
+  while (pos < end) {
+    uint16_t delta, optLen;
+    uint8_t first = *pos++;
+
+    if (first == COAP_PAYLOAD_MARKER) {
+      // a marker with nothing after it is a format error
+      if (pos == end)
+        return 0;
+      msg->payload = pos;
+      msg->payload_len = end - pos;
+      msg->options_len = pos - 1 - msg->options;
+      break;
+    }
+    if (!Coap_ReadNibble(first >> 4, &pos, end, &delta) ||
+        !Coap_ReadNibble(first & 0x0F, &pos, end, &optLen) ||
+        end - pos < optLen)
+      return 0;
+    pos += optLen;
+  }
+  return 1;
+}
+
+/* Iterates over the options of a message checked by Coap_Parse(), opt
+ * being zeroed before the first call. Returns 0 after the last one. */
+uint8_t Coap_OptionNext(const CoapMessage *msg, CoapOption *opt) {
+  const uint8_t *end = msg->options + msg->options_len;
+  const uint8_t *pos = msg->options;
+  uint16_t delta, len;
+  uint8_t first;
+
+  if (opt->value != NULL)
+    pos = opt->value + opt->len;
+  if (pos >= end)
+    return 0;
+  first = *pos++;
+  Coap_ReadNibble(first >> 4, &pos, end, &delta);
+  Coap_ReadNibble(first & 0x0F, &pos, end, &len);
+  opt->number += delta;
+  opt->len = len;
+  opt->value = pos;
+  return 1;
+}
+
+uint32_t Coap_OptionUintValue(const CoapOption *opt) {
+  uint32_t value = 0;
+
+  for (int i = 0; i < opt->len && i < 4; i++)
+    value = value << 8 | opt->value[i];
+  return value;
+}
+
+/* Whether rsp answers req: an ACK or RST carries its message ID, and a
+ * response, piggybacked on the ACK or sent separately, its token */
+uint8_t Coap_Matches(const CoapMessage *rsp, const CoapMessage *req) {
+  uint8_t sameToken = rsp->tkl == req->tkl &&
+                      memcmp(rsp->token, req->token, req->tkl) == 0;
+
+  if (rsp->type == COAP_RST)
+    return rsp->mid == req->mid;
+  if (rsp->type == COAP_ACK && rsp->mid != req->mid)
+    return 0;
+  return rsp->code == COAP_EMPTY ? rsp->type == COAP_ACK : sameToken;
+}
+
+/* Block-wise upload of a request body (RFC 7959): each block is a request
+ * of its own carrying Block1, answered with 2.31 Continue until the last
+ * one gets the answer to the whole body. The server may ask for smaller
+ * blocks, in its Block1 option or with 4.13 Request Entity Too Large. */
+void Coap_BlockStart(CoapBlock *b, size_t len, uint8_t szx) {
+  b->len = len;
+  b->num = 0;
+  b->szx = szx;
+  b->wise = len > COAP_BLOCK_SIZE(szx);
+}
+
+// Length of the next slice of the body, from offset
+size_t Coap_BlockSlice(const CoapBlock *b, size_t *offset, uint8_t *more) {
+  size_t len = b->len;
+
+  *offset = 0;
+  *more = 0;
+  if (b->wise) {
+    *offset = b->num * COAP_BLOCK_SIZE(b->szx);
+    len = b->len - *offset;
+    if (len > COAP_BLOCK_SIZE(b->szx)) {
+      len = COAP_BLOCK_SIZE(b->szx);
+      *more = 1;
+    }
+  }
+  return len;
+}
+
+/* Moves the upload on after the answer to a block. Returns 1 when another
+ * block, or the body again in smaller blocks, must be sent, and 0 when
+ * rsp is the answer to the whole body. */
+uint8_t Coap_BlockAnswer(CoapBlock *b, const CoapMessage *rsp) {
+  uint32_t offset = (b->num + 1) * COAP_BLOCK_SIZE(b->szx);
+  uint8_t szx = b->szx;
+  uint8_t block = 0;
+  uint32_t size = 0;
+  CoapOption opt = {0};
+
+  while (Coap_OptionNext(rsp, &opt)) {
+    if (opt.number == COAP_OPTION_BLOCK1) {
+      szx = Coap_OptionUintValue(&opt) & 0x07;
+      block = 1;
+    } else if (opt.number == COAP_OPTION_SIZE1) {
+      size = Coap_OptionUintValue(&opt);
+    }
+  }
+  if (szx > COAP_SZX_MAX)
+    szx = COAP_SZX_MAX;
+  if (rsp->code == COAP_TOO_LARGE) {
+    // without Block1, Size1 may give the largest body the server takes,
+    // or the blocks are halved
+    if (block == 0 && size != 0) {
+      for (szx = COAP_SZX_MAX; szx > 0 && COAP_BLOCK_SIZE(szx) > size; szx--)
+        ;
+    } else if (block == 0 && szx > 0) {
+      szx--;
+    }
+    if (szx >= b->szx)
+      return 0;
+    // start over, in blocks even if the body fitted in one
+    b->szx = szx;
+    b->num = 0;
+    b->wise = 1;
+    return 1;
+  }
+  // an empty ACK means the block is received, its answer coming later
+  if (b->wise == 0 || offset >= b->len ||
+      (rsp->code != COAP_CONTINUE && rsp->code != COAP_EMPTY))
+    return 0;
+  // the next block, at the size asked for by the server
+  if (szx < b->szx)
+    b->szx = szx;
+  b->num = offset / COAP_BLOCK_SIZE(b->szx);
+  return 1;
+}
+
+/* Retransmission of a confirmable message (RFC 7252 4.2), the same
+ * message ID and token each time: the first wait is drawn from
+ * ACK_TIMEOUT to ACK_TIMEOUT * 1.5, and doubles after each of the
+ * MAX_RETRANSMIT retransmissions. */
+void Coap_RetransmitStart(CoapRetransmit *r, uint32_t random) {
+  r->timeout = COAP_ACK_TIMEOUT + random % (COAP_ACK_TIMEOUT / 2 + 1);
+  r->count = 0;
+}
+
+// Returns 1 when the message is to be sent again, 0 to give up
+uint8_t Coap_RetransmitNext(CoapRetransmit *r) {
+  if (r->count >= COAP_MAX_RETRANSMIT)
+    return 0;
+  r->count++;
+  r->timeout *= 2;
+  return 1;
+}
@@ -1,9 +1,4 @@
 #include "common.h"
-#include "cmox_hmac.h"
-#include "cmox_low_level.h"
-#include "cmox_mac.h"
-#include "crc.h"
-#include "hash/cmox_sha256.h"
 #include "nbInit.h"
 
 static uint8_t sys_pwd[10] = {0};
@@ -11,9 +6,6 @@ static char sensor_data[1200] = {0};
 uint8_t detect_flags = 0;
 uint8_t mode2_flag = 0;
 extern uint8_t rxbuf_u1;
-extern uint8_t mqtt_qos;
-extern bool first_sample;
-extern uint8_t mqtt_qos_flags;
 SYSTEM sys = {.pwd = sys_pwd};
 SENSOR sensor = {.data = sensor_data};
 USER user = {0};
@@ -29,13 +21,7 @@ uint16_t adc0_datalog, adc1_datalog, adc4_datalog;
 uint16_t distance_datalog;
 static uint8_t mod5_init_flag = 0;
 uint8_t debugss = 0;
-extern uint8_t at_downlink_flag;
 extern __IO bool ble_sleep_flags;
-static char at_downlink_data[220] = {0};
-
-static uint8_t hmac_key[] = {
-    // XXX
-};
 
 void product_information_print(void) {
 #ifdef NB_1D
@@ -161,8 +147,10 @@ void led_on(uint16_t time) {
 }
 
 void BSP_sensor_Init(void) {
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_RESET);
-  HAL_Delay(1000);
+  uint8_t clock;
+
+  Sensor_PowerSettle(1000);
+  clock = Clock_Set(CLOCK_HSI16);
   if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
     MX_I2C1_Init();
     if (sht2x_Detect() == 1) {
@@ -212,47 +200,32 @@ void BSP_sensor_Init(void) {
   } else if (sys.mod == model5) {
     WEIGHT_SCK_Init();
     WEIGHT_DOUT_Init();
-    Get_Maopi();
-    HAL_Delay(500);
-    Get_Maopi();
+    if (Weight_Tare_Load() == 0)
+      Get_Maopi();
+    HX711_PowerDown();
     WEIGHT_SCK_DeInit();
     WEIGHT_DOUT_DeInit();
     printf("Use Sensor is HX711\r\n");
     HAL_Delay(20);
   }
 
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_SET);
+  Clock_Set(clock);
+  Sensor_PowerOff();
 }
 
-void txPayLoadDeal(SENSOR *Sensor) {
-  if (ble_sleep_flags == 1) {
-    if ((HAL_GPIO_ReadPin(DX_BT24_STATUS_PORT, DX_BT24_LINK_PIN) == 1) ||
-        (HAL_GPIO_ReadPin(DX_BT24_STATUS_PORT, DX_BT24_WORK_PIN) == 1)) {
-      HAL_Delay(50);
-      printf("AT+PWRM2\r\n");
-    }
-  }
-  memset(Sensor->data, 0, sizeof((char *)Sensor->data));
-  sensor.humSHT = 0;
-  sensor.temSHT = 0;
-  Sensor->data_len = 0;
+/* Reads every sensor of the current mode into Sensor. Only what is left of
+ * the power-on settle time is waited for, on the MSI clock, and the sensors
+ * are read on HSI16. The payload itself is built later by txPayLoadDeal(). */
+void txSensorSample(SENSOR *Sensor) {
+  uint8_t clock;
 
-  Sensor->singal = nb.singal;
+  Sensor_PowerSettle(SENSOR_SETTLE_TIME + sys.power_time);
+  clock = Clock_Set(CLOCK_HSI16);
 
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_RESET);
-  HAL_Delay(500 + sys.power_time);
+  sensor.humSHT = 0;
+  sensor.temSHT = 0;
   Sensor->batteryLevel_mV = getVoltage();
   user_main_printf("remaining battery =%d mv", Sensor->batteryLevel_mV);
-  sprintf(Sensor->data + strlen(Sensor->data), "%c", 'f');
-  for (int i = 0; i < strlen((char *)user.deui); i++)
-    sprintf(Sensor->data + strlen(Sensor->data), "%c", user.deui[i]);
-
-  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", 0x04);
-  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", string_touint());
-
-  sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->batteryLevel_mV);
-  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->singal);
-  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", sys.mod - 0x30);
 
   if (sys.mod == model1) {
     Sensor->temDs18b20_1 = (int)(DS18B20_GetTemp_SkipRom(1) * 10);
@@ -265,22 +238,6 @@ void txPayLoadDeal(SENSOR *Sensor) {
       sht31Data();
     HAL_I2C_MspDeInit(&hi2c1);
     HAL_Delay(20);
-
-    sprintf(Sensor->data + strlen(Sensor->data), "%c",
-            (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
-    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
-            (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
-                                        : Sensor->temDs18b20_1 * (-1));
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x",
-            HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4));
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
-    sprintf(Sensor->data + strlen(Sensor->data), "%c",
-            (Sensor->temSHT >= 0) ? '0' : 'F');
-    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
-            (Sensor->temSHT >= 0) ? Sensor->temSHT : Sensor->temSHT * (-1));
-    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->humSHT);
   } else if (sys.mod == model2) {
     Sensor->temDs18b20_1 = DS18B20_GetTemp_SkipRom(1) * 10;
     Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
@@ -297,25 +254,12 @@ void txPayLoadDeal(SENSOR *Sensor) {
       MX_USART1_UART_Init();
       uart1_Init();
       HAL_UART_Receive_IT(&huart1, (uint8_t *)&rxbuf_u1, RXSIZE);
-      HAL_Delay(100);
       ULT_getData();
       uart1_IoDeInit();
       Sensor->distance = ULT_Data_processing();
     } else {
       Sensor->distance = 0;
     }
-
-    sprintf(Sensor->data + strlen(Sensor->data), "%c",
-            (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
-    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
-            (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
-                                        : Sensor->temDs18b20_1 * (-1));
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x",
-            HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4));
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->distance);
   } else if (sys.mod == model3) {
     Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
     Sensor->adc2 = ADCModel(ADC_CHANNEL_1);
@@ -328,10 +272,243 @@ void txPayLoadDeal(SENSOR *Sensor) {
       sht31Data();
     HAL_I2C_MspDeInit(&hi2c1);
     HAL_Delay(20);
+  } else if (sys.mod == model4) {
+    Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
+    Sensor->temDs18b20_1 = DS18B20_GetTemp_SkipRom(1) * 10;
+    DS18B20_IoDeInit(1);
+    Sensor->temDs18b20_2 = DS18B20_GetTemp_SkipRom(2) * 10;
+    DS18B20_IoDeInit(2);
+    Sensor->temDs18b20_3 = DS18B20_GetTemp_SkipRom(3) * 10;
+    DS18B20_IoDeInit(3);
+  } else if (sys.mod == model5) {
+    if (mod5_init_flag == 0) {
+      if (Weight_Tare_Load() == 0) {
+        WEIGHT_SCK_Init();
+        WEIGHT_DOUT_Init();
+        Get_Maopi();
+        WEIGHT_SCK_DeInit();
+        WEIGHT_DOUT_DeInit();
+      }
+      mod5_init_flag = 1;
+    }
+
+    Sensor->temDs18b20_1 = DS18B20_GetTemp_SkipRom(1) * 10;
+    Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
+    WEIGHT_SCK_Init();
+    WEIGHT_DOUT_Init();
+    Sensor->weight = Get_Weight();
+    WEIGHT_SCK_DeInit();
+    WEIGHT_DOUT_DeInit();
+    user_main_printf("Weight is %d g", Sensor->weight);
+  } else if (sys.mod == model7) {
+    MX_I2C1_Init();
+    if (detect_flags == 1)
+      sht20Data();
+    else if (detect_flags == 2)
+      sht31Data();
+    HAL_I2C_MspDeInit(&hi2c1);
+    HAL_Delay(20);
+    Count_Sample();
+  }
+  Sensor->din = HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4);
+
+  Clock_Set(clock);
+  Sensor_PowerOff();
+  Sensor->sampled = 1;
+}
+
+/* The history of a frame sent by CoAP over UDP isn't copied in
+ * sensor_data: its records are formatted again from EEPROM as the frame is
+ * read by txFrameRead(), so the frame may be longer than the buffer. The
+ * clear frame is sensor_data with the history inserted at txHeadLen. */
+static uint8_t txStreamed = 0;
+static size_t txHeadLen;      // of the frame before the history
+static size_t txPlainLen;     // of the clear frame, tag excluded
+static int txHistorySeq;      // sys.sht_seq when the frame was made
+static size_t txHistoryCount; // records in the history
+static size_t txRecordLen;    // characters of a record
+static char txTag[AUTH_TAG_MAX * 2 + 1]; // ending the frame
+static uint8_t txSealed = 0; // read through Aead_SealRead()
+
+// Formats the record i of the history, the latest first
+static size_t txHistoryRecord(char *out, int i) {
+  int num = (txHistorySeq - 1 - i) & 31;
+  uint32_t r_time = *(__IO uint32_t *)(EEPROM_TIME_START_ADD + num * 0x04);
+
+  out[0] = '\0';
+  if ((sys.mod != model6) && (sys.mod != model7)) {
+    uint32_t r_ad0_data =
+        *(__IO uint32_t *)(EEPROM_D1_AD0_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", (r_ad0_data >> 16) & 0xFFFF);
+    if ((sys.mod != model3)) {
+      sprintf(out + strlen(out), "%.4x", r_ad0_data & 0xFFFF);
+    }
+  }
+  if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
+    uint32_t r_sht_data = *(__IO uint32_t *)(EEPROM_SHT_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", (r_sht_data >> 16) & 0xFFFF);
+    sprintf(out + strlen(out), "%.4x", r_sht_data & 0xFFFF);
+  }
+  if (sys.mod == model2) {
+    uint32_t r_distance_data =
+        *(__IO uint32_t *)(EEPROM_DISTANCE_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", r_distance_data & 0xFFFF);
+  }
+  if (sys.mod == model3) {
+    uint32_t r_ad1_ad4_data =
+        *(__IO uint32_t *)(EEPROM_AD1_AD4_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", (r_ad1_ad4_data >> 16) & 0xFFFF);
+    sprintf(out + strlen(out), "%.4x", r_ad1_ad4_data & 0xFFFF);
+  }
+  if (sys.mod == model4) {
+    uint32_t r_d2_d3_data =
+        *(__IO uint32_t *)(EEPROM_D2D3_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", (r_d2_d3_data >> 16) & 0xFFFF);
+    sprintf(out + strlen(out), "%.4x", r_d2_d3_data & 0xFFFF);
+  }
+  if (sys.mod == model5) {
+    uint32_t r_weight_data =
+        *(__IO uint32_t *)(EEPROM_WEIGHT_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.8x", r_weight_data);
+  }
+  if (sys.mod == model6) {
+    uint32_t r_count_data =
+        *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.8x", r_count_data);
+  }
+  if (sys.mod == model7) {
+    uint32_t r_count_data =
+        *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.8x", r_count_data);
+    uint32_t r_intensity =
+        *(__IO uint32_t *)(EEPROM_INTENSITY_START_ADD + num * 0x04);
+    sprintf(out + strlen(out), "%.4x", r_intensity & 0xFFFF);
+  }
+  sprintf(out + strlen(out), "%.8x", r_time);
+  return strlen(out);
+}
+
+// Reads len characters of the clear frame from offset into dst
+static size_t txPlainRead(size_t offset, char *dst, size_t len) {
+  size_t historyLen = txHistoryCount * txRecordLen;
+  size_t n = 0;
+
+  if (offset >= txPlainLen)
+    return 0;
+  if (len > txPlainLen - offset)
+    len = txPlainLen - offset;
+  while (n < len) {
+    size_t at = offset + n, count = len - n;
+    const char *src;
+    char record[40];
+
+    if (at < txHeadLen) {
+      src = sensor_data + at;
+      if (count > txHeadLen - at)
+        count = txHeadLen - at;
+    } else if (at < txHeadLen + historyLen) {
+      size_t pos = (at - txHeadLen) % txRecordLen;
+
+      txHistoryRecord(record, (at - txHeadLen) / txRecordLen);
+      src = record + pos;
+      if (count > txRecordLen - pos)
+        count = txRecordLen - pos;
+    } else {
+      src = sensor_data + at - historyLen;
+    }
+    memcpy(dst + n, src, count);
+    n += count;
+  }
+  return len;
+}
+
+/**
+ * @brief  Reads the hex frame of the uplink
+ * @param  offset: position of the first character to read
+ * @param  dst: where the characters go, not terminated
+ * @param  len: number of characters to read
+ * @retval Number of characters read, short at the end of the frame
+ */
+size_t txFrameRead(size_t offset, char *dst, size_t len) {
+  size_t n;
+
+  if (txStreamed == 0) {
+    size_t frameLen = strlen(sensor_data);
+
+    if (offset >= frameLen)
+      return 0;
+    n = frameLen - offset < len ? frameLen - offset : len;
+    memcpy(dst, sensor_data + offset, n);
+    return n;
+  }
+  if (txSealed)
+    return Aead_SealRead(offset, dst, len);
+  n = txPlainRead(offset, dst, len);
+  // then the hex tag
+  for (; n < len && offset + n < txPlainLen + strlen(txTag); n++)
+    dst[n] = txTag[offset + n - txPlainLen];
+  return n;
+}
+
+void txPayLoadDeal(SENSOR *Sensor) {
+  char record[40];
+
+  if (ble_sleep_flags == 1) {
+    if ((HAL_GPIO_ReadPin(DX_BT24_STATUS_PORT, DX_BT24_LINK_PIN) == 1) ||
+        (HAL_GPIO_ReadPin(DX_BT24_STATUS_PORT, DX_BT24_WORK_PIN) == 1)) {
+      HAL_Delay(50);
+      printf("AT+PWRM2\r\n");
+    }
+  }
+  memset(Sensor->data, 0, sizeof((char *)Sensor->data));
+  Sensor->data_len = 0;
+
+  if (Sensor->sampled == 0)
+    txSensorSample(Sensor);
+  Sensor->sampled = 0;
 
+  Sensor->singal = nb.singal;
+
+  sprintf(Sensor->data + strlen(Sensor->data), "%c", 'f');
+  for (int i = 0; i < strlen((char *)user.deui); i++)
+    sprintf(Sensor->data + strlen(Sensor->data), "%c", user.deui[i]);
+
+  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", 0x04);
+  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", string_touint());
+
+  sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->batteryLevel_mV);
+  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->singal);
+  sprintf(Sensor->data + strlen(Sensor->data), "%.2x", sys.mod - 0x30);
+
+  if (sys.mod == model1) {
+    sprintf(Sensor->data + strlen(Sensor->data), "%c",
+            (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
+    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
+            (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
+                                        : Sensor->temDs18b20_1 * (-1));
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->din);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x",
-            HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4));
+    sprintf(Sensor->data + strlen(Sensor->data), "%c",
+            (Sensor->temSHT >= 0) ? '0' : 'F');
+    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
+            (Sensor->temSHT >= 0) ? Sensor->temSHT : Sensor->temSHT * (-1));
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->humSHT);
+  } else if (sys.mod == model2) {
+    sprintf(Sensor->data + strlen(Sensor->data), "%c",
+            (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
+    sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
+            (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
+                                        : Sensor->temDs18b20_1 * (-1));
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->din);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->distance);
+  } else if (sys.mod == model3) {
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->din);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc2);
@@ -342,22 +519,13 @@ void txPayLoadDeal(SENSOR *Sensor) {
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->humSHT);
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc3);
   } else if (sys.mod == model4) {
-    Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
-    Sensor->temDs18b20_1 = DS18B20_GetTemp_SkipRom(1) * 10;
-    DS18B20_IoDeInit(1);
-    Sensor->temDs18b20_2 = DS18B20_GetTemp_SkipRom(2) * 10;
-    DS18B20_IoDeInit(2);
-    Sensor->temDs18b20_3 = DS18B20_GetTemp_SkipRom(3) * 10;
-    DS18B20_IoDeInit(3);
-
     sprintf(Sensor->data + strlen(Sensor->data), "%c",
             (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
     sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
             (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
                                         : Sensor->temDs18b20_1 * (-1));
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x",
-            HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4));
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->din);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
     sprintf(Sensor->data + strlen(Sensor->data), "%c",
@@ -371,48 +539,19 @@ void txPayLoadDeal(SENSOR *Sensor) {
             (Sensor->temDs18b20_3 >= 0) ? Sensor->temDs18b20_3
                                         : Sensor->temDs18b20_3 * (-1));
   } else if (sys.mod == model5) {
-    if (mod5_init_flag == 0) {
-      WEIGHT_SCK_Init();
-      WEIGHT_DOUT_Init();
-      Get_Maopi();
-      HAL_Delay(500);
-      Get_Maopi();
-      WEIGHT_SCK_DeInit();
-      WEIGHT_DOUT_DeInit();
-      mod5_init_flag = 1;
-    }
-
-    Sensor->temDs18b20_1 = DS18B20_GetTemp_SkipRom(1) * 10;
-    Sensor->adc1 = ADCModel(ADC_CHANNEL_4);
-    WEIGHT_SCK_Init();
-    WEIGHT_DOUT_Init();
-    int32_t Weight = Get_Weight();
-    WEIGHT_SCK_DeInit();
-    WEIGHT_DOUT_DeInit();
-    user_main_printf("Weight is %d g", Weight);
-
     sprintf(Sensor->data + strlen(Sensor->data), "%c",
             (Sensor->temDs18b20_1 >= 0) ? '0' : 'F');
     sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
             (Sensor->temDs18b20_1 >= 0) ? Sensor->temDs18b20_1
                                         : Sensor->temDs18b20_1 * (-1));
     sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->adc1);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.2x",
-            HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_4));
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->din);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_state);
     sprintf(Sensor->data + strlen(Sensor->data), "%.2x", Sensor->exit_level);
-    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Weight);
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x", Sensor->weight);
   } else if (sys.mod == model6) {
     sprintf(Sensor->data + strlen(Sensor->data), "%.8x", sensor.exit_count);
   } else if (sys.mod == model7) {
-    MX_I2C1_Init();
-    if (detect_flags == 1)
-      sht20Data();
-    else if (detect_flags == 2)
-      sht31Data();
-    HAL_I2C_MspDeInit(&hi2c1);
-    HAL_Delay(20);
-
     sprintf(Sensor->data + strlen(Sensor->data), "%c",
             (Sensor->temSHT >= 0) ? '0' : 'F');
     sprintf(Sensor->data + strlen(Sensor->data), "%.3x",
@@ -423,165 +562,86 @@ void txPayLoadDeal(SENSOR *Sensor) {
   }
   sprintf(Sensor->data + strlen(Sensor->data), "%.8x", sensor.time_stamp);
 
-  int num = sys.sht_seq;
-  for (uint8_t i = 0; i < sys.sht_noud; i++) {
-    num--;
-    if (num < 0)
-      num = 32 + num;
-    uint32_t r_time = *(__IO uint32_t *)(EEPROM_TIME_START_ADD + num * 0x04);
-
-    if ((sys.mod != model6) && (sys.mod != model7)) {
-      uint32_t r_ad0_data =
-          *(__IO uint32_t *)(EEPROM_D1_AD0_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              (r_ad0_data >> 16) & 0xFFFF);
-      if ((sys.mod != model3)) {
-        sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-                r_ad0_data & 0xFFFF);
-      }
-    }
-    if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
-      uint32_t r_sht_data =
-          *(__IO uint32_t *)(EEPROM_SHT_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              (r_sht_data >> 16) & 0xFFFF);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x", r_sht_data & 0xFFFF);
-    }
-    if (sys.mod == model2) {
-      uint32_t r_distance_data =
-          *(__IO uint32_t *)(EEPROM_DISTANCE_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              r_distance_data & 0xFFFF);
-    }
-    if (sys.mod == model3) {
-      uint32_t r_ad1_ad4_data =
-          *(__IO uint32_t *)(EEPROM_AD1_AD4_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              (r_ad1_ad4_data >> 16) & 0xFFFF);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              r_ad1_ad4_data & 0xFFFF);
-    }
-    if (sys.mod == model4) {
-      uint32_t r_d2_d3_data =
-          *(__IO uint32_t *)(EEPROM_D2D3_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              (r_d2_d3_data >> 16) & 0xFFFF);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              r_d2_d3_data & 0xFFFF);
-    }
-    if (sys.mod == model5) {
-      uint32_t r_weight_data =
-          *(__IO uint32_t *)(EEPROM_WEIGHT_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.8x", r_weight_data);
-    }
-    if (sys.mod == model6) {
-      uint32_t r_count_data =
-          *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.8x", r_count_data);
-    }
-    if (sys.mod == model7) {
-      uint32_t r_count_data =
-          *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.8x", r_count_data);
-      uint32_t r_intensity =
-          *(__IO uint32_t *)(EEPROM_INTENSITY_START_ADD + num * 0x04);
-      sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
-              r_intensity & 0xFFFF);
-    }
-    sprintf(Sensor->data + strlen(Sensor->data), "%.8x", r_time);
-  }
-
-  size_t msg_len = strlen(Sensor->data);
-  uint32_t hmac_len = CMOX_SHA256_SIZE;
-  uint8_t hmac[CMOX_SHA256_SIZE] = {0};
-
-  // The crypto library messes up with the CRC component, it's necessary to
-  // reset it and ensure it's on before computing HMACs
-  __HAL_CRC_DR_RESET(&hcrc);
-  cmox_initialize(NULL);
-
-  cmox_hmac_handle_t hmac_ctx;
-  cmox_mac_retval_t retval;
-  uint8_t *msg = (uint8_t *)Sensor->data;
-  int index;
-  cmox_mac_handle_t *mac_ctx = cmox_hmac_construct(&hmac_ctx, CMOX_HMAC_SHA256);
-  if (mac_ctx == NULL) {
-    user_main_printf("Couldn't create MAC context");
-    goto end;
-  }
-  retval = cmox_mac_init(mac_ctx);
-  if (retval != CMOX_MAC_SUCCESS) {
-    user_main_printf("Couldn't initialize MAC context");
-    goto end;
-  }
-  retval = cmox_mac_setKey(mac_ctx, hmac_key, sizeof(hmac_key));
-  if (retval != CMOX_MAC_SUCCESS) {
-    user_main_printf("Couldn't set HMAC key");
-    goto end;
+  txStreamed = sys.protocol == COAP_PRO && sys.coap_mode == COAP_UDP;
+  txSealed = 0;
+  txTag[0] = '\0';
+  txHeadLen = strlen(Sensor->data);
+  txHistorySeq = sys.sht_seq;
+  txHistoryCount = Confirm_History(sys.sht_noud);
+  txRecordLen = txHistoryRecord(record, 0);
+  if (txStreamed == 0) {
+    for (size_t i = 0; i < txHistoryCount; i++)
+      txHistoryRecord(Sensor->data + strlen(Sensor->data), i);
+    txHistoryCount = 0;
   }
 
-  for (index = 0; index < (msg_len - 40); index += 40) {
-    retval = cmox_mac_append(mac_ctx, &msg[index],
-                             40); /* Chunk of data to authenticate */
-    if (retval != CMOX_MAC_SUCCESS) {
-      user_main_printf("Couldn't append message chunk");
-      goto end;
-    }
+  Energy_CycleEnd();
+  if (sys.energy_uplink) {
+    sprintf(Sensor->data + strlen(Sensor->data), "%.8x", Energy_CycleuAh());
+    sprintf(Sensor->data + strlen(Sensor->data), "%.4x",
+            Energy_RemainingDays(sys.bat_cap));
   }
-
-  /* Append the last part of the message if needed */
-  if (index < msg_len) {
-    retval = cmox_mac_append(mac_ctx, &msg[index],
-                             40); /* Chunk of data to authenticate */
-    if (retval != CMOX_MAC_SUCCESS) {
-      user_main_printf("Couldn't append message chunk");
-      goto end;
+  rxAckWrite(Sensor->data + strlen(Sensor->data));
+  // the server counts the uplinks lost since the previous checkpoint
+  if (sys.confirm_every > 1 && Confirm_Checkpoint())
+    sprintf(Sensor->data + strlen(Sensor->data), "%.2x%.2x%.4x",
+            UPLINK_CHECKPOINT, 2, sys.uplink_count);
+
+  size_t msg_len = strlen(Sensor->data) + txHistoryCount * txRecordLen;
+  size_t tag_len = sys.auth_tag;
+  uint8_t hmac[AUTH_TAG_MAX] = {0};
+  // the tag of a streamed frame is kept apart, out of its history's way
+  char *tag_hex = txStreamed ? txTag : Sensor->data + msg_len;
+
+  txPlainLen = msg_len;
+  if (sys.aead && Aead_KeyValid()) {
+    /* The CCM tag replaces the HMAC */
+    if (txStreamed) {
+      msg_len = Aead_SealOpen(txPlainRead, msg_len);
+      txSealed = msg_len != 0;
+    } else {
+      msg_len = Aead_Seal(Sensor->data, msg_len);
     }
-  }
-
-  /* Generate the authentication tag */
-  retval = cmox_mac_generateTag(mac_ctx, hmac, &hmac_len);
-
-  /* Verify API returned value */
-  if (retval != CMOX_MAC_SUCCESS) {
+    // the frame may be partly encrypted: the uplink is skipped
+    if (msg_len == 0)
+      Sensor->data[0] = '\0';
+    tag_len = 0;
+  } else if (tag_len == 0) {
+    /* Legacy tag over the hex string, appended in 40-byte chunks */
+    tag_len = AUTH_TAG_MAX;
+    if ((txStreamed ? Auth_TagRead(txPlainRead, (msg_len + 39) / 40 * 40, 0,
+                                   hmac, tag_len)
+                    : Auth_Tag((uint8_t *)Sensor->data,
+                               (msg_len + 39) / 40 * 40, hmac, tag_len)) == 0)
+      user_main_printf("Couldn't generate tag");
+  } else if ((txStreamed ? Auth_TagRead(txPlainRead, msg_len, 1, hmac, tag_len)
+                         : Auth_TagHex(Sensor->data, msg_len, hmac,
+                                       tag_len)) == 0) {
     user_main_printf("Couldn't generate tag");
-    goto end;
-  }
-
-  /* Verify generated data size is the expected one */
-  if (hmac_len != CMOX_SHA256_SIZE) {
-    user_main_printf("Couldn't generate tag of proper size");
-    goto end;
   }
 
-  user_main_printf("Result of HMAC for payload %s (length %d): %d",
-                   Sensor->data, msg_len, retval);
-
-end:
-  if (mac_ctx) {
-    cmox_mac_cleanup(mac_ctx);
-  }
-  cmox_finalize(NULL);
-
   /* The content of the HMAC is binary but the message is passed as a
    * hex-encoded string to the NB-IoT module, so we have to encode it */
-  for (int pos = 0; pos < sizeof(hmac); pos++) {
-    sprintf(Sensor->data + msg_len + (pos * 2), "%.2x", hmac[pos]);
+  for (size_t pos = 0; pos < tag_len; pos++) {
+    sprintf(tag_hex + (pos * 2), "%.2x", hmac[pos]);
   }
-  Sensor->data[msg_len + sizeof(hmac) * 2] = '\0';
+  if (tag_len != 0)
+    tag_hex[tag_len * 2] = '\0';
 
   /* For UDP and TCP, the server will receive binary data, for other protocols,
    * it will receive a hex-encoded string of that data */
   if (sys.protocol == UDP_PRO || sys.protocol == TCP_PRO) {
-    Sensor->data_len = (msg_len + sizeof(hmac) * 2) / 2;
+    Sensor->data_len = (msg_len + tag_len * 2) / 2;
   } else {
-    Sensor->data_len = msg_len + sizeof(hmac) * 2;
+    Sensor->data_len = msg_len + tag_len * 2;
   }
 
   user_main_printf("Sensor->data:%s", Sensor->data);
   user_main_printf("Sensor->data_len:%d", Sensor->data_len);
+  if (txStreamed && txHistoryCount != 0)
+    user_main_printf("%d history records to read from EEPROM",
+                     (int)txHistoryCount);
   sys.exit_flag = 0;
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_SET);
   HAL_IWDG_Refresh(&hiwdg);
 }
 
@@ -597,236 +657,6 @@ void txPayLoadDeal2(SENSOR *Sensor) {
   }
 }
 
-/**
- * @brief  Processing received data
- * @param  Instruction parameter
- * @retval None
- */
-void rxPayLoadDeal(char *payload) {
-  if (at_downlink_flag == 1) {
-    at_downlink_flag = 0;
-    char *pos_start;
-    char *pos_end;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+SERVADDR\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 14],
-           (pos_end - pos_start - 16));
-    memset(user.add, 0, sizeof(user.add));
-    memcpy(user.add, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+CLIENT\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 12],
-           (pos_end - pos_start - 14));
-    memset(user.client, 0, sizeof(user.client));
-    memcpy(user.client, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+UNAME\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 11],
-           (pos_end - pos_start - 13));
-    memset(user.uname, 0, sizeof(user.uname));
-    memcpy(user.uname, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+PWD\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 9],
-           (pos_end - pos_start - 11));
-    memset(user.pwd, 0, sizeof(user.pwd));
-    memcpy(user.pwd, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+PUBTOPIC\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 14],
-           (pos_end - pos_start - 16));
-    memset(user.pubtopic, 0, sizeof(user.pubtopic));
-    memcpy(user.pubtopic, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+SUBTOPIC\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 14],
-           (pos_end - pos_start - 16));
-    memset(user.subtopic, 0, sizeof(user.subtopic));
-    memcpy(user.subtopic, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+TDC\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 9],
-           (pos_end - pos_start - 11));
-    uint32_t tdc = atoi(at_downlink_data);
-    sys.tdc = tdc;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+INTMOD\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 12],
-           (pos_end - pos_start - 14));
-    sys.inmod = at_downlink_data[0];
-    EX_GPIO_Init(sys.inmod - 0x30);
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+APN\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 9],
-           (pos_end - pos_start - 11));
-    memset(user.apn, 0, sizeof(user.apn));
-    memcpy(user.apn, at_downlink_data, strlen(at_downlink_data));
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+5VT\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 9],
-           (pos_end - pos_start - 11));
-    uint16_t power_time = atoi(at_downlink_data);
-    sys.power_time = power_time;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+PRO\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 9],
-           (pos_end - pos_start - 11));
-    uint8_t protocol = at_downlink_data[0] - 0x30;
-    sys.protocol = protocol;
-    sys.platform = at_downlink_data[2] - 0x30;
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+TR\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 8],
-           (pos_end - pos_start - 10));
-    uint16_t tr = atoi(at_downlink_data);
-    sys.tr_time = tr;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+NOUD\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 10],
-           (pos_end - pos_start - 12));
-    uint8_t noud = atoi(at_downlink_data);
-    sys.sht_noud = noud;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+CSQTIME\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 13],
-           (pos_end - pos_start - 15));
-    uint8_t csqtdc = atoi(at_downlink_data);
-    sys.csq_time = csqtdc;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+DNSTIMER\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 14],
-           (pos_end - pos_start - 16));
-    uint16_t dnstdc = atoi(at_downlink_data);
-    if (dnstdc == 0)
-      sys.dns_timer = 0;
-    else
-      sys.dns_timer = 1;
-    sys.dns_time = dnstdc;
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+TLSMOD\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 12],
-           (pos_end - pos_start - 14));
-    sys.tlsmod = atoi(at_downlink_data);
-    char *pos = strchr(at_downlink_data, ',');
-    sys.cert =
-        atoi(at_downlink_data + (strchr(pos, ',') - at_downlink_data) + 1);
-
-    memset(at_downlink_data, 0, 220);
-    pos_start = strstr((char *)payload, "AT+MQOS\":\"");
-    pos_end = strchr(pos_start, '\n');
-    memcpy(at_downlink_data,
-           &nb.usart.data[pos_start - ((char *)nb.usart.data) + 10],
-           (pos_end - pos_start - 11));
-    mqtt_qos = atoi(at_downlink_data);
-
-    config_Set();
-    if (strstr((char *)at_downlink_data, "ATZ") != NULL) {
-      user_main_printf("Reset the device after receiving the downlink...");
-      NVIC_SystemReset();
-    }
-  } else {
-    uint8_t dataCom[10] = {0};
-    rtrim((char *)payload);
-    StrToHex((char *)dataCom, payload, strlen(payload));
-    uint8_t dataCom_len = strlen(payload) / 2;
-    user_main_debug("dataCom_len:%d", dataCom_len);
-
-    switch (dataCom[0]) {
-    case 0x01:
-      if (dataCom_len == 4) {
-        int tdc = (dataCom[1] << 16 | dataCom[2] << 8 | dataCom[3]);
-        if (tdc >= 60 && tdc <= 0xFFFFFF) {
-          sys.tdc = tdc;
-          config_Set();
-        }
-      }
-      break;
-    case 0x04:
-      if (dataCom_len == 2 && dataCom[1] == 0xFF)
-        NVIC_SystemReset();
-      break;
-    case 0x06:
-      if (dataCom_len == 4 && (dataCom[3] <= 3)) {
-        sys.inmod = dataCom[3] + 0x30;
-        EX_GPIO_Init(sys.inmod - 0x30);
-        config_Set();
-      }
-    case 0x07:
-      if (dataCom_len == 2) {
-        mqtt_qos = dataCom[1];
-        mqtt_qos_flags = 1;
-        config_Set();
-      }
-    case 0x0A:
-      if (dataCom_len == 6) {
-        bool aa = dataCom[1];
-        uint16_t bb = (dataCom[2] << 8 | dataCom[3]);
-        uint8_t cc = dataCom[4];
-        uint8_t dd = dataCom[5];
-        if (((bb < 3600) || (bb == 65535)) && (cc <= 255) && (dd <= 32)) {
-          sys.clock_switch = aa;
-          sys.strat_time = bb;
-          sys.tr_time = cc;
-          sys.sht_noud = dd;
-          first_sample = 0;
-        }
-        config_Set();
-      }
-      break;
-    default:
-      printf("Downstream parameter error\n");
-      break;
-    }
-  }
-}
-
 /**
  * @brief  Processing version number
  * @param  NULL
@@ -1017,7 +847,20 @@ void shtDataINIT(void) {
   }
 }
 
+/* Stores the readings of the last uplink in the history, for the next
+ * checkpoint to send them again. The sensor drivers keep their last
+ * readings, the ADC and distance ones are taken from the uplink. */
+void txHistoryStore(void) {
+  adc0_datalog = sensor.adc1;
+  distance_datalog = sensor.distance;
+  adc1_datalog = sensor.adc2;
+  adc4_datalog = sensor.adc3;
+  shtDataWrite();
+}
+
 void shtDataWrite(void) {
+  Energy_Flash(1);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
   if (sys.sht_seq >= 32)
     sys.sht_seq = 0;
   if (sys.mod == model1 || sys.mod == model3 || sys.mod == model7) {
@@ -1104,6 +947,8 @@ void shtDataWrite(void) {
                                  sensor.time_stamp);
   HAL_FLASHEx_DATAEEPROM_Lock();
   sys.sht_seq++;
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  Energy_Flash(0);
 }
 
 void shtDataClear(void) {
@@ -1261,8 +1106,10 @@ void DatalogClear(void) {
 }
 
 void get_sensorvalue(void) {
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_RESET);
-  HAL_Delay(500 + sys.power_time);
+  uint8_t clock;
+
+  Sensor_PowerSettle(SENSOR_SETTLE_TIME + sys.power_time);
+  clock = Clock_Set(CLOCK_HSI16);
   if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
     MX_I2C1_Init();
     if (detect_flags == 1)
@@ -1292,7 +1139,6 @@ void get_sensorvalue(void) {
       MX_USART1_UART_Init();
       uart1_Init();
       HAL_UART_Receive_IT(&huart1, (uint8_t *)&rxbuf_u1, RXSIZE);
-      HAL_Delay(100);
       ULT_getData();
       uart1_IoDeInit();
       distance_datalog = ULT_Data_processing();
@@ -1317,5 +1163,8 @@ void get_sensorvalue(void) {
     WEIGHT_SCK_DeInit();
     WEIGHT_DOUT_DeInit();
   }
-  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_SET);
+  if (sys.mod == model7)
+    Count_Sample();
+  Clock_Set(clock);
+  Sensor_PowerOff();
 }
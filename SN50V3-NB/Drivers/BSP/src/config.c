@@ -0,0 +1,51 @@
+#include "config.h"
+#include "event.h"
+#include "time_server.h"
+
+/* Settings changed by AT commands and downlinks are written once, after
+ * CONFIG_SAVE_DELAY without further changes, instead of erasing the
+ * config pages on every command. AT+SAVE, ATZ, the resets and sleep write
+ * them at once. The timer only flags the write, which runs from the main
+ * loop rather than from the RTC interrupt. config_Set() in at.c does the
+ * writing and reports it with config_Written(). */
+static TimerEvent_t ConfigSaveTimer;
+static bool configTimerInit = 0;
+static bool configDirty = 0;
+static volatile bool configDue = 0;
+
+static void OnConfigSaveEvent(void) {
+  configDue = 1;
+  Event_Signal(EVENT_SIGNAL_USER);
+}
+
+void config_Save(void) {
+  if (configTimerInit == 0) {
+    TimerInit(&ConfigSaveTimer, OnConfigSaveEvent);
+    TimerSetValue(&ConfigSaveTimer, CONFIG_SAVE_DELAY);
+    configTimerInit = 1;
+  }
+  configDirty = 1;
+  TimerStop(&ConfigSaveTimer);
+  TimerStart(&ConfigSaveTimer);
+}
+
+void config_Flush(void) {
+  if (configDirty)
+    config_Set();
+}
+
+void config_Task(void) {
+  if (configDue) {
+    configDue = 0;
+    config_Flush();
+  }
+}
+
+void config_Written(void) {
+  configDirty = 0;
+  configDue = 0;
+  if (configTimerInit)
+    TimerStop(&ConfigSaveTimer);
+}
+
+bool config_Dirty(void) { return configDirty; }
@@ -0,0 +1,71 @@
+#include "confirm.h"
+
+/* AT+CONFIRM=N makes one uplink in N a checkpoint, sent as a confirmable
+ * CoAP request or an MQTT publish of QoS 1 at least, followed by the
+ * downlink window and carrying the uplink count so that the server can
+ * tell how many were lost. The others go as non-confirmable requests or
+ * QoS 0 publishes, the connection closing as soon as they are sent.
+ *
+ * A checkpoint that isn't confirmed makes the next uplink a checkpoint
+ * again, and so does a downlink waiting for its ack. The readings of the
+ * uplinks not confirmed are stored in the history in EEPROM, and the next
+ * checkpoint carries them all (store and forward), however few records
+ * AT+CLOCKLOG asks for. */
+static uint8_t confirmEvery = 0;
+static uint8_t confirmCheckpoint = 1;   // the uplink is a checkpoint
+static uint8_t confirmPending = 0xFF;   // uplinks since the last checkpoint
+static uint8_t confirmMissed = 0;       // the last checkpoint failed
+
+/**
+ * @brief  Decide whether the next uplink is a checkpoint
+ * @param  every: AT+CONFIRM, 0 or 1 to confirm all
+ * @param  ackPending: an ack of a downlink goes with the uplink
+ * @retval None
+ */
+void Confirm_Start(uint8_t every, uint8_t ackPending) {
+  confirmEvery = every;
+  confirmCheckpoint = every <= 1 || ackPending || confirmMissed ||
+                      confirmPending >= every - 1;
+}
+
+/**
+ * @brief  End of the uplink
+ * @param  delivered: the uplink was sent, and confirmed for a checkpoint
+ * @retval 1 when its readings must be stored for the next checkpoint
+ */
+uint8_t Confirm_End(uint8_t delivered) {
+  if (confirmCheckpoint && delivered) {
+    confirmPending = 0;
+    confirmMissed = 0;
+    return 0;
+  }
+  confirmMissed = confirmCheckpoint;
+  if (confirmPending < 0xFF)
+    confirmPending++;
+  return confirmEvery > 1;
+}
+
+uint8_t Confirm_Checkpoint(void) { return confirmCheckpoint; }
+
+/**
+ * @brief  Number of history records the uplink carries
+ * @param  noud: records asked for by AT+CLOCKLOG
+ * @retval noud, or more for a checkpoint sending stored readings again
+ */
+uint8_t Confirm_History(uint8_t noud) {
+  uint8_t pending = confirmPending;
+
+  // unknown after a reset, the history is left as asked
+  if (confirmEvery <= 1 || confirmCheckpoint == 0 || pending == 0xFF)
+    return noud;
+  if (pending > CONFIRM_HISTORY_MAX)
+    pending = CONFIRM_HISTORY_MAX;
+  return pending > noud ? pending : noud;
+}
+
+// QoS of an MQTT publish, AT+MQOS for a checkpoint but never 0
+uint8_t Confirm_Qos(uint8_t qos) {
+  if (confirmCheckpoint == 0)
+    return 0;
+  return qos != 0 ? qos : 1;
+}
@@ -0,0 +1,77 @@
+#include "count.h"
+#include "event.h"
+#include "time_server.h"
+
+/* Pulse counting for model6 (counter) and model7 (tipping bucket).
+ * Edges on PB15 only increment sensor.exit_count. The model7 intensity is
+ * derived from the count delta over a time window, when the window closes
+ * on an edge or when the sensors are sampled. */
+static TimerTime_t lastCountInt = 0;
+static TimerTime_t windowStart = 0;
+static uint32_t windowCount = 0;
+
+static void Count_CloseWindow(TimerTime_t now) {
+  uint32_t elapsed = now - windowStart;
+  uint32_t delta = sensor.exit_count - windowCount;
+  uint16_t newIntensity = 0;
+
+  if (elapsed != 0 && elapsed <= COUNT_WINDOW_MAX)
+    newIntensity = (uint64_t)delta * COUNT_INTENSITY_UNIT / elapsed;
+  if (newIntensity > sensor.intensity)
+    sensor.intensity = newIntensity;
+
+  windowStart = now;
+  windowCount = sensor.exit_count;
+}
+
+void Count_Edge(void) {
+  if (sys.mod == model7) {
+    TimerTime_t now = TimerGetCurrentTime();
+    if (lastCountInt != 0 && (now - lastCountInt) <= COUNT_LOCKOUT_DELAY) {
+      Event_PostOnce(EVENT_COUNT_LOCKOUT, now - lastCountInt);
+      return;
+    }
+    lastCountInt = now;
+
+    if (windowStart == 0) {
+      windowStart = now;
+      windowCount = sensor.exit_count;
+    } else if ((now - windowStart) >= COUNT_WINDOW_TIME) {
+      Count_CloseWindow(now);
+    }
+  }
+  sensor.exit_count++;
+  Event_PostOnce(EVENT_COUNT, sensor.exit_count);
+}
+
+uint8_t Count_IsActive(void) {
+  return (sys.mod == model6 || sys.mod == model7) && sys.inmod != '0';
+}
+
+/* Called right after a Stop mode wake-up with interrupts masked. If the
+ * only thing that woke the MCU up is a count edge, it is counted here and
+ * 1 is returned so that the caller can go back to Stop without restoring
+ * the system clock. */
+uint8_t Count_FastWake(void) {
+  if (Count_IsActive() == 0)
+    return 0;
+  if (__HAL_GPIO_EXTI_GET_IT(COUNT_PIN) == 0U)
+    return 0;
+  if ((NVIC->ISPR[0] & ~(1UL << EXTI4_15_IRQn)) != 0)
+    return 0;
+  if ((EXTI->PR & 0xFFF0 & ~COUNT_PIN) != 0)
+    return 0;
+
+  __HAL_GPIO_EXTI_CLEAR_IT(COUNT_PIN);
+  NVIC_ClearPendingIRQ(EXTI4_15_IRQn);
+  Count_Edge();
+  return 1;
+}
+
+void Count_Sample(void) {
+  if (sys.mod != model7 || windowStart == 0)
+    return;
+  Count_CloseWindow(TimerGetCurrentTime());
+  user_main_debug("count is %d, intensity: %d", sensor.exit_count,
+                  sensor.intensity);
+}
@@ -0,0 +1,316 @@
+#include "downlink.h"
+#include "at.h"
+#include "config.h"
+
+extern uint8_t mqtt_qos;
+extern uint8_t mqtt_qos_flags;
+extern bool first_sample;
+extern uint8_t at_downlink_flag;
+static char at_downlink_data[220] = {0};
+static uint8_t downlink_ack_pending = 0;
+static uint8_t downlink_ack_seq = 0;
+static uint8_t downlink_ack_status = 0;
+
+/* Flat JSON downlink of "key":"value" pairs, the keys being AT command
+ * names, plus a bare "ATZ" string to reset afterwards. The payload is
+ * scanned once without being modified and each pair handed to `pair`; a
+ * value may also be left unquoted, up to the next ',' or '}'. Returns 1
+ * when a pair changed a setting, and sets reset on "ATZ". */
+uint8_t Downlink_JsonScan(const char *payload, Downlink_Pair pair,
+                          uint8_t *reset) {
+  const char *p = payload;
+  uint8_t changed = 0;
+
+  *reset = 0;
+  while ((p = strchr(p, '"')) != NULL) {
+    const char *key = ++p;
+    const char *value;
+    size_t keyLen, len;
+
+    if ((p = strchr(p, '"')) == NULL)
+      break;
+    keyLen = p++ - key;
+    p += strspn(p, " \t\r\n");
+    if (*p != ':') {
+      if (keyLen == 3 && strncmp(key, "ATZ", 3) == 0)
+        *reset = 1;
+      continue;
+    }
+    p++;
+    p += strspn(p, " \t\r\n");
+    if (*p == '"') {
+      value = ++p;
+      if ((p = strchr(p, '"')) == NULL)
+        break;
+      len = p++ - value;
+    } else {
+      value = p;
+      len = strcspn(p, ",}\r\n");
+      p += len;
+    }
+    changed |= pair(key, keyLen, value, len);
+  }
+  return changed;
+}
+
+/* Setters of the JSON downlink keys that have no AT command of their own
+ * any more, value NUL-terminated */
+static uint8_t rxTr(const char *value) {
+  int tr = atoi(value);
+  if (tr < 0 || tr > 255)
+    return 0;
+  sys.tr_time = tr;
+  return 1;
+}
+
+static uint8_t rxNoud(const char *value) {
+  int noud = atoi(value);
+  if (noud < 0 || noud > 32)
+    return 0;
+  sys.sht_noud = noud;
+  return 1;
+}
+
+/* The JSON downlink keys. Those without a setter go through the AT command
+ * of the same name, with the checks of the console. */
+typedef struct {
+  const char *key;
+  uint8_t (*set)(const char *value); // returns 0 to reject the value
+} DownlinkKey;
+
+static const DownlinkKey downlinkKeys[] = {
+    {AT SERVADDR, NULL}, {AT CLIENT, NULL},   {AT UNAME, NULL},
+    {AT PWD, NULL},      {AT PUBTOPIC, NULL}, {AT SUBTOPIC, NULL},
+    {AT APN, NULL},      {AT TDC, NULL},      {AT INTMOD, NULL},
+    {AT _5VT, NULL},     {AT PRO, NULL},      {"AT+TR", rxTr},
+    {"AT+NOUD", rxNoud}, {AT CSQTIME, NULL},  {AT DNSTIMER, NULL},
+    {AT TLSMOD, NULL},   {AT MQOS, NULL},
+};
+
+static uint8_t rxKeyDeal(const char *key, size_t keyLen, const char *value,
+                         size_t len) {
+  for (size_t i = 0; i < sizeof(downlinkKeys) / sizeof(DownlinkKey); i++) {
+    const DownlinkKey *entry = &downlinkKeys[i];
+    uint8_t ok;
+
+    if (strlen(entry->key) != keyLen || strncmp(entry->key, key, keyLen) != 0)
+      continue;
+    if (entry->set == NULL) {
+      ok = AT_SetValue(entry->key, value, len) == AT_OK;
+    } else if (len >= sizeof(at_downlink_data)) {
+      ok = 0;
+    } else {
+      memcpy(at_downlink_data, value, len);
+      at_downlink_data[len] = '\0';
+      ok = entry->set(at_downlink_data);
+    }
+    if (ok == 0)
+      user_main_printf("Downlink value of %s rejected", entry->key);
+    return ok;
+  }
+  user_main_debug("Unknown downlink key %.*s", (int)keyLen, key);
+  return 0;
+}
+
+/* JSON downlink, see Downlink_JsonScan(); keys left out keep their
+ * setting */
+static void rxJsonDeal(const char *payload) {
+  uint8_t reset;
+  uint8_t changed = Downlink_JsonScan(payload, rxKeyDeal, &reset);
+
+  if (changed)
+    config_Save();
+  if (reset) {
+    user_main_printf("Reset the device after receiving the downlink...");
+    config_Flush();
+    NVIC_SystemReset();
+  }
+}
+
+/* Hex command downlink: a command byte and its arguments */
+static void rxCommandDeal(const char *payload) {
+  uint8_t dataCom[10] = {0};
+  size_t dataCom_len = strlen(payload) / 2;
+  uint8_t changed = 0;
+
+  if (dataCom_len > sizeof(dataCom)) {
+    printf("Downstream parameter error\n");
+    return;
+  }
+  StrToHex((char *)dataCom, (char *)payload, dataCom_len);
+  user_main_debug("dataCom_len:%d", dataCom_len);
+
+  switch (dataCom[0]) {
+  case 0x01:
+    if (dataCom_len == 4) {
+      int tdc = (dataCom[1] << 16 | dataCom[2] << 8 | dataCom[3]);
+      if (tdc >= 60 && tdc <= 0xFFFFFF) {
+        sys.tdc = tdc;
+        changed = 1;
+      }
+    }
+    break;
+  case 0x04:
+    if (dataCom_len == 2 && dataCom[1] == 0xFF) {
+      config_Flush();
+      NVIC_SystemReset();
+    }
+    break;
+  case 0x06:
+    if (dataCom_len == 4 && (dataCom[3] <= 3)) {
+      sys.inmod = dataCom[3] + 0x30;
+      EX_GPIO_Init(sys.inmod - 0x30);
+      changed = 1;
+    }
+    break;
+  case 0x07:
+    if (dataCom_len == 2) {
+      mqtt_qos = dataCom[1];
+      mqtt_qos_flags = 1;
+      changed = 1;
+    }
+    break;
+  case 0x0A:
+    if (dataCom_len == 6) {
+      bool aa = dataCom[1];
+      uint16_t bb = (dataCom[2] << 8 | dataCom[3]);
+      uint8_t cc = dataCom[4];
+      uint8_t dd = dataCom[5];
+      if (((bb < 3600) || (bb == 65535)) && (dd <= 32)) {
+        sys.clock_switch = aa;
+        sys.strat_time = bb;
+        sys.tr_time = cc;
+        sys.sht_noud = dd;
+        first_sample = 0;
+        changed = 1;
+      }
+    }
+    break;
+  default:
+    printf("Downstream parameter error\n");
+    break;
+  }
+  if (changed)
+    config_Save();
+}
+
+/* Settings carried by the TLV downlink, each value being the argument of
+ * the AT command as typed on the console. The type codes are part of the
+ * downlink format and must not be reused. The console password, the
+ * payload key and sleep are left out, as they would lock the server out,
+ * and so is the device id, which names the device to the server.
+ *
+ * Only commands whose setters change nothing but the saved settings are
+ * listed, so that reloading them undoes a frame rejected halfway. The
+ * types 0x0A INTMOD, 0x0F WEIGAP, 0x10 EXT, 0x11 CDP, 0x12
+ * GETSENSORVALUE, 0x18 CLOCKLOG, 0x1E ENERGY and 0x1F BATCAP drive
+ * peripherals, clear the history or write the EEPROM, and are rejected
+ * as unknown. */
+static const struct {
+  uint8_t type;
+  const char *command;
+} downlinkTlvs[] = {
+    {0x01, AT CFGMOD},   {0x03, AT SERVADDR}, {0x04, AT CLIENT},
+    {0x05, AT UNAME},    {0x06, AT PWD},      {0x07, AT PUBTOPIC},
+    {0x08, AT SUBTOPIC}, {0x09, AT TDC},      {0x0B, AT APN},
+    {0x0C, AT _5VT},     {0x0D, AT PRO},      {0x0E, AT RXDL},
+    {0x13, AT DNSCFG},   {0x14, AT CSQTIME},  {0x15, AT DNSTIMER},
+    {0x16, AT TLSMOD},   {0x17, AT MQOS},     {0x19, AT URI1},
+    {0x1A, AT URI2},     {0x1B, AT URI3},     {0x1C, AT URI4},
+    {0x1D, AT LIDARACQ}, {0x20, AT AUTH},     {0x21, AT AEAD},
+    {0x22, AT COAPMOD},  {0x23, AT CONFIRM},
+};
+
+static const char *rxTlvCommand(uint8_t type) {
+  for (size_t i = 0; i < sizeof(downlinkTlvs) / sizeof(downlinkTlvs[0]); i++) {
+    if (downlinkTlvs[i].type == type)
+      return downlinkTlvs[i].command;
+  }
+  return NULL;
+}
+
+/* TLV downlink: DOWNLINK_TLV_VERSION, a sequence number, then records of
+ * type, length and value. The records are applied together: the frame is
+ * checked first, and if a setter rejects its value the settings are
+ * reloaded from flash, written beforehand, so none of them is kept. The
+ * outcome is acknowledged in the next uplink by a DOWNLINK_TLV_ACK record
+ * with the sequence number and status: 0 when applied, else the 1-based
+ * index of the rejected record, or DOWNLINK_TLV_MALFORMED. */
+static void rxTlvDeal(char *payload) {
+  uint8_t *frame = (uint8_t *)payload;
+  size_t len = strlen(payload) / 2;
+  size_t pos;
+  uint8_t index = 0;
+  uint8_t reset = 0;
+  uint8_t status = 0;
+
+  // decoded over the hex string, each byte replacing two characters
+  StrToHex(payload, payload, len);
+  downlink_ack_seq = len > 1 ? frame[1] : 0;
+  downlink_ack_pending = 1;
+
+  for (pos = 2; pos + 2 <= len; pos += 2 + frame[pos + 1]) {
+    if (frame[pos] != DOWNLINK_TLV_RESET && rxTlvCommand(frame[pos]) == NULL)
+      break;
+  }
+  if (len < 2 || pos != len) {
+    user_main_printf("Malformed TLV downlink");
+    downlink_ack_status = DOWNLINK_TLV_MALFORMED;
+    return;
+  }
+
+  config_Flush();
+  for (pos = 2; pos < len && status == 0; pos += 2 + frame[pos + 1]) {
+    uint8_t type = frame[pos];
+
+    index++;
+    if (type == DOWNLINK_TLV_RESET)
+      reset = 1;
+    else if (AT_SetValue(rxTlvCommand(type), (char *)&frame[pos + 2],
+                         frame[pos + 1]) != AT_OK)
+      status = index;
+  }
+  downlink_ack_status = status;
+  if (status != 0) {
+    user_main_printf("TLV downlink record %d rejected", status);
+    config_Get();
+    return;
+  }
+  config_Save();
+  if (reset) {
+    user_main_printf("Reset the device after receiving the downlink...");
+    config_Flush();
+    NVIC_SystemReset();
+  }
+}
+
+/* The ack of a TLV downlink goes with each uplink until one carrying it
+ * is confirmed, which makes them checkpoints */
+uint8_t rxAckPending(void) { return downlink_ack_pending; }
+
+void rxAckDelivered(void) { downlink_ack_pending = 0; }
+
+/* Writes the DOWNLINK_TLV_ACK record of the uplink while the ack is
+ * pending; returns the characters written */
+size_t rxAckWrite(char *out) {
+  if (downlink_ack_pending == 0)
+    return 0;
+  return sprintf(out, "%.2x%.2x%.2x%.2x", DOWNLINK_TLV_ACK, 2, downlink_ack_seq,
+                 downlink_ack_status);
+}
+
+void rxPayLoadDeal(char *payload) {
+  if (at_downlink_flag == 1) {
+    at_downlink_flag = 0;
+    rxJsonDeal(payload);
+  } else {
+    uint8_t version = 0;
+    rtrim((char *)payload);
+    if (strlen(payload) >= 2)
+      StrToHex((char *)&version, payload, 1);
+    if (version == DOWNLINK_TLV_VERSION)
+      rxTlvDeal(payload);
+    else
+      rxCommandDeal(payload);
+  }
+}
@@ -443,14 +443,18 @@ float DS18B20_GetTemp_SkipRom(uint8_t num) {
   uint8_t tpmsb, tplsb;
   short s_tem;
   float f_tem;
+  uint8_t clock;
 
+  LPM_SetStopMode(LPM_1WIRE_Id, LPM_Disable);
+  // the slot timings of DS18B20_delay() and the GPIO calls hold at 32 MHz
+  clock = Clock_Set(CLOCK_PLL32);
   do {
     j++;
     if (DS18B20_Init(num) == 0) {
       DS18B20_SkipRom(num);
       DS18B20_WriteByte(0X44, num);
       ds18b20_connect_status = 1;
-      HAL_Delay(750);
+      Clock_Wait(750);
       DS18B20_SkipRom(num);
       DS18B20_WriteByte(0XBE, num);
       tplsb = DS18B20_ReadByte(num);
@@ -476,6 +480,8 @@ float DS18B20_GetTemp_SkipRom(uint8_t num) {
       break;
     }
   } while (f_tem == 85 && j < 2);
+  Clock_Set(clock);
+  LPM_SetStopMode(LPM_1WIRE_Id, LPM_Enable);
   if (tdc_clock_log_flag == 0) {
     user_main_printf("DS18B20(%d) temp is %.1f ", num, f_tem);
   }
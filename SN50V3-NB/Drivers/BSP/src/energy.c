@@ -0,0 +1,219 @@
+#include "energy.h"
+#include "clock.h"
+#include "flash_eraseprogram.h"
+#include "time_server.h"
+
+/* Time spent in each phase, turned into charge with per-phase currents.
+ * The MCU is always in exactly one of Stop or a Run phase per clock
+ * profile, the modem in at most one of its states, and the rail, flash and
+ * console phases overlap with them.
+ * Time is attributed at each state change, with the state that held since
+ * the previous one, so every phase is entered and left through a call here.
+ *
+ * The same charge is integrated into the battery total, which is saved in
+ * EEPROM every ENERGY_SAVE_CHARGE and compared with the capacity to project
+ * the remaining life at the last daily rate. */
+static const char *const energyName[ENERGY_PHASES] = {
+    "Stop", "Run",   "Attach",   "Registered", "Connected",
+    "5V",   "Flash", "TX",       "Run HSI16",  "Run MSI"};
+
+static uint32_t energyCurrent[ENERGY_PHASES] = {
+    ENERGY_STOP_CURRENT,  ENERGY_RUN_CURRENT,  ENERGY_ON_CURRENT,
+    ENERGY_REG_CURRENT,   ENERGY_CONN_CURRENT, ENERGY_RAIL_CURRENT,
+    ENERGY_FLASH_CURRENT, ENERGY_TX_CURRENT,   ENERGY_HSI_CURRENT,
+    ENERGY_MSI_CURRENT};
+static const uint8_t energyRunPhase[CLOCK_PROFILES] = {
+    ENERGY_RUN_MSI, ENERGY_RUN_HSI16, ENERGY_RUN};
+
+static uint32_t cycleTime[ENERGY_PHASES];
+static uint32_t lastCycleTime[ENERGY_PHASES];
+static uint32_t dayTime[ENERGY_PHASES];
+static uint32_t lastDayTime[ENERGY_PHASES];
+static uint32_t dayElapsed = 0;
+static uint8_t lastDayValid = 0;
+static uint32_t txTimeUs = 0;
+
+static uint32_t batteryUsed = 0;  // uAh
+static uint32_t batterySaved = 0; // uAh, value in EEPROM
+static uint32_t chargeRem = 0;    // uA.ms not yet counted in batteryUsed
+
+static TimerTime_t lastUpdate = 0;
+static uint8_t mcuStop = 0;
+static uint8_t mcuClock = CLOCK_PLL32;
+static uint8_t modemState = ENERGY_MODEM_OFF;
+static uint8_t railOn = 0;
+static uint8_t flashOn = 0;
+
+static void Energy_Add(uint8_t phase, uint32_t time) {
+  uint64_t charge = (uint64_t)time * energyCurrent[phase] + chargeRem;
+
+  cycleTime[phase] += time;
+  dayTime[phase] += time;
+  batteryUsed += charge / 3600000;
+  chargeRem = charge % 3600000;
+}
+
+static void Energy_Save(void) {
+  HAL_FLASHEx_DATAEEPROM_Unlock();
+  if (*(__IO uint32_t *)EEPROM_USER_BATTERY_FLAG != ENERGY_BATTERY_VALID)
+    HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD,
+                                   EEPROM_USER_BATTERY_FLAG,
+                                   ENERGY_BATTERY_VALID);
+  HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD,
+                                 EEPROM_USER_BATTERY_USED, batteryUsed);
+  HAL_FLASHEx_DATAEEPROM_Lock();
+  batterySaved = batteryUsed;
+}
+
+static void Energy_Update(void) {
+  TimerTime_t now = TimerGetCurrentTime();
+  uint32_t elapsed = now - lastUpdate;
+
+  lastUpdate = now;
+  Energy_Add(mcuStop ? ENERGY_STOP : energyRunPhase[mcuClock], elapsed);
+  if (modemState != ENERGY_MODEM_OFF)
+    Energy_Add(ENERGY_MODEM_ON + modemState - ENERGY_MODEM_ATTACH, elapsed);
+  if (railOn)
+    Energy_Add(ENERGY_RAIL, elapsed);
+  if (flashOn)
+    Energy_Add(ENERGY_FLASH, elapsed);
+
+  dayElapsed += elapsed;
+  if (dayElapsed >= ENERGY_DAY_TIME) {
+    memcpy(lastDayTime, dayTime, sizeof(dayTime));
+    memset(dayTime, 0, sizeof(dayTime));
+    dayElapsed = 0;
+    lastDayValid = 1;
+  }
+}
+
+static uint32_t Energy_uAh(const uint32_t *time) {
+  uint64_t charge = 0;
+
+  for (uint8_t i = 0; i < ENERGY_PHASES; i++)
+    charge += (uint64_t)time[i] * energyCurrent[i];
+  return charge / 3600000;
+}
+
+/* Charge the lower clock profiles saved against running from the PLL */
+static uint32_t Energy_ClockSaved(const uint32_t *time) {
+  uint64_t charge = 0;
+
+  for (uint8_t i = ENERGY_RUN_HSI16; i <= ENERGY_RUN_MSI; i++)
+    if (energyCurrent[i] < energyCurrent[ENERGY_RUN])
+      charge += (uint64_t)time[i] *
+                (energyCurrent[ENERGY_RUN] - energyCurrent[i]);
+  return charge / 3600000;
+}
+
+void Energy_Init(void) {
+  if (*(__IO uint32_t *)EEPROM_USER_BATTERY_FLAG == ENERGY_BATTERY_VALID)
+    batteryUsed = *(__IO uint32_t *)EEPROM_USER_BATTERY_USED;
+  batterySaved = batteryUsed;
+  lastUpdate = TimerGetCurrentTime();
+}
+
+void Energy_Mcu(uint8_t stop) {
+  Energy_Update();
+  mcuStop = stop;
+  mcuClock = Clock_Get();
+  // save before sleeping rather than in the middle of a flash operation
+  if (stop && (batteryUsed - batterySaved) >= ENERGY_SAVE_CHARGE)
+    Energy_Save();
+}
+
+void Energy_Modem(uint8_t state) {
+  if (state == modemState)
+    return;
+  Energy_Update();
+  modemState = state;
+}
+
+void Energy_Clock(uint8_t profile) {
+  Energy_Update();
+  mcuClock = profile;
+}
+
+void Energy_Rail(uint8_t on) {
+  Energy_Update();
+  railOn = on;
+}
+
+void Energy_Flash(uint8_t on) {
+  Energy_Update();
+  flashOn = on;
+}
+
+/* Called for every console byte, so it only counts the blocking transmit
+ * time and leaves the conversion to milliseconds for later */
+void Energy_Tx(uint16_t bytes) {
+  txTimeUs += bytes * ENERGY_TX_BYTE_TIME;
+  if (txTimeUs >= 1000) {
+    Energy_Add(ENERGY_TX, txTimeUs / 1000);
+    txTimeUs %= 1000;
+  }
+}
+
+void Energy_CycleEnd(void) {
+  Energy_Update();
+  memcpy(lastCycleTime, cycleTime, sizeof(cycleTime));
+  memset(cycleTime, 0, sizeof(cycleTime));
+}
+
+uint32_t Energy_CycleuAh(void) { return Energy_uAh(lastCycleTime); }
+
+uint8_t Energy_SetCurrent(uint8_t phase, uint32_t current) {
+  if (phase >= ENERGY_PHASES)
+    return 0;
+  energyCurrent[phase] = current;
+  return 1;
+}
+
+void Energy_BatteryReset(void) {
+  batteryUsed = 0;
+  chargeRem = 0;
+  Energy_Save();
+}
+
+uint32_t Energy_BatteryUsed(void) { return batteryUsed; }
+
+/* Days left of capacity (mAh) */
+uint16_t Energy_RemainingDays(uint16_t capacity) {
+  uint32_t left = capacity * 1000;
+  uint32_t daily;
+  uint32_t days;
+
+  if (batteryUsed >= left)
+    return 0;
+  if (lastDayValid)
+    daily = Energy_uAh(lastDayTime);
+  else if (dayElapsed >= ENERGY_RATE_MIN_TIME)
+    daily = (uint64_t)Energy_uAh(dayTime) * ENERGY_DAY_TIME / dayElapsed;
+  else
+    return ENERGY_DAYS_UNKNOWN;
+  if (daily == 0)
+    return ENERGY_DAYS_UNKNOWN;
+
+  days = (left - batteryUsed) / daily;
+  return days < ENERGY_DAYS_UNKNOWN ? days : ENERGY_DAYS_UNKNOWN - 1;
+}
+
+void Energy_Print(uint16_t capacity) {
+  Energy_Update();
+  printf("  %-10s %-6s %-15s %s\r\n", "Phase", "uA", "Last uplink(ms)",
+         "Today(ms)");
+  for (uint8_t i = 0; i < ENERGY_PHASES; i++)
+    printf("%d %-10s %-6u %-15u %u\r\n", i, energyName[i], energyCurrent[i],
+           lastCycleTime[i], dayTime[i]);
+  printf("Last uplink: %u uAh, since: %u uAh\r\n", Energy_uAh(lastCycleTime),
+         Energy_uAh(cycleTime));
+  printf("Last day: %u uAh, today: %u uAh\r\n", Energy_uAh(lastDayTime),
+         Energy_uAh(dayTime));
+  printf("Clock scaling saved: %u uAh last uplink, %u uAh today\r\n",
+         Energy_ClockSaved(lastCycleTime), Energy_ClockSaved(dayTime));
+  printf("Battery: %u of %u mAh used, ", batteryUsed / 1000, capacity);
+  if (Energy_RemainingDays(capacity) == ENERGY_DAYS_UNKNOWN)
+    printf("remaining days unknown yet\r\n");
+  else
+    printf("%u days remaining\r\n", Energy_RemainingDays(capacity));
+}
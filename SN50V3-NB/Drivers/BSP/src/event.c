@@ -0,0 +1,139 @@
+#include "event.h"
+#include "utilities.h"
+
+/* Events posted from interrupt context and drained by the main loop.
+ * Handlers post a compact record instead of logging, so that no console
+ * I/O (about 1 ms per character at 9600 baud) runs with interrupts
+ * pending. The queue keeps the posting order; when it is full, the event
+ * is dropped and counted so the drain can report it. Events posted with
+ * Event_PostOnce are queued at most once until they are drained, so that
+ * a burst of pulses takes a single slot. */
+static Event eventBuff[EVENT_QUEUE_SIZE];
+static queue_t eventQueue;
+static uint32_t eventDropped = 0;
+static uint32_t eventPending = 0;
+
+/* Work the main loop has to dispatch, one EVENT_SIGNAL_x bit per handler.
+ * Interrupts and timers set bits, the loop takes them all at once and
+ * waits in Stop only when none is left. */
+static volatile uint32_t eventSignals = 0;
+
+void Event_Init(void) {
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  CircularQueue_Init(&eventQueue, (uint8_t *)eventBuff, sizeof(eventBuff),
+                     sizeof(Event), CIRCULAR_QUEUE_NO_FLAG);
+  eventDropped = 0;
+  eventPending = 0;
+  RESTORE_PRIMASK();
+}
+
+uint8_t Event_Post(uint8_t type, uint32_t arg) {
+  Event event = {.type = type, .arg = arg};
+  uint8_t *ptr;
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  ptr = CircularQueue_Add(&eventQueue, (uint8_t *)&event, sizeof(Event), 1);
+  if (ptr == NULL)
+    eventDropped++;
+  eventSignals |= EVENT_SIGNAL_LOG;
+  RESTORE_PRIMASK();
+
+  return ptr != NULL;
+}
+
+uint8_t Event_PostOnce(uint8_t type, uint32_t arg) {
+  uint8_t ret = 1;
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  if ((eventPending & (1UL << type)) == 0) {
+    ret = Event_Post(type, arg);
+    if (ret)
+      eventPending |= 1UL << type;
+  }
+  RESTORE_PRIMASK();
+
+  return ret;
+}
+
+uint8_t Event_Get(Event *event) {
+  uint16_t size;
+  uint8_t *ptr;
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  ptr = CircularQueue_Remove(&eventQueue, &size);
+  if (ptr != NULL) {
+    memcpy(event, ptr, sizeof(Event));
+    eventPending &= ~(1UL << event->type);
+  }
+  RESTORE_PRIMASK();
+
+  return ptr != NULL;
+}
+
+bool Event_IsEmpty(void) { return eventQueue.elementCount == 0; }
+
+void Event_Process(void) {
+  Event event;
+  uint32_t dropped;
+  BACKUP_PRIMASK();
+
+  while (Event_Get(&event)) {
+    switch (event.type) {
+    case EVENT_COUNT:
+      user_main_printf("count is %d", sensor.exit_count);
+      break;
+    case EVENT_COUNT_LOCKOUT:
+      user_main_debug("Count lockout, first gap %d ms", event.arg);
+      break;
+    case EVENT_EXTI:
+      user_main_printf("Exti interrupt, level %d", event.arg);
+      break;
+    case EVENT_DNS:
+      user_main_debug("DNS refresh");
+      break;
+    case EVENT_UPLINK_TIMEOUT:
+      user_main_printf("Uplink timeout, error %d", event.arg);
+      break;
+    case EVENT_NO_SIGNAL:
+      user_main_printf("No signal, join network timeout");
+      break;
+    default:
+      break;
+    }
+  }
+
+  DISABLE_IRQ();
+  dropped = eventDropped;
+  eventDropped = 0;
+  RESTORE_PRIMASK();
+  if (dropped != 0) {
+    user_main_printf("%d events dropped", dropped);
+  }
+}
+
+void Event_Signal(uint32_t signals) {
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  eventSignals |= signals;
+  RESTORE_PRIMASK();
+}
+
+uint32_t Event_TakeSignals(void) {
+  uint32_t signals;
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  signals = eventSignals;
+  eventSignals = 0;
+  RESTORE_PRIMASK();
+
+  return signals;
+}
+
+uint32_t Event_PendingSignals(void) { return eventSignals; }
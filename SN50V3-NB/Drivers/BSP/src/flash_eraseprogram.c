@@ -1,5 +1,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "flash_eraseprogram.h"
+#include "energy.h"
+#include "low_power_manager.h"
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -23,6 +25,8 @@ static FLASH_EraseInitTypeDef EraseInitStruct;
     (area defined by FLASH_USER_START_ADDR and FLASH_USER_END_ADDR) ***********/
 void FLASH_erase(uint32_t page_address, uint8_t page) {
   uint8_t err_num = 0;
+  Energy_Flash(1);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
   HAL_FLASH_Unlock();
   /* Fill EraseInit structure*/
   EraseInitStruct.TypeErase = FLASH_TYPEERASE_PAGES;
@@ -48,10 +52,14 @@ void FLASH_erase(uint32_t page_address, uint8_t page) {
        to protect the FLASH memory against possible unwanted operation)
      *********/
   HAL_FLASH_Lock();
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  Energy_Flash(0);
 }
 void FLASH_program(uint32_t add, uint32_t *data, uint8_t count) {
   uint32_t Address = 0;
   uint16_t i = 0;
+  Energy_Flash(1);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
   HAL_FLASH_Unlock();
   Address = add;
 
@@ -65,6 +73,8 @@ void FLASH_program(uint32_t add, uint32_t *data, uint8_t count) {
       printf("error in Write operation\n\r");
       printf("write_error_flag:%x", HAL_FLASH_GetError());
       HAL_FLASH_Lock();
+      LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+      Energy_Flash(0);
       return;
     }
   }
@@ -72,6 +82,31 @@ void FLASH_program(uint32_t add, uint32_t *data, uint8_t count) {
   /* Lock the Flash to disable the flash control register access (recommended
      to protect the FLASH memory against possible unwanted operation) *********/
   HAL_FLASH_Lock();
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  Energy_Flash(0);
+}
+
+/* Programs count words of the data EEPROM from add; returns 1 once they
+ * read back */
+uint8_t EEPROM_program(uint32_t add, uint32_t *data, uint8_t count) {
+  uint8_t i;
+
+  Energy_Flash(1);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
+  HAL_FLASHEx_DATAEEPROM_Unlock();
+  for (i = 0; i < count; i++) {
+    if (HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, add + 4 * i,
+                                       data[i]) != HAL_OK ||
+        *(__IO uint32_t *)(add + 4 * i) != data[i]) {
+      printf("error in EEPROM write at %x\n\r", add + 4 * i);
+      break;
+    }
+  }
+  HAL_FLASHEx_DATAEEPROM_Lock();
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  Energy_Flash(0);
+
+  return i == count;
 }
 
 uint32_t FLASH_read(uint32_t Address) {
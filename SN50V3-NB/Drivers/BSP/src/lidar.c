@@ -1,5 +1,20 @@
 #include "lidar.h"
 extern bool tdc_clock_log_flag;
+
+static void lidar_sleep(uint32_t ms) {
+  uint32_t tickstart = HAL_GetTick();
+  while ((HAL_GetTick() - tickstart) < ms) {
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+  }
+}
+
+static uint8_t lidar_busy(void) {
+  uint8_t status[1] = {0x01};
+  if (HAL_I2C_Mem_Read(&hi2c1, 0xc5, 0x01, 1, status, 1, 1000) != HAL_OK)
+    return 1;
+  return status[0] & 0x01;
+}
+
 uint16_t LidarLite(void) {
   MX_I2C1_Init();
   HAL_Delay(100);
@@ -8,8 +23,15 @@ uint16_t LidarLite(void) {
   uint8_t rxdata2[1] = {0};
   uint16_t distance;
   waitbusy(1);
+  if (sys.lidar_acq != 0) {
+    uint8_t acqCount[1] = {sys.lidar_acq};
+    HAL_I2C_Mem_Write(&hi2c1, 0xc4, LIDAR_ACQ_COUNT_REG, 1, acqCount, 1, 1000);
+  }
   HAL_I2C_Mem_Write(&hi2c1, 0xc4, 0x00, 1, dataByte, 1, 1000);
-  if (waitbusy(2) < 999) {
+  /* sleep through the acquisition instead of polling the status register,
+   * then check it once; keep polling only if the sensor is still busy */
+  lidar_sleep(LIDAR_ACQ_TIME(sys.lidar_acq));
+  if (lidar_busy() == 0 || waitbusy(2) < 999) {
     HAL_I2C_Mem_Read(&hi2c1, 0xc5, 0x0f, 1, rxdata1, 1, 1000);
     HAL_I2C_Mem_Read(&hi2c1, 0xc5, 0x10, 1, rxdata2, 1, 1000);
     distance = (rxdata1[0] << 8) + rxdata2[0];
@@ -1,7 +1,24 @@
 #include "lowpower.h"
+#include "clock.h"
+#include "count.h"
+#include "energy.h"
+#include "event.h"
+#include "hw_rtc.h"
 #include "main.h"
 
-void LPM_EnterStopMode(void (*Clock_Config)(void)) {
+static const char *const lpmIdName[LPM_ID_NUM] = {
+    "Appli",    "Lib",      "RTC",    "GPS",   "Console RX", "Console TX",
+    "Modem RX", "Modem TX", "1-Wire", "HX711", "ULT",        "Flash"};
+
+static uint32_t lpmWakes[LPM_WAKE_LEVELS];
+static uint32_t lpmSleeps = 0;
+static uint32_t lpmRestoreTicks = 0;
+static uint32_t lpmRestores = 0;
+
+/* Main loop work after a wake-up, overridden by the application */
+__weak uint8_t LPM_WakeWork(void) { return LPM_WAKE_RUN; }
+
+static void LPM_Stop(void) {
   HAL_SuspendTick();
   /* Enable Power Control clock */
   __HAL_RCC_PWR_CLK_ENABLE();
@@ -15,13 +32,116 @@ void LPM_EnterStopMode(void (*Clock_Config)(void)) {
   /* Select HSI as system clock source after Wake Up from Stop mode */
   __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI);
 
-  __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
-  /* Enter Stop Mode */
-  HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+  /* In count modes, edges that are the only wake-up source are counted
+   * with interrupts masked and Stop is re-entered on the HSI wake-up clock */
+  uint32_t primask = __get_PRIMASK();
+  Energy_Mcu(1);
+  if (Count_IsActive())
+    __disable_irq();
 
-  Clock_Config();
+  do {
+    __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU);
+    /* Enter Stop Mode */
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+  } while (Count_FastWake());
+
+  /* Still on HSI16: give the HAL tick the right time base before the
+   * pending interrupts run */
+  SystemCoreClockUpdate();
+  HAL_InitTick(TICK_INT_PRIORITY);
+  __set_PRIMASK(primask);
+  Energy_Mcu(0);
+}
+
+/* Sleeps when a user of the low power manager disallows Stop, stops
+ * otherwise. The mode, and `ready` when given, are read with interrupts
+ * masked, so that a veto or some work set by an interrupt handler cannot
+ * slip in before WFI; the pending interrupt wakes the core and runs on
+ * return. Nothing is entered while `ready` returns non-zero. Returns 1 if
+ * Stop was entered. */
+static uint8_t LPM_Enter(uint8_t (*ready)(void)) {
+  uint32_t primask = __get_PRIMASK();
+  uint8_t stop;
+
+  __disable_irq();
+  if (ready != NULL && ready()) {
+    __set_PRIMASK(primask);
+    return 0;
+  }
+  stop = LPM_GetMode() != LPM_SleepMode;
+  if (stop) {
+    LPM_Stop();
+  } else {
+    lpmSleeps++;
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+  }
+  __set_PRIMASK(primask);
+
+  return stop;
+}
+
+/* Stops or sleeps unless ready, when given, returns non-zero, and restarts
+ * the PLL after Stop */
+void LPM_EnterStopMode(void (*Clock_Config)(void), uint8_t (*ready)(void)) {
+  if (LPM_Enter(ready))
+    LPM_RunClock(Clock_Config);
+}
+
+static uint8_t LPM_SignalPending(void) { return Event_PendingSignals() != 0; }
+
+/* Idles in the deepest mode the low power manager allows, until the main
+ * loop has something to do. Wake-ups that only ran interrupt handlers
+ * (timer housekeeping, watchdog refresh) go back to idle on HSI16, light
+ * work (console output) runs on HSI16, and the PLL is only restarted for
+ * the modem, sensor and payload work. The UARTs and I2C are clocked from
+ * HSI16 whatever SYSCLK is, so their baud rate and timing registers stay
+ * valid on both clocks. */
+void LPM_Idle(void (*Clock_Config)(void)) {
+  uint8_t level;
 
+  do {
+    // a partial line must not keep the MCU out of Stop
+    if (LPM_GetStopModeVetoTime(LPM_UART_RX_Id) > LPM_RX_VETO_TIME)
+      LPM_SetStopMode(LPM_UART_RX_Id, LPM_Enable);
+    if (LPM_GetStopModeVetoTime(LPM_MODEM_RX_Id) > LPM_RX_VETO_TIME)
+      LPM_SetStopMode(LPM_MODEM_RX_Id, LPM_Enable);
+
+    // a signal raised since LPM_WakeWork() looked ends the idle at once
+    LPM_Enter(LPM_SignalPending);
+    level = LPM_WakeWork();
+    lpmWakes[level]++;
+  } while (level == LPM_WAKE_SLEEP);
+
+  if (level == LPM_WAKE_RUN)
+    LPM_RunClock(Clock_Config);
+}
+
+void LPM_RunClock(void (*Clock_Config)(void)) {
+  if (__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_PLLCLK)
+    return;
+
+  uint32_t start = HW_RTC_GetTimerValue();
+  Clock_Config();
+  lpmRestoreTicks += HW_RTC_GetTimerValue() - start;
+  lpmRestores++;
+  Energy_Clock(CLOCK_PLL32);
   HAL_ResumeTick();
 }
 
-void LPM_DisableStopMode(void) { __HAL_PWR_CLEAR_FLAG(PWR_FLAG_WU); }
+void LPM_Print(void) {
+  uint32_t veto = LPM_GetStopModeVeto();
+
+  printf("Mode: %s\r\n", LPM_GetMode() == LPM_SleepMode ? "Sleep" : "Stop");
+  for (uint8_t i = 0; i < LPM_ID_NUM; i++)
+    if (veto & (1UL << i))
+      printf("Stop blocked by %s for %u ms\r\n", lpmIdName[i],
+             LPM_GetStopModeVetoTime((LPM_Id_t)(1UL << i)));
+  printf("Wake-ups: %u back to idle, %u on HSI16, %u on PLL, %u Sleep\r\n",
+         lpmWakes[LPM_WAKE_SLEEP], lpmWakes[LPM_WAKE_LIGHT],
+         lpmWakes[LPM_WAKE_RUN], lpmSleeps);
+  // RTC ticks are 1/1024 s, the average over many restores is unbiased
+  if (lpmRestores != 0)
+    printf("PLL restore: %u times, %u us average\r\n", lpmRestores,
+           (uint32_t)((uint64_t)lpmRestoreTicks * 1000000 / 1024 /
+                      lpmRestores));
+}
@@ -0,0 +1,446 @@
+#include "lwm2m_client.h"
+#include "nbInit.h"
+
+/* LwM2M 1.1 client of AT+COAPMOD=2, on top of the CoAP messages of the
+ * UDP socket path. The device registers once in queue mode with a long
+ * lifetime and the IPSO objects of its sensors: the temperatures as 3303,
+ * the humidity as 3304 and the other values as generic sensors 3300, each
+ * instance with its Sensor Value 5700.
+ *
+ * The server observes the objects it wants, and the readings of each
+ * frame go as Notify messages, 2.05 Content in SenML-CBOR, one for each
+ * observation. Until anything is observed, the readings are pushed all
+ * together with the Send operation, a POST to /dp. The server may also
+ * read the objects and write downlinks to /19/1/0 as opaque data.
+ *
+ * The registration is refreshed with an update once half its lifetime has
+ * gone, and redone after a reboot or when the server has lost it, which
+ * ends the observations. */
+#define LWM2M_DOWNLINK_OBJECT 19 // BinaryAppDataContainer
+#define LWM2M_SENSOR_VALUE 5700
+
+#define CBOR_UNSIGNED 0 // major types
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_FLOAT32 0xFA
+
+#define SENML_BASE_TIME 2 // -3, a negative integer
+#define SENML_NAME 0
+#define SENML_VALUE 2
+
+typedef enum {
+  LWM2M_REGISTER = 0,
+  LWM2M_UPDATE,
+  LWM2M_SEND,
+  LWM2M_NOTIFY,
+} Lwm2mOperation;
+
+// An observation of an object, an instance or a value, -1 past the path
+typedef struct {
+  int32_t path[3];
+  uint8_t tkl;
+  uint8_t token[COAP_TOKEN_MAX];
+} Lwm2mObservation;
+
+static uint8_t lwm2mRegistered = 0;
+static uint8_t lwm2mFresh = 0; // registered since the last frame
+static TimerTime_t lwm2mRegisteredAt;
+static Lwm2mOperation lwm2mLast;
+// Location-Path segments, each preceded by its length
+static uint8_t lwm2mLocation[LWM2M_LOCATION_MAX];
+static uint8_t lwm2mLocationLen = 0;
+static Lwm2mReading lwm2mReadings[LWM2M_READINGS_MAX];
+static uint8_t lwm2mReadingCount = 0;
+static uint32_t lwm2mTime; // of the readings, 0 when unknown
+static Lwm2mObservation lwm2mObserved[LWM2M_OBSERVE_MAX];
+static uint8_t lwm2mObserveCount = 0;
+static uint8_t lwm2mPending;       // observations to notify, a bit each
+static uint8_t lwm2mNotifying;     // observation of the last Notify
+static uint32_t lwm2mSequence = 0; // Observe option of the notifications
+
+static void Lwm2m_Path(CoapWriter *w, const char *path) {
+  Coap_Option(w, COAP_OPTION_URI_PATH, path, strlen(path));
+}
+
+static void Lwm2m_Query(CoapWriter *w, const char *query) {
+  Coap_Option(w, COAP_OPTION_URI_QUERY, query, strlen(query));
+}
+
+// CBOR head of the major type, the value in the fewest bytes
+static void Lwm2m_Cbor(CoapWriter *w, uint8_t major, uint32_t value) {
+  uint8_t head[5];
+  size_t len = 1;
+
+  if (value < 24) {
+    head[0] = major << 5 | value;
+  } else if (value < 0x100) {
+    head[0] = major << 5 | 24;
+    head[len++] = value;
+  } else if (value < 0x10000) {
+    head[0] = major << 5 | 25;
+    head[len++] = value >> 8;
+    head[len++] = value & 0xFF;
+  } else {
+    head[0] = major << 5 | 26;
+    for (int shift = 24; shift >= 0; shift -= 8)
+      head[len++] = value >> shift & 0xFF;
+  }
+  Coap_Payload(w, head, len);
+}
+
+static void Lwm2m_CborValue(CoapWriter *w, const Lwm2mReading *r) {
+  uint8_t head[5] = {CBOR_FLOAT32};
+  float value = r->value / 10.0f;
+  uint32_t bits;
+
+  if (r->tenths == 0) {
+    if (r->value >= 0)
+      Lwm2m_Cbor(w, CBOR_UNSIGNED, r->value);
+    else
+      Lwm2m_Cbor(w, CBOR_NEGATIVE, -1 - r->value);
+    return;
+  }
+  memcpy(&bits, &value, sizeof(bits));
+  for (int i = 1; i < 5; i++)
+    head[i] = bits >> (32 - i * 8) & 0xFF;
+  Coap_Payload(w, head, sizeof(head));
+}
+
+static uint8_t Lwm2m_Under(const Lwm2mReading *r, const int32_t *path) {
+  return (path[0] < 0 || path[0] == r->object) &&
+         (path[1] < 0 || path[1] == r->instance) &&
+         (path[2] < 0 || path[2] == LWM2M_SENSOR_VALUE);
+}
+
+/* SenML-CBOR pack of the readings under path, the first record with the
+ * base time: [{-3: time, 0: "/3303/0/5700", 2: 21.5}, ...]. Returns the
+ * number of records. */
+static uint8_t Lwm2m_Senml(CoapWriter *w, const int32_t *path) {
+  uint8_t count = 0;
+  uint8_t first = 1;
+  char name[20];
+
+  for (int i = 0; i < lwm2mReadingCount; i++)
+    count += Lwm2m_Under(&lwm2mReadings[i], path);
+  if (count == 0)
+    return 0;
+  Coap_OptionUint(w, COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_SENML_CBOR);
+  Lwm2m_Cbor(w, CBOR_ARRAY, count);
+  for (int i = 0; i < lwm2mReadingCount; i++) {
+    const Lwm2mReading *r = &lwm2mReadings[i];
+    int len;
+
+    if (!Lwm2m_Under(r, path))
+      continue;
+    if (first && lwm2mTime != 0) {
+      Lwm2m_Cbor(w, CBOR_MAP, 3);
+      Lwm2m_Cbor(w, CBOR_NEGATIVE, SENML_BASE_TIME);
+      Lwm2m_Cbor(w, CBOR_UNSIGNED, lwm2mTime);
+    } else
+      Lwm2m_Cbor(w, CBOR_MAP, 2);
+    first = 0;
+    len = sprintf(name, "/%u/%u/%u", r->object, r->instance,
+                  LWM2M_SENSOR_VALUE);
+    Lwm2m_Cbor(w, CBOR_UNSIGNED, SENML_NAME);
+    Lwm2m_Cbor(w, CBOR_TEXT, len);
+    Coap_Payload(w, name, len);
+    Lwm2m_Cbor(w, CBOR_UNSIGNED, SENML_VALUE);
+    Lwm2m_CborValue(w, r);
+  }
+  return count;
+}
+
+// The object instances, for the registration
+static void Lwm2m_Links(CoapWriter *w) {
+  char link[16];
+
+  for (int i = 0; i < lwm2mReadingCount; i++) {
+    int len = sprintf(link, "</%u/%u>,", lwm2mReadings[i].object,
+                      lwm2mReadings[i].instance);
+    Coap_Payload(w, link, len);
+  }
+  Coap_Payload(w, "</19/1>", 7);
+}
+
+/* Ends an observation, the pending bits of the next ones moving down */
+static void Lwm2m_Forget(uint8_t index) {
+  uint8_t below = lwm2mPending & ((1 << index) - 1);
+
+  memmove(&lwm2mObserved[index], &lwm2mObserved[index + 1],
+          (lwm2mObserveCount - index - 1) * sizeof(Lwm2mObservation));
+  lwm2mObserveCount--;
+  lwm2mPending = below | (lwm2mPending >> (index + 1) << index);
+}
+
+/**
+ * @brief  Take the readings of a new frame, to notify or send
+ * @param  time, Unix time of the readings or 0
+ * @retval None
+ */
+void Lwm2m_NewFrame(const Lwm2mReading *readings, uint8_t count,
+                    uint32_t time) {
+  if (count > LWM2M_READINGS_MAX)
+    count = LWM2M_READINGS_MAX;
+  memcpy(lwm2mReadings, readings, count * sizeof(Lwm2mReading));
+  lwm2mReadingCount = count;
+  lwm2mTime = time;
+  lwm2mPending = (1 << lwm2mObserveCount) - 1;
+}
+
+/**
+ * @brief  Write the next uplink: registration, update or the readings
+ * @param  req, with the message ID and token of the uplink, and its type
+ *         for the notifications
+ * @retval LWM2M_MORE when another notification must follow this one
+ */
+uint8_t Lwm2m_Uplink(CoapWriter *w, uint8_t *buf, size_t size,
+                     CoapMessage *req) {
+  static const int32_t all[3] = {-1, -1, -1};
+  char query[40];
+
+  if (lwm2mRegistered && TimerGetElapsedTime(lwm2mRegisteredAt) >
+                             LWM2M_LIFETIME / 2 * 1000)
+    lwm2mLast = LWM2M_UPDATE;
+  else if (lwm2mRegistered && lwm2mObserveCount != 0)
+    lwm2mLast = LWM2M_NOTIFY;
+  else if (lwm2mRegistered)
+    lwm2mLast = LWM2M_SEND;
+  else
+    lwm2mLast = LWM2M_REGISTER;
+
+  if (lwm2mLast == LWM2M_NOTIFY) {
+    const Lwm2mObservation *obs;
+
+    lwm2mNotifying = 0;
+    while (lwm2mNotifying + 1 < lwm2mObserveCount &&
+           (lwm2mPending >> lwm2mNotifying & 1) == 0)
+      lwm2mNotifying++;
+    obs = &lwm2mObserved[lwm2mNotifying];
+    // a response to the observing GET, under its token
+    req->code = COAP_CONTENT;
+    req->tkl = obs->tkl;
+    memcpy(req->token, obs->token, obs->tkl);
+    Coap_Begin(w, buf, size, req);
+    lwm2mSequence = (lwm2mSequence + 1) & 0xFFFFFF;
+    Coap_OptionUint(w, COAP_OPTION_OBSERVE, lwm2mSequence);
+    Lwm2m_Senml(w, obs->path);
+    // a non-confirmable one has no answer to wait for
+    if (req->type == COAP_NON)
+      lwm2mPending &= ~(1 << lwm2mNotifying);
+    return (lwm2mPending & ~(1 << lwm2mNotifying)) != 0 ? LWM2M_MORE : 0;
+  }
+
+  req->type = COAP_CON;
+  req->code = COAP_POST;
+  Coap_Begin(w, buf, size, req);
+  switch (lwm2mLast) {
+  case LWM2M_REGISTER:
+    Lwm2m_Path(w, "rd");
+    Coap_OptionUint(w, COAP_OPTION_CONTENT_FORMAT, COAP_FORMAT_LINK);
+    sprintf(query, "ep=%s", strlen((char *)nb.imei) != 0 ? (char *)nb.imei
+                                                          : (char *)user.deui);
+    Lwm2m_Query(w, query);
+    sprintf(query, "lt=%d", LWM2M_LIFETIME);
+    Lwm2m_Query(w, query);
+    Lwm2m_Query(w, "lwm2m=1.1");
+    Lwm2m_Query(w, "b=U");
+    Lwm2m_Query(w, "Q");
+    Lwm2m_Links(w);
+    user_main_printf("LwM2M registration");
+    break;
+  case LWM2M_UPDATE:
+    for (int i = 0; i < lwm2mLocationLen; i += 1 + lwm2mLocation[i])
+      Coap_Option(w, COAP_OPTION_URI_PATH, &lwm2mLocation[i + 1],
+                  lwm2mLocation[i]);
+    user_main_printf("LwM2M registration update");
+    break;
+  default:
+    Lwm2m_Path(w, "dp");
+    Lwm2m_Senml(w, all);
+    break;
+  }
+  return 0;
+}
+
+static void Lwm2m_Registered(const CoapMessage *rsp) {
+  CoapOption opt = {0};
+
+  lwm2mLocationLen = 0;
+  while (Coap_OptionNext(rsp, &opt)) {
+    if (opt.number != COAP_OPTION_LOCATION_PATH)
+      continue;
+    if ((size_t)lwm2mLocationLen + 1 + opt.len > sizeof(lwm2mLocation)) {
+      user_main_printf("LwM2M location too long");
+      return;
+    }
+    lwm2mLocation[lwm2mLocationLen] = opt.len;
+    memcpy(&lwm2mLocation[lwm2mLocationLen + 1], opt.value, opt.len);
+    lwm2mLocationLen += 1 + opt.len;
+  }
+  lwm2mRegistered = 1;
+  lwm2mFresh = 1;
+  lwm2mRegisteredAt = TimerGetCurrentTime();
+  // a new registration ends the observations
+  lwm2mObserveCount = 0;
+  lwm2mPending = 0;
+}
+
+// After the answer to a notification, the next one or the end of the frame
+static uint8_t Lwm2m_Notified(void) {
+  return lwm2mPending != 0 || lwm2mObserveCount == 0 ? LWM2M_FOLLOW
+                                                     : LWM2M_DELIVERED;
+}
+
+/**
+ * @brief  Handle the answer of the server to the last uplink
+ * @param  The response, or the reset, matching the uplink
+ * @retval LWM2M_DELIVERED, LWM2M_FOLLOW or 0
+ */
+uint8_t Lwm2m_Answer(const CoapMessage *rsp) {
+  if (lwm2mLast == LWM2M_NOTIFY) {
+    // a reset ends the observation, the readings going on without it
+    if (rsp->type == COAP_RST) {
+      user_main_printf("LwM2M observation cancelled by the server");
+      Lwm2m_Forget(lwm2mNotifying);
+    } else
+      lwm2mPending &= ~(1 << lwm2mNotifying);
+    return Lwm2m_Notified();
+  }
+  if (rsp->type == COAP_RST) {
+    user_main_printf("LwM2M uplink reset by the server");
+    lwm2mRegistered = 0;
+    return 0;
+  }
+  // the response comes separately, the readings being received already
+  if (rsp->code == COAP_EMPTY)
+    return lwm2mLast == LWM2M_SEND ? LWM2M_DELIVERED : 0;
+
+  switch (lwm2mLast) {
+  case LWM2M_REGISTER:
+    if (rsp->code != COAP_CREATED)
+      break;
+    Lwm2m_Registered(rsp);
+    return lwm2mRegistered ? LWM2M_FOLLOW : 0;
+  case LWM2M_UPDATE:
+    if (rsp->code == COAP_CHANGED) {
+      lwm2mFresh = 1;
+      lwm2mRegisteredAt = TimerGetCurrentTime();
+    } else
+      lwm2mRegistered = 0; // registered again right away
+    return LWM2M_FOLLOW;
+  default:
+    if (rsp->code == COAP_CHANGED) {
+      lwm2mFresh = 0;
+      return LWM2M_DELIVERED;
+    }
+    lwm2mRegistered = 0;
+    // a registration just made is not retried in the same cycle
+    if (rsp->code >> 5 == 4 && lwm2mFresh == 0)
+      return LWM2M_FOLLOW;
+    lwm2mFresh = 0;
+    break;
+  }
+  user_main_printf("LwM2M server answered %d.%02d", rsp->code >> 5,
+                   rsp->code & 0x1F);
+  return 0;
+}
+
+/* Observes path for the server, a GET of the path replacing the
+ * observation it had. Returns 0 when there is no room left. */
+static uint8_t Lwm2m_Observe(const CoapMessage *in, const int32_t *path,
+                             uint32_t observe) {
+  Lwm2mObservation *obs;
+
+  for (int i = lwm2mObserveCount - 1; i >= 0; i--) {
+    if (memcmp(lwm2mObserved[i].path, path, sizeof(obs->path)) == 0)
+      Lwm2m_Forget(i);
+  }
+  if (observe != 0 || lwm2mObserveCount == LWM2M_OBSERVE_MAX)
+    return 0;
+  obs = &lwm2mObserved[lwm2mObserveCount++];
+  memcpy(obs->path, path, sizeof(obs->path));
+  obs->tkl = in->tkl;
+  memcpy(obs->token, in->token, in->tkl);
+  return 1;
+}
+
+/**
+ * @brief  Answer a confirmable request of the server
+ * @param  in, the request, the response being written into w
+ * @retval LWM2M_DOWNLINK when the payload of in is a downlink
+ */
+uint8_t Lwm2m_Serve(const CoapMessage *in, CoapWriter *w, uint8_t *buf,
+                    size_t size) {
+  CoapMessage rsp = *in;
+  CoapOption opt = {0};
+  int32_t path[3] = {-1, -1, -1};
+  int depth = 0;
+  uint8_t valid = 1;
+  uint16_t format = COAP_FORMAT_OCTET_STREAM;
+  uint32_t observe = UINT32_MAX;
+  uint8_t result = 0;
+
+  while (Coap_OptionNext(in, &opt)) {
+    if (opt.number == COAP_OPTION_OBSERVE)
+      observe = Coap_OptionUintValue(&opt);
+    if (opt.number == COAP_OPTION_CONTENT_FORMAT)
+      format = Coap_OptionUintValue(&opt);
+    if (opt.number != COAP_OPTION_URI_PATH)
+      continue;
+    if (depth < 3 && opt.len > 0 && opt.len < 6) {
+      path[depth] = 0;
+      for (int i = 0; i < opt.len && path[depth] >= 0; i++) {
+        if (opt.value[i] < '0' || opt.value[i] > '9')
+          path[depth] = -1;
+        else
+          path[depth] = path[depth] * 10 + opt.value[i] - '0';
+      }
+    }
+    valid &= depth >= 3 || path[depth] >= 0;
+    depth++;
+  }
+
+  rsp.type = COAP_ACK;
+  if (depth == 0 || depth > 3 || !valid) {
+    rsp.code = COAP_NOT_FOUND;
+  } else if (path[0] == LWM2M_DOWNLINK_OBJECT) {
+    // downlinks, to /19/1/0
+    if (path[1] != 1 || path[2] > 0)
+      rsp.code = COAP_NOT_FOUND;
+    else if (in->code != COAP_PUT && in->code != COAP_POST)
+      rsp.code = COAP_NOT_ALLOWED;
+    else if (format != COAP_FORMAT_OCTET_STREAM)
+      rsp.code = COAP_UNSUPPORTED_FORMAT;
+    else
+      rsp.code = COAP_CHANGED;
+  } else if (in->code != COAP_GET) {
+    rsp.code = COAP_NOT_ALLOWED;
+  } else {
+    rsp.code = COAP_CONTENT;
+  }
+
+  Coap_Begin(w, buf, size, &rsp);
+  if (rsp.code == COAP_CONTENT) {
+    uint8_t observing = 0;
+    uint8_t count = 0;
+
+    for (int i = 0; i < lwm2mReadingCount; i++)
+      count += Lwm2m_Under(&lwm2mReadings[i], path);
+    if (count != 0)
+      observing = Lwm2m_Observe(in, path, observe);
+    if (observing) {
+      lwm2mSequence = (lwm2mSequence + 1) & 0xFFFFFF;
+      Coap_OptionUint(w, COAP_OPTION_OBSERVE, lwm2mSequence);
+    }
+    if (Lwm2m_Senml(w, path) == 0) {
+      // none of the objects of the device
+      rsp.code = COAP_NOT_FOUND;
+      Coap_Begin(w, buf, size, &rsp);
+    }
+  } else if (rsp.code == COAP_CHANGED && in->payload_len != 0) {
+    result = LWM2M_DOWNLINK;
+  }
+  return result;
+}
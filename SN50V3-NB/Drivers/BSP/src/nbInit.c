@@ -13,7 +13,6 @@ static char buff[200] = {0};
 static uint8_t recieve_data[NB_RX_SIZE] = {0}; // Receive data
 extern uint8_t join_network_num;
 extern uint8_t join_network_flag;
-extern uint8_t join_network_time;
 extern uint8_t join_network_timer;
 extern uint8_t error_num;
 extern uint8_t rxbuf;
@@ -57,6 +56,7 @@ NB nb = {.net_flag = no_status,
 NB_TaskStatus nb_at_send(const struct NBTASK *NB_Task) {
   nb.usart.len = 0;
   memset(nb.usart.data, 0, NB_RX_SIZE);
+  LPM_SetStopMode(LPM_MODEM_TX_Id, LPM_Disable);
   HAL_UART_Transmit_DMA(&hlpuart1, (uint8_t *)ATSendStr, len_string);
   uint32_t time = HAL_GetTick();
   while (HAL_GetTick() - time < NB_Task->time_out) {
@@ -350,7 +350,8 @@ NB_TaskStatus nb_qicfg_get(const char *param) { return nb_cmd_status; }
 
 NB_TaskStatus nb_qicfg_set(const char *param) {
   memset(buff, 0, sizeof(buff));
-  if (sys.platform == 0)
+  if (sys.platform == 0 ||
+      (sys.protocol == COAP_PRO && sys.coap_mode != COAP_MODEM))
     strcat(buff, AT QICFG "=dataformat,1,1" NEWLINE);
   else
     strcat(buff, AT QICFG "=dataformat,0,1" NEWLINE);
@@ -526,6 +527,7 @@ NB_TaskStatus nb_cclk_get(const char *param) {
       SysTimeLocalTime(sensor.time_stamp, &localtime);
       time_test = localtime.tm_min * 60 + localtime.tm_sec;
       TimerInit(&timesampleTimer, OntimesampleEvent);
+      TimerSetSlack(&timesampleTimer, TIMER_PERIOD_SLACK(sys.tr_time * 60000));
       compare_time(time_test);
       first_sample = 1;
     }
@@ -587,6 +589,7 @@ NB_TaskStatus nb_cclk2_get(const char *param) {
       SysTimeLocalTime(sensor.time_stamp, &localtime);
       time_test = localtime.tm_min * 60 + localtime.tm_sec;
       TimerInit(&timesampleTimer, OntimesampleEvent);
+      TimerSetSlack(&timesampleTimer, TIMER_PERIOD_SLACK(sys.tr_time * 60000));
       compare_time(time_test);
       first_sample = 1;
     }
@@ -807,6 +810,22 @@ NB_TaskStatus nb_qrst2_run(const char *param) {
   }
   return nb_cmd_status;
 }
+
+static void nb_checkpoint_start(void) {
+  Confirm_Start(sys.confirm_every, rxAckPending());
+  if (sys.confirm_every > 1 && Confirm_Checkpoint())
+    user_main_printf("Checkpoint uplink");
+}
+
+/* A confirmed checkpoint delivered the ack of a downlink, the readings of
+ * an uplink not confirmed go again with the next one */
+static void nb_checkpoint_end(bool delivered) {
+  if (delivered && Confirm_Checkpoint())
+    rxAckDelivered();
+  if (Confirm_End(delivered))
+    txHistoryStore();
+}
+
 /**
  * @brief  NB task
  * @param  Task instruction code
@@ -869,7 +888,7 @@ ATCmdNum NBTASK(uint8_t *task) {
       if (strstr((char *)user.deui, "NULL") != NULL) {
         memset(user.deui, 0, sizeof(user.deui));
         memcpy(user.deui, nb.imei, 15);
-        config_Set();
+        config_Save();
       }
     } else {
       at_state = _AT_ERROR;
@@ -938,11 +957,15 @@ ATCmdNum NBTASK(uint8_t *task) {
   } break;
 
   case _AT_CFUNOFF: {
+    // the cycle is given up: a sample taken for it must not be sent later
+    Sensor_PowerOff();
+    sensor.sampled = 0;
     if (NBTask[_AT_CFUNOFF].run(NULL) == NB_CMD_SUCC) {
       *task = _AT_QSCLK;
       if (sleep_status == 0) {
         TimerInit(&TxTimer, OnTxTimerEvent);
         TimerSetValue(&TxTimer, sys.tdc * 1000);
+        TimerSetSlack(&TxTimer, TIMER_PERIOD_SLACK(sys.tdc * 1000));
         TimerStart(&TxTimer);
       }
       if (no_singal_flag == 1) {
@@ -964,12 +987,14 @@ ATCmdNum NBTASK(uint8_t *task) {
 
   case _AT_QSCLKOFF: {
     memset(record_log, 0, sizeof(record_log));
+    Sensor_PowerOn();
     if (NBTask[_AT_QSCLKOFF].run(NULL) == NB_CMD_SUCC) {
       if (NBTask[_AT_QSCLKOFF].run(NULL) == NB_CMD_SUCC)
         *task = _AT_CFUNSTA;
       user_main_printf("Exit sleep mode");
       sprintf(record_log, "Exit sleep mode\r\n");
     } else {
+      Sensor_PowerOff();
       at_state = _AT_ERROR;
       user_main_printf("No response");
       sprintf(record_log, "No response\r\n");
@@ -978,8 +1003,13 @@ ATCmdNum NBTASK(uint8_t *task) {
 
   case _AT_CFUNSTA: {
     if (NBTask[_AT_CFUNSTA].run(NULL) == NB_CMD_SUCC) {
+      /* sample while the modem attaches, the payload is built at
+       * _AT_UPLOAD_START */
+      if (sensor.sampled == 0)
+        txSensorSample(&sensor);
       *task = _AT_CSQ;
     } else {
+      Sensor_PowerOff();
       at_state = _AT_ERROR;
       user_main_printf("No response");
       sprintf(record_log + strlen(record_log), "No response\r\n");
@@ -1003,7 +1033,6 @@ ATCmdNum NBTASK(uint8_t *task) {
       }
       led_on(500);
       join_network_timer = 0;
-      join_network_time = 0;
       is_time_to_send = 0;
       csq_fail_log = 0;
     } else {
@@ -1116,9 +1145,9 @@ ATCmdNum NBTASK(uint8_t *task) {
     nb.uplink_flag = send;
     nb.recieve_flag = NB_IDIE;
 
-    if (sys.protocol == COAP_PRO) {
+    if (sys.protocol == COAP_PRO && sys.coap_mode == COAP_MODEM) {
       *task = _AT_COAP_CONFIG;
-    } else if (sys.protocol == UDP_PRO) {
+    } else if (sys.protocol == UDP_PRO || sys.protocol == COAP_PRO) {
       *task = _AT_UDP_OPEN;
     } else if (sys.protocol == MQTT_PRO) {
       *task = _AT_MQTT_Config;
@@ -1128,7 +1157,16 @@ ATCmdNum NBTASK(uint8_t *task) {
     sprintf(record_log + strlen(record_log), "*****Upload start:%d*****\r\n",
             sys.uplink_count);
     user_main_printf("*****Upload start:%d*****", sys.uplink_count++);
+    nb_checkpoint_start();
     txPayLoadDeal(&sensor);
+    if (sensor.data_len == 0) {
+      // the frame could not be sealed, nothing is sent nor retried
+      user_main_printf("No payload to send");
+      sprintf(record_log + strlen(record_log), "No payload to send\r\n");
+      reupload_time = 3;
+      *task = _AT_UPLOAD_END;
+    } else if (sys.protocol == COAP_PRO && sys.coap_mode != COAP_MODEM)
+      nb_COAP_new_uplink();
     memset((char *)nb.usart.data, 0, sizeof(nb.usart.data));
   } break;
   /***************************************************COAP******************************************************************************/
@@ -1498,7 +1536,15 @@ ATCmdNum NBTASK(uint8_t *task) {
               "Subscribe to topic successfully\r\n");
       break;
     case NB_PUB_SUCC:
-      *task = _AT_MQTT_SUB;
+      // a QoS 0 publish closes without the subscription and its window
+      if (Confirm_Checkpoint()) {
+        *task = _AT_MQTT_SUB;
+      } else {
+        mqtt_close_flag = 1;
+        succes_Status = true;
+        reupload_time = 0;
+        *task = _AT_MQTT_CLOSE;
+      }
       user_main_printf("Upload data successfully");
       sprintf(record_log + strlen(record_log), "Upload data successfully\r\n");
       break;
@@ -1520,7 +1566,9 @@ ATCmdNum NBTASK(uint8_t *task) {
     break;
   /**************************************************UDP***********************************************************************************/
   case _AT_UDP_OPEN:
-    if (strstr((char *)user.add, "NULL") != NULL) {
+    if (strstr((char *)user.add, "NULL") != NULL ||
+        (sys.protocol == COAP_PRO && sys.coap_mode == COAP_UDP &&
+         strstr((char *)user.uri1, "NULL") != NULL)) {
       *task = _AT_UPLOAD_END;
       user_main_printf("UDP parameter configuration error");
       sprintf(record_log + strlen(record_log),
@@ -1558,8 +1606,11 @@ ATCmdNum NBTASK(uint8_t *task) {
     HAL_Delay(sys.rxdl);
     read_flag = 1;
     *task = _AT_IDLE;
-    succes_Status = true;
-    reupload_time = 0;
+    // a CoAP uplink is only delivered once the server acknowledges it
+    if (sys.protocol != COAP_PRO) {
+      succes_Status = true;
+      reupload_time = 0;
+    }
     break;
 
   case _AT_UDP_CLOSE:
@@ -1585,13 +1636,36 @@ ATCmdNum NBTASK(uint8_t *task) {
   case _AT_UDP_URI:
     uri_state = NBTask[_AT_UDP_URI].run(NULL);
     if (uri_state == NB_STA_SUCC) {
+      // the LwM2M registration or a block went through, more follows
+      if (sys.protocol == COAP_PRO && nb_COAP_follow()) {
+        read_flag = 0;
+        *task = _AT_UDP_SEND;
+        break;
+      }
+      if (sys.protocol == COAP_PRO && nb_COAP_acked()) {
+        succes_Status = true;
+        reupload_time = 0;
+      }
       resend_flag = 0;
       read_flag = 0;
       *task = _AT_UDP_CLOSE;
       user_main_printf("Datagram is sent by RF");
       sprintf(record_log + strlen(record_log), "Datagram is sent by RF\r\n");
     } else if (uri_state == NB_SEND_SUCC) {
-      *task = _AT_UDP_READ;
+      // a non-confirmable request has no answer to wait for, the next
+      // LwM2M notification going right after it
+      if (sys.protocol == COAP_PRO && sys.coap_mode != COAP_MODEM &&
+          nb_COAP_confirmable() == 0) {
+        if (nb_COAP_follow()) {
+          *task = _AT_UDP_SEND;
+          break;
+        }
+        succes_Status = true;
+        reupload_time = 0;
+        resend_flag = 0;
+        *task = _AT_UDP_CLOSE;
+      } else
+        *task = _AT_UDP_READ;
       user_main_printf("Upload data successfully");
       sprintf(record_log + strlen(record_log), "Upload data successfully\r\n");
     } else if (uri_state == NB_SEND_FAIL) {
@@ -1693,9 +1767,9 @@ ATCmdNum NBTASK(uint8_t *task) {
     if (succes_Status == false && reupload_time < 3) {
       nb.uplink_flag = send;
       nb.recieve_flag = NB_IDIE;
-      if (sys.protocol == COAP_PRO) {
+      if (sys.protocol == COAP_PRO && sys.coap_mode == COAP_MODEM) {
         *task = _AT_COAP_CONFIG;
-      } else if (sys.protocol == UDP_PRO) {
+      } else if (sys.protocol == UDP_PRO || sys.protocol == COAP_PRO) {
         *task = _AT_UDP_OPEN;
       } else if (sys.protocol == MQTT_PRO) {
         *task = _AT_MQTT_Config;
@@ -1708,8 +1782,10 @@ ATCmdNum NBTASK(uint8_t *task) {
       if (sys.exit_flag == 0) {
         TimerInit(&TxTimer, OnTxTimerEvent);
         TimerSetValue(&TxTimer, sys.tdc * 1000);
+        TimerSetSlack(&TxTimer, TIMER_PERIOD_SLACK(sys.tdc * 1000));
         TimerStart(&TxTimer);
       }
+      nb_checkpoint_end(succes_Status);
       reupload_time = 0;
       sensor.exit_state = 0;
       *task = _AT_QSCLK;
@@ -1730,6 +1806,8 @@ ATCmdNum NBTASK(uint8_t *task) {
     break;
 
   case _AT_QRST: {
+    Sensor_PowerOff();
+    sensor.sampled = 0;
     if (NBTask[_AT_QRST].run(NULL) != NB_CMD_SUCC) {
       at_state = _AT_ERROR;
       user_main_printf("No response when shutting down");
@@ -1748,6 +1826,7 @@ ATCmdNum NBTASK(uint8_t *task) {
       *task = _AT_IDLE;
       TimerInit(&TxTimer, OnTxTimerEvent);
       TimerSetValue(&TxTimer, sys.tdc * 1000);
+      TimerSetSlack(&TxTimer, TIMER_PERIOD_SLACK(sys.tdc * 1000));
       TimerStart(&TxTimer);
     } else {
       *task = _AT;
@@ -1760,9 +1839,9 @@ ATCmdNum NBTASK(uint8_t *task) {
     break;
   }
   case _AT_URI: {
-    if (sys.protocol == COAP_PRO)
+    if (sys.protocol == COAP_PRO && sys.coap_mode == COAP_MODEM)
       *task = _AT_COAP_URI;
-    else if (sys.protocol == UDP_PRO)
+    else if (sys.protocol == UDP_PRO || sys.protocol == COAP_PRO)
       *task = _AT_UDP_URI;
     else if (sys.protocol == MQTT_PRO)
       *task = _AT_MQTT_URI;
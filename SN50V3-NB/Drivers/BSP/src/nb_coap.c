@@ -1,4 +1,5 @@
 #include "nb_coap.h"
+#include "lwm2m_client.h"
 #include "time.h"
 #include <time.h>
 extern char buff[2000];
@@ -10,6 +11,8 @@ extern int len_string;
 extern uint8_t try_num;
 extern NB_TaskStatus nb_cmd_status;
 extern void pro_data(void);
+extern size_t pro_data_open(void);
+extern size_t pro_data_read(size_t offset, char *dst, size_t len);
 /**
  * @brief  Configure to show the CoAP option of sender
  * @param  Instruction parameter
@@ -380,3 +383,406 @@ NB_TaskStatus nb_COAP_uri_run(const char *param) {
   }
   return nb_cmd_status;
 }
+
+/* With AT+COAPMOD=1 the CoAP messages are built here and sent as single
+ * datagrams over the UDP socket tasks, replacing the head, option and
+ * send commands of the modem's CoAP stack and the delays between them.
+ * The uplink is a confirmable POST to the AT+URIx options and only counts
+ * as delivered once the server acknowledges it. A confirmable request
+ * left unanswered is sent again with the same message ID and token, as
+ * RFC 7252 4.2 has it. AT+COAPMOD=2 sends the same way the messages of
+ * the LwM2M client in lwm2m_client.c.
+ *
+ * The payload is the frame decoded to binary, where AT+COAPMOD=0 sends
+ * its hex text: the server has to be set up for the mode used.
+ *
+ * An uplink longer than one block goes in Block1 blocks (RFC 7959), each
+ * a request of its own acknowledged with 2.31 Continue. The body is read
+ * block by block, the history of the hex frame or of the JSON formatted
+ * again from EEPROM, and an unanswered block is sent again by the next
+ * upload attempt of the cycle. */
+#define NB_COAP_HEAD_MAX 550 // header, token, AT+URIx, Block1 and Size1
+
+typedef struct {
+  uint16_t number;
+  const char *value;
+  size_t len;
+} NbCoapOption;
+
+static uint8_t coapHead[NB_COAP_HEAD_MAX];
+static CoapMessage coapRequest;
+static uint16_t coapMid = 0;
+static uint8_t coapAcked = 0;
+static uint8_t coapFollow = 0; // another uplink is due in the cycle
+static CoapBlock coapBlock;    // the uplink body and its blocks
+static CoapWriter coapSent;    // the request in coapHead, kept to resend
+static size_t coapSentOffset;  // its body in the frame
+static size_t coapSentLen;
+static CoapRetransmit coapRetransmit;
+static uint8_t coapWaiting = 0; // the confirmable request is unanswered
+static uint8_t coapResend = 0;  // the next AT+QISEND sends it again
+
+// AT+URIx holds <number>,"<value>", as passed to AT+QCOAPOPTION
+static uint8_t nb_COAP_uri_parse(const uint8_t *uri, NbCoapOption *opt) {
+  const char *value = strchr((const char *)uri, ',');
+
+  if (value == NULL || strstr((const char *)uri, "NULL") != NULL)
+    return 0;
+  opt->number = atoi((const char *)uri);
+  value++;
+  if (*value == '"')
+    value++;
+  opt->len = strlen(value);
+  if (opt->len > 0 && value[opt->len - 1] == '"')
+    opt->len--;
+  opt->value = value;
+  return 1;
+}
+
+static void nb_COAP_new_request(uint8_t type, uint8_t code) {
+  uint32_t token;
+
+  if (coapMid == 0)
+    coapMid = HAL_GetUIDw0() ^ HAL_GetTick();
+  token = HAL_GetUIDw1() ^ HAL_GetTick() ^ coapMid << 16;
+  coapRequest.type = type;
+  coapRequest.code = code;
+  coapRequest.mid = coapMid++;
+  coapRequest.tkl = sizeof(token);
+  memcpy(coapRequest.token, &token, sizeof(token));
+  coapAcked = 0;
+  coapFollow = 0;
+  coapWaiting = type == COAP_CON;
+  coapResend = 0;
+  Coap_RetransmitStart(&coapRetransmit, token ^ HAL_GetTick());
+}
+
+// Starts the request in coapHead with the AT+URIx and block options
+static void nb_COAP_head(CoapWriter *w, uint8_t body, uint8_t more) {
+  const uint8_t *uris[] = {user.uri1, user.uri2, user.uri3, user.uri4};
+  NbCoapOption opts[4];
+  int count = 0;
+  uint8_t block = coapBlock.wise;
+  uint8_t size = coapBlock.wise && coapBlock.num == 0;
+
+  // sorted by number, the Uri-Path segments keeping their order
+  for (int i = 0; i < 4; i++) {
+    NbCoapOption opt;
+    int j = count;
+
+    if (nb_COAP_uri_parse(uris[i], &opt) == 0)
+      break;
+    for (; j > 0 && opts[j - 1].number > opt.number; j--)
+      opts[j] = opts[j - 1];
+    opts[j] = opt;
+    count++;
+  }
+
+  Coap_Begin(w, coapHead, sizeof(coapHead), &coapRequest);
+  for (int i = 0; i <= count; i++) {
+    uint16_t number = i < count ? opts[i].number : UINT16_MAX;
+
+    if (block && number > COAP_OPTION_BLOCK1) {
+      Coap_OptionUint(w, COAP_OPTION_BLOCK1,
+                      COAP_BLOCK(coapBlock.num, more, coapBlock.szx));
+      block = 0;
+    }
+    // the size of the whole body, with the first block
+    if (size && number > COAP_OPTION_SIZE1) {
+      Coap_OptionUint(w, COAP_OPTION_SIZE1, coapBlock.len);
+      size = 0;
+    }
+    if (i < count)
+      Coap_Option(w, opts[i].number, opts[i].value, opts[i].len);
+  }
+  if (body)
+    Coap_Payload(w, NULL, 0);
+}
+
+/* Writes in buff the AT+QISEND command of the message in coapHead, then
+ * bodyLen bytes of body, or of the hex frame from offset when body is
+ * NULL. The command must end before end. */
+static NB_TaskStatus nb_COAP_udp_line(CoapWriter *w, const char *body,
+                                      size_t offset, size_t bodyLen,
+                                      const char *end) {
+  size_t headLen = Coap_End(w);
+  size_t msgLen = headLen + bodyLen;
+
+  nb_UDP_send_head();
+  sprintf(buff + strlen(buff), "%d,\"", (int)msgLen);
+  if (headLen == 0 || buff + strlen(buff) + msgLen * 2 + 4 > end) {
+    user_main_printf("CoAP message too long");
+    return NB_CMD_FAIL;
+  }
+  for (size_t i = 0; i < headLen; i++)
+    sprintf(buff + strlen(buff), "%.2x", w->buf[i]);
+  if (body == NULL) {
+    char *hex = buff + strlen(buff);
+
+    // straight from the frame, its history read from EEPROM
+    if (txFrameRead(offset * 2, hex, bodyLen * 2) != bodyLen * 2)
+      return NB_CMD_FAIL;
+    hex[bodyLen * 2] = '\0';
+  } else {
+    for (size_t i = 0; i < bodyLen; i++)
+      sprintf(buff + strlen(buff), "%.2x", (uint8_t)body[i]);
+  }
+  strcat(buff, "\"\r\n");
+
+  ATSendStr = NULL;
+  ATSendStr = buff;
+  len_string = strlen(ATSendStr);
+  user_main_debug("NBTask[_AT_UDP_SEND].ATSendStr:%s", ATSendStr);
+  return NB_CMD_SUCC;
+}
+
+/* The first blocks follow the coverage: a weak signal means many
+ * repetitions, and a smaller datagram loses less when it has to be sent
+ * again. The server may still ask for smaller blocks. */
+static uint8_t nb_COAP_szx(void) {
+  if (nb.singal >= 20)
+    return 5; // 512 bytes
+  if (nb.singal >= 10)
+    return 4;
+  return 3;
+}
+
+static void nb_COAP_reading(Lwm2mReading *r, uint8_t *count,
+                            uint16_t object, uint8_t instance, uint8_t tenths,
+                            int32_t value) {
+  r += (*count)++;
+  r->object = object;
+  r->instance = instance;
+  r->tenths = tenths;
+  r->value = value;
+}
+
+/* The readings of the frame for the LwM2M client: the battery, in mV, and
+ * the values of the mode as generic sensors, the DS18B20 probes as
+ * temperatures 0 to 2 and the SHT sensor as temperature 3 and humidity 0 */
+static uint8_t nb_COAP_readings(Lwm2mReading *r) {
+  uint8_t n = 0;
+
+  nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 0, 0, sensor.batteryLevel_mV);
+  if (sys.mod == model1 || sys.mod == model2 || sys.mod == model4 ||
+      sys.mod == model5)
+    nb_COAP_reading(r, &n, LWM2M_TEMPERATURE, 0, 1, sensor.temDs18b20_1);
+  if (sys.mod == model4) {
+    nb_COAP_reading(r, &n, LWM2M_TEMPERATURE, 1, 1, sensor.temDs18b20_2);
+    nb_COAP_reading(r, &n, LWM2M_TEMPERATURE, 2, 1, sensor.temDs18b20_3);
+  }
+  if (sys.mod == model1 || sys.mod == model3 || sys.mod == model7) {
+    nb_COAP_reading(r, &n, LWM2M_TEMPERATURE, 3, 1, sensor.temSHT);
+    nb_COAP_reading(r, &n, LWM2M_HUMIDITY, 0, 1, sensor.humSHT);
+  }
+  if (sys.mod >= model1 && sys.mod <= model5)
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 1, 0, sensor.adc1);
+  if (sys.mod == model2)
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 2, 0, sensor.distance);
+  else if (sys.mod == model5)
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 2, 0, sensor.weight);
+  else if (sys.mod == model6 || sys.mod == model7)
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 2, 0, sensor.exit_count);
+  if (sys.mod == model3) {
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 3, 0, sensor.adc2);
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 4, 0, sensor.adc3);
+  } else if (sys.mod == model7)
+    nb_COAP_reading(r, &n, LWM2M_GENERIC_SENSOR, 3, 0, sensor.intensity);
+  return n;
+}
+
+/**
+ * @brief  Start the upload of a new frame, from its first block
+ * @param  None
+ * @retval None
+ */
+void nb_COAP_new_uplink(void) {
+  if (sys.coap_mode == COAP_LWM2M) {
+    Lwm2mReading readings[LWM2M_READINGS_MAX];
+
+    Coap_BlockStart(&coapBlock, 0, nb_COAP_szx());
+    Lwm2m_NewFrame(readings, nb_COAP_readings(readings), sensor.time_stamp);
+    return;
+  }
+  Coap_BlockStart(&coapBlock,
+                  sys.platform == 5 ? pro_data_open() : sensor.data_len / 2,
+                  nb_COAP_szx());
+}
+
+/**
+ * @brief  Build the CoAP uplink and its AT+QISEND command in buff
+ * @param  Instruction parameter
+ * @retval NB_CMD_SUCC, or NB_CMD_FAIL when the message doesn't fit
+ */
+NB_TaskStatus nb_COAP_udp_send_set(const char *param) {
+  const char *payload = NULL;
+  char *end = buff + sizeof(buff);
+  uint8_t more = 0;
+
+  if (coapResend) {
+    coapResend = 0;
+    user_main_printf("CoAP retransmission %d", coapRetransmit.count);
+  } else if (sys.coap_mode == COAP_LWM2M) {
+    nb_COAP_new_request(Confirm_Checkpoint() ? COAP_CON : COAP_NON, COAP_POST);
+    more = Lwm2m_Uplink(&coapSent, coapHead, sizeof(coapHead),
+                        &coapRequest) == LWM2M_MORE;
+    // the LwM2M client may make it confirmable
+    coapWaiting = coapRequest.type == COAP_CON;
+    // the non-confirmable notifications follow without an answer
+    coapFollow = more && coapRequest.type == COAP_NON;
+    coapSentLen = 0;
+  } else {
+    // the blocks need their 2.31 Continue, whatever AT+CONFIRM says
+    nb_COAP_new_request(Confirm_Checkpoint() || coapBlock.wise ? COAP_CON
+                                                               : COAP_NON,
+                        COAP_POST);
+    coapSentLen = Coap_BlockSlice(&coapBlock, &coapSentOffset, &more);
+    if (coapBlock.wise)
+      user_main_printf("CoAP block %d, %d bytes", (int)coapBlock.num,
+                       (int)coapSentLen);
+    nb_COAP_head(&coapSent, coapSentLen != 0, more);
+  }
+
+  if (sys.coap_mode == COAP_LWM2M) {
+    payload = "";
+  } else if (sys.platform == 5) {
+    // the JSON is read to the end of buff, out of the way of the command
+    end -= coapSentLen;
+    payload = end;
+    if (pro_data_read(coapSentOffset, end, coapSentLen) != coapSentLen)
+      return NB_CMD_FAIL;
+  }
+  return nb_COAP_udp_line(&coapSent, payload, coapSentOffset, coapSentLen,
+                          end);
+}
+
+/**
+ * @brief  Time to wait for the answer to the request
+ * @param  None
+ * @retval ms, 0 when no confirmable request is waiting for an answer
+ */
+uint32_t nb_COAP_timeout(void) {
+  if (sys.protocol != COAP_PRO || sys.coap_mode == COAP_MODEM ||
+      read_flag != 1 || coapWaiting == 0)
+    return 0;
+  return coapRetransmit.timeout;
+}
+
+/**
+ * @brief  The wait for the answer ran out
+ * @param  None
+ * @retval 1 when the request is to be sent again, 0 to give up
+ */
+uint8_t nb_COAP_retransmit(void) {
+  if (Coap_RetransmitNext(&coapRetransmit) == 0) {
+    coapWaiting = 0;
+    return 0;
+  }
+  // the socket answers SEND OK again before the wait
+  coapResend = 1;
+  read_flag = 0;
+  return 1;
+}
+
+// Sends the message in coapHead right away, ahead of the task sequence
+static void nb_COAP_udp_reply(CoapWriter *w) {
+  if (nb_COAP_udp_line(w, "", 0, 0, buff + sizeof(buff)) == NB_CMD_SUCC)
+    nb_at_send(&NBTask[_AT_UDP_SEND]);
+}
+
+// Passes a payload on as a downlink, encoded back to hex in data
+static void nb_COAP_downlink(char *data, const CoapMessage *msg) {
+  // in place from the last byte, the payload being further in data
+  memmove(data, msg->payload, msg->payload_len);
+  for (int i = msg->payload_len - 1; i >= 0; i--) {
+    uint8_t byte = data[i];
+    sprintf(data + i * 2, "%.2x", byte);
+  }
+  rxPayLoadDeal(data);
+}
+
+// A request of the LwM2M server, reading or observing the readings or
+// writing a downlink; the uplink still waits for its own answer
+static void nb_COAP_lwm2m_serve(char *data, const CoapMessage *in) {
+  CoapWriter w;
+  uint8_t result;
+
+  // after the request, which may have to be sent again
+  result = Lwm2m_Serve(in, &w, coapHead + Coap_End(&coapSent),
+                       sizeof(coapHead) - Coap_End(&coapSent));
+  nb_COAP_udp_reply(&w);
+  if (result == LWM2M_DOWNLINK)
+    nb_COAP_downlink(data, in);
+}
+
+/**
+ * @brief  Handle a datagram received on the socket, hex encoded
+ * @param  The datagram, also used to pass the response payload on
+ * @retval None
+ */
+void nb_COAP_udp_read(char *data) {
+  size_t len = strlen(data) / 2;
+  CoapMessage rsp;
+  uint8_t matches;
+
+  StrToHex(data, data, len);
+  if (Coap_Parse(&rsp, (uint8_t *)data, len) == 0) {
+    user_main_printf("Ignored a malformed CoAP message");
+    return;
+  }
+  matches = Coap_Matches(&rsp, &coapRequest);
+  if (sys.coap_mode == COAP_LWM2M && matches == 0 && rsp.type == COAP_CON &&
+      rsp.code != COAP_EMPTY && rsp.code >> 5 == 0) {
+    nb_COAP_lwm2m_serve(data, &rsp);
+    return;
+  }
+  if (matches == 0) {
+    user_main_printf("Ignored a CoAP message not answering the uplink");
+    return;
+  }
+  coapWaiting = 0;
+  if (rsp.type == COAP_CON) {
+    // a separate response, acknowledged with an empty message
+    nb_UDP_send_head();
+    sprintf(buff + strlen(buff), "4,\"%.2x%.2x%.4x\"\r\n",
+            1 << 6 | COAP_ACK << 4, COAP_EMPTY, rsp.mid);
+    ATSendStr = buff;
+    len_string = strlen(ATSendStr);
+    nb_at_send(&NBTask[_AT_UDP_SEND]);
+  }
+  if (sys.coap_mode == COAP_LWM2M) {
+    uint8_t answer = Lwm2m_Answer(&rsp);
+
+    coapAcked = answer == LWM2M_DELIVERED;
+    coapFollow = answer == LWM2M_FOLLOW;
+    if (coapAcked && rsp.payload_len != 0)
+      nb_COAP_downlink(data, &rsp);
+    return;
+  }
+  if (rsp.type == COAP_RST) {
+    user_main_printf("CoAP uplink rejected by the server");
+    coapBlock.num = 0;
+    return;
+  }
+  // the next block, or the body again in smaller blocks
+  if (Coap_BlockAnswer(&coapBlock, &rsp)) {
+    coapFollow = 1;
+    return;
+  }
+  if (rsp.code != COAP_EMPTY && rsp.code >> 5 != 2) {
+    user_main_printf("CoAP server answered %d.%02d", rsp.code >> 5,
+                     rsp.code & 0x1F);
+    // a block-wise upload starts over
+    coapBlock.num = 0;
+    return;
+  }
+  coapAcked = 1;
+  if (rsp.payload_len != 0)
+    nb_COAP_downlink(data, &rsp);
+}
+
+uint8_t nb_COAP_acked(void) { return coapAcked; }
+
+uint8_t nb_COAP_follow(void) { return coapFollow; }
+
+uint8_t nb_COAP_confirmable(void) { return coapRequest.type == COAP_CON; }
@@ -243,12 +243,14 @@ NB_TaskStatus nb_MQTT_pub_run(const char *param) {
 }
 
 NB_TaskStatus nb_MQTT_pub_set(const char *param) {
+  uint8_t qos = Confirm_Qos(mqtt_qos);
+
   memset(buff, 0, sizeof(buff));
-  if (mqtt_qos == 2)
+  if (qos == 2)
     strcat(buff, AT QMTPUB "=0,1,2,0,\"");
-  else if (mqtt_qos == 0)
+  else if (qos == 0)
     strcat(buff, AT QMTPUB "=0,0,0,0,\"");
-  else if (mqtt_qos == 1)
+  else if (qos == 1)
     strcat(buff, AT QMTPUB "=0,1,1,0,\"");
 
   strcat(buff, (char *)user.pubtopic);
@@ -280,12 +282,14 @@ NB_TaskStatus nb_MQTT_pub1_run(const char *param) {
 }
 
 NB_TaskStatus nb_MQTT_pub1_set(const char *param) {
+  uint8_t qos = Confirm_Qos(mqtt_qos);
+
   memset(buff, 0, sizeof(buff));
-  if (mqtt_qos == 2)
+  if (qos == 2)
     strcat(buff, AT QMTPUB "=0,1,2,0,\"channels/");
-  else if (mqtt_qos == 0)
+  else if (qos == 0)
     strcat(buff, AT QMTPUB "=0,0,0,0,\"channels/");
-  else if (mqtt_qos == 1)
+  else if (qos == 1)
     strcat(buff, AT QMTPUB "=0,1,1,0,\"channels/");
 
   strcat(buff, (char *)user.pubtopic);
@@ -318,12 +322,14 @@ NB_TaskStatus nb_MQTT_pub2_run(const char *param) {
 }
 
 NB_TaskStatus nb_MQTT_pub2_set(const char *param) {
+  uint8_t qos = Confirm_Qos(mqtt_qos);
+
   memset(buff, 0, sizeof(buff));
-  if (mqtt_qos == 2)
+  if (qos == 2)
     strcat(buff, AT QMTPUB "=0,1,2,0,\"");
-  else if (mqtt_qos == 0)
+  else if (qos == 0)
     strcat(buff, AT QMTPUB "=0,0,0,0,\"");
-  else if (mqtt_qos == 1)
+  else if (qos == 1)
     strcat(buff, AT QMTPUB "=0,1,1,0,\"");
 
   strcat(buff, (char *)user.pubtopic);
@@ -355,12 +361,14 @@ NB_TaskStatus nb_MQTT_pub3_run(const char *param) {
 }
 
 NB_TaskStatus nb_MQTT_pub3_set(const char *param) {
+  uint8_t qos = Confirm_Qos(mqtt_qos);
+
   memset(buff, 0, sizeof(buff));
-  if (mqtt_qos == 2)
+  if (qos == 2)
     strcat(buff, AT QMTPUB "=0,1,2,0,\"");
-  else if (mqtt_qos == 0)
+  else if (qos == 0)
     strcat(buff, AT QMTPUB "=0,0,0,0,\"");
-  else if (mqtt_qos == 1)
+  else if (qos == 1)
     strcat(buff, AT QMTPUB "=0,1,1,0,\"");
 
   strcat(buff, (char *)user.pubtopic);
@@ -392,12 +400,14 @@ NB_TaskStatus nb_MQTT_pub5_run(const char *param) {
 }
 
 NB_TaskStatus nb_MQTT_pub5_set(const char *param) {
+  uint8_t qos = Confirm_Qos(mqtt_qos);
+
   memset(buff, 0, sizeof(buff));
-  if (mqtt_qos == 2)
+  if (qos == 2)
     strcat(buff, AT QMTPUB "=0,1,2,0,\"");
-  else if (mqtt_qos == 0)
+  else if (qos == 0)
     strcat(buff, AT QMTPUB "=0,0,0,0,\"");
-  else if (mqtt_qos == 1)
+  else if (qos == 1)
     strcat(buff, AT QMTPUB "=0,1,1,0,\"");
   strcat(buff, (char *)user.pubtopic);
   strcat(buff, (char *)"\",");
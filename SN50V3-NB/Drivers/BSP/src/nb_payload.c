@@ -71,6 +71,88 @@ void pro_data_thingspeak(void) {
   sprintf(buff + strlen(buff), "%d,%s\r\n", strlen(buff1), buff1);
 }
 
+// Appends history record i, stored at EEPROM index num, to out
+static void pro_record(char *out, uint8_t i, int num) {
+  int16_t tem, hum, d1, d2, d3;
+  uint16_t ad0, ad1, ad4, distance, intensity;
+  uint32_t count;
+  int32_t weight;
+  time_t curtime;
+  struct tm *info;
+  uint32_t r_time = *(__IO uint32_t *)(EEPROM_TIME_START_ADD + num * 0x04);
+  curtime = r_time;
+  info = localtime(&curtime);
+  char mini[80];
+  memset(mini, 0, sizeof(mini));
+  strftime(mini, 80, "%Y/%m/%d %H:%M:%S", info);
+
+  if ((sys.mod != model6) && (sys.mod != model7)) {
+    uint32_t r_d1_ad0_data =
+        *(__IO uint32_t *)(EEPROM_D1_AD0_START_ADD + num * 0x04);
+    ad0 = ((r_d1_ad0_data >> 16) & 0xFFFF);
+    if ((sys.mod != model3)) {
+      d1 = (r_d1_ad0_data & 0xFFFF);
+    }
+  }
+  if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
+    uint32_t r_sht_data = *(__IO uint32_t *)(EEPROM_SHT_START_ADD + num * 0x04);
+    tem = ((r_sht_data >> 16) & 0xFFFF);
+    hum = (r_sht_data & 0xFFFF);
+  }
+  if (sys.mod == model2) {
+    uint32_t r_distance_data =
+        *(__IO uint32_t *)(EEPROM_DISTANCE_START_ADD + num * 0x04);
+    distance = (r_distance_data & 0xFFFF);
+  } else if (sys.mod == model3) {
+    uint32_t r_ad1_ad4_data =
+        *(__IO uint32_t *)(EEPROM_AD1_AD4_START_ADD + num * 0x04);
+    ad1 = ((r_ad1_ad4_data >> 16) & 0xFFFF);
+    ad4 = (r_ad1_ad4_data & 0xFFFF);
+  } else if (sys.mod == model4) {
+    uint32_t r_d2_d3_data =
+        *(__IO uint32_t *)(EEPROM_D2D3_START_ADD + num * 0x04);
+    d2 = ((r_d2_d3_data >> 16) & 0xFFFF);
+    d3 = (r_d2_d3_data & 0xFFFF);
+  } else if (sys.mod == model5) {
+    uint32_t r_weight_data =
+        *(__IO uint32_t *)(EEPROM_WEIGHT_START_ADD + num * 0x04);
+    weight = r_weight_data;
+  } else if (sys.mod == model6) {
+    uint32_t r_count_data =
+        *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
+    count = r_count_data;
+  } else if (sys.mod == model7) {
+    uint32_t r_count_data =
+        *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
+    count = r_count_data;
+    uint32_t r_intensity =
+        *(__IO uint32_t *)(EEPROM_INTENSITY_START_ADD + num * 0x04);
+    intensity = r_intensity & 0xFFFF;
+  }
+  sprintf(out + strlen(out), ",\"%d\":", i + 1);
+  if (sys.mod == model1) {
+    sprintf(out + strlen(out), "[%.1f,%.1f,%d,%.1f,\"%s\"]", (float)tem / 10.0,
+            (float)hum / 10.0, ad0, (float)d1 / 10.0, mini);
+  } else if (sys.mod == model2) {
+    sprintf(out + strlen(out), "[%d,%d,%.1f,\"%s\"]", distance, ad0,
+            (float)d1 / 10.0, mini);
+  } else if (sys.mod == model3) {
+    sprintf(out + strlen(out), "[%.1f,%.1f,%d,%d,%d,\"%s\"]",
+            (float)tem / 10.0, (float)hum / 10.0, ad0, ad1, ad4, mini);
+  } else if (sys.mod == model4) {
+    sprintf(out + strlen(out), "[%d,%.1f,%.1f,%.1f,\"%s\"]", ad0,
+            (float)d1 / 10.0, (float)d2 / 10.0, (float)d3 / 10.0, mini);
+  } else if (sys.mod == model5) {
+    sprintf(out + strlen(out), "[%d,%.1f,%d,\"%s\"]", ad0, (float)d1 / 10.0,
+            weight, mini);
+  } else if (sys.mod == model6) {
+    sprintf(out + strlen(out), "[%d,\"%s\"]", count, mini);
+  } else if (sys.mod == model7) {
+    sprintf(out + strlen(out), "[%.1f,%.1f,%d,%.1f,\"%s\"]", (float)tem / 10.0,
+            (float)hum / 10.0, count, (float)intensity / 10.0, mini);
+  }
+}
+
 void pro_data(void) {
   uint16_t str_end, str_beg = 0;
   uint16_t batteryLevel_mV = getVoltage();
@@ -87,13 +169,7 @@ void pro_data(void) {
             user.deui, sys.mod - 0x30, batteryLevel_mV / 1000.0, nb.singal);
     mode_data(buff);
     int num = sys.sht_seq;
-    int16_t tem, hum, d1, d2, d3;
-    uint16_t ad0, ad1, ad4, distance, intensity;
-    uint32_t count;
-    int32_t weight;
-    time_t curtime;
-    struct tm *info;
-    int num2 = sys.sht_noud;
+    int num2 = Confirm_History(sys.sht_noud);
     if (sys.protocol == MQTT_PRO) {
       if (num2 >= 24)
         num2 = 24;
@@ -106,81 +182,7 @@ void pro_data(void) {
       num--;
       if (num < 0)
         num = 32 + num;
-      uint32_t r_time = *(__IO uint32_t *)(EEPROM_TIME_START_ADD + num * 0x04);
-      curtime = r_time;
-      info = localtime(&curtime);
-      char mini[80];
-      memset(mini, 0, sizeof(mini));
-      strftime(mini, 80, "%Y/%m/%d %H:%M:%S", info);
-
-      if ((sys.mod != model6) && (sys.mod != model7)) {
-        uint32_t r_d1_ad0_data =
-            *(__IO uint32_t *)(EEPROM_D1_AD0_START_ADD + num * 0x04);
-        ad0 = ((r_d1_ad0_data >> 16) & 0xFFFF);
-        if ((sys.mod != model3)) {
-          d1 = (r_d1_ad0_data & 0xFFFF);
-        }
-      }
-      if ((sys.mod == model1) || (sys.mod == model3) || (sys.mod == model7)) {
-        uint32_t r_sht_data =
-            *(__IO uint32_t *)(EEPROM_SHT_START_ADD + num * 0x04);
-        tem = ((r_sht_data >> 16) & 0xFFFF);
-        hum = (r_sht_data & 0xFFFF);
-      }
-      if (sys.mod == model2) {
-        uint32_t r_distance_data =
-            *(__IO uint32_t *)(EEPROM_DISTANCE_START_ADD + num * 0x04);
-        distance = (r_distance_data & 0xFFFF);
-      } else if (sys.mod == model3) {
-        uint32_t r_ad1_ad4_data =
-            *(__IO uint32_t *)(EEPROM_AD1_AD4_START_ADD + num * 0x04);
-        ad1 = ((r_ad1_ad4_data >> 16) & 0xFFFF);
-        ad4 = (r_ad1_ad4_data & 0xFFFF);
-      } else if (sys.mod == model4) {
-        uint32_t r_d2_d3_data =
-            *(__IO uint32_t *)(EEPROM_D2D3_START_ADD + num * 0x04);
-        d2 = ((r_d2_d3_data >> 16) & 0xFFFF);
-        d3 = (r_d2_d3_data & 0xFFFF);
-      } else if (sys.mod == model5) {
-        uint32_t r_weight_data =
-            *(__IO uint32_t *)(EEPROM_WEIGHT_START_ADD + num * 0x04);
-        weight = r_weight_data;
-      } else if (sys.mod == model6) {
-        uint32_t r_count_data =
-            *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
-        count = r_count_data;
-      } else if (sys.mod == model7) {
-        uint32_t r_count_data =
-            *(__IO uint32_t *)(EEPROM_COUNT_START_ADD + num * 0x04);
-        count = r_count_data;
-        uint32_t r_intensity =
-            *(__IO uint32_t *)(EEPROM_INTENSITY_START_ADD + num * 0x04);
-        intensity = r_intensity & 0xFFFF;
-      }
-      sprintf(buff + strlen(buff), ",\"%d\":", i + 1);
-      if (sys.mod == model1) {
-        sprintf(buff + strlen(buff), "[%.1f,%.1f,%d,%.1f,\"%s\"]",
-                (float)tem / 10.0, (float)hum / 10.0, ad0, (float)d1 / 10.0,
-                mini);
-      } else if (sys.mod == model2) {
-        sprintf(buff + strlen(buff), "[%d,%d,%.1f,\"%s\"]", distance, ad0,
-                (float)d1 / 10.0, mini);
-      } else if (sys.mod == model3) {
-        sprintf(buff + strlen(buff), "[%.1f,%.1f,%d,%d,%d,\"%s\"]",
-                (float)tem / 10.0, (float)hum / 10.0, ad0, ad1, ad4, mini);
-      } else if (sys.mod == model4) {
-        sprintf(buff + strlen(buff), "[%d,%.1f,%.1f,%.1f,\"%s\"]", ad0,
-                (float)d1 / 10.0, (float)d2 / 10.0, (float)d3 / 10.0, mini);
-      } else if (sys.mod == model5) {
-        sprintf(buff + strlen(buff), "[%d,%.1f,%d,\"%s\"]", ad0,
-                (float)d1 / 10.0, weight, mini);
-      } else if (sys.mod == model6) {
-        sprintf(buff + strlen(buff), "[%d,\"%s\"]", count, mini);
-      } else if (sys.mod == model7) {
-        sprintf(buff + strlen(buff), "[%.1f,%.1f,%d,%.1f,\"%s\"]",
-                (float)tem / 10.0, (float)hum / 10.0, count,
-                (float)intensity / 10.0, mini);
-      }
+      pro_record(buff, i, num);
     }
     strcat(buff, (char *)"}");
     str_end = strlen(buff);
@@ -189,6 +191,85 @@ void pro_data(void) {
   }
 }
 
+/* pro_data() for the block-wise CoAP uplink, which carries every record
+ * of AT+CLOCKLOG: the JSON is read a slice at a time, the records being
+ * formatted again from EEPROM for each slice instead of being held in
+ * RAM. Only the head is kept, its readings having to stay the same from
+ * one slice to the next. */
+static char proHead[400];
+static int proSeq;
+static uint8_t proCount;
+
+/**
+ * @brief  Start a JSON uplink read with pro_data_read()
+ * @param  None
+ * @retval The length of the JSON
+ */
+size_t pro_data_open(void) {
+  uint16_t batteryLevel_mV = getVoltage();
+  char record[100];
+  size_t len;
+  int num;
+
+  sprintf(proHead,
+          "{\"IMEI\":\"%s\",\"Model\":\"SN50V3-NB\",\"mod\":%d,\"battery\":%."
+          "2f,\"signal\":%d,",
+          user.deui, sys.mod - 0x30, batteryLevel_mV / 1000.0, nb.singal);
+  mode_data(proHead);
+  proSeq = num = sys.sht_seq;
+  proCount = Confirm_History(sys.sht_noud);
+  len = strlen(proHead) + 1;
+  for (uint8_t i = 0; i < proCount; i++) {
+    num--;
+    if (num < 0)
+      num = 32 + num;
+    record[0] = '\0';
+    pro_record(record, i, num);
+    len += strlen(record);
+  }
+  return len;
+}
+
+/**
+ * @brief  Read a slice of the JSON uplink
+ * @param  offset and len of the slice, copied to dst
+ * @retval The number of bytes copied
+ */
+size_t pro_data_read(size_t offset, char *dst, size_t len) {
+  char record[100];
+  size_t pos = 0, copied = 0;
+  int num = proSeq;
+
+  // the head, the records, then the closing brace
+  for (int i = -1; i <= proCount && copied < len; i++) {
+    const char *piece = proHead;
+    size_t pieceLen;
+
+    if (i == proCount) {
+      piece = "}";
+    } else if (i >= 0) {
+      num--;
+      if (num < 0)
+        num = 32 + num;
+      record[0] = '\0';
+      pro_record(record, i, num);
+      piece = record;
+    }
+    pieceLen = strlen(piece);
+    if (offset < pos + pieceLen) {
+      size_t take = pos + pieceLen - offset;
+
+      if (take > len - copied)
+        take = len - copied;
+      memcpy(dst + copied, piece + (offset - pos), take);
+      copied += take;
+      offset += take;
+    }
+    pos += pieceLen;
+  }
+  return copied;
+}
+
 void mode_data(char *buff) {
   if (sys.mod == model1) {
     sprintf(buff + strlen(buff), "\"DS18B20_Temp\":%.1f,", ds1820_value);
@@ -0,0 +1,41 @@
+#include "nb_step.h"
+#include "event.h"
+#include "nbInit.h"
+#include "time_server.h"
+
+/* Pacing of the NB task steps of NBTASK(). A step that moved on is
+ * followed by the next one right away, but for the restarts: the modem
+ * ignores commands while it boots, which would fail the step after it and
+ * count towards the next restart. A failed step, or one still waiting on
+ * the modem, is tried again after NB_RETRY_TIME. Both waits are spent in
+ * Stop on NbStepTimer. */
+static TimerEvent_t NbStepTimer;
+
+static void OnNbStepEvent(void) { Event_Signal(EVENT_SIGNAL_NB); }
+
+void NbStep_Init(void) { TimerInit(&NbStepTimer, OnNbStepEvent); }
+
+static void NbStep_After(uint32_t ms) {
+  TimerStop(&NbStepTimer);
+  TimerSetValue(&NbStepTimer, ms);
+  TimerStart(&NbStepTimer);
+}
+
+/* Runs the step of task, then schedules the next one; returns the state
+ * of NBTASK() */
+uint8_t NbStep_Run(uint8_t *task) {
+  uint8_t step = *task;
+  uint8_t state;
+
+  if (step == _AT_IDLE)
+    return _AT_IDLE;
+  state = NBTASK(task);
+  if ((step == _AT_QRST || step == _AT_QRST2) && *task != step &&
+      *task != _AT_IDLE)
+    NbStep_After(NB_BOOT_TIME);
+  else if (state == _AT_ERROR || *task == step)
+    NbStep_After(NB_RETRY_TIME);
+  else if (*task != _AT_IDLE)
+    Event_Signal(EVENT_SIGNAL_NB);
+  return state;
+}
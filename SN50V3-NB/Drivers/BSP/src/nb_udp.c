@@ -62,7 +62,14 @@ NB_TaskStatus nb_UDP_open_set(const char *param) {
  */
 NB_TaskStatus nb_UDP_send_run(const char *param) {
   try_num = 4;
-  NBTask[_AT_UDP_SEND].set(param);
+  // CoAP only reaches the UDP tasks when the messages are built here
+  if (sys.protocol == COAP_PRO) {
+    if (nb_COAP_udp_send_set(param) != NB_CMD_SUCC) {
+      nb_cmd_status = NB_CMD_FAIL;
+      return nb_cmd_status;
+    }
+  } else
+    NBTask[_AT_UDP_SEND].set(param);
 
   if (nb_at_send(&NBTask[_AT_UDP_SEND]) == NB_CMD_SUCC) {
     nb_cmd_status = NB_CMD_SUCC;
@@ -72,25 +79,32 @@ NB_TaskStatus nb_UDP_send_run(const char *param) {
   return nb_cmd_status;
 }
 
-NB_TaskStatus nb_UDP_send_set(const char *param) {
-  memset(buff, 0, sizeof(buff));
+/* Starts buff with the AT+QISEND command up to the length of the data,
+ * leaving the rest of buff as it is */
+void nb_UDP_send_head(void) {
+  buff[0] = '\0';
   strcat(buff, AT QISEND "=");
   strcat(buff, "0");
   strcat(buff, ",\"");
   if (strlen((char *)user.add_ip) != 0) {
     char *pos = strchr((char *)user.add_ip, ',');
-    memcpy(buff + strlen(buff), user.add_ip, (pos - (char *)user.add_ip));
+    strncat(buff, (char *)user.add_ip, (pos - (char *)user.add_ip));
     strcat(buff, "\"");
     strcat(buff, (char *)&user.add_ip[(pos - (char *)user.add_ip)]);
     //		strcat(buff,(char*)user.add_ip);
   } else {
     char *pos = strchr((char *)user.add, ',');
-    memcpy(buff + strlen(buff), user.add, (pos - (char *)user.add));
+    strncat(buff, (char *)user.add, (pos - (char *)user.add));
     strcat(buff, "\"");
     strcat(buff, (char *)&user.add[(pos - (char *)user.add)]);
     //		strcat(buff,(char*)user.add);
   }
   strcat(buff, ",");
+}
+
+NB_TaskStatus nb_UDP_send_set(const char *param) {
+  memset(buff, 0, sizeof(buff));
+  nb_UDP_send_head();
   if (sys.platform == 5) {
     pro_data();
   }
@@ -116,7 +130,10 @@ NB_TaskStatus nb_UDP_send_set(const char *param) {
 //  */
 NB_TaskStatus nb_UDP_read_run(const char *param) {
   if (NBTask[_AT_UDP_READ].get(param) == NB_READ_DATA) {
-    rxPayLoadDeal(downlink_data);
+    if (sys.protocol == COAP_PRO)
+      nb_COAP_udp_read(downlink_data);
+    else
+      rxPayLoadDeal(downlink_data);
   }
   return nb_cmd_status;
 }
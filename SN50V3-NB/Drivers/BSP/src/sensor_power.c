@@ -0,0 +1,42 @@
+#include "sensor_power.h"
+#include "clock.h"
+#include "energy.h"
+#include "time_server.h"
+
+/* The 5V sensor rail. It is switched on at the start of an uplink cycle,
+ * so that its settle time runs while the modem leaves sleep and attaches,
+ * and the sensors are read once what is left of it has passed. */
+static uint8_t railOn = 0;
+static TimerTime_t railOnTime = 0;
+
+void Sensor_PowerOn(void) {
+  if (railOn == 1)
+    return;
+  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_RESET);
+  Energy_Rail(1);
+  railOnTime = TimerGetCurrentTime();
+  railOn = 1;
+}
+
+void Sensor_PowerOff(void) {
+  HAL_GPIO_WritePin(Power_5v_GPIO_Port, Power_5v_Pin, GPIO_PIN_SET);
+  Energy_Rail(0);
+  railOn = 0;
+}
+
+uint8_t Sensor_PowerIsOn(void) { return railOn; }
+
+/* Switches the rail on if it is off, and waits until it has been on for
+ * settle ms, on the MSI clock. Returns the ms waited. */
+uint32_t Sensor_PowerSettle(uint32_t settle) {
+  uint32_t elapsed;
+
+  Sensor_PowerOn();
+  elapsed = TimerGetElapsedTime(railOnTime);
+  if (elapsed >= settle)
+    return 0;
+  user_main_debug("Sensor power settle: %d ms overlapped, %d ms waited",
+                  (int)elapsed, (int)(settle - elapsed));
+  Clock_Wait(settle - elapsed);
+  return settle - elapsed;
+}
@@ -20,10 +20,10 @@ void sht20Data(void) {
   uint8_t SHT2X_Tem_Buffer[1] = {0xf3};
   uint16_t AD_code = 0;
 
-  HAL_Delay(100);
+  Clock_Wait(100);
   HAL_I2C_Master_Transmit(&hi2c1, 0x80, SHT2X_Hum_Buffer,
                           strlen((char *)SHT2X_Hum_Buffer), 1000);
-  HAL_Delay(100);
+  Clock_Wait(100);
   HAL_I2C_Master_Receive(&hi2c1, 0x81, rxdata, 2, 1000);
 
   AD_code = (rxdata[0] << 8) + rxdata[1];
@@ -33,10 +33,10 @@ void sht20Data(void) {
     hum = 101.0;
   }
   memset(rxdata, 0, sizeof(rxdata));
-  HAL_Delay(100);
+  Clock_Wait(100);
   HAL_I2C_Master_Transmit(&hi2c1, 0x80, SHT2X_Tem_Buffer,
                           strlen((char *)SHT2X_Tem_Buffer), 1000);
-  HAL_Delay(100);
+  Clock_Wait(100);
   HAL_I2C_Master_Receive(&hi2c1, 0x81, rxdata, 2, 1000);
 
   AD_code = (rxdata[0] << 8) + rxdata[1];
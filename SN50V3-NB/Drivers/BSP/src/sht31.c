@@ -33,7 +33,7 @@ void sht31Data(void) {
   uint8_t SHT3X_Start_Buffer[2] = {0xE0, 0x00};
   uint16_t AD_code = 0;
   sht31Init();
-  HAL_Delay(100);
+  Clock_Wait(100);
   HAL_I2C_Master_Transmit(&hi2c1, 0x88, SHT3X_Start_Buffer, 2, 1000);
   HAL_I2C_Master_Receive(&hi2c1, 0x89, rxdata, 6, 1000);
 
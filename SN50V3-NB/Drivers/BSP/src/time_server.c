@@ -146,6 +146,7 @@ void GetTime(uint32_t Time) {
   } while (0);
 
 static TimerEvent_t *TimerListHead = NULL;
+static uint32_t TimerAlarmTime = 0;
 
 /*!
  * \brief Adds or replace the head timer of the list.
@@ -177,6 +178,18 @@ static void TimerInsertTimer(TimerEvent_t *obj);
  */
 static void TimerSetTimeout(TimerEvent_t *obj);
 
+/*!
+ * \brief Computes the coalesced wake-up time of the list
+ *
+ * \remark The list is sorted by deadline. The wake-up is the earliest
+ *     deadline plus slack, so that every timer whose deadline falls before it
+ *     expires on the same RTC alarm without any of them being later than
+ *     allowed.
+ *
+ * \retval Wake-up time in ticks from TimerContext
+ */
+static uint32_t TimerWakeTime(void);
+
 /*!
  * \brief Check if the Object to be added is not already in the list
  *
@@ -188,6 +201,7 @@ static bool TimerExists(TimerEvent_t *obj);
 void TimerInit(TimerEvent_t *obj, void (*callback)(void)) {
   obj->Timestamp = 0;
   obj->ReloadValue = 0;
+  obj->Slack = 0;
   obj->IsRunning = false;
   obj->Callback = callback;
   obj->Next = NULL;
@@ -218,6 +232,11 @@ void TimerStart(TimerEvent_t *obj) {
       TimerInsertNewHeadTimer(obj);
     } else {
       TimerInsertTimer(obj);
+      // the new timer may not tolerate waiting for the armed alarm
+      if ((TimerListHead->IsRunning == true) &&
+          (obj->Timestamp + obj->Slack < TimerAlarmTime)) {
+        TimerSetTimeout(TimerListHead);
+      }
     }
   }
   RESTORE_PRIMASK();
@@ -255,7 +274,6 @@ static void TimerInsertNewHeadTimer(TimerEvent_t *obj) {
 
 void TimerIrqHandler(void) {
   TimerEvent_t *cur;
-  TimerEvent_t *next;
 
   uint32_t old = HW_RTC_GetTimerContext();
   uint32_t now = HW_RTC_SetTimerContext();
@@ -263,27 +281,22 @@ void TimerIrqHandler(void) {
 
   /* update timeStamp based upon new Time Reference*/
   /* beacuse delta context should never exceed 2^32*/
-  if (TimerListHead != NULL) {
-    for (cur = TimerListHead; cur->Next != NULL; cur = cur->Next) {
-      next = cur->Next;
-      if (next->Timestamp > DeltaContext) {
-        next->Timestamp -= DeltaContext;
-      } else {
-        next->Timestamp = 0;
-      }
+  for (cur = TimerListHead; cur != NULL; cur = cur->Next) {
+    if (cur->Timestamp > DeltaContext) {
+      cur->Timestamp -= DeltaContext;
+    } else {
+      cur->Timestamp = 0;
     }
   }
 
-  /* execute imediately the alarm callback */
+  /* the alarm is consumed, the head is re-armed below if it is not due */
   if (TimerListHead != NULL) {
-    cur = TimerListHead;
-    TimerListHead = TimerListHead->Next;
-    exec_cb(cur->Callback);
+    TimerListHead->IsRunning = false;
   }
 
-  // remove all the expired object from the list
+  // execute, in deadline order, all the objects expired before this wake-up
   while ((TimerListHead != NULL) &&
-         (TimerListHead->Timestamp < HW_RTC_GetTimerElapsedTime())) {
+         (TimerListHead->Timestamp <= HW_RTC_GetTimerElapsedTime())) {
     cur = TimerListHead;
     TimerListHead = TimerListHead->Next;
     exec_cb(cur->Callback);
@@ -363,6 +376,17 @@ static bool TimerExists(TimerEvent_t *obj) {
   return false;
 }
 
+bool TimerIsStarted(TimerEvent_t *obj) {
+  bool started;
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  started = TimerExists(obj);
+  RESTORE_PRIMASK();
+
+  return started;
+}
+
 void TimerReset(TimerEvent_t *obj) {
   TimerStop(obj);
   TimerStart(obj);
@@ -384,6 +408,14 @@ void TimerSetValue(TimerEvent_t *obj, uint32_t value) {
   obj->ReloadValue = ticks;
 }
 
+void TimerSetSlack(TimerEvent_t *obj, uint32_t value) {
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+  obj->Slack = HW_RTC_ms2Tick(value);
+  RESTORE_PRIMASK();
+}
+
 TimerTime_t TimerGetCurrentTime(void) {
   uint32_t now = HW_RTC_GetTimerValue();
   return HW_RTC_Tick2ms(now);
@@ -396,15 +428,33 @@ TimerTime_t TimerGetElapsedTime(TimerTime_t past) {
   return HW_RTC_Tick2ms(nowInTicks - pastInTicks);
 }
 
+static uint32_t TimerWakeTime(void) {
+  TimerEvent_t *cur = TimerListHead;
+  uint32_t wake = cur->Timestamp + cur->Slack;
+
+  // later deadlines can only lower the wake-up if they come before it
+  for (cur = cur->Next; (cur != NULL) && (cur->Timestamp < wake);
+       cur = cur->Next) {
+    if (cur->Timestamp + cur->Slack < wake) {
+      wake = cur->Timestamp + cur->Slack;
+    }
+  }
+  return wake;
+}
+
 static void TimerSetTimeout(TimerEvent_t *obj) {
-  int32_t minTicks = HW_RTC_GetMinimumTimeout();
+  uint32_t minTimeout =
+      HW_RTC_GetTimerElapsedTime() + HW_RTC_GetMinimumTimeout();
   obj->IsRunning = true;
 
-  // in case deadline too soon
-  if (obj->Timestamp < (HW_RTC_GetTimerElapsedTime() + minTicks)) {
-    obj->Timestamp = HW_RTC_GetTimerElapsedTime() + minTicks;
+  // in case deadline too soon, hold back the alarm: moving the deadline
+  // would unsort the list, and a later timer due before it would be set an
+  // alarm behind the RTC counter
+  TimerAlarmTime = TimerWakeTime();
+  if (TimerAlarmTime < minTimeout) {
+    TimerAlarmTime = minTimeout;
   }
-  HW_RTC_SetAlarm(obj->Timestamp);
+  HW_RTC_SetAlarm(TimerAlarmTime);
 }
 
 static void CalendarDiv86400(uint32_t in, uint32_t *out, uint32_t *remainder) {
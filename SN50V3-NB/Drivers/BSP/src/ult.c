@@ -1,10 +1,23 @@
 #include "ult.h"
+#include "lowpower.h"
+#include "time_server.h"
 
+extern void SystemClock_Config(void);
 extern uint8_t rxbuf_u1;
 extern uint8_t rxDATA_u1[100];
 extern uint8_t rxlen_u1;
 extern bool tdc_clock_log_flag;
 static uint16_t receive_data_ult_check[10] = {0};
+static TimerEvent_t ULTTimeoutTimer;
+static volatile uint8_t ult_timeout = 0;
+static uint8_t ult_seen = 0; // bytes ULT_WaitFrame() last looked at
+
+static void OnULTTimeoutEvent(void) { ult_timeout = 1; }
+
+// Called with interrupts masked before Stop
+static uint8_t ULT_Ready(void) {
+  return ult_timeout != 0 || rxlen_u1 != ult_seen;
+}
 
 void ULT_Rest(void) {
   rxlen_u1 = 0;
@@ -22,25 +35,67 @@ void ULT_DeInit(void (*uart_disable)(void), void (*uart_485_disable)(void)) {
   uart_485_disable();
 }
 
+/* Sleeps in Stop mode until `frames` valid frames have been received on
+ * USART1 or `timeout` ms have passed. A start bit on USART1 or the RTC
+ * alarm of the timeout wakes the MCU up; Stop is vetoed while the rest of
+ * a started frame is due, and not entered when a byte or the timeout came
+ * in after the buffer was looked at. Returns the frames found. */
+uint8_t ULT_WaitFrame(uint8_t frames, uint32_t timeout) {
+  uint8_t num = 0;
+
+  ult_timeout = 0;
+  TimerInit(&ULTTimeoutTimer, OnULTTimeoutEvent);
+  TimerSetValue(&ULTTimeoutTimer, timeout);
+  TimerStart(&ULTTimeoutTimer);
+  My_UARTEx_StopModeWakeUp(&huart1);
+
+  while (ult_timeout == 0) {
+    ult_seen = rxlen_u1;
+    if (ult_seen >= ULT_FRAME_SIZE) {
+      num = ULT_Check_Sum();
+      if (num >= frames)
+        break;
+    }
+    LPM_SetStopMode(LPM_ULT_Id,
+                    (ult_seen % ULT_FRAME_SIZE) ? LPM_Disable : LPM_Enable);
+    LPM_EnterStopMode(SystemClock_Config, ULT_Ready);
+  }
+
+  LPM_SetStopMode(LPM_ULT_Id, LPM_Enable);
+  TimerStop(&ULTTimeoutTimer);
+  HAL_UARTEx_DisableStopMode(&huart1);
+  if (ult_timeout == 1) {
+    user_main_debug("ULT timeout, %d frame(s), %d byte(s)", num, rxlen_u1);
+  }
+
+  return num;
+}
+
 uint8_t ULT_Connection_Test() {
   uint8_t state = 0;
   HAL_UART_Receive_IT(&huart1, (uint8_t *)&rxbuf_u1, RXSIZE);
-  HAL_Delay(100);
-  HAL_Delay(3000);
-  if (rxDATA_u1[0] == 0xFF || rxDATA_u1[1] == 0xFF || rxDATA_u1[2] == 0xFF ||
-      rxDATA_u1[3] == 0xFF)
+  if (ULT_WaitFrame(1, ULT_TEST_TIMEOUT) > 0)
+    state = 1;
+  else if (rxDATA_u1[0] == 0xFF || rxDATA_u1[1] == 0xFF ||
+           rxDATA_u1[2] == 0xFF || rxDATA_u1[3] == 0xFF)
     state = 1;
   return state;
 }
 
-void ULT_getData() { HAL_Delay(2000); }
+void ULT_getData() { ULT_WaitFrame(ULT_FRAMES, ULT_DATA_TIMEOUT); }
 
+/* The mean of the valid frames received, 0 without any: a frame left
+ * from an earlier reading is not counted. */
 int ULT_Data_processing(void) {
-  ULT_Check_Sum();
-  ULT_Data_Read();
+  uint8_t frames = ULT_Check_Sum();
+  uint32_t sum = 0;
   uint16_t distanceSum = 0;
 
-  distanceSum = (receive_data_ult_check[0] + receive_data_ult_check[1]) / 2;
+  ULT_Data_Read();
+  for (uint8_t i = 0; i < frames; i++)
+    sum += receive_data_ult_check[i];
+  if (frames > 0)
+    distanceSum = sum / frames;
   if (tdc_clock_log_flag == 0)
     user_main_printf("distance:%d", distanceSum);
   return distanceSum;
@@ -58,9 +113,9 @@ void ULT_Data_Read(void) {
   //	rxDATA_u1[8], rxDATA_u1[9], rxDATA_u1[10]);
 }
 
-void ULT_Check_Sum(void) {
+uint8_t ULT_Check_Sum(void) {
   uint8_t n = 0, m = 0;
-  for (uint8_t i = 0; i < 30; i++) {
+  while (n + ULT_FRAME_SIZE <= rxlen_u1) {
     if (rxDATA_u1[n] == 0xFF) {
       if (rxDATA_u1[n + 3] ==
           ((rxDATA_u1[n] + rxDATA_u1[n + 1] + rxDATA_u1[n + 2]) & 0x00FF)) {
@@ -76,7 +131,8 @@ void ULT_Check_Sum(void) {
       n++;
     }
 
-    if (m >= 2)
+    if (m >= ULT_FRAMES)
       break;
   }
+  return m;
 }
@@ -1,4 +1,7 @@
 #include "weight.h"
+#include "flash_eraseprogram.h"
+#include "low_power_manager.h"
+#include "time_server.h"
 
 uint32_t HX711_Buffer = 0;
 uint32_t Weight_Maopi = 0;
@@ -26,9 +29,13 @@ void WEIGHT_DOUT_Init(void) {
   HW_GPIO_Init(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN, &GPIO_InitStruct);
 }
 
+/* SCK is left pulled up rather than floating: a low SCK would wake the
+ * HX711 out of power-down between two reads */
 void WEIGHT_SCK_DeInit(void) {
   GPIO_InitTypeDef GPIO_InitStruct = {0};
 
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
   HW_GPIO_Init(WEIGHT_SCK_PORT, WEIGHT_SCK_PIN, &GPIO_InitStruct);
 }
 
@@ -38,42 +45,181 @@ void WEIGHT_DOUT_DeInit(void) {
   HW_GPIO_Init(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN, &GPIO_InitStruct);
 }
 
+/* DOUT (PB7) shares EXTI line 7 with the user key (PA7). While a read waits
+ * for DOUT to fall the line is borrowed, and handed back afterwards. */
+static volatile uint8_t hx711_wait = 0;
+static volatile uint8_t hx711_ready = 0;
+static volatile uint8_t hx711_expired = 0;
+static uint8_t hx711_timeout = 0;
+static TimerEvent_t HX711Timer;
+
+uint8_t HX711_IsWaiting(void) { return hx711_wait; }
+
+void HX711_DoutReady(void) { hx711_ready = 1; }
+
+static void OnHX711Timeout(void) { hx711_expired = 1; }
+
+/* Sleeps until DOUT falls, woken by its edge or by the RTC alarm of the
+ * timeout. SysTick is suspended meanwhile, as it would wake the core every
+ * ms of the up to 400 ms settling. The flags are tested with interrupts
+ * masked: an edge or the alarm after the test leaves its interrupt pending,
+ * which ends WFI at once, and the handler runs once unmasked. */
+static uint8_t HX711_WaitReady(uint32_t timeout) {
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t primask;
+
+  if (HAL_GPIO_ReadPin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN) == GPIO_PIN_RESET)
+    return 1;
+
+  hx711_ready = 0;
+  hx711_expired = 0;
+  hx711_wait = 1;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HW_GPIO_Init(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN, &GPIO_InitStruct);
+  TimerInit(&HX711Timer, OnHX711Timeout);
+  TimerSetValue(&HX711Timer, timeout);
+  TimerStart(&HX711Timer);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  HAL_SuspendTick();
+  while (hx711_ready == 0 && hx711_expired == 0 &&
+         HAL_GPIO_ReadPin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN) == GPIO_PIN_SET) {
+    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    __set_PRIMASK(primask);
+    __disable_irq();
+  }
+  HAL_ResumeTick();
+  __set_PRIMASK(primask);
+  TimerStop(&HX711Timer);
+
+  /* give EXTI line 7 back to the user key before releasing DOUT */
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HW_GPIO_Init(GPIO_USERKEY_PORT, GPIO_USERKEY_PIN, &GPIO_InitStruct);
+  __HAL_GPIO_EXTI_CLEAR_IT(WEIGHT_DOUT_PIN);
+  hx711_wait = 0;
+  WEIGHT_DOUT_Init();
+
+  return HAL_GPIO_ReadPin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN) == GPIO_PIN_RESET;
+}
+
 uint32_t HX711_Read(void) {
-  uint32_t count;
+  uint32_t count = 0;
+  uint32_t primask;
   uint8_t i;
-  HX711_SCK_0;
-  count = 0;
 
-  TimerTime_t currentTime = TimerGetCurrentTime();
-  while (HAL_GPIO_ReadPin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN) !=
-         GPIO_PIN_RESET) {
-    if (TimerGetElapsedTime(currentTime) >= 2000) {
-      break;
-    }
+  /* PD_SCK low wakes the chip up if it was powered down */
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Disable);
+  HX711_SCK_0;
+  hx711_timeout = 0;
+  if (HX711_WaitReady(HX711_READY_TIMEOUT) == 0) {
+    hx711_timeout = 1;
+    user_main_debug("HX711 not ready");
   }
 
+  /* PD_SCK high for more than 60us powers the chip down, keep it short */
+  primask = __get_PRIMASK();
+  __disable_irq();
   for (i = 0; i < 24; i++) {
     HX711_SCK_1;
     count = count << 1;
     HX711_SCK_0;
-    if (HAL_GPIO_ReadPin(WEIGHT_DOUT_PORT, WEIGHT_DOUT_PIN) == GPIO_PIN_SET)
+    if (WEIGHT_DOUT_PORT->IDR & WEIGHT_DOUT_PIN)
       count++;
   }
+  /* 25th pulse selects channel A, gain 128 for the next conversion */
   HX711_SCK_1;
   count = count ^ 0x800000;
   HX711_SCK_0;
+  __set_PRIMASK(primask);
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Enable);
+
   return (count);
 }
 
+void HX711_PowerDown(void) {
+  /* held high until the next HX711_Read() */
+  HX711_SCK_1;
+}
+
+static uint32_t median3(uint32_t a, uint32_t b, uint32_t c) {
+  if (a > b) {
+    uint32_t t = a;
+    a = b;
+    b = t;
+  }
+  if (b > c)
+    b = c;
+  return (a > b) ? a : b;
+}
+
+uint32_t HX711_ReadFiltered(uint8_t n) {
+  uint32_t raw[HX711_SAMPLES_MAX];
+  uint32_t sum = 0;
+  uint8_t num = 0;
+
+  if (n > HX711_SAMPLES_MAX)
+    n = HX711_SAMPLES_MAX;
+
+  for (uint8_t i = 0; i < n; i++) {
+    raw[num] = HX711_Read();
+    if (hx711_timeout == 1)
+      break;
+    num++;
+  }
+  HX711_PowerDown();
+
+  if (num == 0) {
+    hx711_timeout = 1;
+    return Weight_Maopi;
+  }
+  hx711_timeout = 0;
+
+  /* median of each sample and its neighbours kills single spikes; the
+   * first and last samples take the window of their inner neighbour, so
+   * that a spike at either end is not counted twice */
+  for (uint8_t i = 0; i < num; i++) {
+    uint8_t j = (i == 0) ? 0 : (i == num - 1) ? i - 2 : i - 1;
+
+    if (num < 3)
+      sum += raw[i];
+    else
+      sum += median3(raw[j], raw[j + 1], raw[j + 2]);
+  }
+  return sum / num;
+}
+
+uint8_t Weight_Tare_Load(void) {
+  if (*(__IO uint32_t *)EEPROM_USER_WEIGHT_TARE_FLAG != HX711_TARE_VALID)
+    return 0;
+
+  Weight_Maopi = *(__IO uint32_t *)EEPROM_USER_WEIGHT_TARE;
+  user_main_debug("Weight_Maopi %d (stored)\r\n", Weight_Maopi);
+  return 1;
+}
+
 void Get_Maopi(void) {
-  Weight_Maopi = HX711_Read();
+  Weight_Maopi = HX711_ReadFiltered(HX711_SAMPLES);
   user_main_debug("Weight_Maopi %d \r\n", Weight_Maopi);
   //	user_main_printf("Weight_Maopi %d \r\n",Weight_Maopi);
+  if (hx711_timeout == 1)
+    return;
+
+  /* the tare before its flag: a reset in between leaves no flag on a
+   * first tare, and the flag is only written once */
+  EEPROM_program(EEPROM_USER_WEIGHT_TARE, &Weight_Maopi, 1);
+  if (*(__IO uint32_t *)EEPROM_USER_WEIGHT_TARE_FLAG != HX711_TARE_VALID) {
+    uint32_t valid = HX711_TARE_VALID;
+
+    EEPROM_program(EEPROM_USER_WEIGHT_TARE_FLAG, &valid, 1);
+  }
 }
 
 int32_t Get_Weight(void) {
   //	user_main_printf("Weight_Maopi %d \r\n",HX711_Read());
-  HX711_Buffer = HX711_Read();
+  HX711_Buffer = HX711_ReadFiltered(HX711_SAMPLES);
   if (HX711_Buffer != Weight_Maopi) {
     Weight_Shiwu = HX711_Buffer - Weight_Maopi;
 
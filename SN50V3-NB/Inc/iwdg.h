@@ -34,7 +34,14 @@ extern "C" {
 extern IWDG_HandleTypeDef hiwdg;
 
 /* USER CODE BEGIN Private defines */
-
+/* Prescaler and reload of MX_IWDG_Init(), and the time the IWDG takes to
+ * expire with the fastest LSI of the STM32L072 datasheet */
+#define IWDG_PRESCALER IWDG_PRESCALER_256
+#define IWDG_RELOAD_VALUE 4095
+#define IWDG_LSI_MAX 56000 // Hz
+#define IWDG_DIVIDER (4UL << IWDG_PRESCALER)
+#define IWDG_TIMEOUT_MIN                                                       \
+  ((IWDG_RELOAD_VALUE + 1) * IWDG_DIVIDER * 1000 / IWDG_LSI_MAX) // ms
 /* USER CODE END Private defines */
 
 void MX_IWDG_Init(void);
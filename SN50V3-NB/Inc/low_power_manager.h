@@ -95,75 +95,21 @@ LPM_GetMode_t LPM_GetMode(void);
 void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode);
 
 void LPM_SetOffMode(LPM_Id_t id, LPM_SetMode_t mode);
-/**
- * @brief  This API shall be used by the application when there is no more code
- * to execute so that the system may enter low-power mode. The mode selected
- * depends on the information received from LPM_OffModeSelection() and
- *         LPM_SysclockRequest()
- *         This function shall be called in critical section
- * @param  None
- * @retval None
- */
-void LPM_EnterLowPower(void);
-
-/**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * entering Sleep Mode
- * @param  None
- * @retval None
- */
-void LPM_EnterSleepMode(void);
 
 /**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * getting out from Sleep Mode
+ * @brief  This API returns the users currently disallowing Stop mode
  * @param  None
- * @retval None
+ * @retval Bitmask of LPM_Id_t
  */
-void LPM_ExitSleepMode(void);
+uint32_t LPM_GetStopModeVeto(void);
 
 /**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * entering Stop Mode
- * @param  None
- * @retval None
- */
-void LPM_EnterStopMode(void);
-
-/**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * getting out from Stop Mode. This is where the application should reconfigure
- * the clock tree when needed
- * @param  None
- * @retval None
- */
-void LPM_ExitStopMode(void);
-
-/**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * entering Off mode. This is where the application could save data in the
- * retention memory as the RAM memory content will be lost
- * @param  None
- * @retval None
- */
-void LPM_EnterOffMode(void);
-
-/**
- * @brief  This API is called by the low power manager in a critical section
- * (PRIMASK bit set) to allow the application to implement dedicated code before
- * getting out from Off mode. This can only happen when the Off mode is finally
- * not entered. In that case, the application may reverse some configurations
- * done before entering Off mode. When Off mode is successful, the system is
- * reset when getting out from this low-power mode
- * @param  None
- * @retval None
+ * @brief  This API returns how long the specified users have been disallowing
+ * Stop mode, the longest one when several are given
+ * @param  id: process Id, or several OR-ed together
+ * @retval Time in ms, 0 if none of them disallows Stop mode
  */
-void LPM_ExitOffMode(void);
+uint32_t LPM_GetStopModeVetoTime(LPM_Id_t id);
 
 #ifdef __cplusplus
 }
@@ -62,8 +62,16 @@ typedef enum {
   LPM_GPS_Id = (1 << 3),
   LPM_UART_RX_Id = (1 << 4),
   LPM_UART_TX_Id = (1 << 5),
+  LPM_MODEM_RX_Id = (1 << 6), // modem line partially received
+  LPM_MODEM_TX_Id = (1 << 7), // LPUART1 DMA transmit in progress
+  LPM_1WIRE_Id = (1 << 8),    // DS18B20 transaction
+  LPM_HX711_Id = (1 << 9),    // HX711 conversion and readout
+  LPM_ULT_Id = (1 << 10),     // ULT frame partially received
+  LPM_FLASH_Id = (1 << 11),   // flash/EEPROM erase or program
 } LPM_Id_t;
 
+#define LPM_ID_NUM 12
+
 //#define OutputInit  vcom_Init
 //#define OutputTrace vcom_Trace
 
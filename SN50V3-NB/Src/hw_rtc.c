@@ -255,12 +255,6 @@ static void HW_RTC_SetConfig(void) {
   sAlarm.AlarmDateWeekDay = 0x1;
   sAlarm.Alarm = RTC_ALARM_A;
   HAL_RTC_SetAlarm_IT(&RtcHandle, &sAlarm, RTC_FORMAT_BCD);
-
-  /** Enable the Alarm B
-   */
-  sAlarm.AlarmTime.Seconds = 0x5;
-  sAlarm.Alarm = RTC_ALARM_B;
-  HAL_RTC_SetAlarm_IT(&RtcHandle, &sAlarm, RTC_FORMAT_BCD);
 }
 
 /*!
@@ -37,9 +37,9 @@ void MX_IWDG_Init(void) {
 
   /* USER CODE END IWDG_Init 1 */
   hiwdg.Instance = IWDG;
-  hiwdg.Init.Prescaler = IWDG_PRESCALER_256;
-  hiwdg.Init.Window = 4095;
-  hiwdg.Init.Reload = 4095;
+  hiwdg.Init.Prescaler = IWDG_PRESCALER;
+  hiwdg.Init.Window = IWDG_RELOAD_VALUE;
+  hiwdg.Init.Reload = IWDG_RELOAD_VALUE;
   if (HAL_IWDG_Init(&hiwdg) != HAL_OK) {
     Error_Handler();
   }
@@ -55,6 +55,7 @@
 /* Private variables ---------------------------------------------------------*/
 static uint32_t StopModeDisable = 0;
 static uint32_t OffModeDisable = 0;
+static uint32_t StopModeDisableTime[LPM_ID_NUM]; /* RTC ticks, when vetoed */
 
 /* Global variables ----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
@@ -89,6 +90,9 @@ void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode) {
 
   switch (mode) {
   case LPM_Disable: {
+    for (uint8_t i = 0; i < LPM_ID_NUM; i++)
+      if ((id & ~StopModeDisable) & (1UL << i))
+        StopModeDisableTime[i] = HW_RTC_GetTimerValue();
     StopModeDisable |= (uint32_t)id;
     break;
   }
@@ -104,32 +108,6 @@ void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode) {
   return;
 }
 
-void LPM_EnterLowPower(void) {
-  if (StopModeDisable) {
-    /**
-     * SLEEP mode is required
-     */
-    LPM_EnterSleepMode();
-    LPM_ExitSleepMode();
-  } else {
-    if (OffModeDisable) {
-      /**
-       * STOP mode is required
-       */
-      LPM_EnterStopMode();
-      LPM_ExitStopMode();
-    } else {
-      /**
-       * OFF mode is required
-       */
-      LPM_EnterOffMode();
-      LPM_ExitOffMode();
-    }
-  }
-
-  return;
-}
-
 LPM_GetMode_t LPM_GetMode(void) {
   LPM_GetMode_t mode_selected;
 
@@ -152,11 +130,26 @@ LPM_GetMode_t LPM_GetMode(void) {
   return mode_selected;
 }
 
-__weak void LPM_EnterSleepMode(void) {}
-__weak void LPM_ExitSleepMode(void) {}
-__weak void LPM_EnterStopMode(void) {}
-__weak void LPM_ExitStopMode(void) {}
-__weak void LPM_EnterOffMode(void) {}
-__weak void LPM_ExitOffMode(void) {}
+uint32_t LPM_GetStopModeVeto(void) { return StopModeDisable; }
+
+uint32_t LPM_GetStopModeVetoTime(LPM_Id_t id) {
+  uint32_t ticks = 0;
+
+  BACKUP_PRIMASK();
+
+  DISABLE_IRQ();
+
+  for (uint8_t i = 0; i < LPM_ID_NUM; i++) {
+    if ((StopModeDisable & (uint32_t)id) & (1UL << i)) {
+      uint32_t elapsed = HW_RTC_GetTimerValue() - StopModeDisableTime[i];
+      if (elapsed > ticks)
+        ticks = elapsed;
+    }
+  }
+
+  RESTORE_PRIMASK();
+
+  return HW_RTC_Tick2ms(ticks);
+}
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
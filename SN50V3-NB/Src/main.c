@@ -31,9 +31,11 @@
 /* USER CODE BEGIN Includes */
 #include "at.h"
 #include "cmox_crypto.h"
+#include "event.h"
 #include "hw_rtc.h"
 #include "lowpower.h"
 #include "nbInit.h"
+#include "nb_step.h"
 //#include "low_power_manager.h"
 //#include "vcom.h"
 
@@ -60,7 +62,6 @@
 
 /* Private macro -------------------------------------------------------------*/
 /* USER CODE BEGIN PM */
-#define LOCKOUT_INT_DELAY 500
 /* USER CODE END PM */
 
 /* Private variables ---------------------------------------------------------*/
@@ -70,6 +71,20 @@
 #define ID2 0x1FF80054
 #define ID3 0x1FF80064
 
+/* The IWDG keeps running in Stop mode and expires after 18.7 s with the
+ * fastest LSI, so it is refreshed at least every 16 s. The timer may fire
+ * after the other callbacks due on the same alarm, hence the margin. */
+#define IWDG_REFRESH_TIME 12000
+#define IWDG_REFRESH_SLACK 4000
+#define IWDG_REFRESH_MARGIN 1000
+#if IWDG_REFRESH_TIME + IWDG_REFRESH_SLACK + IWDG_REFRESH_MARGIN >            \
+    IWDG_TIMEOUT_MIN
+#error "The IWDG refresh timer may fire after the IWDG expires"
+#endif
+#define PWD_TIMEOUT 300000    // ms, console password session
+#define CSQ_RETRY_TIME 10000  // ms, between two signal queries
+#define UPLINK_TIMEOUT 120000 // ms, without reply to an uplink
+
 uint8_t rxbuf = 0;
 static uint16_t rxlen = 0;
 static uint8_t rxDATA[300] = {0};
@@ -86,17 +101,12 @@ extern int32_t Weight_Shiwu;
 extern uint16_t adc0_datalog, adc1_datalog, adc4_datalog;
 extern uint16_t distance_datalog;
 extern uint8_t mode2_flag;
-static uint8_t pwd_time_count = 0; // Password time count times
-
-static uint16_t dns_time_count = 0; // DNS time count times
-
 static uint8_t task_num = _AT_IDLE; // NB task directory
 extern bool no_singal_flag;
 uint8_t error_num = 0;          // Error count
 uint8_t press_button_times = 0; // Press the button times in a row fast
 uint8_t is_time_to_send = 0;
 static uint8_t dns_reset_num;
-static uint8_t uplink_time_num = 0;
 uint8_t nbmodel_int = 0;
 bool at_sleep_flag = 0;
 uint8_t OnPressButtonTimeout_status = 0;
@@ -104,16 +114,13 @@ uint8_t join_network_num = 0;
 uint8_t PressButtonTimeoutTime = 0;
 uint8_t user_key_duration = 0;
 uint8_t join_network_flag = 0;
-uint8_t join_network_time = 0;
 uint8_t join_network_timer = 0;
-uint8_t nds_network_time = 0;
 uint8_t nds_timer_flag = 0;
 uint8_t nds_timer_flag2 = 0;
 uint8_t user_key_exti_flag = 0;
 extern int32_t cal_time_difference;
 extern bool clock_cal_time_flag;
 
-uint32_t lastCountInt = 0;
 
 bool first_clock_flag = 0;
 uint8_t first_clock_time = 0;
@@ -133,6 +140,13 @@ TimerEvent_t PressButtonTimeoutTimer;
 TimerEvent_t nb_intTimeoutTimer;
 TimerEvent_t timesampleTimer;
 TimerEvent_t CalibrationtimeTimer;
+TimerEvent_t IwdgRefreshTimer;
+TimerEvent_t PwdTimeoutTimer;
+TimerEvent_t DnsTimer;
+TimerEvent_t CsqRetryTimer;
+TimerEvent_t JoinNetworkTimer;
+TimerEvent_t UplinkTimeoutTimer;
+TimerEvent_t CoapRetransmitTimer;
 void LoraStartTx(void);
 void OnTxTimerEvent(void);
 void OnCheckBLETimesEvent(void);
@@ -147,8 +161,21 @@ void user_key_event(void);
 void OntimesampleEvent(void);
 void compare_time(uint16_t time);
 void onCalibrationtimeEvent(void);
+void OnIwdgRefreshEvent(void);
+void OnPwdTimeoutEvent(void);
+void OnDnsTimerEvent(void);
+void OnCsqRetryEvent(void);
+void OnJoinNetworkTimeoutEvent(void);
+void OnUplinkTimeoutEvent(void);
+void OnCoapRetransmitEvent(void);
 /* USER CODE BEGIN PFP */
+static void NbTaskStart(uint8_t task);
+static void NbTaskHandler(void);
+static void UplinkHandler(void);
+static void UserHandler(void);
 static void USERTASK(void);
+static void TimeoutTimersUpdate(void);
+static uint8_t ModemEnergyState(void);
 void HW_GetUniqueId(uint8_t *id);
 /* USER CODE END PFP */
 
@@ -173,7 +200,7 @@ int main(void) {
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  Event_Init();
   /* USER CODE END Init */
 
   /* Configure the system clock */
@@ -195,10 +222,14 @@ int main(void) {
   HW_RTC_Init();
   HW_RTC_SetTimerContext();
   MX_ADC_Init();
+  HW_AdcCalibrate();
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Disable); // Standby would lose the RAM
   new_firmware_update();
   config_Get();
+  AT_Init();
+  Energy_Init();
   GPIO_BLE_STATUS_Ioinit();
   rename_ble();
   LoraStartCheckBLE();
@@ -213,21 +244,37 @@ int main(void) {
   My_UARTEx_StopModeWakeUp(&huart2);   // Enable serial port wake up
   My_UARTEx_StopModeWakeUp(&hlpuart1); // Enable serial port wake up
   TimerInit(&CalibrationtimeTimer, onCalibrationtimeEvent);
+  TimerSetSlack(&CalibrationtimeTimer, TIMER_PERIOD_SLACK(86400000));
   onCalibrationtimeEvent();
+  TimerInit(&PwdTimeoutTimer, OnPwdTimeoutEvent);
+  TimerInit(&DnsTimer, OnDnsTimerEvent);
+  TimerInit(&CsqRetryTimer, OnCsqRetryEvent);
+  TimerInit(&JoinNetworkTimer, OnJoinNetworkTimeoutEvent);
+  TimerInit(&UplinkTimeoutTimer, OnUplinkTimeoutEvent);
+  TimerInit(&CoapRetransmitTimer, OnCoapRetransmitEvent);
+  NbStep_Init();
+#ifndef ST_DEBUG
+  TimerInit(&IwdgRefreshTimer, OnIwdgRefreshEvent);
+  TimerSetValue(&IwdgRefreshTimer, IWDG_REFRESH_TIME);
+  TimerSetSlack(&IwdgRefreshTimer, IWDG_REFRESH_SLACK);
+  TimerStart(&IwdgRefreshTimer);
+#endif
   MX_CRC_Init();
+  Auth_Init();
+  Aead_Init();
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
 #ifdef NBIOT
   if ((*(__IO uint8_t *)EEPROM_USER_START_FDR_FLAG) == 0x01) {
-    task_num = _AT_FLAG_INIT;
+    NbTaskStart(_AT_FLAG_INIT);
     HAL_FLASHEx_DATAEEPROM_Unlock();
     HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD,
                                    EEPROM_USER_START_FDR_FLAG, 0x00);
     HAL_FLASHEx_DATAEEPROM_Lock();
   } else
-    task_num = _AT_FLAG_INIT;
+    NbTaskStart(_AT_FLAG_INIT);
 #else
   task_num = _AT_IDLE;
 #endif
@@ -236,95 +283,34 @@ int main(void) {
 
     /* USER CODE BEGIN 3 */
 
-#ifdef NBIOT
-
-    if (task_num != _AT_IDLE) {
-      HAL_Delay(1000);
+    if (LPM_WakeWork() == LPM_WAKE_RUN)
+      LPM_RunClock(SystemClock_Config);
 
-      if (NBTASK(&task_num) == _AT_ERROR) {
-        error_num++;
-      }
-    }
-    if ((error_num > 6 && nb.uplink_flag == no_status) || (error_num > 6)) {
-      user_main_printf("Restart the module...");
-      task_num = _AT_QRST;
-      error_num = 0;
-      MX_LPUART1_UART_Init();
-      HAL_UART_Receive_IT(&hlpuart1, rxbuf_lp, RXSIZE);
-      My_UARTEx_StopModeWakeUp(&hlpuart1);
-    }
-    if (dns_reset_num > 2) {
-      NVIC_SystemReset();
-      dns_reset_num = 0;
-    }
-    if (/*nb.recieve_flag == NB_RECIEVE &&*/ nb.uplink_flag == send &&
-        task_num == _AT_IDLE && sleep_status == 0) {
-      task_num = _AT_URI;
-      nb.recieve_flag = NB_IDIE;
-    }
-    if (getsensorvalue_flag == 1 && nb.uplink_flag == no_status &&
-        sleep_status == 0) {
-      task_num = _AT_QSCLKOFF;
-      nb.uplink_flag = send;
-      NBTASK(&task_num);
-      getsensorvalue_flag = 0;
-    }
+    uint32_t signals = Event_TakeSignals();
 
-    if (is_time_to_send == 1 && nb.uplink_flag == no_status &&
-        sleep_status == 0) {
-      if (nb.net_flag == no_status) {
-        task_num = _AT_FLAG_INIT;
-        is_time_to_send = 0;
-      } else if (nb.net_flag == success) {
-        task_num = _AT_QSCLKOFF;
-        nb.uplink_flag = send;
-        is_time_to_send = 0;
-      }
+#ifdef NBIOT
+    Energy_Modem(ModemEnergyState());
 
-      LPM_DisableStopMode();
-    }
+    if (signals & EVENT_SIGNAL_NB)
+      NbTaskHandler();
 #endif
-
-    USERTASK();
-
-    if (ble_sleep_command == 1) {
-      HAL_Delay(50);
-      printf("AT+PWRM2\r\n");
-      HAL_Delay(100);
-      ble_sleep_command = 0;
-      ble_sleep_flags = 1;
+    if (signals & EVENT_SIGNAL_UPLINK)
+      UplinkHandler();
+    if (signals & EVENT_SIGNAL_LOG)
+      Event_Process();
+    if (signals & EVENT_SIGNAL_USER)
+      UserHandler();
+    if (signals & EVENT_SIGNAL_KEY) {
+      user_key_event();
+      Event_Signal(EVENT_SIGNAL_UPLINK);
     }
 
-    user_key_event();
-
-    if (at_sleep_flag == 1 && nb.uplink_flag == no_status) {
-      EX_GPIO_Init(0);
-      at_sleep_flag = 0;
-      sleep_status = 1;
-      TimerStop(&CheckBLETimesTimer);
-      TimerStop(&TxTimer);
-      TimerStop(&timesampleTimer);
-      TimerStop(&CalibrationtimeTimer);
-      task_num = _AT_CFUNOFF;
-      NBTASK(&task_num);
-
-      HAL_Delay(500);
-      TimerInit(&PressButtonTimesLedTimer, OnPressButtonTimesLedEvent);
-      TimerSetValue(&PressButtonTimesLedTimer, 5000);
-      HAL_GPIO_WritePin(LED_RGB_PORT, LED_RED_PIN, GPIO_PIN_SET);
-      TimerStart(&PressButtonTimesLedTimer);
-
-      ble_sleep_command = 0;
-      ble_sleep_flags = 1;
-      HAL_Delay(50);
-      printf("AT+PWRM2\r\n");
-      HAL_Delay(100);
-      printf("SLEEP\r\n");
-    }
+    TimeoutTimersUpdate();
+    Energy_Modem(ModemEnergyState());
 
 #ifdef lowpower_enter
-    if (task_num == _AT_IDLE && uart2_recieve_flag == 0) {
-      LPM_EnterStopMode(SystemClock_Config);
+    if (Event_PendingSignals() == 0) {
+      LPM_Idle(SystemClock_Config);
     }
 #endif
   }
@@ -389,11 +375,104 @@ void SystemClock_Config(void) {
 }
 
 /* USER CODE BEGIN 4 */
-static void USERTASK(void) {
-  if (sys.pwd_flag == 1 && sys.pwd_flag == 0 && pwd_time_count == 0) {
-    HAL_UART_Transmit(&huart2, (uint8_t *)"Password timeout\r\n", 20, 20);
+/* Set the next NB task step and have the main loop run it */
+static void NbTaskStart(uint8_t task) {
+  task_num = task;
+  Event_Signal(EVENT_SIGNAL_NB);
+}
+
+/* One NB task step, the next one paced by nb_step.c */
+static void NbTaskHandler(void) {
+  if (NbStep_Run(&task_num) == _AT_ERROR)
+    error_num++;
+  if ((error_num > 6 && nb.uplink_flag == no_status) || (error_num > 6)) {
+    user_main_printf("Restart the module...");
+    NbTaskStart(_AT_QRST);
+    error_num = 0;
+    MX_LPUART1_UART_Init();
+    HAL_UART_Receive_IT(&hlpuart1, rxbuf_lp, RXSIZE);
+    My_UARTEx_StopModeWakeUp(&hlpuart1);
+  }
+  if (dns_reset_num > 2) {
+    config_Flush();
+    NVIC_SystemReset();
+    dns_reset_num = 0;
+  }
+  // The step may have ended an uplink, which releases the pending requests
+  Event_Signal(EVENT_SIGNAL_UPLINK | EVENT_SIGNAL_USER);
+}
+
+static void UplinkHandler(void) {
+#ifdef NBIOT
+  if (/*nb.recieve_flag == NB_RECIEVE &&*/ nb.uplink_flag == send &&
+      task_num == _AT_IDLE && sleep_status == 0) {
+    NbTaskStart(_AT_URI);
+    nb.recieve_flag = NB_IDIE;
+  }
+  if (getsensorvalue_flag == 1 && nb.uplink_flag == no_status &&
+      sleep_status == 0) {
+    NbTaskStart(_AT_QSCLKOFF);
+    nb.uplink_flag = send;
+    NBTASK(&task_num);
+    getsensorvalue_flag = 0;
+  }
+
+  if (is_time_to_send == 1 && nb.uplink_flag == no_status &&
+      sleep_status == 0) {
+    if (nb.net_flag == no_status) {
+      NbTaskStart(_AT_FLAG_INIT);
+      is_time_to_send = 0;
+    } else if (nb.net_flag == success) {
+      NbTaskStart(_AT_QSCLKOFF);
+      nb.uplink_flag = send;
+      is_time_to_send = 0;
+    }
+  }
+#endif
+
+  if (at_sleep_flag == 1 && nb.uplink_flag == no_status) {
+    config_Flush();
+    EX_GPIO_Init(0);
+    at_sleep_flag = 0;
+    sleep_status = 1;
+    TimerStop(&CheckBLETimesTimer);
+    TimerStop(&TxTimer);
+    TimerStop(&timesampleTimer);
+    TimerStop(&CalibrationtimeTimer);
+    NbTaskStart(_AT_CFUNOFF);
+    NBTASK(&task_num);
+
+    HAL_Delay(500);
+    TimerInit(&PressButtonTimesLedTimer, OnPressButtonTimesLedEvent);
+    TimerSetValue(&PressButtonTimesLedTimer, 5000);
+    HAL_GPIO_WritePin(LED_RGB_PORT, LED_RED_PIN, GPIO_PIN_SET);
+    TimerStart(&PressButtonTimesLedTimer);
+
+    ble_sleep_command = 0;
+    ble_sleep_flags = 1;
+    HAL_Delay(50);
+    printf("AT+PWRM2\r\n");
+    HAL_Delay(100);
+    printf("SLEEP\r\n");
+  }
+}
+
+static void UserHandler(void) {
+  USERTASK();
+  config_Task();
+
+  if (ble_sleep_command == 1) {
+    HAL_Delay(50);
+    printf("AT+PWRM2\r\n");
+    HAL_Delay(100);
+    ble_sleep_command = 0;
+    ble_sleep_flags = 1;
   }
+  // AT commands may have requested a sensor read, an uplink or sleep
+  Event_Signal(EVENT_SIGNAL_UPLINK);
+}
 
+static void USERTASK(void) {
   if (sys.pwd_flag == 0 && uart2_recieve_flag) {
     rtrim((char *)rxDATA);
     if (strcmp((char *)rxDATA, (char *)sys.pwd) == 0 &&
@@ -420,6 +499,7 @@ static void USERTASK(void) {
       memset(nb.usart.data, 0, NB_RX_SIZE);
       rxDATA[strlen((char *)rxDATA)] = '\r';
       rxDATA[strlen((char *)rxDATA)] = '\n';
+      LPM_SetStopMode(LPM_MODEM_TX_Id, LPM_Disable);
       HAL_UART_Transmit_DMA(&hlpuart1, (uint8_t *)rxDATA,
                             strlen((char *)rxDATA));
       HAL_Delay(1500); // Waiting to Send
@@ -459,13 +539,13 @@ static void USERTASK(void) {
       HAL_Delay(3000);
       if (NBTask[_AT_QDNS].get(NULL) == NB_CMD_SUCC) {
         if (nds_timer_flag2 == 0) {
-          task_num = _AT_UPLOAD_START;
+          NbTaskStart(_AT_UPLOAD_START);
         }
         dns_reset_num = 0;
         break;
       } else {
         if (nds_timer_flag2 == 0) {
-          task_num = _AT_QRST;
+          NbTaskStart(_AT_QRST);
 
           if (dns_num == 0)
             dns_reset_num++;
@@ -482,15 +562,21 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
     if (task_num == _AT_IDLE) {
       if (rxbuf_lp[1] == '\r' && rxbuf_lp[0] == '\n') {
         lpuart_recieve_flag = 1;
+        Event_Signal(EVENT_SIGNAL_USER);
       }
     }
+    LPM_SetStopMode(LPM_MODEM_RX_Id,
+                    rxbuf_lp[0] == '\n' ? LPM_Enable : LPM_Disable);
     rxbuf_lp[1] = rxbuf_lp[0];
     HAL_UART_Receive_IT(&hlpuart1, rxbuf_lp, RXSIZE);
   } else if (huart == &huart2) {
     rxDATA[rxlen++] = rxbuf;
     if (rxbuf == '\r' || rxbuf == '\n') {
       uart2_recieve_flag = 1;
-    }
+      Event_Signal(EVENT_SIGNAL_USER);
+      LPM_SetStopMode(LPM_UART_RX_Id, LPM_Enable);
+    } else
+      LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
     HAL_UART_Receive_IT(&huart2, (uint8_t *)&rxbuf, RXSIZE);
   } else if (huart == &huart1) {
     if (rxlen_u1 < 40)
@@ -499,69 +585,170 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
   }
 }
 
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+  if (huart == &hlpuart1)
+    LPM_SetStopMode(LPM_MODEM_TX_Id, LPM_Enable);
+}
+
 void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc) { TimerIrqHandler(); }
 
-void HAL_RTCEx_AlarmBEventCallback(RTC_HandleTypeDef *hrtc) {
+void OnIwdgRefreshEvent(void) {
   HAL_IWDG_Refresh(&hiwdg);
+  TimerStart(&IwdgRefreshTimer);
+}
+
+void OnPwdTimeoutEvent(void) {
+  if (sys.pwd_flag == 1)
+    sys.pwd_flag = 0;
+}
+
+void OnDnsTimerEvent(void) {
+  if (sys.dns_timer == 1 && sleep_status == 0) {
+    nds_timer_flag = 1;
+    nds_timer_flag2 = 1;
+    NbTaskStart(_AT_QDNS);
+    Event_Post(EVENT_DNS, 0);
+  }
+}
+
+void OnCsqRetryEvent(void) {
+  if (nb.net_flag == fail && sleep_status == 0) {
+    NbTaskStart(_AT_CSQ);
+    join_network_timer = 1;
+  }
+}
+
+void OnJoinNetworkTimeoutEvent(void) {
+  if (join_network_timer == 1 && sleep_status == 0) {
+    join_network_timer = 0;
+    no_singal_flag = 1;
+    nb.net_flag = no_status;
+    NbTaskStart(_AT_CFUNOFF);
+    Event_Post(EVENT_NO_SIGNAL, 0);
+  }
+}
+
+void OnUplinkTimeoutEvent(void) {
+  if (nb.net_flag == success && nb.uplink_flag == send && sleep_status == 0) {
+    error_num++;
+    Event_Post(EVENT_UPLINK_TIMEOUT, error_num);
+    if (sys.protocol == COAP_PRO && sys.coap_mode == COAP_MODEM) {
+      NbTaskStart(_AT_COAP_CLOSE);
+    } else if (sys.protocol == UDP_PRO || sys.protocol == COAP_PRO) {
+      NbTaskStart(_AT_UDP_CLOSE);
+    } else if (sys.protocol == MQTT_PRO) {
+      NbTaskStart(_AT_MQTT_CLOSE);
+    } else if (sys.protocol == TCP_PRO) {
+      NbTaskStart(_AT_TCP_CLOSE);
+    }
+  }
+}
+
+// A confirmable CoAP request got no answer in time
+void OnCoapRetransmitEvent(void) {
+  if (nb.uplink_flag == send && sleep_status == 0 && nb_COAP_timeout() != 0)
+    NbTaskStart(nb_COAP_retransmit() ? _AT_UDP_SEND : _AT_UDP_CLOSE);
+}
+
+/* Modem phase for the energy accounting, from the NB task state */
+static uint8_t ModemEnergyState(void) {
+  if (sleep_status == 1)
+    return ENERGY_MODEM_OFF;
+  if (nb.net_flag == success && nb.uplink_flag == send)
+    return ENERGY_MODEM_CONNECTED;
+  if (task_num == _AT_IDLE)
+    return ENERGY_MODEM_OFF;
+  if (nb.net_flag == success)
+    return ENERGY_MODEM_REGISTERED;
+  return ENERGY_MODEM_ATTACH;
+}
+
+/* Work the main loop has after a Stop wake-up, from the pending signals,
+ * which decides whether the PLL is restarted. The modem, sensor and
+ * storage paths use delay loops calibrated for 32 MHz and need it; console
+ * output and event logs run on HSI16; timer housekeeping alone goes back
+ * to Stop. */
+uint8_t LPM_WakeWork(void) {
+  uint32_t signals = Event_PendingSignals();
+
+  if (signals & (EVENT_SIGNAL_NB | EVENT_SIGNAL_KEY))
+    return LPM_WAKE_RUN;
+  if ((signals & EVENT_SIGNAL_UPLINK) != 0 && at_sleep_flag == 1)
+    return LPM_WAKE_RUN;
+#ifdef NBIOT
+  if ((signals & EVENT_SIGNAL_UPLINK) != 0 && sleep_status == 0 &&
+      (nb.uplink_flag == no_status || task_num == _AT_IDLE) &&
+      (is_time_to_send == 1 || getsensorvalue_flag == 1 ||
+       nb.uplink_flag == send))
+    return LPM_WAKE_RUN;
+  if ((signals & EVENT_SIGNAL_USER) != 0 &&
+      (uart2_recieve_flag == 1 || nb.dns_flag == running ||
+       (tdc_clock_log_flag == 1 && sys.clock_switch == 1 &&
+        nb.uplink_flag != send && sleep_status == 0)))
+    return LPM_WAKE_RUN;
+#endif
+  if (signals != 0)
+    return LPM_WAKE_LIGHT;
+  return LPM_WAKE_SLEEP;
+}
+
+/* Arms the one-shot timeouts that are pending and stops the others, so that
+ * no RTC wake-up is programmed for a timeout that cannot expire. */
+static void TimeoutTimersUpdate(void) {
 #ifdef NBIOT
   if (sys.pwd_flag == 1) {
-    pwd_time_count++;
-    if (pwd_time_count == 30) {
-      sys.pwd_flag = 0;
-      pwd_time_count = 0;
+    if (TimerIsStarted(&PwdTimeoutTimer) == false) {
+      TimerSetValue(&PwdTimeoutTimer, PWD_TIMEOUT);
+      TimerStart(&PwdTimeoutTimer);
     }
-  }
+  } else
+    TimerStop(&PwdTimeoutTimer);
 #endif
 
   if (sys.dns_timer == 1 && sleep_status == 0) {
-    nds_network_time++;
-    if (nds_network_time == (sys.dns_time * 360)) {
-      nds_network_time = 0;
-      nds_timer_flag = 1;
-      nds_timer_flag2 = 1;
-      task_num = _AT_QDNS;
+    if (TimerIsStarted(&DnsTimer) == false) {
+      TimerSetValue(&DnsTimer, sys.dns_time * 3600000);
+      TimerSetSlack(&DnsTimer, TIMER_PERIOD_SLACK(sys.dns_time * 3600000));
+      TimerStart(&DnsTimer);
     }
-  }
+  } else
+    TimerStop(&DnsTimer);
 
   if (nb.net_flag == fail && join_network_flag == 1 && sleep_status == 0) {
-    task_num = _AT_CSQ;
-    join_network_timer = 1;
     join_network_flag = 0;
+    TimerSetValue(&CsqRetryTimer, CSQ_RETRY_TIME);
+    TimerStart(&CsqRetryTimer);
   }
 
+  if (join_network_timer == 1 && sleep_status == 0) {
+    if (TimerIsStarted(&JoinNetworkTimer) == false) {
+      TimerSetValue(&JoinNetworkTimer, sys.csq_time * 60000);
+      TimerStart(&JoinNetworkTimer);
+    }
+  } else
+    TimerStop(&JoinNetworkTimer);
+
   if (nb.net_flag == success && nb.uplink_flag == send && sleep_status == 0) {
-    uplink_time_num++;
-    if (uplink_time_num >= 12) {
-      uplink_time_num = 0;
-      error_num++;
-      if (sys.protocol == COAP_PRO) {
-        task_num = _AT_COAP_CLOSE;
-      } else if (sys.protocol == UDP_PRO) {
-        task_num = _AT_UDP_CLOSE;
-      } else if (sys.protocol == MQTT_PRO) {
-        task_num = _AT_MQTT_CLOSE;
-      } else if (sys.protocol == TCP_PRO) {
-        task_num = _AT_TCP_CLOSE;
-      }
+    if (TimerIsStarted(&UplinkTimeoutTimer) == false) {
+      TimerSetValue(&UplinkTimeoutTimer, UPLINK_TIMEOUT);
+      TimerStart(&UplinkTimeoutTimer);
     }
   } else
-    uplink_time_num = 0;
+    TimerStop(&UplinkTimeoutTimer);
 
-  if (join_network_timer == 1 && sleep_status == 0) {
-    join_network_time++;
-    if (join_network_time == (sys.csq_time * 6)) {
-      join_network_time = 0;
-      join_network_timer = 0;
-      no_singal_flag = 1;
-      nb.net_flag = no_status;
-      task_num = _AT_CFUNOFF;
+  // the wait set again for each retransmission
+  if (nb_COAP_timeout() != 0 && sleep_status == 0) {
+    if (TimerIsStarted(&CoapRetransmitTimer) == false) {
+      TimerSetValue(&CoapRetransmitTimer, nb_COAP_timeout());
+      TimerStart(&CoapRetransmitTimer);
     }
-  }
-  My_AlarmInit(10, 1);
+  } else
+    TimerStop(&CoapRetransmitTimer);
 }
 
 void LoraStartCheckBLE(void) {
   TimerInit(&CheckBLETimesTimer, OnCheckBLETimesEvent);
+  TimerSetSlack(&CheckBLETimesTimer, TIMER_PERIOD_SLACK(60000));
   TimerSetValue(&CheckBLETimesTimer, 60000);
   TimerStart(&CheckBLETimesTimer);
 }
@@ -573,6 +760,7 @@ void OnCheckBLETimesEvent(void) {
   } else {
     TimerStop(&CheckBLETimesTimer);
     ble_sleep_command = 1;
+    Event_Signal(EVENT_SIGNAL_USER);
   }
 }
 
@@ -592,7 +780,7 @@ void OnPressButtonTimeoutEvent(void) {
 void nb_intTimeoutEvent(void) {
   TimerStop(&nb_intTimeoutTimer);
   if (sleep_status == 0)
-    task_num = _AT;
+    NbTaskStart(_AT);
 }
 
 void OntimesampleEvent(void) {
@@ -647,6 +835,7 @@ void OntimesampleEvent(void) {
     TimerStart(&timesampleTimer);
   }
   tdc_clock_log_flag = 1;
+  Event_Signal(EVENT_SIGNAL_USER);
 }
 
 void onCalibrationtimeEvent(void) {
@@ -686,11 +875,15 @@ void rename_ble(void) {
   HAL_GPIO_WritePin(DX_BT24_PORT, DX_BT24_RST_PIN, GPIO_PIN_SET);
 }
 
-void OnTxTimerEvent(void) { is_time_to_send = 1; }
+void OnTxTimerEvent(void) {
+  is_time_to_send = 1;
+  Event_Signal(EVENT_SIGNAL_UPLINK);
+}
 
 void LoraStartTx(void) {
   TimerInit(&TxTimer, OnTxTimerEvent);
   TimerSetValue(&TxTimer, sys.tdc * 1000);
+  TimerSetSlack(&TxTimer, TIMER_PERIOD_SLACK(sys.tdc * 1000));
   OnTxTimerEvent();
 }
 
@@ -782,13 +975,14 @@ void user_key_event(void) {
 
     case 2: // sleep
     {
+      config_Flush();
       EX_GPIO_Init(0);
       sleep_status = 1;
       TimerStop(&CheckBLETimesTimer);
       TimerStop(&TxTimer);
       TimerStop(&timesampleTimer);
       TimerStop(&CalibrationtimeTimer);
-      task_num = _AT_CFUNOFF;
+      NbTaskStart(_AT_CFUNOFF);
       NBTASK(&task_num);
 
       HAL_Delay(500);
@@ -811,6 +1005,7 @@ void user_key_event(void) {
     case 3: // system reset,Activation Mode
     {
       user_key_duration = 0;
+      config_Flush();
       NVIC_SystemReset();
       break;
     }
@@ -822,37 +1017,30 @@ void user_key_event(void) {
 }
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
   if (GPIO_Pin == GPIO_PIN_15) {
-    if (sys.mod == model6) {
-      sensor.exit_count++;
-    } else if (sys.mod == model7) {
-      uint32_t diff = TimerGetElapsedTime(lastCountInt);
-      if (diff > LOCKOUT_INT_DELAY) {
-        sensor.exit_count++;
-        uint16_t newIntensity =
-            lastCountInt == 0 || diff > 3600000 ? 0 : 2 * 3600000 / diff;
-        lastCountInt = TimerGetCurrentTime();
-        user_main_printf("count is %d, now: %d, diff: %d, intensity: %d",
-                         sensor.exit_count, lastCountInt, diff, newIntensity);
-        if (newIntensity > sensor.intensity) {
-          sensor.intensity = newIntensity;
-        }
-      }
+    if (sys.mod == model6 || sys.mod == model7) {
+      Count_Edge();
     } else if (nb.net_flag == success && sys.mod != model6 &&
                sys.mod != model7 &&
                (task_num < _AT_COAP_CONFIG || task_num > _AT_TCP_CLOSE)) {
       if (nb.uplink_flag == no_status) {
-        task_num = _AT_QSCLKOFF;
+        NbTaskStart(_AT_QSCLKOFF);
         nb.uplink_flag = send;
         sys.exit_flag = 1;
         sensor.exit_level = HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_15);
         sensor.exit_state = 1;
-        LPM_DisableStopMode();
+        Event_Post(EVENT_EXTI, sensor.exit_level);
       }
     }
   } else if (GPIO_Pin == GPIO_PIN_8) {
     nb.recieve_flag = NB_RECIEVE;
+    Event_Signal(EVENT_SIGNAL_UPLINK);
   } else if (GPIO_Pin == GPIO_PIN_7) {
-    user_key_exti_flag = 1;
+    if (HX711_IsWaiting()) {
+      HX711_DoutReady();
+    } else {
+      user_key_exti_flag = 1;
+      Event_Signal(EVENT_SIGNAL_KEY);
+    }
   }
 }
 void compare_time(uint16_t time) {
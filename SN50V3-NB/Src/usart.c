@@ -21,7 +21,7 @@
 #include "usart.h"
 
 /* USER CODE BEGIN 0 */
-
+#include "energy.h"
 /* USER CODE END 0 */
 
 UART_HandleTypeDef hlpuart1;
@@ -327,6 +327,7 @@ PUTCHAR_PROTOTYPE {
    */
   HAL_UART_Transmit(&huart2, (uint8_t *)&ch, 1, 0xFF);
   __HAL_UART_CLEAR_IDLEFLAG(&huart2);
+  Energy_Tx(1);
   return ch;
 }
 
@@ -0,0 +1,196 @@
+#include "aead_ref.h"
+#include <string.h>
+
+#define FRAME_HEADER 8
+#define FRAME_COUNTER 4
+#define FRAME_TAG 8
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b,
+    0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0,
+    0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26,
+    0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2,
+    0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0,
+    0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed,
+    0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f,
+    0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5,
+    0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec,
+    0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14,
+    0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c,
+    0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d,
+    0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f,
+    0x4b, 0xbd, 0x8b, 0x8a, 0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e,
+    0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f,
+    0xb0, 0x54, 0xbb, 0x16};
+
+static uint8_t xtime(uint8_t x) { return x << 1 ^ (x & 0x80 ? 0x1b : 0); }
+
+void Aes128_Init(Aes128 *aes, const uint8_t *key) {
+  uint8_t rcon = 1;
+
+  memcpy(aes->round[0], key, 16);
+  for (int r = 1; r <= 10; r++) {
+    const uint8_t *p = aes->round[r - 1];
+    uint8_t *k = aes->round[r];
+
+    k[0] = p[0] ^ sbox[p[13]] ^ rcon;
+    k[1] = p[1] ^ sbox[p[14]];
+    k[2] = p[2] ^ sbox[p[15]];
+    k[3] = p[3] ^ sbox[p[12]];
+    for (int i = 4; i < 16; i++)
+      k[i] = p[i] ^ k[i - 4];
+    rcon = xtime(rcon);
+  }
+}
+
+void Aes128_Encrypt(const Aes128 *aes, const uint8_t *in, uint8_t *out) {
+  uint8_t s[16], t[16];
+
+  for (int i = 0; i < 16; i++)
+    s[i] = in[i] ^ aes->round[0][i];
+  for (int r = 1; r <= 10; r++) {
+    // SubBytes and ShiftRows, the state being column major
+    for (int i = 0; i < 16; i++)
+      t[i] = sbox[s[(i + 4 * (i % 4)) % 16]];
+    // MixColumns, but in the last round
+    for (int c = 0; c < 4 && r < 10; c++) {
+      uint8_t *col = &t[4 * c];
+      uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3], first = col[0];
+
+      col[0] ^= all ^ xtime(col[0] ^ col[1]);
+      col[1] ^= all ^ xtime(col[1] ^ col[2]);
+      col[2] ^= all ^ xtime(col[2] ^ col[3]);
+      col[3] ^= all ^ xtime(col[3] ^ first);
+    }
+    for (int i = 0; i < 16; i++)
+      s[i] = t[i] ^ aes->round[r][i];
+  }
+  memcpy(out, s, 16);
+}
+
+// Counter block i, flags then nonce then i on the remaining bytes
+static void Ccm_Counter(uint8_t *a, const uint8_t *nonce, size_t nonceLen,
+                        size_t i) {
+  memset(a, 0, 16);
+  a[0] = 14 - nonceLen;
+  memcpy(a + 1, nonce, nonceLen);
+  for (int b = 15; b > (int)nonceLen; b--, i >>= 8)
+    a[b] = i & 0xFF;
+}
+
+// CBC-MAC of B0, the associated data and the plaintext
+static void Ccm_Mac(const Aes128 *aes, const uint8_t *nonce, size_t nonceLen,
+                    const uint8_t *ad, size_t adLen, const uint8_t *in,
+                    size_t len, size_t tagLen, uint8_t *mac) {
+  uint8_t block[16];
+  size_t pos, n;
+
+  Ccm_Counter(block, nonce, nonceLen, len);
+  block[0] |= (adLen ? 0x40 : 0) | (tagLen - 2) / 2 << 3;
+  Aes128_Encrypt(aes, block, mac);
+
+  if (adLen) {
+    // the 2-byte length prefix, enough below 0xFF00 bytes
+    memset(block, 0, 16);
+    block[0] = adLen >> 8;
+    block[1] = adLen & 0xFF;
+    pos = 2;
+    for (size_t i = 0; i < adLen; i++) {
+      block[pos++] = ad[i];
+      if (pos == 16 || i == adLen - 1) {
+        for (int b = 0; b < 16; b++)
+          mac[b] ^= block[b];
+        Aes128_Encrypt(aes, mac, mac);
+        memset(block, 0, 16);
+        pos = 0;
+      }
+    }
+  }
+  for (pos = 0; pos < len; pos += 16) {
+    n = len - pos < 16 ? len - pos : 16;
+    for (size_t b = 0; b < n; b++)
+      mac[b] ^= in[pos + b];
+    Aes128_Encrypt(aes, mac, mac);
+  }
+}
+
+static void Ccm_Ctr(const Aes128 *aes, const uint8_t *nonce, size_t nonceLen,
+                    const uint8_t *in, size_t len, uint8_t *out) {
+  uint8_t a[16], s[16];
+
+  for (size_t pos = 0; pos < len; pos += 16) {
+    Ccm_Counter(a, nonce, nonceLen, pos / 16 + 1);
+    Aes128_Encrypt(aes, a, s);
+    for (size_t b = 0; b < 16 && pos + b < len; b++)
+      out[pos + b] = in[pos + b] ^ s[b];
+  }
+}
+
+static void Ccm_Tag(const Aes128 *aes, const uint8_t *nonce, size_t nonceLen,
+                    const uint8_t *mac, uint8_t *tag, size_t tagLen) {
+  uint8_t a[16], s[16];
+
+  Ccm_Counter(a, nonce, nonceLen, 0);
+  Aes128_Encrypt(aes, a, s);
+  for (size_t b = 0; b < tagLen; b++)
+    tag[b] = mac[b] ^ s[b];
+}
+
+size_t Ccm_Seal(const uint8_t *key, const uint8_t *nonce, size_t nonceLen,
+                const uint8_t *ad, size_t adLen, const uint8_t *in,
+                size_t len, uint8_t *out, size_t tagLen) {
+  Aes128 aes;
+  uint8_t mac[16];
+
+  Aes128_Init(&aes, key);
+  Ccm_Mac(&aes, nonce, nonceLen, ad, adLen, in, len, tagLen, mac);
+  Ccm_Ctr(&aes, nonce, nonceLen, in, len, out);
+  Ccm_Tag(&aes, nonce, nonceLen, mac, out + len, tagLen);
+  return len + tagLen;
+}
+
+int Ccm_Open(const uint8_t *key, const uint8_t *nonce, size_t nonceLen,
+             const uint8_t *ad, size_t adLen, const uint8_t *in, size_t len,
+             uint8_t *out, size_t tagLen) {
+  Aes128 aes;
+  uint8_t mac[16], tag[16], diff = 0;
+
+  if (len < tagLen)
+    return -1;
+  len -= tagLen;
+  Aes128_Init(&aes, key);
+  Ccm_Ctr(&aes, nonce, nonceLen, in, len, out);
+  Ccm_Mac(&aes, nonce, nonceLen, ad, adLen, out, len, tagLen, mac);
+  Ccm_Tag(&aes, nonce, nonceLen, mac, tag, tagLen);
+  for (size_t b = 0; b < tagLen; b++)
+    diff |= tag[b] ^ in[len + b];
+  if (diff != 0) {
+    memset(out, 0, len);
+    return -1;
+  }
+  return len;
+}
+
+int Aead_Open(const uint8_t *key, const uint8_t *frame, size_t len,
+              uint8_t *out, uint32_t *counter) {
+  const size_t start = FRAME_HEADER + FRAME_COUNTER;
+  int n;
+
+  if (len < start + FRAME_TAG)
+    return -1;
+  // the nonce is the header and the counter as sent
+  n = Ccm_Open(key, frame, start, NULL, 0, frame + start, len - start,
+               out + FRAME_HEADER, FRAME_TAG);
+  if (n < 0)
+    return -1;
+  memcpy(out, frame, FRAME_HEADER);
+  *counter = (uint32_t)frame[8] << 24 | frame[9] << 16 | frame[10] << 8 |
+             frame[11];
+  return FRAME_HEADER + n;
+}
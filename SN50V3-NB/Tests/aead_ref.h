@@ -0,0 +1,31 @@
+#ifndef __AEAD_REF_H
+#define __AEAD_REF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Reference AES-128-CCM, written from FIPS 197 and RFC 3610 and sharing
+ * nothing with the firmware, to check the frames it seals the way a server
+ * would open them. */
+typedef struct {
+  uint8_t round[11][16];
+} Aes128;
+
+void Aes128_Init(Aes128 *aes, const uint8_t *key);
+void Aes128_Encrypt(const Aes128 *aes, const uint8_t *in, uint8_t *out);
+
+size_t Ccm_Seal(const uint8_t *key, const uint8_t *nonce, size_t nonceLen,
+                const uint8_t *ad, size_t adLen, const uint8_t *in,
+                size_t len, uint8_t *out, size_t tagLen);
+// Returns the plaintext length, or -1 when the tag does not match
+int Ccm_Open(const uint8_t *key, const uint8_t *nonce, size_t nonceLen,
+             const uint8_t *ad, size_t adLen, const uint8_t *in, size_t len,
+             uint8_t *out, size_t tagLen);
+
+/* Opens a sealed uplink as received over UDP, header | counter |
+ * ciphertext | tag. Writes the clear frame, header then payload, and the
+ * counter. Returns the frame length, or -1 when it does not authenticate. */
+int Aead_Open(const uint8_t *key, const uint8_t *frame, size_t len,
+              uint8_t *out, uint32_t *counter);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef __HOST_H
+#define __HOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Helpers shared by the host tests */
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);          \
+      host_failures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+extern int host_failures;
+
+// EEPROM stand-in: words programmed so far, and failure injection
+extern uint32_t host_eeprom_writes;
+extern uint8_t host_eeprom_fail;
+void host_eeprom_clear(void);
+
+// Flash stand-in: erase operations and pages erased so far
+extern uint32_t host_flash_erases;
+extern uint32_t host_flash_pages;
+
+extern uint32_t host_tick;
+
+// SysTick suspended by HAL_SuspendTick(), interrupts masked, and the GPIO
+// port that last took each EXTI line
+extern uint8_t host_tick_suspended;
+extern uint32_t host_primask;
+extern uint32_t host_exti[16];
+
+// Hooks of the tests modelling a chip or the core, empty by default: the
+// outputs of a port changed, WFI is entered with the pending BSRR and BRR
+// writes applied, and interrupts are unmasked
+void host_gpio_output(uint32_t base, uint32_t before, uint32_t after);
+void host_wfi(void);
+void host_irq(void);
+void host_gpio_sync(void);
+
+// The AT command handlers of at.c, generated into build/at_handlers.c,
+// all call this one with their name
+int host_at_handler(const char *name, const char *param);
+
+// SHA-256 blocks compressed by host_cmox.c
+extern uint32_t host_sha256_blocks;
+
+// Hex helpers, returning the number of bytes or characters written
+size_t host_unhex(uint8_t *out, const char *hex);
+size_t host_hex(char *out, const uint8_t *in, size_t len);
+
+int host_report(const char *name);
+
+#endif
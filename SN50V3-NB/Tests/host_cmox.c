@@ -0,0 +1,264 @@
+#include "aead_ref.h"
+#include "cmox_crypto.h"
+#include "host.h"
+#include <string.h>
+
+/* Host stand-in for the ST cryptographic library. CCM streams like the
+ * library does, so the firmware's chunked appends are exercised: whole
+ * blocks until the last one, each one MACed and encrypted as it comes.
+ * SHA-256 is written from FIPS 180-4. */
+const cmox_ccm_impl_t CMOX_AESSMALL_CCM_ENC = 1;
+const cmox_hash_algo_t CMOX_SHA256_ALGO = 1;
+uint32_t host_sha256_blocks;
+
+cmox_init_retval_t cmox_initialize(void *P_pInitTarget) {
+  return CMOX_INIT_SUCCESS;
+}
+
+cmox_init_retval_t cmox_finalize(void *P_pInitTarget) {
+  return CMOX_INIT_SUCCESS;
+}
+
+cmox_cipher_handle_t *cmox_ccm_construct(cmox_ccm_handle_t *P_pThis,
+                                         cmox_ccm_impl_t P_impl) {
+  memset(P_pThis, 0, sizeof(*P_pThis));
+  return &P_pThis->super;
+}
+
+cmox_cipher_retval_t cmox_cipher_init(cmox_cipher_handle_t *P_pThis) {
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_cleanup(cmox_cipher_handle_t *P_pThis) {
+  memset(P_pThis, 0, sizeof(*P_pThis));
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_setKey(cmox_cipher_handle_t *P_pThis,
+                                        const uint8_t *P_pKey,
+                                        cmox_cipher_keyLen_t P_keyLen) {
+  if (P_keyLen != 16)
+    return CMOX_CIPHER_ERR_BAD_OPERATION;
+  memcpy(P_pThis->key, P_pKey, 16);
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_setTagLen(cmox_cipher_handle_t *P_pThis,
+                                           size_t P_tagLen) {
+  P_pThis->tagLen = P_tagLen;
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_setPayloadLen(cmox_cipher_handle_t *P_pThis,
+                                               size_t P_totalPayloadLen) {
+  P_pThis->payloadLen = P_totalPayloadLen;
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_setADLen(cmox_cipher_handle_t *P_pThis,
+                                          size_t P_totalADLen) {
+  // the firmware authenticates no associated data
+  P_pThis->adLen = P_totalADLen;
+  return P_totalADLen == 0 ? CMOX_CIPHER_SUCCESS
+                           : CMOX_CIPHER_ERR_BAD_OPERATION;
+}
+
+static void Ccm_Block(const cmox_cipher_handle_t *h, size_t i, uint8_t *a) {
+  memset(a, 0, 16);
+  a[0] = 14 - h->nonceLen;
+  memcpy(a + 1, h->nonce, h->nonceLen);
+  for (int b = 15; b > (int)h->nonceLen; b--, i >>= 8)
+    a[b] = i & 0xFF;
+}
+
+// B0 goes through the MAC once the lengths and the nonce are known
+cmox_cipher_retval_t cmox_cipher_setIV(cmox_cipher_handle_t *P_pThis,
+                                       const uint8_t *P_pIv, size_t P_ivLen) {
+  Aes128 aes;
+  uint8_t b0[16];
+
+  if (P_ivLen < 7 || P_ivLen > 13 || P_pThis->tagLen < 4)
+    return CMOX_CIPHER_ERR_BAD_OPERATION;
+  memcpy(P_pThis->nonce, P_pIv, P_ivLen);
+  P_pThis->nonceLen = P_ivLen;
+  Ccm_Block(P_pThis, P_pThis->payloadLen, b0);
+  b0[0] |= (P_pThis->tagLen - 2) / 2 << 3;
+  Aes128_Init(&aes, P_pThis->key);
+  Aes128_Encrypt(&aes, b0, P_pThis->mac);
+  P_pThis->ready = 1;
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_append(cmox_cipher_handle_t *P_pThis,
+                                        const uint8_t *P_pInput,
+                                        size_t P_inputLen, uint8_t *P_pOutput,
+                                        size_t *P_pOutputLen) {
+  Aes128 aes;
+  uint8_t a[16], s[16];
+
+  if (P_pThis->ready == 0 || P_pThis->done % 16 != 0 ||
+      P_pThis->done + P_inputLen > P_pThis->payloadLen)
+    return CMOX_CIPHER_ERR_BAD_OPERATION;
+  Aes128_Init(&aes, P_pThis->key);
+  for (size_t pos = 0; pos < P_inputLen; pos += 16) {
+    size_t n = P_inputLen - pos < 16 ? P_inputLen - pos : 16;
+
+    for (size_t b = 0; b < n; b++)
+      P_pThis->mac[b] ^= P_pInput[pos + b];
+    Aes128_Encrypt(&aes, P_pThis->mac, P_pThis->mac);
+    Ccm_Block(P_pThis, (P_pThis->done + pos) / 16 + 1, a);
+    Aes128_Encrypt(&aes, a, s);
+    for (size_t b = 0; b < n; b++)
+      P_pOutput[pos + b] = P_pInput[pos + b] ^ s[b];
+  }
+  P_pThis->done += P_inputLen;
+  if (P_pOutputLen != NULL)
+    *P_pOutputLen = P_inputLen;
+  return CMOX_CIPHER_SUCCESS;
+}
+
+cmox_cipher_retval_t cmox_cipher_generateTag(cmox_cipher_handle_t *P_pThis,
+                                             uint8_t *P_pTag,
+                                             size_t *P_pTagLen) {
+  Aes128 aes;
+  uint8_t a[16], s[16];
+
+  if (P_pThis->ready == 0 || P_pThis->done != P_pThis->payloadLen)
+    return CMOX_CIPHER_ERR_BAD_OPERATION;
+  Aes128_Init(&aes, P_pThis->key);
+  Ccm_Block(P_pThis, 0, a);
+  Aes128_Encrypt(&aes, a, s);
+  for (size_t b = 0; b < P_pThis->tagLen; b++)
+    P_pTag[b] = P_pThis->mac[b] ^ s[b];
+  if (P_pTagLen != NULL)
+    *P_pTagLen = P_pThis->tagLen;
+  return CMOX_CIPHER_SUCCESS;
+}
+
+static const uint32_t Sha256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static uint32_t Sha256_Rotr(uint32_t x, int n) {
+  return x >> n | x << (32 - n);
+}
+
+static void Sha256_Block(cmox_sha256_handle_t *h, const uint8_t *block) {
+  uint32_t w[64], v[8];
+
+  host_sha256_blocks++;
+  for (int t = 0; t < 16; t++)
+    w[t] = (uint32_t)block[t * 4] << 24 | block[t * 4 + 1] << 16 |
+           block[t * 4 + 2] << 8 | block[t * 4 + 3];
+  for (int t = 16; t < 64; t++) {
+    uint32_t s0 = Sha256_Rotr(w[t - 15], 7) ^ Sha256_Rotr(w[t - 15], 18) ^
+                  w[t - 15] >> 3;
+    uint32_t s1 = Sha256_Rotr(w[t - 2], 17) ^ Sha256_Rotr(w[t - 2], 19) ^
+                  w[t - 2] >> 10;
+
+    w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+  }
+  memcpy(v, h->state, sizeof(v));
+  for (int t = 0; t < 64; t++) {
+    uint32_t s1 = Sha256_Rotr(v[4], 6) ^ Sha256_Rotr(v[4], 11) ^
+                  Sha256_Rotr(v[4], 25);
+    uint32_t ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+    uint32_t t1 = v[7] + s1 + ch + Sha256_K[t] + w[t];
+    uint32_t s0 = Sha256_Rotr(v[0], 2) ^ Sha256_Rotr(v[0], 13) ^
+                  Sha256_Rotr(v[0], 22);
+    uint32_t maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+
+    memmove(v + 1, v, 7 * sizeof(uint32_t));
+    v[4] += t1;
+    v[0] = t1 + s0 + maj;
+  }
+  for (int i = 0; i < 8; i++)
+    h->state[i] += v[i];
+}
+
+cmox_hash_handle_t *cmox_sha256_construct(cmox_sha256_handle_t *P_pThis) {
+  memset(P_pThis, 0, sizeof(*P_pThis));
+  P_pThis->super.tagLen = 32;
+  return &P_pThis->super;
+}
+
+cmox_hash_retval_t cmox_hash_init(cmox_hash_handle_t *P_pThis) {
+  static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                 0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                 0x1f83d9ab, 0x5be0cd19};
+  cmox_sha256_handle_t *h = (cmox_sha256_handle_t *)P_pThis;
+
+  memcpy(h->state, iv, sizeof(iv));
+  h->len = 0;
+  h->ready = 1;
+  return CMOX_HASH_SUCCESS;
+}
+
+cmox_hash_retval_t cmox_hash_append(cmox_hash_handle_t *P_pThis,
+                                    const uint8_t *P_pInput,
+                                    size_t P_inputLen) {
+  cmox_sha256_handle_t *h = (cmox_sha256_handle_t *)P_pThis;
+
+  if (h->ready == 0)
+    return CMOX_HASH_ERR_BAD_OPERATION;
+  for (size_t i = 0; i < P_inputLen; i++) {
+    h->block[h->len++ % 64] = P_pInput[i];
+    if (h->len % 64 == 0)
+      Sha256_Block(h, h->block);
+  }
+  return CMOX_HASH_SUCCESS;
+}
+
+cmox_hash_retval_t cmox_hash_generateTag(cmox_hash_handle_t *P_pThis,
+                                         uint8_t *P_pDigest,
+                                         size_t *P_pDigestLen) {
+  cmox_sha256_handle_t *h = (cmox_sha256_handle_t *)P_pThis;
+  uint64_t bits = h->len * 8;
+  uint8_t pad = 0x80;
+
+  if (h->ready == 0)
+    return CMOX_HASH_ERR_BAD_OPERATION;
+  cmox_hash_append(P_pThis, &pad, 1);
+  pad = 0;
+  while (h->len % 64 != 56)
+    cmox_hash_append(P_pThis, &pad, 1);
+  for (int i = 7; i >= 0; i--) {
+    pad = bits >> (i * 8) & 0xFF;
+    cmox_hash_append(P_pThis, &pad, 1);
+  }
+  for (int i = 0; i < 32; i++)
+    P_pDigest[i] = h->state[i / 4] >> (24 - i % 4 * 8) & 0xFF;
+  if (P_pDigestLen != NULL)
+    *P_pDigestLen = 32;
+  h->ready = 0;
+  return CMOX_HASH_SUCCESS;
+}
+
+cmox_hash_retval_t cmox_hash_compute(cmox_hash_algo_t P_algo,
+                                     const uint8_t *P_pPlaintext,
+                                     size_t P_plaintextLen,
+                                     uint8_t *P_pDigest,
+                                     const size_t P_expectedDigestLen,
+                                     size_t *P_pComputedDigestLen) {
+  cmox_sha256_handle_t h;
+  uint8_t digest[32];
+
+  if (P_algo != CMOX_SHA256_ALGO || P_expectedDigestLen > 32)
+    return CMOX_HASH_ERR_BAD_PARAMETER;
+  cmox_hash_init(cmox_sha256_construct(&h));
+  cmox_hash_append(&h.super, P_pPlaintext, P_plaintextLen);
+  cmox_hash_generateTag(&h.super, digest, NULL);
+  memcpy(P_pDigest, digest, P_expectedDigestLen);
+  if (P_pComputedDigestLen != NULL)
+    *P_pComputedDigestLen = P_expectedDigestLen;
+  return CMOX_HASH_SUCCESS;
+}
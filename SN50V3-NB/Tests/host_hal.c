@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include "common.h"
+#include "crc.h"
+#include "utilities.h"
+#include <stdarg.h>
+#include <sys/mman.h>
+
+/* HAL stand-in of the host tests. The data EEPROM, the flash and the
+ * factory calibration data are anonymous mappings at the addresses the
+ * firmware reads them from, so that the modules keep dereferencing their
+ * EEPROM_*, FLASH_USER_* and *_CAL addresses. */
+#define HOST_EEPROM_SIZE (DATA_EEPROM_BANK2_END + 1 - DATA_EEPROM_BASE)
+#define HOST_FLASH_SIZE (192 * 1024)
+#define HOST_FACTORY_SIZE 4096
+#define HOST_GPIO_PORTS 8
+
+int host_failures = 0;
+uint32_t host_eeprom_writes = 0;
+uint8_t host_eeprom_fail = 0;
+uint32_t host_flash_erases = 0;
+uint32_t host_flash_pages = 0;
+uint32_t host_tick = 0;
+uint32_t host_primask = 0;
+uint8_t host_tick_suspended = 0;
+uint32_t host_exti[16];
+EXTI_TypeDef host_EXTI;
+NVIC_Type host_NVIC;
+static GPIO_TypeDef hostPorts[HOST_GPIO_PORTS];
+char host_last_log[256];
+CRC_HandleTypeDef hcrc;
+
+static void host_map(uintptr_t address, size_t size, const char *name) {
+  void *p = mmap((void *)address, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if (p != (void *)address) {
+    perror(name);
+    exit(2);
+  }
+}
+
+static void __attribute__((constructor)) host_memory_map(void) {
+  host_map(DATA_EEPROM_BASE, HOST_EEPROM_SIZE, "EEPROM mapping");
+  host_map(FLASH_BASE, HOST_FLASH_SIZE, "flash mapping");
+  host_map(FACTORY_BASE, HOST_FACTORY_SIZE, "factory data mapping");
+}
+
+void host_eeprom_clear(void) {
+  memset((void *)DATA_EEPROM_BASE, 0, HOST_EEPROM_SIZE);
+  host_eeprom_writes = 0;
+  host_eeprom_fail = 0;
+}
+
+uint32_t HAL_GetTick(void) { return host_tick; }
+
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {
+  NVIC->ISPR[0] &= ~(1UL << IRQn);
+}
+
+void __attribute__((weak))
+host_gpio_output(uint32_t base, uint32_t before, uint32_t after) {}
+
+void __attribute__((weak)) host_wfi(void) {}
+
+void __attribute__((weak)) host_irq(void) {}
+
+static void host_gpio_apply(uint32_t n) {
+  GPIO_TypeDef *port = &hostPorts[n];
+  uint32_t set = port->BSRR & 0xFFFF;
+  uint32_t reset = (port->BSRR >> 16 | port->BRR) & ~set;
+  uint32_t before = port->ODR;
+
+  if (port->BSRR == 0 && port->BRR == 0)
+    return;
+  port->BSRR = port->BRR = 0;
+  port->ODR = (before | set) & ~reset;
+  if (port->ODR != before)
+    host_gpio_output(GPIOA_BASE + n * 0x400, before, port->ODR);
+}
+
+GPIO_TypeDef *host_gpio(uint32_t base) {
+  uint32_t n = (base - GPIOA_BASE) / 0x400;
+
+  host_gpio_apply(n);
+  return &hostPorts[n];
+}
+
+// Applies the writes left pending on every port
+void host_gpio_sync(void) {
+  for (uint32_t n = 0; n < HOST_GPIO_PORTS; n++)
+    host_gpio_apply(n);
+}
+
+// The EXTI line of a pin follows the last port configured for interrupts
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+  uint32_t base = GPIOA_BASE + (GPIOx - hostPorts) * 0x400;
+
+  for (uint32_t line = 0; line < 16; line++) {
+    if ((GPIO_Init->Pin & (1U << line)) && (GPIO_Init->Mode >> 28) == 1)
+      host_exti[line] = base;
+  }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+  return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState) {
+  if (PinState == GPIO_PIN_SET)
+    GPIOx->BSRR = GPIO_Pin;
+  else
+    GPIOx->BRR = GPIO_Pin;
+}
+
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry) {
+  host_gpio_sync();
+  host_wfi();
+}
+
+void HAL_SuspendTick(void) { host_tick_suspended = 1; }
+
+void HAL_ResumeTick(void) { host_tick_suspended = 0; }
+
+uint32_t __get_PRIMASK(void) { return host_primask; }
+
+void __set_PRIMASK(uint32_t priMask) {
+  host_primask = priMask;
+  if (priMask == 0)
+    host_irq();
+}
+
+void __disable_irq(void) { host_primask = 1; }
+
+void __enable_irq(void) { __set_PRIMASK(0); }
+
+void host_log(const char *format, ...) {
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(host_last_log, sizeof(host_last_log), format, args);
+  va_end(args);
+#ifdef HOST_VERBOSE
+  printf("[%u]%s\n", host_tick, host_last_log);
+#endif
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Unlock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Lock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Program(uint32_t TypeProgram,
+                                                 uint32_t Address,
+                                                 uint32_t Data) {
+  if (TypeProgram != FLASH_TYPEPROGRAMDATA_WORD || Address < DATA_EEPROM_BASE ||
+      Address + 4 > DATA_EEPROM_BASE + HOST_EEPROM_SIZE || (Address & 3) != 0)
+    return HAL_ERROR;
+  if (host_eeprom_fail)
+    return HAL_ERROR;
+  *(volatile uint32_t *)(uintptr_t)Address = Data;
+  host_eeprom_writes++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) { return HAL_OK; }
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) { return HAL_OK; }
+
+uint32_t HAL_FLASH_GetError(void) { return 0; }
+
+// Pages erase to zeros on the STM32L0
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit,
+                                    uint32_t *PageError) {
+  uint32_t address = pEraseInit->PageAddress;
+  uint32_t size = pEraseInit->NbPages * FLASH_PAGE_SIZE;
+
+  *PageError = 0xFFFFFFFF;
+  if (pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES || address < FLASH_BASE ||
+      address + size > FLASH_BASE + HOST_FLASH_SIZE ||
+      address % FLASH_PAGE_SIZE != 0)
+    return HAL_ERROR;
+  memset((void *)(uintptr_t)address, 0, size);
+  host_flash_erases++;
+  host_flash_pages += pEraseInit->NbPages;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address,
+                                    uint32_t Data) {
+  if (TypeProgram != FLASH_TYPEPROGRAM_WORD || Address < FLASH_BASE ||
+      Address + 4 > FLASH_BASE + HOST_FLASH_SIZE || (Address & 3) != 0)
+    return HAL_ERROR;
+  *(volatile uint32_t *)(uintptr_t)Address = Data;
+  return HAL_OK;
+}
+
+static int host_nibble(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    return (c | 0x20) - 'a' + 10;
+  return -1;
+}
+
+void StrToHex(char *pbDest, char *pszSrc, int nLen) {
+  for (int i = 0; i < nLen; i++)
+    pbDest[i] =
+        host_nibble(pszSrc[2 * i]) << 4 | host_nibble(pszSrc[2 * i + 1]);
+}
+
+size_t host_unhex(uint8_t *out, const char *hex) {
+  size_t n = 0;
+
+  while (host_nibble(hex[0]) >= 0 && host_nibble(hex[1]) >= 0) {
+    out[n++] = host_nibble(hex[0]) << 4 | host_nibble(hex[1]);
+    hex += 2;
+  }
+  return n;
+}
+
+size_t host_hex(char *out, const uint8_t *in, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    sprintf(out + i * 2, "%.2x", in[i]);
+  out[len * 2] = '\0';
+  return len * 2;
+}
+
+int host_report(const char *name) {
+  printf("%s: %s\n", name, host_failures ? "FAILED" : "ok");
+  return host_failures != 0;
+}
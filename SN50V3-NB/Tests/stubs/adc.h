@@ -0,0 +1,8 @@
+#ifndef __ADC_H__
+#define __ADC_H__
+
+#include "stm32l0xx_hal.h"
+
+extern ADC_HandleTypeDef hadc;
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __CMOX_CRYPTO_H
+#define __CMOX_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The subset of the ST cryptographic library used by the BSP, implemented
+ * for the host in host_cmox.c. */
+typedef uint32_t cmox_init_retval_t;
+typedef uint32_t cmox_cipher_retval_t;
+typedef uint32_t cmox_hash_retval_t;
+typedef size_t cmox_cipher_keyLen_t;
+
+#define CMOX_INIT_SUCCESS 0x00000000U
+#define CMOX_CIPHER_SUCCESS 0x00010000U
+#define CMOX_CIPHER_ERR_BAD_OPERATION 0x00010004U
+#define CMOX_HASH_SUCCESS 0x00020000U
+#define CMOX_HASH_ERR_BAD_PARAMETER 0x00020003U
+#define CMOX_HASH_ERR_BAD_OPERATION 0x00020004U
+
+typedef struct {
+  uint8_t key[16];
+  uint8_t nonce[13];
+  size_t nonceLen, tagLen, payloadLen, adLen, done;
+  uint8_t mac[16];
+  uint8_t ready;
+} cmox_cipher_handle_t;
+
+typedef struct {
+  cmox_cipher_handle_t super;
+} cmox_ccm_handle_t;
+
+typedef int cmox_ccm_impl_t;
+extern const cmox_ccm_impl_t CMOX_AESSMALL_CCM_ENC;
+
+typedef struct {
+  size_t tagLen;
+} cmox_hash_handle_t;
+
+// Copied by value to keep a state, as the library's handle can be
+typedef struct {
+  cmox_hash_handle_t super;
+  uint32_t state[8];
+  uint64_t len; // bytes appended
+  uint8_t block[64];
+  uint8_t ready;
+} cmox_sha256_handle_t;
+
+typedef int cmox_hash_algo_t;
+extern const cmox_hash_algo_t CMOX_SHA256_ALGO;
+
+cmox_init_retval_t cmox_initialize(void *P_pInitTarget);
+cmox_init_retval_t cmox_finalize(void *P_pInitTarget);
+
+cmox_cipher_handle_t *cmox_ccm_construct(cmox_ccm_handle_t *P_pThis,
+                                         cmox_ccm_impl_t P_impl);
+cmox_cipher_retval_t cmox_cipher_init(cmox_cipher_handle_t *P_pThis);
+cmox_cipher_retval_t cmox_cipher_cleanup(cmox_cipher_handle_t *P_pThis);
+cmox_cipher_retval_t cmox_cipher_setKey(cmox_cipher_handle_t *P_pThis,
+                                        const uint8_t *P_pKey,
+                                        cmox_cipher_keyLen_t P_keyLen);
+cmox_cipher_retval_t cmox_cipher_setIV(cmox_cipher_handle_t *P_pThis,
+                                       const uint8_t *P_pIv, size_t P_ivLen);
+cmox_cipher_retval_t cmox_cipher_setTagLen(cmox_cipher_handle_t *P_pThis,
+                                           size_t P_tagLen);
+cmox_cipher_retval_t cmox_cipher_setPayloadLen(cmox_cipher_handle_t *P_pThis,
+                                               size_t P_totalPayloadLen);
+cmox_cipher_retval_t cmox_cipher_setADLen(cmox_cipher_handle_t *P_pThis,
+                                          size_t P_totalADLen);
+cmox_cipher_retval_t cmox_cipher_append(cmox_cipher_handle_t *P_pThis,
+                                        const uint8_t *P_pInput,
+                                        size_t P_inputLen, uint8_t *P_pOutput,
+                                        size_t *P_pOutputLen);
+cmox_cipher_retval_t cmox_cipher_generateTag(cmox_cipher_handle_t *P_pThis,
+                                             uint8_t *P_pTag,
+                                             size_t *P_pTagLen);
+
+cmox_hash_handle_t *cmox_sha256_construct(cmox_sha256_handle_t *P_pThis);
+cmox_hash_retval_t cmox_hash_init(cmox_hash_handle_t *P_pThis);
+cmox_hash_retval_t cmox_hash_append(cmox_hash_handle_t *P_pThis,
+                                    const uint8_t *P_pInput,
+                                    size_t P_inputLen);
+cmox_hash_retval_t cmox_hash_generateTag(cmox_hash_handle_t *P_pThis,
+                                         uint8_t *P_pDigest,
+                                         size_t *P_pDigestLen);
+cmox_hash_retval_t cmox_hash_compute(cmox_hash_algo_t P_algo,
+                                     const uint8_t *P_pPlaintext,
+                                     size_t P_plaintextLen,
+                                     uint8_t *P_pDigest,
+                                     const size_t P_expectedDigestLen,
+                                     size_t *P_pComputedDigestLen);
+
+#endif
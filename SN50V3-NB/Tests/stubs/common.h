@@ -0,0 +1,63 @@
+#ifndef __COMMON_H__
+#define __COMMON_H__
+
+/* Stands for the firmware's common.h in the host tests: the standard
+ * headers, the HAL stand-in, the settings the modules under test reach and
+ * the helpers of common.c they call, without the peripherals and globals
+ * of the whole firmware. */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc.h"
+#include "i2c.h"
+#include "stm32l0xx_hal.h"
+#include "usart.h"
+
+typedef enum {
+  model1 = '1',
+  model2,
+  model3,
+  model4,
+  model5,
+  model6,
+  model7,
+} model;
+
+typedef struct {
+  uint8_t inmod;       // Interrupt mode
+  uint32_t tdc;        // Send cycle
+  uint8_t tr_time;     // Time interval of sensor recording data
+  uint8_t sht_noud;
+  bool clock_switch;
+  uint16_t strat_time;
+  uint8_t mod;       // mode
+  uint8_t lidar_acq; // LIDAR-Lite acquisition count, 0 for its default
+} SYSTEM;
+
+extern SYSTEM sys;
+
+// The user key of main.h, sharing EXTI line 7 with the HX711 DOUT
+#define GPIO_USERKEY_PORT GPIOA
+#define GPIO_USERKEY_PIN GPIO_PIN_7
+
+// The 5V sensor rail switch of main.h, on when low
+#define Power_5v_GPIO_Port GPIOB
+#define Power_5v_Pin GPIO_PIN_5
+
+typedef struct {
+  uint32_t exit_count;
+  uint16_t batteryLevel_mV;
+  uint16_t intensity;
+  float GapValue;
+} SENSOR;
+
+extern SENSOR sensor;
+
+void EX_GPIO_Init(uint8_t state);
+void StrToHex(char *pbDest, char *pszSrc, int nLen);
+
+#endif
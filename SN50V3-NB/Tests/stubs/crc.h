@@ -0,0 +1,8 @@
+#ifndef __CRC_H__
+#define __CRC_H__
+
+#include "stm32l0xx_hal.h"
+
+extern CRC_HandleTypeDef hcrc;
+
+#endif
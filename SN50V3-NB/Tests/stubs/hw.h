@@ -0,0 +1,9 @@
+#ifndef __HW_H__
+#define __HW_H__
+
+/* Stands for the firmware's hw.h in the host tests: the RTC timer of
+ * hw_rtc.h, defined by the test of time_server.c */
+#include "rtc.h"
+#include "hw_rtc.h"
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef __i2c_H
+#define __i2c_H
+
+#include "stm32l0xx_hal.h"
+
+extern I2C_HandleTypeDef hi2c1;
+void MX_I2C1_Init(void);
+
+#endif
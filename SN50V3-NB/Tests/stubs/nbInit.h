@@ -0,0 +1,38 @@
+#ifndef __NB_INIT_H__
+#define __NB_INIT_H__
+
+#include <stdint.h>
+
+#include "time_server.h"
+
+/* Stands for the firmware's nbInit.h in the host tests: the identities the
+ * LwM2M client reaches, and the NB task steps nb_step.c paces, defined by
+ * their tests */
+typedef enum {
+  _AT = 0,
+  _ATE,
+  _AT_QCFGEV,
+  _AT_IMEI,
+  _AT_CGMM,
+  _AT_QRST,
+  _AT_QRST2,
+  _AT_URI,
+  _AT_ERROR,
+  _AT_IDLE,
+  _AT_FLAG_INIT,
+} ATCmdNum;
+
+typedef struct {
+  uint8_t imei[20];
+} NB;
+
+typedef struct {
+  uint8_t deui[16];
+} USER;
+
+extern NB nb;
+extern USER user;
+
+ATCmdNum NBTASK(uint8_t *task);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __RTC_H__
+#define __RTC_H__
+
+#include <stdint.h>
+
+#include "stm32l0xx_hal.h"
+
+/* Stands for the firmware's rtc.h, and the main.h it includes, in the host
+ * tests: the calendar part of the RTC HAL that time_server.c reaches, and
+ * Error_Handler(), defined by its test */
+typedef struct {
+  uint8_t Hours;
+  uint8_t Minutes;
+  uint8_t Seconds;
+  uint8_t TimeFormat;
+  uint32_t SubSeconds;
+  uint32_t SecondFraction;
+  uint32_t DayLightSaving;
+  uint32_t StoreOperation;
+} RTC_TimeTypeDef;
+
+typedef struct {
+  uint8_t WeekDay;
+  uint8_t Month;
+  uint8_t Date;
+  uint8_t Year;
+} RTC_DateTypeDef;
+
+typedef struct {
+  RTC_TimeTypeDef AlarmTime;
+  uint32_t AlarmMask;
+  uint32_t AlarmSubSecondMask;
+  uint32_t AlarmDateWeekDaySel;
+  uint8_t AlarmDateWeekDay;
+  uint32_t Alarm;
+} RTC_AlarmTypeDef;
+
+#define RTC_FORMAT_BIN 0x00000000U
+#define RTC_FORMAT_BCD 0x00000001U
+#define RTC_DAYLIGHTSAVING_NONE 0x00000000U
+#define RTC_STOREOPERATION_RESET 0x00000000U
+#define RTC_ALARMMASK_DATEWEEKDAY 0x80000000U
+#define RTC_ALARMSUBSECONDMASK_ALL 0x00000000U
+#define RTC_ALARMDATEWEEKDAYSEL_DATE 0x00000000U
+#define RTC_ALARM_A 0x00000100U
+#define RTC_ALARM_B 0x00000200U
+
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef *hrtc,
+                                  RTC_TimeTypeDef *sTime, uint32_t Format);
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef *hrtc,
+                                  RTC_DateTypeDef *sDate, uint32_t Format);
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef *hrtc,
+                                      RTC_AlarmTypeDef *sAlarm,
+                                      uint32_t Format);
+HAL_StatusTypeDef HAL_RTC_DeactivateAlarm(RTC_HandleTypeDef *hrtc,
+                                          uint32_t Alarm);
+void Error_Handler(void);
+
+#endif
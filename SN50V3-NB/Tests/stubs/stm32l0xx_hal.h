@@ -0,0 +1,299 @@
+#ifndef __STM32L0xx_HAL_H
+#define __STM32L0xx_HAL_H
+
+#include <stdint.h>
+
+/* The part of the HAL the host tests reach, backed by host_hal.c. The data
+ * EEPROM and the flash are mapped at their addresses on the STM32L072.
+ * The GPIO ports are reached through host_gpio(), which applies the BSRR
+ * and BRR writes made since the last access, so that a model of the chip
+ * on the pins sees their edges in program order. */
+#define __IO volatile
+
+typedef enum {
+  HAL_OK = 0x00U,
+  HAL_ERROR = 0x01U,
+  HAL_BUSY = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+#define FLASH_BASE (0x08000000UL)
+#define FLASH_PAGE_SIZE (128U)
+#define DATA_EEPROM_BASE (0x08080000UL)
+#define DATA_EEPROM_BANK2_BASE (0x08080C00UL)
+#define DATA_EEPROM_BANK2_END (0x080817FFUL)
+#define FACTORY_BASE (0x1FF80000UL) // VREFINT and temperature sensor data
+#define FLASH_TYPEPROGRAMDATA_WORD (0x02U)
+#define FLASH_TYPEPROGRAM_WORD (0x02U)
+#define FLASH_TYPEERASE_PAGES (0x00U)
+
+typedef struct {
+  uint32_t TypeErase;
+  uint32_t PageAddress;
+  uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+typedef struct {
+  uint32_t State;
+} CRC_HandleTypeDef;
+
+#define __HAL_CRC_DR_RESET(__HANDLE__) ((void)(__HANDLE__))
+
+typedef struct {
+  __IO uint32_t MODER;
+  __IO uint32_t OTYPER;
+  __IO uint32_t OSPEEDR;
+  __IO uint32_t PUPDR;
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+  __IO uint32_t LCKR;
+  __IO uint32_t AFR[2];
+  __IO uint32_t BRR;
+} GPIO_TypeDef;
+
+typedef struct {
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef enum { GPIO_PIN_RESET = 0U, GPIO_PIN_SET } GPIO_PinState;
+
+#define GPIOA_BASE (0x50000000UL)
+#define GPIOB_BASE (0x50000400UL)
+#define GPIOC_BASE (0x50000800UL)
+#define GPIOD_BASE (0x50000C00UL)
+#define GPIOH_BASE (0x50001C00UL)
+#define GPIOA host_gpio(GPIOA_BASE)
+#define GPIOB host_gpio(GPIOB_BASE)
+#define GPIOC host_gpio(GPIOC_BASE)
+#define GPIOD host_gpio(GPIOD_BASE)
+#define GPIOH host_gpio(GPIOH_BASE)
+
+#define GPIO_PIN_0 ((uint16_t)0x0001U)
+#define GPIO_PIN_1 ((uint16_t)0x0002U)
+#define GPIO_PIN_2 ((uint16_t)0x0004U)
+#define GPIO_PIN_3 ((uint16_t)0x0008U)
+#define GPIO_PIN_4 ((uint16_t)0x0010U)
+#define GPIO_PIN_5 ((uint16_t)0x0020U)
+#define GPIO_PIN_6 ((uint16_t)0x0040U)
+#define GPIO_PIN_7 ((uint16_t)0x0080U)
+#define GPIO_PIN_8 ((uint16_t)0x0100U)
+#define GPIO_PIN_9 ((uint16_t)0x0200U)
+#define GPIO_PIN_10 ((uint16_t)0x0400U)
+#define GPIO_PIN_11 ((uint16_t)0x0800U)
+#define GPIO_PIN_12 ((uint16_t)0x1000U)
+#define GPIO_PIN_13 ((uint16_t)0x2000U)
+#define GPIO_PIN_14 ((uint16_t)0x4000U)
+#define GPIO_PIN_15 ((uint16_t)0x8000U)
+
+#define GPIO_MODE_INPUT (0x00000000U)
+#define GPIO_MODE_OUTPUT_PP (0x00000001U)
+#define GPIO_MODE_ANALOG (0x00000003U)
+#define GPIO_MODE_IT_RISING (0x10110000U)
+#define GPIO_MODE_IT_FALLING (0x10210000U)
+#define GPIO_NOPULL (0x00000000U)
+#define GPIO_PULLUP (0x00000001U)
+#define GPIO_PULLDOWN (0x00000002U)
+#define GPIO_SPEED_HIGH (0x00000002U)
+
+#define __HAL_RCC_GPIOA_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE() ((void)0)
+#define __HAL_RCC_GPIOH_CLK_ENABLE() ((void)0)
+
+// The pending bits of the EXTI lines and of the NVIC, set by the tests
+typedef struct {
+  __IO uint32_t IMR;
+  __IO uint32_t EMR;
+  __IO uint32_t RTSR;
+  __IO uint32_t FTSR;
+  __IO uint32_t SWIER;
+  __IO uint32_t PR;
+} EXTI_TypeDef;
+
+typedef struct {
+  __IO uint32_t ISPR[1];
+} NVIC_Type;
+
+typedef enum {
+  RTC_IRQn = 2,
+  EXTI0_1_IRQn = 5,
+  EXTI2_3_IRQn = 6,
+  EXTI4_15_IRQn = 7,
+  LPUART1_IRQn = 29,
+} IRQn_Type;
+
+extern EXTI_TypeDef host_EXTI;
+extern NVIC_Type host_NVIC;
+#define EXTI (&host_EXTI)
+#define NVIC (&host_NVIC)
+
+#define __HAL_GPIO_EXTI_GET_IT(__EXTI_LINE__) (EXTI->PR & (__EXTI_LINE__))
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__)                                \
+  (EXTI->PR &= ~(uint32_t)(__EXTI_LINE__))
+
+// The UARTs, their bytes delivered by the tests
+typedef struct {
+  uint32_t Instance;
+} UART_HandleTypeDef;
+
+// The I2C buses, their devices modelled by the tests
+typedef struct {
+  uint32_t Instance;
+} I2C_HandleTypeDef;
+
+// The RTC, its calendar part in rtc.h
+typedef struct {
+  uint32_t Instance;
+} RTC_HandleTypeDef;
+
+// The ADC, modelled by the tests through the host_adc_ functions
+typedef struct {
+  __IO uint32_t ISR;
+  __IO uint32_t CR;
+  __IO uint32_t SMPR;
+  __IO uint32_t CHSELR;
+  __IO uint32_t DR;
+  __IO uint32_t CALFACT;
+} ADC_TypeDef;
+
+typedef struct {
+  uint32_t SamplingTime;
+} ADC_InitTypeDef;
+
+typedef struct {
+  ADC_TypeDef *Instance;
+  ADC_InitTypeDef Init;
+} ADC_HandleTypeDef;
+
+typedef struct {
+  uint32_t Channel;
+  uint32_t Rank;
+} ADC_ChannelConfTypeDef;
+
+#define ADC_SINGLE_ENDED (0x00000000U)
+#define ADC_FLAG_RDY (0x00000001U)
+#define ADC_CR_ADEN (0x00000001U)
+#define ADC_SMPR_SMPR (0x00000007U)
+#define ADC_SAMPLETIME_7CYCLES_5 (0x00000002U)
+#define ADC_SAMPLETIME_160CYCLES_5 (0x00000007U)
+#define ADC_CHANNEL_0 (0x00000001U)
+#define ADC_CHANNEL_1 (0x00000002U)
+#define ADC_CHANNEL_4 (0x00000010U)
+#define ADC_CHANNEL_VREFINT (0x00020000U)
+#define ADC_CHANNEL_TEMPSENSOR (0x00040000U)
+#define ADC_CHANNEL_MASK (0x0007FFFFU)
+#define ADC_RANK_CHANNEL_NUMBER (0x00001000U)
+#define ADC_RANK_NONE (0x00001001U)
+#define HAL_MAX_DELAY (0xFFFFFFFFU)
+#define PWR_FLAG_VREFINTRDY (0x00000008U)
+
+#define MODIFY_REG(REG, CLEARMASK, SETMASK)                                    \
+  ((REG) = (((REG) & (~(CLEARMASK))) | (SETMASK)))
+#define __HAL_ADC_ENABLE(__HANDLE__) host_adc_enable(__HANDLE__, 1)
+#define __HAL_ADC_DISABLE(__HANDLE__) host_adc_enable(__HANDLE__, 0)
+#define __HAL_ADC_GET_FLAG(__HANDLE__, __FLAG__)                               \
+  ((host_adc_isr(__HANDLE__) & (__FLAG__)) == (__FLAG__))
+#define __HAL_ADC_CLEAR_FLAG(__HANDLE__, __FLAG__)                             \
+  ((__HANDLE__)->Instance->ISR &= ~(uint32_t)(__FLAG__))
+#define ADC_IS_ENABLE(__HANDLE__) host_adc_is_enable(__HANDLE__)
+#define __HAL_RCC_ADC1_CLK_ENABLE() host_adc_clock(1)
+#define __HAL_RCC_ADC1_CLK_DISABLE() host_adc_clock(0)
+#define __HAL_PWR_GET_FLAG(__FLAG__) (1U)
+
+void host_adc_enable(ADC_HandleTypeDef *hadc, uint8_t on);
+uint32_t host_adc_isr(ADC_HandleTypeDef *hadc);
+uint32_t host_adc_is_enable(ADC_HandleTypeDef *hadc);
+void host_adc_clock(uint8_t on);
+
+#define PWR_MAINREGULATOR_ON (0x00000000U)
+#define PWR_SLEEPENTRY_WFI ((uint8_t)0x01U)
+
+// Stop and the system clock, modelled by the tests through the host_rcc_
+// functions
+#define __weak __attribute__((weak))
+#define TICK_INT_PRIORITY (0x00U)
+#define PWR_LOWPOWERREGULATOR_ON (0x00000001U)
+#define PWR_STOPENTRY_WFI ((uint8_t)0x01U)
+#define PWR_FLAG_WU (0x00000001U)
+#define RCC_STOP_WAKEUPCLOCK_MSI (0x00000000U)
+#define RCC_STOP_WAKEUPCLOCK_HSI (0x00008000U)
+#define RCC_SYSCLKSOURCE_STATUS_MSI (0x00000000U)
+#define RCC_SYSCLKSOURCE_STATUS_HSI (0x00000004U)
+#define RCC_SYSCLKSOURCE_STATUS_PLLCLK (0x0000000CU)
+#define __HAL_RCC_PWR_CLK_ENABLE() ((void)0)
+#define __HAL_PWR_CLEAR_FLAG(__FLAG__) ((void)0)
+#define __HAL_RCC_WAKEUPSTOP_CLK_CONFIG(__STCLKSOURCE__)                       \
+  host_rcc_stop_wakeup(__STCLKSOURCE__)
+#define __HAL_RCC_GET_SYSCLK_SOURCE() host_rcc_sysclk()
+
+extern uint32_t SystemCoreClock;
+void host_rcc_stop_wakeup(uint32_t clock);
+uint32_t host_rcc_sysclk(void);
+
+GPIO_TypeDef *host_gpio(uint32_t base);
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState);
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry);
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry);
+void HAL_PWREx_EnableUltraLowPower(void);
+void HAL_PWREx_EnableFastWakeUp(void);
+void SystemCoreClockUpdate(void);
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority);
+void HAL_SuspendTick(void);
+void HAL_ResumeTick(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void __disable_irq(void);
+void __enable_irq(void);
+
+void HAL_Delay(uint32_t Delay);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *hadc,
+                                        ADC_ChannelConfTypeDef *sConfig);
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADC_PollForConversion(ADC_HandleTypeDef *hadc,
+                                            uint32_t Timeout);
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *hadc);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc,
+                                              uint32_t SingleDiff);
+uint32_t HAL_ADCEx_Calibration_GetValue(ADC_HandleTypeDef *hadc,
+                                        uint32_t SingleDiff);
+HAL_StatusTypeDef HAL_ADCEx_Calibration_SetValue(ADC_HandleTypeDef *hadc,
+                                                 uint32_t SingleDiff,
+                                                 uint32_t CalibrationFactor);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c,
+                                    uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c,
+                                   uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart,
+                                      uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UARTEx_DisableStopMode(UART_HandleTypeDef *huart);
+
+uint32_t HAL_GetTick(void);
+void NVIC_SystemReset(void);
+void NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Unlock(void);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Lock(void);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Program(uint32_t TypeProgram,
+                                                 uint32_t Address,
+                                                 uint32_t Data);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address,
+                                    uint32_t Data);
+uint32_t HAL_FLASH_GetError(void);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit,
+                                    uint32_t *PageError);
+
+#endif
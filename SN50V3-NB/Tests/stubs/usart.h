@@ -0,0 +1,24 @@
+#ifndef __USART_H__
+#define __USART_H__
+
+#include <stdio.h>
+
+#include "stm32l0xx_hal.h"
+
+#define RXSIZE 1
+
+extern UART_HandleTypeDef huart1;
+void My_UARTEx_StopModeWakeUp(UART_HandleTypeDef *uartHandle);
+
+/* Logs of the modules under test: the last user_main_printf() line is
+ * kept in host_last_log, and printed when HOST_VERBOSE is set */
+extern char host_last_log[256];
+void host_log(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+#define user_main_printf(format, ...) host_log(format, ##__VA_ARGS__)
+#define user_main_info(format, ...)
+#define user_main_debug(format, ...)
+#define user_main_error(format, ...)
+
+#endif
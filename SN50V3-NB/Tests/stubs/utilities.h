@@ -0,0 +1,21 @@
+#ifndef __UTILITIES_H__
+#define __UTILITIES_H__
+
+#include <stdint.h>
+
+/* Stands for the firmware's utilities.h in the host tests: the critical
+ * sections mask the interrupts in host_primask, which the tests check is
+ * restored */
+extern uint32_t host_primask;
+
+#define BACKUP_PRIMASK() uint32_t primask_bit = host_primask
+#define DISABLE_IRQ() (host_primask = 1)
+#define ENABLE_IRQ() (host_primask = 0)
+#define RESTORE_PRIMASK() (host_primask = primask_bit)
+
+typedef uint32_t TimerTime_t;
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __VCOM_H__
+#define __VCOM_H__
+
+/* Stands for the console driver that utilities_conf.h pulls in, with the
+ * hardware configuration behind it */
+#include <stdint.h>
+
+#endif
@@ -0,0 +1,243 @@
+#include "aead.h"
+#include "aead_ref.h"
+#include "flash_eraseprogram.h"
+#include "host.h"
+
+/* AES-128-CCM frames of aead.c, opened with the reference of aead_ref.c.
+ * The frame vectors were sealed with OpenSSL (EVP_aes_128_ccm, 12-byte
+ * nonce, 8-byte tag) under the key 00..0f, over the header 0011..77 and
+ * the payload 01 02 03 .. */
+#define HEADER "0011223344556677"
+
+static const uint8_t key[AEAD_KEY_SIZE] = {0, 1, 2,  3,  4,  5,  6,  7,
+                                           8, 9, 10, 11, 12, 13, 14, 15};
+
+static const struct {
+  uint32_t counter;
+  size_t len; // payload bytes
+  const char *sealed;
+} frames[] = {
+    {0, 17, HEADER "00000000"
+                   "39753847a4110e392a760bbca48adf4066"
+                   "8082c4779f6e8bf2"},
+    {64, 17, HEADER "00000040"
+                    "08676c6725cee2d8eb7540422d1b5a564f"
+                    "4cb5578748b820bf"},
+    {0x01020304, 40, HEADER "01020304"
+                            "f11fc48532cca58dc266f4f96c85c50d951f7e376c2555"
+                            "2c8ea2331bf464ad2c2f05ba91c458e0b3"
+                            "417580b40a8bd7c7"},
+};
+
+static char frame[1200];
+
+// The clear frame as txPayLoadDeal() hands it to Aead_Seal()
+static size_t clear_frame(size_t len) {
+  strcpy(frame, HEADER);
+  for (size_t i = 0; i < len; i++)
+    sprintf(frame + strlen(frame), "%.2x", (unsigned)(i + 1));
+  return strlen(frame);
+}
+
+// Seals the frame and checks the reference opens it back
+static uint32_t seal_open(size_t len) {
+  uint8_t bin[600], clear[600];
+  uint32_t counter = 0xFFFFFFFF;
+  size_t sealed = Aead_Seal(frame, clear_frame(len));
+  int n;
+
+  CHECK(sealed == strlen(frame));
+  CHECK(sealed == (len + AEAD_HEADER_SIZE + AEAD_COUNTER_SIZE +
+                   AEAD_TAG_SIZE) * 2);
+  n = Aead_Open(key, bin, host_unhex(bin, frame), clear, &counter);
+  CHECK(n == (int)(AEAD_HEADER_SIZE + len));
+  for (int i = 0; i < n; i++)
+    CHECK(clear[i] == (i < AEAD_HEADER_SIZE ? 0x11 * i : i - 7));
+  return counter;
+}
+
+static void test_reference(void) {
+  // FIPS 197 appendix C.1
+  static const uint8_t pt[16] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                                 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb,
+                                 0xcc, 0xdd, 0xee, 0xff};
+  static const char ct[] = "69c4e0d86a7b0430d8cdb78070b4c55a";
+  // SP 800-38C example 3
+  static const char ccm[] = "e3b201a9f5b71a7a9b1ceaeccd97e70b6176aad9a4428aa5"
+                            "484392fbc1b09951";
+  uint8_t k[16], nonce[12], ad[20], in[24], out[40];
+  char hex[81];
+  Aes128 aes;
+
+  Aes128_Init(&aes, key);
+  Aes128_Encrypt(&aes, pt, out);
+  host_hex(hex, out, 16);
+  CHECK(strcmp(hex, ct) == 0);
+
+  for (int i = 0; i < 24; i++) {
+    if (i < 16)
+      k[i] = 0x40 + i;
+    if (i < 12)
+      nonce[i] = 0x10 + i;
+    if (i < 20)
+      ad[i] = i;
+    in[i] = 0x20 + i;
+  }
+  CHECK(Ccm_Seal(k, nonce, 12, ad, 20, in, 24, out, 8) == 32);
+  host_hex(hex, out, 32);
+  CHECK(strcmp(hex, ccm) == 0);
+  CHECK(Ccm_Open(k, nonce, 12, ad, 20, out, 32, in, 8) == 24);
+  CHECK(in[0] == 0x20 && in[23] == 0x37);
+  out[31] ^= 1;
+  CHECK(Ccm_Open(k, nonce, 12, ad, 20, out, 32, in, 8) == -1);
+}
+
+static void test_vectors(void) {
+  uint8_t bin[600], clear[600];
+  uint32_t counter;
+
+  host_eeprom_clear();
+  CHECK(Aead_KeySet(key) == 1);
+  clear_frame(frames[0].len);
+  CHECK(Aead_Seal(frame, strlen(frame)) == strlen(frames[0].sealed));
+  CHECK(strcmp(frame, frames[0].sealed) == 0);
+
+  // a reset resumes after the block reserved before the first frame
+  Aead_Init();
+  CHECK(Aead_Counter() == AEAD_NONCE_STEP);
+  clear_frame(frames[1].len);
+  Aead_Seal(frame, strlen(frame));
+  CHECK(strcmp(frame, frames[1].sealed) == 0);
+
+  *(volatile uint32_t *)EEPROM_USER_AEAD_COUNTER = frames[2].counter;
+  Aead_Init();
+  clear_frame(frames[2].len);
+  Aead_Seal(frame, strlen(frame));
+  CHECK(strcmp(frame, frames[2].sealed) == 0);
+
+  for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+    size_t n = host_unhex(bin, frames[i].sealed);
+
+    CHECK(Aead_Open(key, bin, n, clear, &counter) ==
+          (int)(AEAD_HEADER_SIZE + frames[i].len));
+    CHECK(counter == frames[i].counter);
+    // the counter is part of the nonce
+    bin[AEAD_HEADER_SIZE + 3] ^= 1;
+    CHECK(Aead_Open(key, bin, n, clear, &counter) == -1);
+  }
+}
+
+// Setting the same key again must not reuse the nonces already sent
+static void test_key_set_again(void) {
+  uint32_t first, second;
+
+  host_eeprom_clear();
+  CHECK(Aead_KeySet(key) == 1);
+  first = seal_open(17);
+  seal_open(3);
+  CHECK(Aead_KeySet(key) == 1);
+  second = seal_open(17);
+  CHECK(second > first + 1);
+  CHECK(Aead_Counter() == second + 1);
+}
+
+// No counter is used before its block is in EEPROM
+static void test_reservation(void) {
+  uint32_t writes, counter;
+
+  host_eeprom_clear();
+  CHECK(Aead_KeySet(key) == 1);
+  seal_open(5);
+  writes = host_eeprom_writes;
+  for (int i = 1; i < AEAD_NONCE_STEP; i++)
+    seal_open(5);
+  CHECK(host_eeprom_writes == writes);
+
+  host_eeprom_fail = 1;
+  counter = Aead_Counter();
+  CHECK(Aead_Seal(frame, clear_frame(5)) == 0);
+  CHECK(Aead_Counter() == counter);
+  host_eeprom_fail = 0;
+  CHECK(seal_open(5) == counter);
+  CHECK(*(volatile uint32_t *)EEPROM_USER_AEAD_COUNTER ==
+        counter + AEAD_NONCE_STEP);
+
+  // nor is a key taken when it did not make it to EEPROM
+  host_eeprom_fail = 1;
+  CHECK(Aead_KeySet(key) == 0);
+}
+
+/* A frame too long for RAM, sealed as it is read: the clear frame comes
+ * from clear_read() and the sealed one is read back in slices of random
+ * lengths, which must give the frame Aead_Seal() makes at that counter. */
+static char clear[1200];
+static int clearReads;
+
+static size_t clear_read(size_t offset, char *dst, size_t len) {
+  size_t clearLen = strlen(clear);
+
+  clearReads++;
+  if (offset >= clearLen)
+    return 0;
+  if (len > clearLen - offset)
+    len = clearLen - offset;
+  memcpy(dst, clear + offset, len);
+  return len;
+}
+
+static void test_streamed(void) {
+  static const size_t lens[] = {0, 1, 15, 16, 17, 160, 255};
+  char sealed[1200];
+  uint32_t counter;
+  size_t len;
+
+  host_eeprom_clear();
+  CHECK(Aead_KeySet(key) == 1);
+  srand(49);
+  for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    size_t offset = 0, n;
+
+    clear_frame(lens[i]);
+    strcpy(clear, frame);
+    counter = Aead_Counter();
+    len = Aead_SealOpen(clear_read, strlen(clear));
+    CHECK(len == strlen(clear) + (AEAD_COUNTER_SIZE + AEAD_TAG_SIZE) * 2);
+    CHECK(Aead_Counter() == counter + 1);
+    while ((n = Aead_SealRead(offset, sealed + offset, 1 + rand() % 70)) != 0)
+      offset += n;
+    CHECK(offset == len);
+    sealed[offset] = '\0';
+
+    // the same frame as sealed in place with that counter
+    *(volatile uint32_t *)EEPROM_USER_AEAD_COUNTER = counter;
+    Aead_Init();
+    CHECK(Aead_Seal(frame, strlen(frame)) == len);
+    CHECK(strcmp(frame, sealed) == 0);
+    *(volatile uint32_t *)EEPROM_USER_AEAD_COUNTER = counter + 2;
+    Aead_Init();
+  }
+  // only the slices asked for are read again
+  clearReads = 0;
+  clear_frame(255);
+  strcpy(clear, frame);
+  len = Aead_SealOpen(clear_read, strlen(clear));
+  clearReads = 0;
+  CHECK(Aead_SealRead(0, sealed, 40) == 40);
+  CHECK(clearReads <= 3);
+  CHECK(Aead_SealRead(len - 10, sealed, 40) == 10);
+  CHECK(Aead_SealRead(len, sealed, 40) == 0);
+  // a frame that can't be read isn't sealed
+  counter = Aead_Counter();
+  clear[0] = '\0';
+  CHECK(Aead_SealOpen(clear_read, 40) == 0);
+  CHECK(Aead_Counter() == counter);
+}
+
+int main(void) {
+  test_reference();
+  test_vectors();
+  test_key_set_again();
+  test_reservation();
+  test_streamed();
+  return host_report("aead");
+}
@@ -0,0 +1,151 @@
+#include "at.h"
+#include "config.h"
+#include "host.h"
+
+/* The command lookup of at_cmd.c over the whole ATCommand table: every
+ * command with each of its suffixes reaches the handler its entry names,
+ * and commands that share a prefix (FDR and FDR1, AEAD and AEADKEY, CFG
+ * and CFGMOD, the URIs) never reach one another, nor do their prefixes or
+ * extensions reach any. AT_Sort() reports a command listed twice. */
+#define COMMANDS ((int)(sizeof(ATCommand) / sizeof(ATCommand[0])))
+
+typedef struct {
+  const char *line;
+  const char *handler; // of at.c, or NULL for no command
+} Lookup;
+
+static const Lookup collisions[] = {
+    {"AT+FDR", "at_fdr_run"},
+    {"AT+FDR1", "at_fdr1_run"},
+    {"AT+AEAD=?", "at_aead_get"},
+    {"AT+AEADKEY=?", "at_aeadkey_get"},
+    {"AT+PWD=?", "at_pwd_get"},
+    {"AT+PWORD=?", "at_pword_get"},
+    {"AT+CFG", "at_cfg_run"},
+    {"AT+CFGMOD=?", "at_mod_get"},
+    {"AT+URI1=?", "at_uri1_get"},
+    {"AT+URI4=?", "at_uri4_get"},
+    {"ATZ", "at_reset_run"},
+    // prefixes and extensions of commands, and other cases
+    {"AT+FD", NULL},
+    {"AT+FDR2", NULL},
+    {"AT+AEADK=1", NULL},
+    {"AT+CFGMO=?", NULL},
+    {"AT+URI=?", NULL},
+    {"AT+URI5=?", NULL},
+    {"AT+PW=?", NULL},
+    {"AT+", NULL},
+    {"ATZZ", NULL},
+    {"AT=1", NULL},
+    {"at+tdc=?", NULL},
+};
+
+static const char *called = NULL;
+static const char *calledParam = NULL;
+static uint32_t saves = 0;
+
+int host_at_handler(const char *name, const char *param) {
+  called = name;
+  calledParam = param;
+  return strcmp(name, "at_return_error") == 0 ? AT_ERROR : AT_OK;
+}
+
+void config_Save(void) { saves++; }
+
+// The name of the at.c handler behind a table pointer
+static const char *handler(ATEerror_t (*fn)(const char *param)) {
+  called = NULL;
+  fn(NULL);
+  return called;
+}
+
+// A console line as usart.c hands it over, with its line ending
+static ATEerror_t type(const char *line) {
+  static char buf[AT_VALUE_MAX + 20];
+
+  snprintf(buf, sizeof(buf), "%s\r\n", line);
+  called = calledParam = NULL;
+  host_last_log[0] = '\0';
+  return ATInsPro(buf);
+}
+
+static void test_table(void) {
+  char line[64];
+  uint32_t lookups = 0;
+
+  for (int i = 0; i < COMMANDS; i++) {
+    const struct ATCommand_s *c = &ATCommand[i];
+    const char *run = handler(c->run), *get = handler(c->get);
+    const char *set = handler(c->set);
+    uint32_t before = saves;
+
+    CHECK(c->size_string == (int)strlen(c->string) - 2);
+
+    // the command alone runs it
+    type(c->string);
+    CHECK(called == run && strcmp(calledParam, c->string) == 0);
+
+    // "=?" reads it
+    snprintf(line, sizeof(line), "%s=?", c->string);
+    type(line);
+    CHECK(called == get && strcmp(calledParam, line) == 0);
+
+    // "=" sets it, and an accepted setting is saved
+    snprintf(line, sizeof(line), "%s=1", c->string);
+    type(line);
+    CHECK(called == set && strcmp(calledParam, line) == 0);
+    CHECK(saves - before == (strcmp(set, "at_return_error") != 0));
+
+    // "?" prints its help without a handler
+    snprintf(line, sizeof(line), "%s?", c->string);
+    CHECK(type(line) == AT_OK && called == NULL);
+    CHECK(strcmp(host_last_log, c->help_string) == 0);
+    lookups += 4;
+  }
+  printf("AT command table: %d commands, %u lookups\n", COMMANDS, lookups);
+}
+
+static void test_collisions(void) {
+  for (size_t i = 0; i < sizeof(collisions) / sizeof(collisions[0]); i++) {
+    const Lookup *l = &collisions[i];
+    ATEerror_t ret = type(l->line);
+
+    if (l->handler == NULL) {
+      CHECK(ret == AT_ERROR && called == NULL);
+    } else {
+      CHECK(called != NULL && strcmp(called, l->handler) == 0);
+    }
+    if (called != NULL && l->handler != NULL && strcmp(called, l->handler))
+      printf("%s reached %s\n", l->line, called);
+  }
+  CHECK(type("AT") == AT_OK && called == NULL);
+}
+
+static void test_sort(void) {
+  static const struct ATCommand_s twice[] = {
+      {.string = AT "+TDC"}, {.string = AT "+APN"}, {.string = AT "+TDC"},
+      {.string = AT "+5VT"}, {.string = AT "+APN"},
+  };
+  uint8_t index[COMMANDS];
+
+  // the firmware's table lists every command once
+  CHECK(AT_Sort(ATCommand, index, COMMANDS) == 0);
+  for (int i = 1; i < COMMANDS; i++)
+    CHECK(strcmp(ATCommand[index[i - 1]].string,
+                 ATCommand[index[i]].string) < 0);
+
+  // the duplicates are found wherever they are
+  CHECK(AT_Sort(twice, index, 5) == 2);
+  CHECK(strcmp(twice[index[0]].string, "AT+5VT") == 0);
+  CHECK(strcmp(twice[index[4]].string, "AT+TDC") == 0);
+  CHECK(AT_Sort(twice, index, 3) == 1);
+  CHECK(AT_Sort(twice, index, 2) == 0);
+}
+
+int main(void) {
+  AT_Init();
+  test_table();
+  test_collisions();
+  test_sort();
+  return host_report("at");
+}
@@ -0,0 +1,226 @@
+#include "auth.h"
+#include "cmox_crypto.h"
+#include "host.h"
+
+/* The HMAC-SHA256 tags of auth.c, started from the cached ipad and opad
+ * states, against the known answers of RFC 4231 and an HMAC computed from
+ * its definition for each tag (RFC 2104), the way the tags were made
+ * before the states were cached. Covers the binary, hex and streamed
+ * frames, and the AT+AUTH=0 tag over the hex string padded to 40. */
+typedef struct {
+  const char *key;  // hex, or NULL for keyLen bytes of keyByte
+  uint8_t keyByte;
+  size_t keyLen;
+  const char *data; // text, or NULL for dataLen bytes of dataByte
+  uint8_t dataByte;
+  size_t dataLen;
+  size_t tagLen;
+  const char *tag;
+} Vector;
+
+static const Vector rfc4231[] = {
+    {NULL, 0x0b, 20, "Hi There", 0, 0, 32,
+     "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"},
+    {"4a656665", 0, 0, "what do ya want for nothing?", 0, 0, 32,
+     "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843"},
+    {NULL, 0xaa, 20, NULL, 0xdd, 50, 32,
+     "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe"},
+    {"0102030405060708090a0b0c0d0e0f10111213141516171819", 0, 0, NULL, 0xcd,
+     50, 32,
+     "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b"},
+    {NULL, 0x0c, 20, "Test With Truncation", 0, 0, 16,
+     "a3b6167473100ee06e0c796c2955552b"},
+    {NULL, 0xaa, 131, "Test Using Larger Than Block-Size Key - Hash Key First",
+     0, 0, 32,
+     "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"},
+    {NULL, 0xaa, 131,
+     "This is a test using a larger than block-size key and a larger than "
+     "block-size data. The key needs to be hashed before being used by the "
+     "HMAC algorithm.",
+     0, 0, 32,
+     "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2"},
+};
+
+static uint8_t key[200];
+static size_t keyLen;
+
+// The streamed frame, and the longest read asked for
+static const char *frame;
+static size_t frameLen;
+static size_t readMax;
+
+static size_t frame_read(size_t offset, char *dst, size_t len) {
+  size_t n = offset < frameLen ? frameLen - offset : 0;
+
+  if (len > readMax)
+    readMax = len;
+  if (n > len)
+    n = len;
+  memcpy(dst, frame + offset, n);
+  return n;
+}
+
+// HMAC(K, m) = H((K0 ^ opad) | H((K0 ^ ipad) | m)), nothing kept between
+static void hmac_ref(const uint8_t *msg, size_t len, uint8_t *tag) {
+  static uint8_t buf[64 + 2000];
+  uint8_t k0[64] = {0};
+
+  if (keyLen > 64)
+    cmox_hash_compute(CMOX_SHA256_ALGO, key, keyLen, k0, 32, NULL);
+  else
+    memcpy(k0, key, keyLen);
+  for (int i = 0; i < 64; i++)
+    buf[i] = k0[i] ^ 0x36;
+  memcpy(buf + 64, msg, len);
+  cmox_hash_compute(CMOX_SHA256_ALGO, buf, 64 + len, buf + 64, 32, NULL);
+  for (int i = 0; i < 64; i++)
+    buf[i] = k0[i] ^ 0x5c;
+  cmox_hash_compute(CMOX_SHA256_ALGO, buf, 64 + 32, tag, 32, NULL);
+}
+
+static void set_key(const uint8_t *k, size_t len) {
+  memcpy(key, k, len);
+  keyLen = len;
+  CHECK(Auth_SetKey(key, keyLen));
+}
+
+static void test_sha256(void) {
+  static const char *two =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  uint8_t digest[32], expected[32];
+
+  cmox_hash_compute(CMOX_SHA256_ALGO, (const uint8_t *)"abc", 3, digest, 32,
+                    NULL);
+  host_unhex(expected, "ba7816bf8f01cfea414140de5dae2223"
+                       "b00361a396177a9cb410ff61f20015ad");
+  CHECK(memcmp(digest, expected, 32) == 0);
+  cmox_hash_compute(CMOX_SHA256_ALGO, (const uint8_t *)two, strlen(two),
+                    digest, 32, NULL);
+  host_unhex(expected, "248d6a61d20638b8e5c026930c3e6039"
+                       "a33ce45964ff2167f6ecedd419db06c1");
+  CHECK(memcmp(digest, expected, 32) == 0);
+}
+
+static void test_rfc4231(void) {
+  for (size_t v = 0; v < sizeof(rfc4231) / sizeof(rfc4231[0]); v++) {
+    const Vector *t = &rfc4231[v];
+    uint8_t k[200], data[200], expected[32], tag[32], ref[32];
+    char hex[401];
+    size_t len;
+
+    if (t->key != NULL) {
+      set_key(k, host_unhex(k, t->key));
+    } else {
+      memset(k, t->keyByte, t->keyLen);
+      set_key(k, t->keyLen);
+    }
+    if (t->data != NULL) {
+      len = strlen(t->data);
+      memcpy(data, t->data, len);
+    } else {
+      len = t->dataLen;
+      memset(data, t->dataByte, len);
+    }
+    host_unhex(expected, t->tag);
+    hmac_ref(data, len, ref);
+    CHECK(memcmp(ref, expected, t->tagLen) == 0);
+
+    // the binary frame
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_Tag(data, len, tag, t->tagLen));
+    CHECK(memcmp(tag, expected, t->tagLen) == 0);
+    // again, the cached states being copied and not used up
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_Tag(data, len, tag, t->tagLen));
+    CHECK(memcmp(tag, expected, t->tagLen) == 0);
+
+    // the hex string, decoded as it is hashed, whole or streamed
+    host_hex(hex, data, len);
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_TagHex(hex, len * 2, tag, t->tagLen));
+    CHECK(memcmp(tag, expected, t->tagLen) == 0);
+    frame = hex;
+    frameLen = len * 2;
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_TagRead(frame_read, len * 2, 1, tag, t->tagLen));
+    CHECK(memcmp(tag, expected, t->tagLen) == 0);
+    frame = (const char *)data;
+    frameLen = len;
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_TagRead(frame_read, len, 0, tag, t->tagLen));
+    CHECK(memcmp(tag, expected, t->tagLen) == 0);
+  }
+}
+
+/* AT+AUTH=0: the tag over the hex string padded with zeros to a multiple
+ * of 40 characters, from the frame in RAM or streamed */
+static void test_legacy(void) {
+  static char text[401];
+  uint8_t data[200], tag[32], ref[32];
+
+  set_key((const uint8_t *)"Jefe", 4);
+  for (size_t len = 1; len <= 200; len += 13) {
+    size_t padded = (len * 2 + 39) / 40 * 40;
+
+    for (size_t i = 0; i < len; i++)
+      data[i] = (uint8_t)(i * 29 + len);
+    memset(text, 0, sizeof(text));
+    host_hex(text, data, len);
+    hmac_ref((const uint8_t *)text, padded, ref);
+
+    CHECK(Auth_Tag((const uint8_t *)text, padded, tag, AUTH_TAG_MAX));
+    CHECK(memcmp(tag, ref, AUTH_TAG_MAX) == 0);
+    frame = text;
+    frameLen = len * 2;
+    readMax = 0;
+    memset(tag, 0, sizeof(tag));
+    CHECK(Auth_TagRead(frame_read, padded, 0, tag, AUTH_TAG_MAX));
+    CHECK(memcmp(tag, ref, AUTH_TAG_MAX) == 0);
+    // a block at a time, never the whole frame
+    CHECK(readMax <= 64);
+  }
+}
+
+static void test_refused(void) {
+  uint8_t tag[AUTH_TAG_MAX + 1];
+
+  set_key((const uint8_t *)"Jefe", 4);
+  CHECK(Auth_Tag((const uint8_t *)"x", 1, tag, AUTH_TAG_MAX + 1) == 0);
+  CHECK(Auth_TagHex("abc", 3, tag, 4) == 0);
+  frame = "abc";
+  frameLen = 3;
+  CHECK(Auth_TagRead(frame_read, 3, 1, tag, 4) == 0);
+  CHECK(Auth_TagLenValid(0) && Auth_TagLenValid(4) && Auth_TagLenValid(32));
+  CHECK(!Auth_TagLenValid(5) && !Auth_TagLenValid(64));
+}
+
+/* SHA-256 blocks per tag, from the cached states and from the key, the
+ * saving being the ipad and opad blocks */
+static void test_cost(void) {
+  uint8_t msg[512] = {0}, tag[32];
+  static const size_t lens[] = {11, 40, 120, 512};
+
+  set_key((const uint8_t *)"Jefe", 4);
+  for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    uint32_t cached, full;
+
+    host_sha256_blocks = 0;
+    Auth_Tag(msg, lens[i], tag, AUTH_TAG_MAX);
+    cached = host_sha256_blocks;
+    host_sha256_blocks = 0;
+    hmac_ref(msg, lens[i], tag);
+    full = host_sha256_blocks;
+    printf("HMAC of %3d bytes: %2d SHA-256 blocks, %2d from the key\n",
+           (int)lens[i], (int)cached, (int)full);
+    CHECK(cached + 2 == full);
+  }
+}
+
+int main(void) {
+  test_sha256();
+  test_rfc4231();
+  test_legacy();
+  test_refused();
+  test_cost();
+  return host_report("auth");
+}
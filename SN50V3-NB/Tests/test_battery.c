@@ -0,0 +1,240 @@
+#include "battery_read.h"
+#include "host.h"
+#include "time_server.h"
+
+/* The battery reading of battery_read.c against a model of the ADC, on a
+ * virtual clock. The ADC is ready a few ISR reads after it is enabled, and
+ * only then takes a calibration factor; CALFACT is lost in Stop, and a
+ * conversion without the calibrated factor is off by CAL_ERROR counts.
+ * The internal channels read VDD and the die temperature of the model
+ * through the factory data at FACTORY_BASE. */
+#define FACTOR 0x45    // CALFACT measured by a calibration
+#define CAL_ERROR 20   // counts, of a conversion without it
+#define READY_POLLS 3  // ISR reads from ADEN to ADRDY
+#define VREFINT_3V 1671 // factory VREFINT reading at 3 V
+#define TS_30C 670      // and of the temperature sensor at 30 and 130 C
+#define TS_130C 902
+
+SENSOR sensor;
+static ADC_TypeDef adc;
+ADC_HandleTypeDef hadc = {&adc, {ADC_SAMPLETIME_7CYCLES_5}};
+
+static struct {
+  uint8_t clock;
+  uint32_t readyIn; // ISR reads to ADRDY
+  uint16_t vdd;     // mV
+  int16_t temp;     // C
+  uint8_t setFails; // CALFACT writes to fail
+  uint32_t conversions;
+  uint32_t temps; // conversions of the temperature sensor
+  uint32_t uncalibrated;
+  uint32_t calibrations;
+} m;
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t past) { return host_tick - past; }
+
+void HAL_Delay(uint32_t Delay) { host_tick += Delay; }
+
+void host_adc_clock(uint8_t on) { m.clock = on; }
+
+void host_adc_enable(ADC_HandleTypeDef *h, uint8_t on) {
+  CHECK(h == &hadc && m.clock);
+  if (on) {
+    adc.CR |= ADC_CR_ADEN;
+    m.readyIn = READY_POLLS;
+  } else {
+    adc.CR &= ~ADC_CR_ADEN;
+    adc.ISR &= ~ADC_FLAG_RDY;
+  }
+}
+
+uint32_t host_adc_isr(ADC_HandleTypeDef *h) {
+  if ((adc.CR & ADC_CR_ADEN) && m.readyIn > 0 && --m.readyIn == 0)
+    adc.ISR |= ADC_FLAG_RDY;
+  return adc.ISR;
+}
+
+uint32_t host_adc_is_enable(ADC_HandleTypeDef *h) {
+  return adc.CR & ADC_CR_ADEN;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *h,
+                                              uint32_t SingleDiff) {
+  CHECK(m.clock && !(adc.CR & ADC_CR_ADEN));
+  m.calibrations++;
+  adc.CALFACT = FACTOR;
+  return HAL_OK;
+}
+
+uint32_t HAL_ADCEx_Calibration_GetValue(ADC_HandleTypeDef *h,
+                                        uint32_t SingleDiff) {
+  return adc.CALFACT;
+}
+
+// CALFACT is written with ADEN and ADRDY set, and no conversion ongoing
+HAL_StatusTypeDef HAL_ADCEx_Calibration_SetValue(ADC_HandleTypeDef *h,
+                                                 uint32_t SingleDiff,
+                                                 uint32_t CalibrationFactor) {
+  if (m.setFails > 0) {
+    m.setFails--;
+    return HAL_ERROR;
+  }
+  if (!(adc.CR & ADC_CR_ADEN) || !(adc.ISR & ADC_FLAG_RDY))
+    return HAL_ERROR;
+  adc.CALFACT = CalibrationFactor;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef *h,
+                                        ADC_ChannelConfTypeDef *sConfig) {
+  if (sConfig->Rank == ADC_RANK_NONE)
+    adc.CHSELR &= ~sConfig->Channel;
+  else
+    adc.CHSELR |= sConfig->Channel;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *h) {
+  uint32_t raw = 0;
+
+  CHECK(m.clock && (adc.ISR & ADC_FLAG_RDY));
+  m.conversions++;
+  if (adc.CHSELR == ADC_CHANNEL_VREFINT) {
+    raw = (uint32_t)*VREFINT_CAL * VDDA_VREFINT_CAL / m.vdd;
+  } else if (adc.CHSELR == ADC_CHANNEL_TEMPSENSOR) {
+    int32_t ts = *TEMP30_CAL + (m.temp - 30) *
+                                   (*TEMP130_CAL - *TEMP30_CAL) / (130 - 30);
+
+    raw = ts * VDDA_VREFINT_CAL / m.vdd;
+    m.temps++;
+  } else {
+    CHECK(adc.CHSELR == ADC_CHANNEL_4);
+    raw = 2048;
+  }
+  // the internal channels need the long sampling time
+  if (adc.CHSELR & (ADC_CHANNEL_VREFINT | ADC_CHANNEL_TEMPSENSOR))
+    CHECK((adc.SMPR & ADC_SMPR_SMPR) == ADC_SAMPLETIME_160CYCLES_5);
+  else
+    CHECK((adc.SMPR & ADC_SMPR_SMPR) == hadc.Init.SamplingTime);
+  if (adc.CALFACT != FACTOR) {
+    m.uncalibrated++;
+    raw += CAL_ERROR;
+  }
+  adc.DR = raw;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_PollForConversion(ADC_HandleTypeDef *h,
+                                            uint32_t Timeout) {
+  return HAL_OK;
+}
+
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *h) { return adc.DR; }
+
+// Stop, between two readings: CALFACT is lost
+static void stop(uint32_t ms) {
+  CHECK(!m.clock && !(adc.CR & ADC_CR_ADEN));
+  adc.CALFACT = 0;
+  host_tick += ms;
+}
+
+// A battery reading, and the conversions it took
+static uint16_t voltage(uint32_t *conversions) {
+  uint32_t before = m.conversions;
+  uint16_t mV = getVoltage();
+
+  *conversions = m.conversions - before;
+  return mV;
+}
+
+static void test_boot(void) {
+  *VREFINT_CAL = VREFINT_3V;
+  *TEMP30_CAL = TS_30C;
+  *TEMP130_CAL = TS_130C;
+  m.vdd = 3300;
+  m.temp = 25;
+  host_tick = 1000;
+
+  // measured once, with VDD and the temperature it was taken at
+  HW_AdcCalibrate();
+  CHECK(m.calibrations == 1 && m.conversions == 2 && m.temps == 1);
+  CHECK(m.uncalibrated == 0);
+}
+
+static void test_restore(void) {
+  uint32_t conversions;
+
+  // the factor lost in Stop is written back before every conversion, once
+  // the ADC is ready, without calibrating again
+  for (int i = 0; i < 10; i++) {
+    stop(60000);
+    CHECK(abs(voltage(&conversions) - 3300) <= 2 && conversions == 1);
+  }
+  CHECK(m.calibrations == 1 && m.uncalibrated == 0);
+
+  // a factor that did not take is measured again on the next read
+  stop(60000);
+  m.setFails = 1;
+  voltage(&conversions);
+  CHECK(m.calibrations == 1 && m.uncalibrated == 1);
+  stop(60000);
+  voltage(&conversions);
+  CHECK(m.calibrations == 2 && m.uncalibrated == 1 && conversions == 3);
+
+  // the other channels too
+  stop(60000);
+  CHECK(HW_AdcReadChannel(ADC_CHANNEL_4) == 2048);
+  CHECK(m.calibrations == 2 && m.uncalibrated == 1);
+}
+
+static void test_drift(void) {
+  uint32_t temps, conversions, start;
+  uint16_t mV = 0;
+
+  // the check once the interval is over: VDD and the temperature where
+  // they were, the factor is kept
+  stop(ADC_CAL_CHECK_INTERVAL);
+  voltage(&conversions);
+  CHECK(conversions == 2 && m.calibrations == 2);
+  start = host_tick;
+
+  // VDD and the temperature moving within the interval: no temperature
+  // conversion, and no new calibration, for an hour of readings
+  m.vdd = 3000;
+  m.temp = 45;
+  temps = m.temps;
+  while (host_tick - start + 60000 < ADC_CAL_CHECK_INTERVAL) {
+    stop(60000);
+    mV = voltage(&conversions);
+    CHECK(conversions == 1);
+  }
+  CHECK(m.temps == temps && m.calibrations == 2);
+  // the filter has followed VDD all the same
+  CHECK(abs(mV - 3000) <= 2);
+
+  // the check at the interval sees the drift, and calibrates again
+  stop(60000);
+  voltage(&conversions);
+  CHECK(conversions == 4 && m.temps == temps + 2 && m.calibrations == 3);
+
+  // a check within the thresholds keeps the factor
+  stop(ADC_CAL_CHECK_INTERVAL);
+  m.vdd = 3000 - ADC_CAL_VDD_DRIFT_MV / 2;
+  m.temp = 45 - ADC_CAL_TEMP_DRIFT_C / 2;
+  voltage(&conversions);
+  CHECK(conversions == 2 && m.calibrations == 3);
+  stop(60000);
+  voltage(&conversions);
+  CHECK(conversions == 1 && m.uncalibrated == 1);
+  printf("%u conversions, %u of the temperature, %u calibrations\n",
+         m.conversions, m.temps, m.calibrations);
+}
+
+int main(void) {
+  test_boot();
+  test_restore();
+  test_drift();
+  return host_report("battery");
+}
@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include "coap.h"
+#include "host.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Block-wise uploads (RFC 7959) of coap.c: the slicing and the answers to
+ * the blocks, then whole bodies over UDP on the loopback to a responder
+ * standing for the server, which drops requests and answers on cue and
+ * may want smaller blocks. The device reads the body a block at a time,
+ * as nb_coap.c reads the frame, and the responder puts it back together. */
+#define BODY_MAX 2000
+
+static uint16_t mid = 0x200;
+
+// Byte at offset of the body, which is never held whole by the device
+static uint8_t body_byte(size_t offset) {
+  return (uint8_t)(offset * 7 + (offset >> 8));
+}
+
+static CoapMessage answer(uint8_t code, int32_t block1, int32_t size1) {
+  static uint8_t out[64];
+  CoapMessage msg = {.type = COAP_ACK, .code = code, .mid = mid}, rsp;
+  CoapWriter w;
+
+  Coap_Begin(&w, out, sizeof(out), &msg);
+  if (block1 >= 0)
+    Coap_OptionUint(&w, COAP_OPTION_BLOCK1, block1);
+  if (size1 >= 0)
+    Coap_OptionUint(&w, COAP_OPTION_SIZE1, size1);
+  CHECK(Coap_Parse(&rsp, out, Coap_End(&w)));
+  return rsp;
+}
+
+static void test_slices(void) {
+  CoapBlock b;
+  size_t offset, len;
+  uint8_t more;
+
+  // a body that fits goes whole
+  Coap_BlockStart(&b, 64, 2);
+  CHECK(b.wise == 0);
+  CHECK(Coap_BlockSlice(&b, &offset, &more) == 64 && offset == 0 && !more);
+
+  Coap_BlockStart(&b, 100, 2);
+  CHECK(b.wise == 1);
+  len = Coap_BlockSlice(&b, &offset, &more);
+  CHECK(len == 64 && offset == 0 && more);
+  b.num = 1;
+  len = Coap_BlockSlice(&b, &offset, &more);
+  CHECK(len == 36 && offset == 64 && !more);
+}
+
+static void test_answers(void) {
+  CoapMessage rsp;
+  CoapBlock b;
+
+  // 2.31 Continue, then smaller blocks asked for by the server
+  Coap_BlockStart(&b, 3000, 6);
+  rsp = answer(COAP_CONTINUE, COAP_BLOCK(0, 1, 6), -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.num == 1 && b.szx == 6);
+  rsp = answer(COAP_CONTINUE, COAP_BLOCK(1, 1, 4), -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.num == 8 && b.szx == 4);
+  // an empty ACK moves on too, the answer to the last block ends it
+  rsp = answer(COAP_EMPTY, -1, -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.num == 9);
+  b.num = 11;
+  rsp = answer(COAP_CHANGED, COAP_BLOCK(b.num, 0, 4), -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 0);
+
+  // 4.13 with Block1 starts over at its size
+  Coap_BlockStart(&b, 3000, 6);
+  b.num = 2;
+  rsp = answer(COAP_TOO_LARGE, COAP_BLOCK(0, 0, 3), -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.num == 0 && b.szx == 3);
+  // without, Size1 giving the largest body or else halved blocks
+  rsp = answer(COAP_TOO_LARGE, -1, 100);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.szx == 2);
+  rsp = answer(COAP_TOO_LARGE, -1, -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.szx == 1);
+  // a body that fitted goes in blocks
+  Coap_BlockStart(&b, 40, 2);
+  rsp = answer(COAP_TOO_LARGE, -1, 20);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 1 && b.wise && b.szx == 0);
+  // no smaller blocks, an error for the caller
+  rsp = answer(COAP_TOO_LARGE, -1, -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 0);
+  rsp = answer(COAP_TOO_LARGE, COAP_BLOCK(0, 0, 4), -1);
+  CHECK(Coap_BlockAnswer(&b, &rsp) == 0);
+}
+
+/* The server end of the loopback. Blocks are put back together at their
+ * offset, so that a block sent again is taken once. Requests whose bit is
+ * set in dropIn are lost on the way in, and answers in dropOut on the way
+ * out, counting from 0. Blocks larger than maxSzx get 2.31 with the size
+ * to use, or 4.13 without Block1 when tooLarge is set, with Size1 too when
+ * size1 is set. */
+typedef struct {
+  int fd;
+  struct sockaddr_in client;
+  uint32_t dropIn, dropOut;
+  uint8_t maxSzx, tooLarge, size1;
+  int in, out;
+  uint8_t body[BODY_MAX];
+  size_t received;
+  uint8_t complete;
+} Responder;
+
+// Value of the option, -1 when absent
+static int32_t option(const CoapMessage *msg, uint16_t number) {
+  CoapOption opt = {0};
+
+  while (Coap_OptionNext(msg, &opt)) {
+    if (opt.number == number)
+      return Coap_OptionUintValue(&opt);
+  }
+  return -1;
+}
+
+static void responder_step(Responder *r) {
+  static uint8_t in[1500], out[64];
+  socklen_t addrLen = sizeof(r->client);
+  CoapMessage msg, rsp;
+  CoapWriter w;
+  ssize_t len;
+
+  while ((len = recvfrom(r->fd, in, sizeof(in), MSG_DONTWAIT,
+                         (struct sockaddr *)&r->client, &addrLen)) > 0) {
+    int32_t block1;
+    size_t offset = 0, size;
+    uint8_t szx = 0, more = 0;
+
+    if (r->dropIn >> r->in++ & 1)
+      continue;
+    CHECK(Coap_Parse(&msg, in, len));
+    CHECK(msg.type == COAP_CON && msg.code == COAP_POST);
+    rsp = (CoapMessage){.type = COAP_ACK, .mid = msg.mid, .tkl = msg.tkl};
+    memcpy(rsp.token, msg.token, msg.tkl);
+    block1 = option(&msg, COAP_OPTION_BLOCK1);
+    if (block1 >= 0) {
+      szx = block1 & 0x07;
+      more = block1 >> 3 & 1;
+      offset = (block1 >> 4) * COAP_BLOCK_SIZE(szx);
+      if (offset == 0)
+        CHECK(option(&msg, COAP_OPTION_SIZE1) > 0);
+    }
+    size = block1 >= 0 ? COAP_BLOCK_SIZE(szx) : msg.payload_len;
+
+    if (size > COAP_BLOCK_SIZE(r->maxSzx) && (r->tooLarge || block1 < 0)) {
+      rsp.code = COAP_TOO_LARGE;
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+      if (r->size1)
+        Coap_OptionUint(&w, COAP_OPTION_SIZE1, COAP_BLOCK_SIZE(r->maxSzx));
+    } else if (offset > r->received) {
+      rsp.code = COAP_CODE(4, 8); // Request Entity Incomplete
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+    } else {
+      CHECK(offset + msg.payload_len <= BODY_MAX);
+      CHECK(more == 0 || msg.payload_len == size);
+      memcpy(r->body + offset, msg.payload, msg.payload_len);
+      if (offset + msg.payload_len > r->received)
+        r->received = offset + msg.payload_len;
+      if (more == 0)
+        r->complete = 1;
+      rsp.code = more ? COAP_CONTINUE : COAP_CHANGED;
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+      if (block1 >= 0)
+        Coap_OptionUint(&w, COAP_OPTION_BLOCK1,
+                        COAP_BLOCK((uint32_t)(block1 >> 4), more,
+                                   szx < r->maxSzx ? szx : r->maxSzx));
+    }
+    if (r->dropOut >> r->out++ & 1)
+      continue;
+    len = Coap_End(&w);
+    CHECK(len != 0);
+    sendto(r->fd, out, len, 0, (struct sockaddr *)&r->client,
+           sizeof(r->client));
+  }
+}
+
+/* Uploads a body of len bytes in blocks of szx as nb_coap.c does: each
+ * block waits for its answer and is sent again, same message id, when the
+ * answer doesn't come. Returns the code of the final answer, 0 when the
+ * attempts ran out. */
+static uint8_t device_upload(int fd, Responder *r, size_t len, uint8_t szx,
+                             int *sent) {
+  static uint8_t msgBuf[1500], in[64];
+  CoapBlock b;
+  CoapMessage req = {0}, rsp;
+  CoapWriter w;
+  uint8_t more, slice[1024];
+  size_t offset, n;
+  ssize_t got;
+  int answered = 1;
+
+  Coap_BlockStart(&b, len, szx);
+  for (*sent = 0; *sent < 200; (*sent)++) {
+    if (answered) {
+      req = (CoapMessage){.type = COAP_CON, .code = COAP_POST, .mid = ++mid,
+                          .tkl = 1};
+      req.token[0] = mid & 0xFF;
+    }
+    n = Coap_BlockSlice(&b, &offset, &more);
+    for (size_t i = 0; i < n; i++)
+      slice[i] = body_byte(offset + i);
+    Coap_Begin(&w, msgBuf, sizeof(msgBuf), &req);
+    Coap_Option(&w, COAP_OPTION_URI_PATH, "up", 2);
+    if (b.wise)
+      Coap_OptionUint(&w, COAP_OPTION_BLOCK1, COAP_BLOCK(b.num, more, b.szx));
+    if (b.wise && b.num == 0)
+      Coap_OptionUint(&w, COAP_OPTION_SIZE1, b.len);
+    Coap_Payload(&w, slice, n);
+    CHECK(send(fd, msgBuf, Coap_End(&w), 0) > 0);
+    responder_step(r);
+
+    answered = 0;
+    while ((got = recv(fd, in, sizeof(in), MSG_DONTWAIT)) > 0) {
+      CHECK(Coap_Parse(&rsp, in, got));
+      if (Coap_Matches(&rsp, &req) == 0)
+        continue;
+      answered = 1;
+      if (Coap_BlockAnswer(&b, &rsp))
+        break;
+      if (rsp.code >> 5 == 2)
+        return rsp.code;
+      // an error, the body starts over
+      b.num = 0;
+    }
+  }
+  return 0;
+}
+
+// The body the responder put back together is the one read by the device
+static uint8_t body_received(const Responder *r, size_t len) {
+  if (r->complete == 0 || r->received != len)
+    return 0;
+  for (size_t i = 0; i < len; i++) {
+    if (r->body[i] != body_byte(i))
+      return 0;
+  }
+  return 1;
+}
+
+// Uploads a body of len bytes, which must take the server that many requests
+static void upload(int fd, Responder *r, size_t len, uint8_t szx,
+                   int requests) {
+  int sent;
+
+  r->in = r->out = 0;
+  r->received = 0;
+  r->complete = 0;
+  memset(r->body, 0, sizeof(r->body));
+  CHECK(device_upload(fd, r, len, szx, &sent) == COAP_CHANGED);
+  CHECK(body_received(r, len));
+  if (r->in != requests)
+    printf("%d requests, %d expected\n", r->in, requests);
+  CHECK(r->in == requests && sent + 1 == requests);
+}
+
+static void test_loopback(void) {
+  struct sockaddr_in addr = {.sin_family = AF_INET};
+  socklen_t addrLen = sizeof(addr);
+  Responder r = {.maxSzx = COAP_SZX_MAX};
+  int fd;
+
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  r.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (r.fd < 0 || fd < 0 || bind(r.fd, (struct sockaddr *)&addr, addrLen) ||
+      getsockname(r.fd, (struct sockaddr *)&addr, &addrLen) ||
+      connect(fd, (struct sockaddr *)&addr, addrLen)) {
+    perror("loopback");
+    host_failures++;
+    return;
+  }
+
+  // whole, then in 17 blocks of 64 bytes and a short one
+  upload(fd, &r, 60, 2, 1);
+  upload(fd, &r, 1100, 2, 18);
+  // lost blocks are sent again
+  r.dropIn = 1 << 0 | 1 << 3 | 1 << 4 | 1 << 17;
+  upload(fd, &r, 1100, 2, 22);
+  // so are blocks whose answer is lost, the server taking them once
+  r.dropIn = 0;
+  r.dropOut = 1 << 1 | 1 << 5 | 1 << 6 | 1 << 18;
+  upload(fd, &r, 1100, 2, 22);
+  r.dropOut = 0;
+
+  // the server asks for blocks of 128 bytes in its 2.31
+  r.maxSzx = 3;
+  upload(fd, &r, 1500, 6, 1 + 4);
+  // 4.13 without Block1: at the size of Size1, or else halved each time
+  r.tooLarge = 1;
+  r.size1 = 1;
+  upload(fd, &r, 1500, 6, 1 + 12);
+  r.size1 = 0;
+  upload(fd, &r, 1500, 6, 3 + 12);
+  // a body that fitted in one message goes in blocks
+  upload(fd, &r, 300, 5, 2 + 3);
+  // and so on with losses
+  r.dropIn = 1 << 2;
+  r.dropOut = 1 << 4;
+  upload(fd, &r, 1500, 6, 3 + 12 + 2);
+  close(fd);
+  close(r.fd);
+}
+
+int main(void) {
+  test_slices();
+  test_answers();
+  test_loopback();
+  return host_report("block");
+}
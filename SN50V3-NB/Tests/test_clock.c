@@ -0,0 +1,57 @@
+#include "clock.h"
+#include "host.h"
+
+/* The baud rate registers clock.c writes when the UART kernel clocks move
+ * between HSI16 and SYSCLK, for every UART of usart.c on every profile:
+ * within the limits of RM0367 and close enough to the rate for the far
+ * end to keep up. */
+typedef struct {
+  const char *name;
+  uint32_t baud;
+  uint8_t lpuart;
+} Uart;
+
+static const Uart uarts[] = {
+    {"USART1", 9600, 0},
+    {"USART2", 9600, 0},
+    {"LPUART1", 115200, 1},
+};
+
+// Kernel clock of the UARTs: HSI16, or SYSCLK on the MSI profile
+static const uint32_t kernelHz[CLOCK_PROFILES] = {2097152, 16000000,
+                                                  16000000};
+
+static void test_brr(void) {
+  for (uint8_t profile = 0; profile < CLOCK_PROFILES; profile++) {
+    for (size_t i = 0; i < sizeof(uarts) / sizeof(uarts[0]); i++) {
+      const Uart *u = &uarts[i];
+      uint32_t clk = kernelHz[profile];
+      uint32_t brr;
+      double baud;
+
+      if (u->lpuart) {
+        brr = CLOCK_LPUART_BRR(clk, u->baud);
+        CHECK(brr >= 0x300 && brr <= 0xFFFFF);
+        // the kernel clock from 3 to 4096 times the rate
+        CHECK(clk >= 3 * u->baud && clk <= 4096 * u->baud);
+        baud = clk * 256.0 / brr;
+      } else {
+        brr = CLOCK_USART_BRR(clk, u->baud);
+        CHECK(brr >= 0x10 && brr <= 0xFFFF);
+        baud = (double)clk / brr;
+      }
+      // the receiver tolerates about 3.5 % with 16 times oversampling
+      CHECK(baud > u->baud * 0.99 && baud < u->baud * 1.01);
+    }
+  }
+  // the HAL values at the rates of usart.c
+  CHECK(CLOCK_USART_BRR(16000000, 9600) == 1667);
+  CHECK(CLOCK_USART_BRR(2097152, 9600) == 218);
+  CHECK(CLOCK_LPUART_BRR(16000000, 115200) == 35556);
+  CHECK(CLOCK_LPUART_BRR(2097152, 115200) == 4660);
+}
+
+int main(void) {
+  test_brr();
+  return host_report("clock");
+}
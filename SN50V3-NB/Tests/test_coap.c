@@ -0,0 +1,213 @@
+#include "coap.h"
+#include "host.h"
+
+/* The CoAP messages of coap.c against the encodings of RFC 7252: the
+ * exchanges of its Appendix A byte for byte, the extended option deltas
+ * and lengths of 3.1, the malformed messages a receiver must reject, and
+ * the retransmission of a confirmable message (4.2, 4.8). */
+
+// "22.3 C", the payload of the responses in Appendix A
+static const char *temperature = "22.3 C";
+
+static size_t build(uint8_t *out, size_t size, const CoapMessage *msg,
+                    const char *path, const char *payload) {
+  CoapWriter w;
+
+  Coap_Begin(&w, out, size, msg);
+  if (path != NULL)
+    Coap_Option(&w, COAP_OPTION_URI_PATH, path, strlen(path));
+  if (payload != NULL)
+    Coap_Payload(&w, payload, strlen(payload));
+  return Coap_End(&w);
+}
+
+static uint8_t same(const uint8_t *out, size_t len, const char *hex) {
+  uint8_t expected[64];
+  size_t expectedLen = host_unhex(expected, hex);
+
+  return len == expectedLen && memcmp(out, expected, len) == 0;
+}
+
+static void test_appendix(void) {
+  CoapMessage get = {.type = COAP_CON, .code = COAP_GET, .mid = 0x7d34};
+  CoapMessage ack = {.type = COAP_ACK, .code = COAP_CONTENT, .mid = 0x7d34};
+  CoapMessage msg;
+  uint8_t out[64];
+  size_t len;
+
+  // GET /temperature, answered by a piggybacked 2.05
+  len = build(out, sizeof(out), &get, "temperature", NULL);
+  CHECK(same(out, len, "40017d34bb74656d7065726174757265"));
+  CHECK(Coap_Parse(&msg, out, len));
+  CHECK(msg.type == COAP_CON && msg.code == COAP_GET && msg.mid == 0x7d34);
+  CHECK(msg.tkl == 0 && msg.options_len == 12 && msg.payload == NULL);
+  len = build(out, sizeof(out), &ack, NULL, temperature);
+  CHECK(same(out, len, "60457d34ff32322e332043"));
+  CHECK(Coap_Parse(&msg, out, len));
+  CHECK(msg.payload_len == 6 && memcmp(msg.payload, temperature, 6) == 0);
+  CHECK(Coap_Matches(&msg, &get));
+
+  // the same with the token 0x20
+  get.mid = ack.mid = 0x7d35;
+  get.tkl = ack.tkl = 1;
+  get.token[0] = ack.token[0] = 0x20;
+  len = build(out, sizeof(out), &get, "temperature", NULL);
+  CHECK(same(out, len, "41017d3520bb74656d7065726174757265"));
+  len = build(out, sizeof(out), &ack, NULL, temperature);
+  CHECK(same(out, len, "61457d3520ff32322e332043"));
+  CHECK(Coap_Parse(&msg, out, len) && Coap_Matches(&msg, &get));
+
+  // a separate response: the empty ACK, then a CON 2.05 under the token
+  CHECK(Coap_Parse(&msg, (const uint8_t *)"\x60\x00\x7d\x35", 4));
+  CHECK(msg.code == COAP_EMPTY && Coap_Matches(&msg, &get));
+  CHECK(host_unhex(out, "4145a3f720ff32322e332043") == 12);
+  CHECK(Coap_Parse(&msg, out, 12) && Coap_Matches(&msg, &get));
+  // the token tells the answer, not the message ID of a CON
+  out[4] = 0x21;
+  CHECK(Coap_Parse(&msg, out, 12) && !Coap_Matches(&msg, &get));
+  // an ACK or RST is for the message ID it carries
+  CHECK(Coap_Parse(&msg, (const uint8_t *)"\x60\x00\x7d\x36", 4));
+  CHECK(!Coap_Matches(&msg, &get));
+  CHECK(Coap_Parse(&msg, (const uint8_t *)"\x70\x00\x7d\x35", 4));
+  CHECK(msg.type == COAP_RST && Coap_Matches(&msg, &get));
+}
+
+static void test_options(void) {
+  CoapMessage msg = {.type = COAP_NON, .code = COAP_POST, .mid = 1};
+  CoapOption opt = {0};
+  uint8_t value[300] = {0};
+  uint8_t out[400];
+  CoapWriter w;
+  size_t len;
+
+  // deltas and lengths from 13 on take one or two more bytes (3.1)
+  Coap_Begin(&w, out, sizeof(out), &msg);
+  Coap_Option(&w, COAP_OPTION_URI_PATH, value, 12);
+  Coap_Option(&w, COAP_OPTION_URI_PATH, value, 13);
+  Coap_OptionUint(&w, COAP_OPTION_BLOCK1, 0);
+  Coap_OptionUint(&w, COAP_OPTION_SIZE1, 0x1234);
+  Coap_Option(&w, 400, value, 269);
+  len = Coap_End(&w);
+  CHECK(len == 4 + 13 + 15 + 2 + 4 + 274);
+  CHECK(out[4] == 0xBC);                     // delta 11, length 12
+  CHECK(out[17] == 0x0D && out[18] == 0x00); // delta 0, length 13 + 0
+  CHECK(out[32] == 0xD0 && out[33] == 3);    // delta 13 + 3, empty
+  CHECK(out[34] == 0xD2 && out[35] == 20);   // delta 13 + 20, 2 bytes
+  CHECK(out[36] == 0x12 && out[37] == 0x34);
+  CHECK(out[38] == 0xEE);                    // delta and length 269 + ...
+  CHECK(out[39] == 0 && out[40] == 71 && out[41] == 0 && out[42] == 0);
+
+  CHECK(Coap_Parse(&msg, out, len));
+  CHECK(Coap_OptionNext(&msg, &opt) && opt.number == 11 && opt.len == 12);
+  CHECK(Coap_OptionNext(&msg, &opt) && opt.number == 11 && opt.len == 13);
+  CHECK(Coap_OptionNext(&msg, &opt) && opt.number == 27 && opt.len == 0);
+  CHECK(Coap_OptionUintValue(&opt) == 0);
+  CHECK(Coap_OptionNext(&msg, &opt) && opt.number == 60);
+  CHECK(Coap_OptionUintValue(&opt) == 0x1234);
+  CHECK(Coap_OptionNext(&msg, &opt) && opt.number == 400 && opt.len == 269);
+  CHECK(!Coap_OptionNext(&msg, &opt));
+
+  // options out of order, or after the payload, are refused
+  Coap_Begin(&w, out, sizeof(out), &msg);
+  Coap_OptionUint(&w, COAP_OPTION_SIZE1, 1);
+  Coap_OptionUint(&w, COAP_OPTION_BLOCK1, 1);
+  CHECK(Coap_End(&w) == 0);
+  Coap_Begin(&w, out, sizeof(out), &msg);
+  Coap_Payload(&w, "x", 1);
+  Coap_OptionUint(&w, COAP_OPTION_SIZE1, 1);
+  CHECK(Coap_End(&w) == 0);
+  // and so is a message larger than the buffer
+  Coap_Begin(&w, out, 18, &msg);
+  Coap_Option(&w, COAP_OPTION_URI_PATH, value, 13);
+  CHECK(Coap_End(&w) == 0);
+}
+
+static void test_malformed(void) {
+  static const char *const bad[] = {
+      "400100",       // shorter than the header
+      "80017d34",     // version 2
+      "49017d34",     // token length 9, reserved
+      "42017d3420",   // token cut short
+      "40017d34ff",   // payload marker, no payload
+      "40017d34f0",   // option delta 15 without the marker
+      "40017d340f",   // option length 15
+      "40017d34d0",   // extended delta missing
+      "40017d34b374", // option value cut short
+  };
+  CoapMessage msg;
+  uint8_t out[16];
+
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    size_t len = host_unhex(out, bad[i]);
+
+    CHECK(Coap_Parse(&msg, out, len) == 0);
+  }
+  // an empty message has only the header
+  CHECK(Coap_Parse(&msg, (const uint8_t *)"\x40\x00\x00\x01", 4));
+  CHECK(msg.code == COAP_EMPTY && msg.options_len == 0);
+}
+
+static void test_retransmit(void) {
+  CoapRetransmit r;
+  uint32_t span = 0, wait;
+
+  // the first wait from ACK_TIMEOUT to ACK_TIMEOUT * ACK_RANDOM_FACTOR
+  Coap_RetransmitStart(&r, 0);
+  CHECK(r.timeout == 2000 && r.count == 0);
+  Coap_RetransmitStart(&r, 1000);
+  CHECK(r.timeout == 3000);
+  for (uint32_t random = 0; random < 100000; random += 997) {
+    Coap_RetransmitStart(&r, random * 2654435761u);
+    CHECK(r.timeout >= 2000 && r.timeout <= 3000);
+  }
+
+  // MAX_RETRANSMIT doubling waits: MAX_TRANSMIT_SPAN 45 s and
+  // MAX_TRANSMIT_WAIT 93 s at the most (4.8.2)
+  Coap_RetransmitStart(&r, 1000);
+  for (int i = 0; i < COAP_MAX_RETRANSMIT; i++) {
+    span += r.timeout;
+    CHECK(Coap_RetransmitNext(&r) && r.count == i + 1);
+  }
+  wait = span + r.timeout;
+  CHECK(span == 45000 && wait == 93000);
+  CHECK(Coap_RetransmitNext(&r) == 0 && r.count == COAP_MAX_RETRANSMIT);
+}
+
+/* A request sent again as nb_coap.c does: the copies are the same bytes,
+ * so the server takes the retransmission for a duplicate, and the ACK of
+ * any of them answers the request */
+static void test_duplicates(void) {
+  CoapMessage req = {.type = COAP_CON, .code = COAP_POST, .mid = 0xBEEF,
+                     .tkl = 2, .token = {0xCA, 0xFE}};
+  CoapMessage rsp;
+  CoapRetransmit r;
+  uint8_t first[64], copy[64], ack[64];
+  size_t len, copyLen, ackLen;
+  int sent = 1;
+
+  len = build(first, sizeof(first), &req, "data", "payload");
+  Coap_RetransmitStart(&r, 0);
+  // the first two copies are lost
+  while (sent < 3 && Coap_RetransmitNext(&r)) {
+    copyLen = build(copy, sizeof(copy), &req, "data", "payload");
+    CHECK(copyLen == len && memcmp(copy, first, len) == 0);
+    sent++;
+  }
+  CHECK(sent == 3 && r.count == 2 && r.timeout == 8000);
+  ackLen = build(ack, sizeof(ack), &(CoapMessage){.type = COAP_ACK,
+                                                  .code = COAP_CHANGED,
+                                                  .mid = 0xBEEF,
+                                                  .tkl = 2,
+                                                  .token = {0xCA, 0xFE}},
+                 NULL, NULL);
+  CHECK(Coap_Parse(&rsp, ack, ackLen) && Coap_Matches(&rsp, &req));
+}
+
+int main(void) {
+  test_appendix();
+  test_options();
+  test_malformed();
+  test_retransmit();
+  test_duplicates();
+  return host_report("coap");
+}
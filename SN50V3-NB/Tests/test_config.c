@@ -0,0 +1,248 @@
+#include "config.h"
+#include "at.h"
+#include "event.h"
+#include "flash_eraseprogram.h"
+#include "host.h"
+#include "low_power_manager.h"
+#include "time_server.h"
+
+/* The deferred config writes of config.c over scripted console sessions.
+ * Each line goes through ATInsPro() and the ATCommand table to the handler
+ * of at.c it names, and an accepted setting to config_Save(); the main
+ * loop's config_Task() and the config_Flush() of AT+SAVE, ATZ and sleep
+ * write. config_Set() erases and programs the config pages through
+ * flash_eraseprogram.c as at.c does, and the host flash counts the
+ * erases. */
+#define CONFIG_ERASES 2 // the config pages, then the CoAP URI pages
+#define CONFIG_PAGES                                                           \
+  ((FLASH_USER_END_ADDR - FLASH_USER_START_ADDR_CONFIG +                      \
+    FLASH_USER_COAP_END - FLASH_USER_COAP_URI1) /                              \
+   FLASH_PAGE_SIZE)
+
+typedef struct {
+  uint32_t ms; // since the previous line
+  const char *line;
+  const char *handler; // of at.c, that the line reaches
+} Step;
+
+// Provisioning over BLE, a command every 2 to 4 s
+static const Step provisioning[] = {
+    {0, "AT+PRO=2,0", "at_pro_set"},
+    {3000, "AT+SERVADDR=120.24.4.116,5683", "at_servaddr_set"},
+    {2000, "AT+URI1=11,\"mqtt\"", "at_uri1_set"},
+    {2000, "AT+URI2=11,\"mqtt\"", "at_uri2_set"},
+    {2000, "AT+URI3=11,\"aaaa\"", "at_uri3_set"},
+    {2000, "AT+URI4=11,\"bbbb\"", "at_uri4_set"},
+    {4000, "AT+APN=iot.nb", "at_apn_set"},
+    {2000, "AT+TDC=1200", "at_tdc_set"},
+    {2000, "AT+5VT=1000", "at_5vt_set"},
+    {2000, "AT+CFGMOD=1", "at_mod_set"},
+    {3000, "AT+CFGMOD=?", "at_mod_get"},
+    {2000, "AT+INTMOD=0", "at_inmod_set"},
+    {2000, "AT+CSQTIME=5", "at_csqtime_set"},
+    {2000, "AT+DNSTIMER=24", "at_dnstimer_set"},
+    {2000, "AT+RXDL=1000", "at_rxdl_set"},
+    {3000, "AT+COAPMOD=1", "at_coapmod_set"},
+    {2000, "AT+CONFIRM=4", "at_confirm_set"},
+    {2000, "AT+BATCAP=8500", "at_batcap_set"},
+};
+
+static const char *called = NULL;
+static int vetoes = 0;
+static uint32_t signals = 0;
+static TimerEvent_t *timer = NULL;
+
+// The handlers of at.c accept every value; those of at_return_error() fail
+int host_at_handler(const char *name, const char *param) {
+  called = name;
+  if (strcmp(name, "at_return_error") == 0)
+    return AT_ERROR;
+  // AT+SAVE, and ATZ before its reset
+  if (strcmp(name, "at_save_run") == 0 || strcmp(name, "at_reset_run") == 0)
+    config_Flush();
+  return AT_OK;
+}
+
+// config_Set() of at.c, after packing sys and user into the blocks
+void config_Set(void) {
+  static uint32_t block[32];
+
+  FLASH_erase(FLASH_USER_START_ADDR_CONFIG,
+              (FLASH_USER_END_ADDR - FLASH_USER_START_ADDR_CONFIG) /
+                  FLASH_PAGE_SIZE);
+  FLASH_erase(FLASH_USER_COAP_URI1,
+              (FLASH_USER_COAP_END - FLASH_USER_COAP_URI1) / FLASH_PAGE_SIZE);
+  block[2]++;
+  FLASH_program(FLASH_USER_START_ADDR_CONFIG, block, 32);
+  config_Written();
+}
+
+void Energy_Flash(uint8_t on) {}
+
+void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode) {
+  CHECK(id == LPM_FLASH_Id);
+  vetoes += mode == LPM_Disable ? 1 : -1;
+}
+
+void Event_Signal(uint32_t sig) { signals |= sig; }
+
+void TimerInit(TimerEvent_t *obj, void (*callback)(void)) {
+  obj->Callback = callback;
+  obj->IsRunning = false;
+  timer = obj;
+}
+
+void TimerSetValue(TimerEvent_t *obj, uint32_t value) {
+  obj->ReloadValue = value;
+}
+
+void TimerStart(TimerEvent_t *obj) {
+  obj->Timestamp = host_tick + obj->ReloadValue;
+  obj->IsRunning = true;
+}
+
+void TimerStop(TimerEvent_t *obj) { obj->IsRunning = false; }
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t savedTime) {
+  return host_tick - savedTime;
+}
+
+// Config writes made so far, each one erase of the config pages
+static uint32_t writes(void) {
+  CHECK(host_flash_erases % CONFIG_ERASES == 0);
+  CHECK(host_flash_pages == host_flash_erases / CONFIG_ERASES * CONFIG_PAGES);
+  CHECK(vetoes == 0);
+  return host_flash_erases / CONFIG_ERASES;
+}
+
+// The main loop for ms: the timer fires, then the user task runs
+static void idle(uint32_t ms) {
+  uint32_t end = host_tick + ms;
+
+  while (host_tick < end) {
+    host_tick++;
+    if (timer != NULL && timer->IsRunning && host_tick == timer->Timestamp) {
+      timer->IsRunning = false;
+      timer->Callback();
+    }
+    if (signals & EVENT_SIGNAL_USER) {
+      signals = 0;
+      config_Task();
+    }
+  }
+}
+
+// A console line as usart.c hands it over, with its line ending
+static ATEerror_t type(const char *line) {
+  char buf[AT_VALUE_MAX + 20];
+
+  snprintf(buf, sizeof(buf), "%s\r\n", line);
+  called = NULL;
+  return ATInsPro(buf);
+}
+
+// Plays a session, every command accepted; returns the writes made
+static uint32_t session(const Step *steps, size_t count, uint32_t gap) {
+  uint32_t before = writes();
+
+  for (size_t i = 0; i < count; i++) {
+    idle(i == 0 ? 0 : steps[i].ms + gap);
+    CHECK(type(steps[i].line) == AT_OK);
+    CHECK(called != NULL && strcmp(called, steps[i].handler) == 0);
+  }
+  return writes() - before;
+}
+
+static void test_provisioning(void) {
+  size_t count = sizeof(provisioning) / sizeof(provisioning[0]);
+  uint32_t before;
+
+  // nothing is written while the commands come in
+  CHECK(session(provisioning, count, 0) == 0);
+  CHECK(config_Dirty());
+  idle(CONFIG_SAVE_DELAY - 1);
+  CHECK(writes() == 0 && config_Dirty());
+  idle(1);
+  CHECK(writes() == 1 && !config_Dirty());
+  CHECK(host_flash_erases == CONFIG_ERASES);
+  CHECK(FLASH_read(FLASH_USER_START_ADDR_CONFIG + 8) == 1);
+  idle(10 * CONFIG_SAVE_DELAY);
+  CHECK(writes() == 1);
+  printf("Provisioning: %d commands, %u config write(s), %u erases of %u "
+         "pages\n",
+         (int)count, writes(), host_flash_erases, host_flash_pages);
+
+  // a pause longer than the delay writes what came before it
+  before = writes();
+  session(provisioning, count / 2, 0);
+  idle(CONFIG_SAVE_DELAY + 5000);
+  session(provisioning + count / 2, count - count / 2, 0);
+  idle(CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == 2);
+  // and settings slower than the delay are each written, the read not
+  before = writes();
+  session(provisioning, count, CONFIG_SAVE_DELAY);
+  idle(CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == count - 1);
+}
+
+static void test_rejected(void) {
+  uint32_t before = writes();
+
+  // commands the table does not have, and a setting at_return_error()
+  // refuses, change nothing
+  CHECK(type("AT+TR=900") == AT_ERROR && called == NULL);
+  CHECK(type("AT+NOUD=8") == AT_ERROR && called == NULL);
+  CHECK(type("AT+MOD=1") == AT_ERROR && called == NULL);
+  CHECK(type("AT+MODEL=1") == AT_ERROR &&
+        strcmp(called, "at_return_error") == 0);
+  // nor do reads and help
+  CHECK(type("AT+TDC=?") == AT_OK && strcmp(called, "at_tdc_get") == 0);
+  CHECK(type("AT+TDC?") == AT_OK && called == NULL);
+  CHECK(type("AT") == AT_OK);
+  CHECK(!config_Dirty());
+  idle(2 * CONFIG_SAVE_DELAY);
+  CHECK(writes() == before);
+}
+
+static void test_flush(void) {
+  uint32_t before = writes();
+
+  // AT+SAVE writes at once, and only what changed
+  CHECK(type("AT+TDC=600") == AT_OK);
+  idle(1000);
+  CHECK(config_Dirty()); // AT+SAVE=? reports 1
+  CHECK(type("AT+SAVE=?") == AT_OK && strcmp(called, "at_save_get") == 0);
+  CHECK(type("AT+SAVE") == AT_OK && strcmp(called, "at_save_run") == 0);
+  CHECK(writes() - before == 1 && !config_Dirty());
+  CHECK(type("AT+SAVE") == AT_OK);
+  idle(2 * CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == 1);
+
+  // ATZ right after a command
+  CHECK(type("AT+APN=iot.nb") == AT_OK);
+  CHECK(type("ATZ") == AT_OK && strcmp(called, "at_reset_run") == 0);
+  CHECK(writes() - before == 2);
+  idle(2 * CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == 2);
+
+  // a downlink of several settings is one config_Save()
+  config_Save();
+  idle(CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == 3);
+
+  // a direct config_Set() leaves nothing pending
+  config_Save();
+  config_Set();
+  idle(2 * CONFIG_SAVE_DELAY);
+  CHECK(writes() - before == 4 && !config_Dirty());
+}
+
+int main(void) {
+  test_provisioning();
+  test_rejected();
+  test_flush();
+  return host_report("config");
+}
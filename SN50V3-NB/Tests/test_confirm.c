@@ -0,0 +1,264 @@
+#include "confirm.h"
+#include "host.h"
+
+/* The confirmation policy of confirm.c over scripted uplink cycles, for
+ * each AT+CONFIRM setting. The device stand-in issues the commands NBTASK
+ * does for the policy's decision, each taking the radio-on time given in
+ * the script, and keeps the EEPROM history the unconfirmed readings are
+ * stored in. The server stand-in loses the frames it is told to, counts
+ * the readings it gets, from the frames and their history records, and
+ * tells the losses from the uplink count of the checkpoints. */
+#define CYCLES 120
+#define HISTORY 32
+
+typedef struct {
+  const char *command; // up to the first parameter
+  uint16_t ms;         // radio-on time
+} Step;
+
+// BC660K figures: the modem is attached, PSM left after the last command
+static const Step coapSteps[] = {
+    {"AT+QIOPEN", 300},
+    {"AT+QISEND", 200},
+    {"ACK", 1500},    // waited for by a CON request
+    {"WINDOW", 3000}, // downlink window after a checkpoint
+    {"AT+QICLOSE", 100},
+};
+
+static const Step mqttSteps[] = {
+    {"AT+QMTOPEN", 800}, {"AT+QMTCONN", 1200}, {"AT+QMTPUB", 300},
+    {"PUBACK", 1500},    {"AT+QMTSUB", 1500},  {"WINDOW", 3000},
+    {"AT+QMTCLOSE", 300},
+};
+
+typedef struct {
+  uint8_t every;
+  uint8_t mqtt;
+  uint32_t lossMask; // cycle k's first attempt is lost when bit k % 32 is set
+  uint8_t ackAt;     // cycle receiving a downlink to acknowledge, 0 for none
+  // results
+  uint32_t radioMs;
+  int checkpoints;
+  int frames;      // received by the server
+  int lostSeen;    // frames the server knows lost from the uplink count
+  int missing;     // readings the server never got
+  int lastChecked; // last cycle the server has a checkpoint of
+  int acked;       // cycle the ack reached the server
+  char log[4][160]; // commands of the first cycles
+} Run;
+
+static uint16_t history[HISTORY];
+static int historySeq;
+static uint8_t received[CYCLES];      // the reading, in any frame
+static uint8_t frameReceived[CYCLES]; // the frame of the cycle
+
+static uint32_t run_step(Run *r, int cycle, const char *command, uint16_t ms) {
+  if (cycle < 4)
+    sprintf(r->log[cycle] + strlen(r->log[cycle]), "%s%s",
+            r->log[cycle][0] != '\0' ? " " : "", command);
+  r->radioMs += ms;
+  return ms;
+}
+
+/* One attempt of the uplink of cycle, as NBTASK issues it, returns 1 when
+ * the server got the frame */
+static uint8_t attempt(Run *r, int cycle, uint8_t lost, uint8_t mqttQos) {
+  const Step *steps = r->mqtt ? mqttSteps : coapSteps;
+  size_t count = r->mqtt ? sizeof(mqttSteps) / sizeof(Step)
+                         : sizeof(coapSteps) / sizeof(Step);
+  uint8_t checkpoint = Confirm_Checkpoint();
+
+  for (size_t i = 0; i < count; i++) {
+    const char *command = steps[i].command;
+    char pub[32];
+
+    if (strcmp(command, "AT+QMTPUB") == 0) {
+      uint8_t qos = Confirm_Qos(mqttQos);
+
+      // as nb_MQTT_pub_set() writes it
+      sprintf(pub, "AT+QMTPUB=0,%d,%d,0", qos != 0, qos);
+      command = pub;
+    }
+    if (strcmp(command, "ACK") == 0 || strcmp(command, "PUBACK") == 0 ||
+        strcmp(command, "AT+QMTSUB") == 0 || strcmp(command, "WINDOW") == 0) {
+      if (checkpoint == 0)
+        continue;
+      // nothing comes back for a lost frame, the wait runs out
+      if (lost && strcmp(command, "WINDOW") != 0) {
+        run_step(r, cycle, "TIMEOUT", steps[i].ms * 2);
+        break;
+      }
+    }
+    run_step(r, cycle, command, steps[i].ms);
+  }
+  return lost == 0;
+}
+
+/* The uplink of cycle: the reading, the history records the policy asks
+ * for, and for a checkpoint the uplink count */
+static void cycle_run(Run *r, int cycle, uint8_t mqttQos) {
+  uint8_t lost = r->lossMask >> (cycle % 32) & 1;
+  uint8_t ackPending = r->ackAt != 0 && cycle >= r->ackAt && r->acked < 0;
+  uint8_t checkpoint, delivered = 0;
+  uint8_t records;
+
+  Confirm_Start(r->every, ackPending);
+  checkpoint = Confirm_Checkpoint();
+  records = Confirm_History(0);
+  // a checkpoint is tried 3 times, the others are sent once
+  for (int tries = 0; tries < (checkpoint ? 3 : 1) && !delivered; tries++)
+    delivered = attempt(r, cycle, lost && tries == 0, mqttQos);
+
+  if (delivered) {
+    r->frames++;
+    frameReceived[cycle] = 1;
+    received[cycle] = 1;
+    for (int i = 0; i < records; i++)
+      received[history[(historySeq - 1 - i) & (HISTORY - 1)]] = 1;
+  }
+  if (delivered && checkpoint) {
+    // the uplink count tells the frames lost since the last one
+    r->checkpoints++;
+    r->lostSeen = cycle + 1 - r->frames;
+    for (int k = r->lastChecked + 1; k <= cycle; k++)
+      r->missing += received[k] == 0;
+    r->lastChecked = cycle;
+    if (ackPending)
+      r->acked = cycle;
+  }
+  // a non-confirmable uplink is delivered as far as the device knows
+  if (Confirm_End(delivered || !checkpoint))
+    history[historySeq++ & (HISTORY - 1)] = cycle;
+}
+
+static void run(Run *r, uint8_t mqttQos) {
+  memset(received, 0, sizeof(received));
+  memset(frameReceived, 0, sizeof(frameReceived));
+  memset(history, 0, sizeof(history));
+  historySeq = 0;
+  r->lastChecked = -1;
+  r->acked = -1;
+  Confirm_Start(0, 0);
+  Confirm_End(1); // a fresh start
+  for (int cycle = 0; cycle < CYCLES; cycle++)
+    cycle_run(r, cycle, mqttQos);
+}
+
+// Frames lost up to the last checkpoint
+static int lostFrames(const Run *r) {
+  int count = 0;
+
+  for (int k = 0; k <= r->lastChecked; k++)
+    count += frameReceived[k] == 0;
+  return count;
+}
+
+// Every reading up to the last checkpoint made it to the server
+static uint8_t all_received(const Run *r) {
+  for (int k = 0; k <= r->lastChecked; k++) {
+    if (received[k] == 0)
+      return 0;
+  }
+  return r->lastChecked >= CYCLES - r->every;
+}
+
+static void test_policy(void) {
+  // every uplink confirmed, the QoS at least 1
+  Confirm_Start(0, 0);
+  CHECK(Confirm_Checkpoint() && Confirm_Qos(0) == 1 && Confirm_Qos(2) == 2);
+  CHECK(Confirm_History(8) == 8);
+  CHECK(Confirm_End(1) == 0);
+  Confirm_Start(1, 0);
+  CHECK(Confirm_Checkpoint());
+  CHECK(Confirm_End(0) == 0);
+
+  // one in 4, the others QoS 0 and stored
+  Confirm_Start(4, 0);
+  CHECK(Confirm_Checkpoint());
+  CHECK(Confirm_End(1) == 0);
+  for (int i = 0; i < 3; i++) {
+    Confirm_Start(4, 0);
+    CHECK(Confirm_Checkpoint() == 0 && Confirm_Qos(1) == 0);
+    CHECK(Confirm_History(2) == 2);
+    CHECK(Confirm_End(1) == 1);
+  }
+  // the checkpoint carries the 3 readings, again after it failed
+  Confirm_Start(4, 0);
+  CHECK(Confirm_Checkpoint() && Confirm_History(2) == 3);
+  CHECK(Confirm_End(0) == 1);
+  Confirm_Start(4, 0);
+  CHECK(Confirm_Checkpoint() && Confirm_History(2) == 4);
+  CHECK(Confirm_History(8) == 8);
+  CHECK(Confirm_End(1) == 0);
+  // a downlink ack makes a checkpoint
+  Confirm_Start(4, 1);
+  CHECK(Confirm_Checkpoint() && Confirm_History(0) == 0);
+  Confirm_End(1);
+  Confirm_Start(4, 0);
+  CHECK(Confirm_Checkpoint() == 0);
+  Confirm_End(1);
+  // no more than the history holds
+  for (int i = 0; i < 40; i++) {
+    Confirm_Start(40, 0);
+    Confirm_End(0);
+  }
+  Confirm_Start(40, 0);
+  CHECK(Confirm_History(0) == CONFIRM_HISTORY_MAX);
+}
+
+static void test_sequences(void) {
+  Run r = {.every = 4, .mqtt = 1};
+
+  // a checkpoint is QoS 1 even with AT+MQOS=0, the others QoS 0
+  run(&r, 0);
+  CHECK(strcmp(r.log[0], "AT+QMTOPEN AT+QMTCONN AT+QMTPUB=0,0,0,0 "
+                         "AT+QMTCLOSE") == 0);
+  CHECK(strcmp(r.log[3], "AT+QMTOPEN AT+QMTCONN AT+QMTPUB=0,1,1,0 PUBACK "
+                         "AT+QMTSUB WINDOW AT+QMTCLOSE") == 0);
+  r = (Run){.every = 4, .mqtt = 1};
+  run(&r, 2);
+  CHECK(strncmp(r.log[3] + 22, "AT+QMTPUB=0,1,2,0", 17) == 0);
+
+  // a lost checkpoint is tried again
+  r = (Run){.every = 4, .lossMask = 1 << 3};
+  run(&r, 0);
+  CHECK(strcmp(r.log[0], "AT+QIOPEN AT+QISEND AT+QICLOSE") == 0);
+  CHECK(strcmp(r.log[3], "AT+QIOPEN AT+QISEND TIMEOUT AT+QIOPEN AT+QISEND "
+                         "ACK WINDOW AT+QICLOSE") == 0);
+}
+
+static void test_runs(void) {
+  static const uint8_t policies[] = {1, 4, 10};
+  // about one frame in 8 lost, checkpoints included
+  const uint32_t loss = 1u << 3 | 1u << 6 | 1u << 12 | 1u << 20 | 1u << 29;
+
+  for (int mqtt = 0; mqtt <= 1; mqtt++) {
+    uint32_t previous = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < sizeof(policies); i++) {
+      Run r = {.every = policies[i], .mqtt = mqtt, .lossMask = loss,
+               .ackAt = 50};
+
+      run(&r, 0);
+      printf("%s AT+CONFIRM=%-2d %5.2f s radio on per uplink, %3d "
+             "checkpoints, %d frames lost\n",
+             mqtt ? "MQTT" : "CoAP", r.every,
+             r.radioMs / 1000.0 / CYCLES, r.checkpoints, r.lostSeen);
+      // the readings of the frames lost are sent again by the checkpoints
+      CHECK(all_received(&r) && r.missing == 0);
+      CHECK(r.lostSeen == lostFrames(&r));
+      CHECK(r.every <= 1 ? r.lostSeen == 0 : r.lostSeen > 0);
+      // the ack rides on the first uplink after the downlink
+      CHECK(r.acked == r.ackAt);
+      CHECK(r.radioMs < previous);
+      previous = r.radioMs;
+    }
+  }
+}
+
+int main(void) {
+  test_policy();
+  test_sequences();
+  test_runs();
+  return host_report("confirm");
+}
@@ -0,0 +1,194 @@
+#include "count.h"
+#include "event.h"
+#include "host.h"
+#include "time_server.h"
+
+/* The pulse counting of count.c on the virtual clock of
+ * TimerGetCurrentTime(): the model7 lockout of bucket bounces, the
+ * intensity of each window and its maximum until main.c clears it, and
+ * Count_FastWake() taking a count edge, and nothing else, after Stop. */
+#define TIP_MM 2 // 0.1 mm a tip
+
+SYSTEM sys;
+SENSOR sensor;
+
+static uint32_t counts = 0;   // EVENT_COUNT posts
+static uint32_t lockouts = 0; // EVENT_COUNT_LOCKOUT posts
+static uint32_t lockoutGap = 0;
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+uint8_t Event_PostOnce(uint8_t type, uint32_t arg) {
+  if (type == EVENT_COUNT) {
+    counts++;
+  } else {
+    CHECK(type == EVENT_COUNT_LOCKOUT);
+    lockouts++;
+    lockoutGap = arg;
+  }
+  return 1;
+}
+
+// An edge after ms, taken by the EXTI handler
+static void edge(uint32_t ms) {
+  host_tick += ms;
+  Count_Edge();
+}
+
+// Intensity in 0.1 mm/h of tips over ms
+static uint16_t intensity(uint32_t tips, uint32_t ms) {
+  return (uint64_t)tips * TIP_MM * 3600000 / ms;
+}
+
+static void test_lockout(void) {
+  uint32_t count;
+
+  sys.mod = model7;
+  host_tick = 1000;
+  edge(0);
+  count = sensor.exit_count;
+
+  // a bucket bouncing: every edge within the lockout of the last tip is
+  // rejected, and reports its gap to it
+  edge(200);
+  edge(200);
+  CHECK(sensor.exit_count == count && lockouts == 2 && lockoutGap == 400);
+  edge(COUNT_LOCKOUT_DELAY - 400);
+  CHECK(sensor.exit_count == count && lockoutGap == COUNT_LOCKOUT_DELAY);
+  // the bounces do not push the lockout back
+  edge(1);
+  CHECK(sensor.exit_count == count + 1 && lockouts == 3);
+
+  // tips just apart are all counted
+  for (int i = 0; i < 10; i++)
+    edge(COUNT_LOCKOUT_DELAY + 1);
+  CHECK(sensor.exit_count == count + 11 && lockouts == 3);
+  CHECK(counts == sensor.exit_count);
+
+  // model6 counts every edge, however close
+  sys.mod = model6;
+  for (int i = 0; i < 10; i++)
+    edge(1);
+  CHECK(sensor.exit_count == count + 21 && lockouts == 3);
+}
+
+static void test_window(void) {
+  uint32_t count;
+
+  sys.mod = model7;
+  host_tick += 100000;
+  sensor.intensity = 0;
+  // the window opened at the previous test's tips closes on the first
+  // edge, more than an hour later: too old to give an intensity
+  edge(COUNT_WINDOW_MAX);
+  CHECK(sensor.intensity == 0);
+
+  // a tip every 10 s: the window closes on the edge 60 s after it opened,
+  // with the 6 tips before that edge
+  count = sensor.exit_count;
+  for (int i = 0; i < 5; i++)
+    edge(10000);
+  CHECK(sensor.intensity == 0);
+  edge(10000);
+  CHECK(sensor.intensity == intensity(6, COUNT_WINDOW_TIME));
+  CHECK(sensor.exit_count == count + 6);
+  printf("6 tips a minute: %u.%u mm/h\n", sensor.intensity / 10,
+         sensor.intensity % 10);
+
+  // a slower window keeps the maximum, a faster one raises it
+  for (int i = 0; i < 3; i++)
+    edge(20000);
+  CHECK(sensor.intensity == intensity(6, COUNT_WINDOW_TIME));
+  for (int i = 0; i < 59; i++)
+    edge(1000);
+  CHECK(sensor.intensity == intensity(6, COUNT_WINDOW_TIME));
+  edge(1000);
+  CHECK(sensor.intensity == intensity(60, 60000));
+
+  // the sample closes the window early, over the time it was open: the
+  // tip that opened it and two more
+  sensor.intensity = 0; // cleared by main.c with each datalog record
+  edge(5000);
+  edge(5000);
+  host_tick += 20000;
+  Count_Sample();
+  CHECK(sensor.intensity == intensity(3, 30000));
+  // twice at once divides by nothing
+  Count_Sample();
+  CHECK(sensor.intensity == intensity(3, 30000));
+  // a window without tips gives no intensity
+  sensor.intensity = 0;
+  host_tick += 60000;
+  Count_Sample();
+  CHECK(sensor.intensity == 0);
+
+  // across the wrap of the clock, from a window the sample opened
+  host_tick = UINT32_MAX - 30000;
+  Count_Sample();
+  edge(20000);
+  edge(20000);
+  edge(20000);
+  CHECK(host_tick < 30000 && sensor.intensity == intensity(2, 60000));
+
+  // model6 has no window
+  sys.mod = model6;
+  sensor.intensity = 0;
+  edge(1000);
+  host_tick += 60000;
+  Count_Sample();
+  CHECK(sensor.intensity == 0);
+}
+
+// Stop left with the given EXTI lines and NVIC interrupts pending
+static uint8_t wake(uint32_t pr, uint32_t ispr) {
+  EXTI->PR = pr;
+  NVIC->ISPR[0] = ispr;
+  return Count_FastWake();
+}
+
+static void test_fastwake(void) {
+  const uint32_t countIrq = 1UL << EXTI4_15_IRQn;
+  uint32_t count;
+
+  sys.mod = model6;
+  sys.inmod = '1';
+  count = sensor.exit_count;
+  // the count edge alone is taken, and cleared
+  CHECK(Count_IsActive());
+  CHECK(wake(COUNT_PIN, countIrq) == 1);
+  CHECK(EXTI->PR == 0 && NVIC->ISPR[0] == 0);
+  CHECK(sensor.exit_count == count + 1);
+
+  // anything else pending goes through the full wake-up, the edge with it
+  CHECK(wake(COUNT_PIN | GPIO_PIN_7, countIrq) == 0);
+  CHECK(EXTI->PR == (COUNT_PIN | GPIO_PIN_7) && NVIC->ISPR[0] == countIrq);
+  CHECK(wake(COUNT_PIN, countIrq | 1UL << RTC_IRQn) == 0);
+  CHECK(wake(COUNT_PIN, countIrq | 1UL << LPUART1_IRQn) == 0);
+  CHECK(wake(COUNT_PIN | GPIO_PIN_2, countIrq | 1UL << EXTI2_3_IRQn) == 0);
+  CHECK(wake(GPIO_PIN_7, countIrq) == 0);
+  CHECK(wake(0, 1UL << RTC_IRQn) == 0);
+  CHECK(sensor.exit_count == count + 1);
+
+  // a model7 bounce is rejected, and the MCU goes back to Stop
+  sys.mod = model7;
+  host_tick += 100000;
+  CHECK(wake(COUNT_PIN, countIrq) == 1);
+  host_tick += 10;
+  CHECK(wake(COUNT_PIN, countIrq) == 1);
+  CHECK(sensor.exit_count == count + 2 && EXTI->PR == 0);
+
+  // counting off, or another mode: the edge is left to the EXTI handler
+  sys.inmod = '0';
+  CHECK(!Count_IsActive() && wake(COUNT_PIN, countIrq) == 0);
+  sys.inmod = '1';
+  sys.mod = model1;
+  CHECK(!Count_IsActive() && wake(COUNT_PIN, countIrq) == 0);
+  CHECK(sensor.exit_count == count + 2);
+}
+
+int main(void) {
+  test_lockout();
+  test_window();
+  test_fastwake();
+  return host_report("count");
+}
@@ -0,0 +1,419 @@
+#include "downlink.h"
+#include "at.h"
+#include "config.h"
+#include "host.h"
+
+/* Downlink_JsonScan() over golden downlinks, then over random ones that
+ * must neither read past the payload nor hand out a pair outside it. The
+ * hex command downlinks go through rxPayLoadDeal() as the modem hands them
+ * over, one golden case per command byte and the frames it must refuse.
+ * The TLV downlinks set the saved settings through the AT setters, here a
+ * model of the settings in RAM and of their copy in flash, and are checked
+ * through the ack of the next uplink. */
+#define NO_GPIO 0xFF
+#define SETTINGS 16
+
+SYSTEM sys;
+uint8_t mqtt_qos = 0;
+uint8_t mqtt_qos_flags = 0;
+bool first_sample = 1;
+uint8_t at_downlink_flag = 0;
+static uint32_t saves = 0;
+static uint32_t flushes = 0;
+static uint32_t resets = 0;
+static uint32_t reloads = 0;
+static uint8_t gpio = NO_GPIO;
+
+// A setting by the name of its setter in at.c
+typedef struct {
+  char name[24];
+  char value[AT_VALUE_MAX + 1];
+} Setting;
+
+static Setting ram[SETTINGS];
+static Setting flash[SETTINGS];
+
+static char trace[512];
+static const char *payload;
+static size_t payloadLen;
+
+static uint8_t record(const char *key, size_t keyLen, const char *value,
+                      size_t len) {
+  CHECK(key >= payload && key + keyLen <= payload + payloadLen);
+  CHECK(value >= payload && value + len <= payload + payloadLen);
+  if (strlen(trace) + keyLen + len + 3 < sizeof(trace))
+    sprintf(trace + strlen(trace), "%.*s=%.*s;", (int)keyLen, key, (int)len,
+            value);
+  return keyLen != 0 && key[0] != 'x';
+}
+
+static uint8_t scan(const char *json, uint8_t *reset) {
+  payload = json;
+  payloadLen = strlen(json);
+  trace[0] = '\0';
+  return Downlink_JsonScan(json, record, reset);
+}
+
+static const struct {
+  const char *json;
+  const char *pairs;
+  uint8_t changed, reset;
+} golden[] = {
+    {"{\"AT+TDC\":\"1200\"}", "AT+TDC=1200;", 1, 0},
+    {"{\"AT+TDC\": 1200, \"AT+PRO\": \"1,5\"}", "AT+TDC=1200;AT+PRO=1,5;", 1,
+     0},
+    {"{ \"AT+TDC\" :\r\n \"600\" ,\"ATZ\"}", "AT+TDC=600;", 1, 1},
+    {"[\"ATZ\"]", "", 0, 1},
+    {"{\"AT+PRO\":\"1,\"}", "AT+PRO=1,;", 1, 0},
+    {"{\"AT+PRO\":1,}", "AT+PRO=1;", 1, 0},
+    {"{\"x\":\"1\"}", "x=1;", 0, 0},
+    {"{\"AT+APN\":\"\"}", "AT+APN=;", 1, 0},
+    {"{\"AT+APN\":}", "AT+APN=;", 1, 0},
+    // truncated frames stop at the last complete pair
+    {"{\"AT+TDC\":\"1200\",\"AT+5VT\":\"50", "AT+TDC=1200;", 1, 0},
+    {"{\"AT+TDC", "", 0, 0},
+    {"{\"AT+TDC\"", "", 0, 0},
+    {"{\"AT+TDC\":", "AT+TDC=;", 1, 0},
+    {"\"", "", 0, 0},
+    {"", "", 0, 0},
+    {"{\"ATZ\" \"AT+TDC\":\"60\"}", "AT+TDC=60;", 1, 1},
+};
+
+static void test_golden(void) {
+  for (size_t i = 0; i < sizeof(golden) / sizeof(golden[0]); i++) {
+    uint8_t reset = 0xFF;
+    uint8_t changed = scan(golden[i].json, &reset);
+
+    if (strcmp(trace, golden[i].pairs) != 0)
+      printf("%s: got %s\n", golden[i].json, trace);
+    CHECK(strcmp(trace, golden[i].pairs) == 0);
+    CHECK(changed == golden[i].changed);
+    CHECK(reset == golden[i].reset);
+  }
+}
+
+static Setting *setting(Setting *settings, const char *name) {
+  for (int i = 0; i < SETTINGS; i++) {
+    if (settings[i].name[0] == '\0')
+      snprintf(settings[i].name, sizeof(settings[i].name), "%s", name);
+    if (strcmp(settings[i].name, name) == 0)
+      return &settings[i];
+  }
+  return NULL;
+}
+
+// Value of the setting in RAM, "" when never set
+static const char *value(const char *name) {
+  return setting(ram, name)->value;
+}
+
+// The setters keep the value after the "=", and refuse those from "bad"
+int host_at_handler(const char *name, const char *param) {
+  const char *value = param != NULL ? strchr(param, '=') : NULL;
+  Setting *s;
+
+  if (strstr(name, "_set") == NULL || value == NULL)
+    return AT_OK;
+  if (strncmp(++value, "bad", 3) == 0)
+    return AT_PARAM_ERROR;
+  s = setting(ram, name);
+  CHECK(s != NULL);
+  snprintf(s->value, sizeof(s->value), "%s", value);
+  return AT_OK;
+}
+
+void config_Save(void) { saves++; }
+
+void config_Flush(void) {
+  memcpy(flash, ram, sizeof(flash));
+  flushes++;
+}
+
+void config_Get(void) {
+  memcpy(ram, flash, sizeof(ram));
+  reloads++;
+}
+
+void EX_GPIO_Init(uint8_t state) { gpio = state; }
+
+// Returns here, where the firmware restarts
+void NVIC_SystemReset(void) { resets++; }
+
+static const SYSTEM defaults = {
+    .inmod = '0',
+    .tdc = 1200,
+    .tr_time = 15,
+    .sht_noud = 8,
+    .clock_switch = 1,
+    .strat_time = 65535,
+};
+
+// The settings of sys the commands change
+typedef struct {
+  uint8_t inmod;
+  uint32_t tdc;
+  uint8_t tr_time;
+  uint8_t sht_noud;
+  bool clock_switch;
+  uint16_t strat_time;
+} Settings;
+
+static const struct {
+  const char *hex;
+  Settings sys;   // afterwards
+  uint8_t qos;    // mqtt_qos, 0xFF when left alone
+  uint8_t saved;  // config_Save() called
+  uint8_t reset;  // after config_Flush()
+  uint8_t gpio;   // EX_GPIO_Init() argument
+  bool sample;    // first_sample afterwards
+} commands[] = {
+    // 0x01 TDC, 3 bytes of seconds from 60
+    {"01000E10", {'0', 3600, 15, 8, 1, 65535}, 0xFF, 1, 0, NO_GPIO, 1},
+    {"0100003C", {'0', 60, 15, 8, 1, 65535}, 0xFF, 1, 0, NO_GPIO, 1},
+    {"01FFFFFF", {'0', 0xFFFFFF, 15, 8, 1, 65535}, 0xFF, 1, 0, NO_GPIO, 1},
+    {"0100003B", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"01000E", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    // 0x04 reset, on FF only
+    {"04FF", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 1, NO_GPIO, 1},
+    {"04FE", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"04FF00", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    // 0x06 interrupt mode 0 to 3, in the last byte
+    {"06000003", {'3', 1200, 15, 8, 1, 65535}, 0xFF, 1, 0, 3, 1},
+    {"06000000", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 1, 0, 0, 1},
+    {"06000004", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    // 0x07 MQTT QoS
+    {"0701", {'0', 1200, 15, 8, 1, 65535}, 1, 1, 0, NO_GPIO, 1},
+    {"070102", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    // 0x0A clock log: switch, start minute below 3600 or FFFF, interval,
+    // records per uplink up to 32
+    {"0A000E0F1E20", {'0', 1200, 30, 32, 0, 3599}, 0xFF, 1, 0, NO_GPIO, 0},
+    {"0A01FFFF0000", {'0', 1200, 0, 0, 1, 65535}, 0xFF, 1, 0, NO_GPIO, 0},
+    {"0A010E101E08", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"0A01000A1E21", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"0A01000A1E", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    // short, oversized and unknown frames change nothing
+    {"", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"01", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"0100000E10000000000000", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0,
+     NO_GPIO, 1},
+    {"04FFFFFFFFFFFFFFFFFFFF", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0,
+     NO_GPIO, 1},
+    {"0201", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"0B000E10", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+    {"FF", {'0', 1200, 15, 8, 1, 65535}, 0xFF, 0, 0, NO_GPIO, 1},
+};
+
+static void test_commands(void) {
+  for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    char payload[64];
+    const Settings *want = &commands[i].sys;
+
+    sys = defaults;
+    mqtt_qos = 0xFF;
+    mqtt_qos_flags = 0;
+    first_sample = 1;
+    saves = flushes = resets = 0;
+    gpio = NO_GPIO;
+    // as the modem hands it over
+    sprintf(payload, "%s\r\n", commands[i].hex);
+    rxPayLoadDeal(payload);
+
+    if (sys.tdc != want->tdc || sys.inmod != want->inmod ||
+        sys.tr_time != want->tr_time || sys.sht_noud != want->sht_noud ||
+        sys.clock_switch != want->clock_switch ||
+        sys.strat_time != want->strat_time)
+      printf("%s: settings differ\n", commands[i].hex);
+    CHECK(sys.tdc == want->tdc && sys.inmod == want->inmod);
+    CHECK(sys.tr_time == want->tr_time && sys.sht_noud == want->sht_noud);
+    CHECK(sys.clock_switch == want->clock_switch &&
+          sys.strat_time == want->strat_time);
+    CHECK(mqtt_qos == commands[i].qos);
+    CHECK(mqtt_qos_flags == (commands[i].qos != 0xFF));
+    CHECK(saves == commands[i].saved);
+    CHECK(resets == commands[i].reset && flushes == commands[i].reset);
+    CHECK(gpio == commands[i].gpio);
+    CHECK(first_sample == commands[i].sample);
+    CHECK(!rxAckPending());
+  }
+}
+
+typedef struct {
+  uint8_t type;
+  const char *value;
+} Record;
+
+// Hands a hex downlink over as the modem does
+static void receive(const char *hex) {
+  char payload[600];
+
+  snprintf(payload, sizeof(payload), "%s\r\n", hex);
+  saves = flushes = resets = reloads = 0;
+  rxPayLoadDeal(payload);
+}
+
+// A TLV frame of the records
+static void send(uint8_t seq, const Record *records, size_t count) {
+  uint8_t frame[256];
+  char hex[520];
+  size_t len = 0;
+
+  frame[len++] = DOWNLINK_TLV_VERSION;
+  frame[len++] = seq;
+  for (size_t i = 0; i < count; i++) {
+    size_t n = strlen(records[i].value);
+
+    frame[len++] = records[i].type;
+    frame[len++] = n;
+    memcpy(&frame[len], records[i].value, n);
+    len += n;
+  }
+  host_hex(hex, frame, len);
+  receive(hex);
+}
+
+// Status of the ack the next uplink carries for seq, or -1 for none
+static int ack(uint8_t seq) {
+  char hex[16];
+  uint8_t record[4];
+  size_t n = rxAckWrite(hex);
+
+  if (n == 0)
+    return -1;
+  CHECK(n == 8 && host_unhex(record, hex) == 4);
+  CHECK(record[0] == DOWNLINK_TLV_ACK && record[1] == 2 && record[2] == seq);
+  return record[3];
+}
+
+static void test_tlv(void) {
+  static const Record settings[] = {
+      {0x09, "600"},
+      {0x0B, "iot.nb"},
+      {0x19, "11,\"mqtt\""},
+      {0x23, "4"},
+  };
+  static const Record resetting[] = {{0x14, "5"}, {0x00, ""}};
+
+  CHECK(ack(0) == -1);
+  // the settings are applied as typed on the console, and saved once
+  send(0x10, settings, 4);
+  CHECK(strcmp(value("at_tdc_set"), "600") == 0);
+  CHECK(strcmp(value("at_apn_set"), "iot.nb") == 0);
+  CHECK(strcmp(value("at_uri1_set"), "11,\"mqtt\"") == 0);
+  CHECK(strcmp(value("at_confirm_set"), "4") == 0);
+  CHECK(saves == 1 && flushes == 1 && reloads == 0 && resets == 0);
+  // and acknowledged until an uplink carrying it is confirmed
+  CHECK(rxAckPending() && ack(0x10) == 0 && ack(0x10) == 0);
+  rxAckDelivered();
+  CHECK(!rxAckPending() && ack(0x10) == -1);
+
+  // the reset record restarts after the others, once they are written
+  send(0x11, resetting, 2);
+  CHECK(strcmp(value("at_csqtime_set"), "5") == 0);
+  CHECK(ack(0x11) == 0 && saves == 1 && resets == 1 && flushes == 2);
+  CHECK(memcmp(flash, ram, sizeof(ram)) == 0);
+
+  // an empty frame is acknowledged, and changes nothing
+  receive("A112");
+  CHECK(ack(0x12) == 0 && resets == 0);
+  rxAckDelivered();
+}
+
+static void test_tlv_rollback(void) {
+  static const Record rejected[] = {
+      {0x09, "900"},
+      {0x0B, "bad.apn"},
+      {0x14, "9"},
+  };
+  static const Record last[] = {{0x09, "900"}, {0x0B, "iot.b"},
+                                {0x23, "bad"}};
+  Setting before[SETTINGS];
+
+  // a setting of the console not yet written survives the rollback
+  CHECK(AT_SetValue(AT TDC, "1200", 4) == AT_OK);
+  memcpy(before, ram, sizeof(ram));
+
+  // the second record is refused: the first is undone, the third not run
+  send(0x20, rejected, 3);
+  CHECK(ack(0x20) == 2);
+  CHECK(reloads == 1 && saves == 0 && resets == 0);
+  CHECK(memcmp(ram, before, sizeof(ram)) == 0);
+  CHECK(strcmp(value("at_tdc_set"), "1200") == 0);
+  CHECK(strcmp(value("at_csqtime_set"), "5") == 0);
+
+  // the last record, after two applied
+  send(0x21, last, 3);
+  CHECK(ack(0x21) == 3 && reloads == 1 && saves == 0);
+  CHECK(memcmp(ram, before, sizeof(ram)) == 0);
+
+  // a value with a NUL in it is refused by AT_SetValue()
+  receive("A122" "0903360030");
+  CHECK(ack(0x22) == 1 && reloads == 1);
+  CHECK(memcmp(ram, before, sizeof(ram)) == 0);
+  rxAckDelivered();
+}
+
+static void test_tlv_malformed(void) {
+  static const struct {
+    const char *hex;
+    uint8_t seq;
+  } frames[] = {
+      // lengths past the end, short of it, and cut headers
+      {"A130" "0905363030", 0x30},
+      {"A131" "0902363030", 0x31},
+      {"A132" "09", 0x32},
+      {"A133" "090336303000", 0x33},
+      {"A134" "0903363030" "0B", 0x34},
+      {"A135" "09FF363030", 0x35},
+      {"A1", 0x00},
+      // types that are not settings of the downlink, after a valid record
+      {"A136" "0903363030" "0A0131", 0x36},
+      {"A137" "0903363030" "1F0431303030", 0x37},
+      {"A138" "0903363030" "020131", 0x38},
+      {"A139" "0903363030" "AC020000", 0x39},
+      {"A13A" "FF00", 0x3A},
+  };
+  Setting before[SETTINGS];
+
+  memcpy(before, ram, sizeof(ram));
+  for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+    receive(frames[i].hex);
+    if (ack(frames[i].seq) != DOWNLINK_TLV_MALFORMED)
+      printf("%s: not refused\n", frames[i].hex);
+    CHECK(ack(frames[i].seq) == DOWNLINK_TLV_MALFORMED);
+    // refused before anything is written or set
+    CHECK(flushes == 0 && saves == 0 && reloads == 0 && resets == 0);
+    CHECK(memcmp(ram, before, sizeof(ram)) == 0);
+  }
+  rxAckDelivered();
+}
+
+// Random payloads over the characters the scanner reacts to
+static void test_fuzz(void) {
+  static const char alphabet[] = "\":,{} \r\n\tAT+DCZx019";
+  uint32_t seed = 1;
+
+  for (int n = 0; n < 200000; n++) {
+    // exact size heap copy, so that a read past the end is caught
+    size_t len = (seed = seed * 1103515245 + 12345) >> 16 & 63;
+    char *json = malloc(len + 1);
+    uint8_t reset;
+
+    for (size_t i = 0; i < len; i++) {
+      seed = seed * 1103515245 + 12345;
+      json[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+    }
+    json[len] = '\0';
+    scan(json, &reset);
+    free(json);
+  }
+}
+
+int main(void) {
+  test_golden();
+  test_fuzz();
+  test_commands();
+  test_tlv();
+  test_tlv_rollback();
+  test_tlv_malformed();
+  return host_report("downlink");
+}
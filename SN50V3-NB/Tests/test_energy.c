@@ -0,0 +1,256 @@
+#include "energy.h"
+#include "clock.h"
+#include "flash_eraseprogram.h"
+#include "host.h"
+#include "time_server.h"
+
+/* The phase accounting of energy.c over a scripted uplink cycle: the calls
+ * the firmware makes at each state change, at the time it makes them, with
+ * no other update in between. Each phase is measured on its own by giving
+ * it a current of 1 uAh per ms and none to the others. The charge the clock
+ * profiles save is that of the same cycle with the PLL current for all.
+ * A day of such cycles is then replayed for the battery total, its EEPROM
+ * copy and the remaining days, before and after AT+BATCAP. */
+#define CYCLE_TIME 60000 // ms
+#define UAH_PER_MS 3600000 // uA
+
+typedef enum { MCU, MODEM, CLOCK, RAIL, FLASH, TX, END } Call;
+
+typedef struct {
+  uint32_t ms;
+  uint8_t call;
+  uint16_t arg;
+} Event;
+
+// Woken from Stop at 1 s, back in Stop 3 s later
+static const Event cycle[] = {
+    {1000, MCU, 0},
+    {1005, RAIL, 1},                       // txSensorPowerOn()
+    {1010, MODEM, ENERGY_MODEM_ATTACH},
+    {1020, CLOCK, CLOCK_MSI2},             // Clock_Wait() of the settle time
+    {1520, CLOCK, CLOCK_PLL32},
+    {1520, CLOCK, CLOCK_HSI16},            // sensor reads
+    {1530, CLOCK, CLOCK_PLL32},            // DS18B20 transaction
+    {1540, CLOCK, CLOCK_MSI2},             // its conversion time
+    {2290, CLOCK, CLOCK_PLL32},
+    {2300, CLOCK, CLOCK_HSI16},
+    {2380, CLOCK, CLOCK_PLL32},
+    {2381, RAIL, 0},                       // txSensorPowerOff()
+    {2500, MODEM, ENERGY_MODEM_REGISTERED},
+    {3000, MODEM, ENERGY_MODEM_CONNECTED},
+    {3050, TX, 500},                       // console bytes
+    {3100, FLASH, 1},
+    {3110, FLASH, 0},
+    {4000, MODEM, ENERGY_MODEM_OFF},
+    {4010, MCU, 1},
+    {CYCLE_TIME, END, 0},
+};
+
+static const uint32_t cycleTime[ENERGY_PHASES] = {
+    [ENERGY_STOP] = 1000 + CYCLE_TIME - 4010,
+    [ENERGY_RUN] = 20 + 10 + 10 + 4010 - 2380,
+    [ENERGY_MODEM_ON] = 2500 - 1010,
+    [ENERGY_MODEM_REG] = 3000 - 2500,
+    [ENERGY_MODEM_CONN] = 4000 - 3000,
+    [ENERGY_RAIL] = 2381 - 1005,
+    [ENERGY_FLASH] = 3110 - 3100,
+    [ENERGY_TX] = 500 * ENERGY_TX_BYTE_TIME / 1000,
+    [ENERGY_RUN_HSI16] = 10 + 2380 - 2300,
+    [ENERGY_RUN_MSI] = 1520 - 1020 + 2290 - 1540,
+};
+
+// A wake-up that only runs the timers, between two uplinks
+static const Event quiet[] = {
+    {1000, MCU, 0},
+    {1003, MCU, 1},
+    {CYCLE_TIME, END, 0},
+};
+
+static const uint32_t quietTime[ENERGY_PHASES] = {
+    [ENERGY_STOP] = CYCLE_TIME - 3,
+    [ENERGY_RUN] = 3,
+};
+
+static const uint32_t defaultCurrent[ENERGY_PHASES] = {
+    ENERGY_STOP_CURRENT,  ENERGY_RUN_CURRENT,  ENERGY_ON_CURRENT,
+    ENERGY_REG_CURRENT,   ENERGY_CONN_CURRENT, ENERGY_RAIL_CURRENT,
+    ENERGY_FLASH_CURRENT, ENERGY_TX_CURRENT,   ENERGY_HSI_CURRENT,
+    ENERGY_MSI_CURRENT};
+
+static uint8_t sysclk = CLOCK_PLL32;
+static uint32_t start = 0;
+static uint32_t cycles = 0;
+
+uint8_t Clock_Get(void) { return sysclk; }
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t savedTime) {
+  return host_tick - savedTime;
+}
+
+// Plays the events from the end of the last cycle played
+static void play(const Event *events, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const Event *e = &events[i];
+
+    host_tick = start + e->ms;
+    switch (e->call) {
+    case MCU:
+      Energy_Mcu(e->arg);
+      break;
+    case MODEM:
+      Energy_Modem(e->arg);
+      break;
+    case CLOCK:
+      sysclk = e->arg; // as Clock_Set() switches, then tells
+      Energy_Clock(e->arg);
+      break;
+    case RAIL:
+      Energy_Rail(e->arg);
+      break;
+    case FLASH:
+      Energy_Flash(e->arg);
+      break;
+    case TX:
+      Energy_Tx(e->arg);
+      break;
+    case END:
+      Energy_CycleEnd();
+      start = host_tick;
+      cycles++;
+      break;
+    }
+  }
+}
+
+static void currents(const uint32_t *current) {
+  for (uint8_t i = 0; i < ENERGY_PHASES; i++)
+    CHECK(Energy_SetCurrent(i, current[i]));
+}
+
+static void test_phases(void) {
+  uint32_t current[ENERGY_PHASES];
+  uint64_t charge = 0;
+
+  for (uint8_t phase = 0; phase < ENERGY_PHASES; phase++) {
+    memset(current, 0, sizeof(current));
+    current[phase] = UAH_PER_MS;
+    currents(current);
+    play(cycle, sizeof(cycle) / sizeof(cycle[0]));
+    if (Energy_CycleuAh() != cycleTime[phase])
+      printf("phase %d: %u ms, expected %u\n", phase, Energy_CycleuAh(),
+             cycleTime[phase]);
+    CHECK(Energy_CycleuAh() == cycleTime[phase]);
+  }
+
+  currents(defaultCurrent);
+  play(cycle, sizeof(cycle) / sizeof(cycle[0]));
+  for (uint8_t i = 0; i < ENERGY_PHASES; i++)
+    charge += (uint64_t)cycleTime[i] * defaultCurrent[i];
+  printf("Scripted uplink cycle: %u uAh\n", Energy_CycleuAh());
+  CHECK(Energy_CycleuAh() == charge / 3600000);
+  CHECK(Energy_SetCurrent(ENERGY_PHASES, 1) == 0);
+}
+
+// Battery charge of count cycles, in uAh
+static uint32_t charge(uint32_t count) {
+  uint32_t used = Energy_BatteryUsed();
+
+  for (uint32_t i = 0; i < count; i++)
+    play(cycle, sizeof(cycle) / sizeof(cycle[0]));
+  return Energy_BatteryUsed() - used;
+}
+
+static void test_savings(void) {
+  uint32_t current[ENERGY_PHASES];
+  uint32_t profiles, pll, saved;
+  uint64_t model = 0;
+
+  memcpy(current, defaultCurrent, sizeof(current));
+  currents(current);
+  profiles = charge(100);
+  current[ENERGY_RUN_HSI16] = current[ENERGY_RUN_MSI] = ENERGY_RUN_CURRENT;
+  currents(current);
+  pll = charge(100);
+  saved = pll - profiles;
+
+  for (uint8_t i = ENERGY_RUN_HSI16; i <= ENERGY_RUN_MSI; i++)
+    model += (uint64_t)cycleTime[i] * (ENERGY_RUN_CURRENT - defaultCurrent[i]);
+  model = model * 100 / 3600000;
+  printf("100 uplinks: %u uAh, %u uAh on the PLL alone, %u uAh saved\n",
+         profiles, pll, saved);
+  // within the rounding of the two totals
+  CHECK(pll > profiles && saved >= model - 1 && saved <= model + 1);
+  currents(defaultCurrent);
+}
+
+// The day of the log: an uplink every 20 minutes, timer wake-ups between
+static void play_day(void) {
+  for (uint32_t i = 0; i < ENERGY_DAY_TIME / CYCLE_TIME; i++) {
+    if (i % 20 == 0)
+      play(cycle, sizeof(cycle) / sizeof(cycle[0]));
+    else
+      play(quiet, sizeof(quiet) / sizeof(quiet[0]));
+  }
+}
+
+static uint32_t eeprom(uint32_t address) {
+  return *(volatile uint32_t *)(uintptr_t)address;
+}
+
+static void test_battery(void) {
+  uint64_t day = 0;
+  uint32_t daily, used, writes;
+
+  for (uint8_t i = 0; i < ENERGY_PHASES; i++)
+    day += ((uint64_t)cycleTime[i] * 72 + (uint64_t)quietTime[i] * 1368) *
+           defaultCurrent[i];
+  daily = day / 3600000;
+
+  // from the start of a day, the last one being that of the tests above
+  while (cycles % (ENERGY_DAY_TIME / CYCLE_TIME) != 0)
+    play(quiet, sizeof(quiet) / sizeof(quiet[0]));
+  // AT+BATCAP starts from a full cell
+  Energy_BatteryReset();
+  CHECK(eeprom(EEPROM_USER_BATTERY_FLAG) == ENERGY_BATTERY_VALID);
+  CHECK(eeprom(EEPROM_USER_BATTERY_USED) == 0);
+
+  host_eeprom_writes = 0;
+  play_day();
+  used = Energy_BatteryUsed();
+  writes = host_eeprom_writes;
+  printf("Day replayed: %u uAh, %u EEPROM writes, %u days left of %u mAh\n",
+         used, writes, Energy_RemainingDays(ENERGY_BATTERY_CAPACITY),
+         ENERGY_BATTERY_CAPACITY);
+  CHECK(used >= daily && used <= daily + 1);
+  CHECK(Energy_RemainingDays(ENERGY_BATTERY_CAPACITY) ==
+        (ENERGY_BATTERY_CAPACITY * 1000 - used) / daily);
+  // saved every ENERGY_SAVE_CHARGE, before Stop
+  CHECK(writes == used / ENERGY_SAVE_CHARGE);
+  CHECK(eeprom(EEPROM_USER_BATTERY_USED) <= used &&
+        used - eeprom(EEPROM_USER_BATTERY_USED) < ENERGY_SAVE_CHARGE);
+  CHECK(Energy_RemainingDays(used / 1000) == 0);
+
+  // a reset resumes from the saved total, the rate from the last day
+  Energy_Init();
+  CHECK(Energy_BatteryUsed() == eeprom(EEPROM_USER_BATTERY_USED));
+  used = Energy_BatteryUsed();
+  CHECK(Energy_RemainingDays(ENERGY_BATTERY_CAPACITY) ==
+        (ENERGY_BATTERY_CAPACITY * 1000 - used) / daily);
+
+  // AT+BATCAP=2400 for a smaller cell
+  Energy_BatteryReset();
+  CHECK(Energy_BatteryUsed() == 0 && eeprom(EEPROM_USER_BATTERY_USED) == 0);
+  CHECK(Energy_RemainingDays(2400) == 2400 * 1000 / daily);
+}
+
+int main(void) {
+  host_eeprom_clear();
+  Energy_Init();
+  Energy_Mcu(1);
+  test_phases();
+  test_savings();
+  test_battery();
+  return host_report("energy");
+}
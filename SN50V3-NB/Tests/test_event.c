@@ -0,0 +1,158 @@
+#include "event.h"
+#include "host.h"
+#include "utilities.h"
+
+/* The event queue and the signal bits of event.c under the bursts the
+ * interrupt handlers post between two drains of the main loop: the order
+ * kept across the wrap of the queue, the single slot of Event_PostOnce(),
+ * the count of the events dropped when the queue is full, and the signals
+ * Event_TakeSignals() hands over once. Every call leaves the interrupts as
+ * it found them. */
+SENSOR sensor;
+
+// Drains the queue into types and args; returns the events taken
+static uint32_t drain(uint8_t *types, uint32_t *args, uint32_t max) {
+  Event event;
+  uint32_t n = 0;
+
+  while (Event_Get(&event)) {
+    if (n < max) {
+      types[n] = event.type;
+      args[n] = event.arg;
+    }
+    n++;
+  }
+  CHECK(host_primask == 0 && Event_IsEmpty());
+  return n;
+}
+
+static void test_order(void) {
+  uint8_t types[EVENT_QUEUE_SIZE];
+  uint32_t args[EVENT_QUEUE_SIZE];
+  uint32_t next = 0, taken = 0;
+
+  Event_Init();
+  // a full queue comes out in the posting order
+  for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    CHECK(Event_Post(EVENT_EXTI, i));
+  CHECK(drain(types, args, EVENT_QUEUE_SIZE) == EVENT_QUEUE_SIZE);
+  for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    CHECK(types[i] == EVENT_EXTI && args[i] == i);
+
+  // and so do bursts of 5 drained by 3, wrapping the queue several times
+  for (uint32_t round = 0; round < 4 * EVENT_QUEUE_SIZE; round++) {
+    Event event;
+
+    for (uint32_t i = 0; i < 5; i++) {
+      if (Event_Post(EVENT_UPLINK_TIMEOUT, next))
+        next++;
+    }
+    for (uint32_t i = 0; i < 3 && Event_Get(&event); i++)
+      CHECK(event.type == EVENT_UPLINK_TIMEOUT && event.arg == taken++);
+  }
+  while (taken < next) {
+    Event event;
+
+    CHECK(Event_Get(&event) && event.arg == taken++);
+  }
+  CHECK(Event_IsEmpty() && host_primask == 0);
+  Event_Process(); // reports the events the bursts dropped
+}
+
+static void test_once(void) {
+  uint8_t types[EVENT_QUEUE_SIZE];
+  uint32_t args[EVENT_QUEUE_SIZE];
+
+  Event_Init();
+  // a burst of count edges takes a single slot, with the first arg
+  CHECK(Event_PostOnce(EVENT_COUNT, 1));
+  CHECK(Event_Post(EVENT_EXTI, 0));
+  for (uint32_t i = 2; i < 100; i++)
+    CHECK(Event_PostOnce(EVENT_COUNT, i));
+  CHECK(Event_Post(EVENT_DNS, 0));
+  CHECK(drain(types, args, EVENT_QUEUE_SIZE) == 3);
+  CHECK(types[0] == EVENT_COUNT && args[0] == 1);
+  CHECK(types[1] == EVENT_EXTI && types[2] == EVENT_DNS);
+
+  // once drained, it is queued again
+  CHECK(Event_PostOnce(EVENT_COUNT, 7));
+  CHECK(Event_PostOnce(EVENT_COUNT, 8));
+  CHECK(drain(types, args, EVENT_QUEUE_SIZE) == 1 && args[0] == 7);
+
+  // a full queue refuses it without marking it queued, so that the next
+  // edge after a drain is posted
+  for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    CHECK(Event_Post(EVENT_EXTI, i));
+  CHECK(Event_PostOnce(EVENT_COUNT, 9) == 0);
+  CHECK(Event_Get(&(Event){0}));
+  CHECK(Event_PostOnce(EVENT_COUNT, 10));
+  CHECK(drain(types, args, EVENT_QUEUE_SIZE) == EVENT_QUEUE_SIZE);
+  CHECK(types[EVENT_QUEUE_SIZE - 1] == EVENT_COUNT &&
+        args[EVENT_QUEUE_SIZE - 1] == 10);
+  Event_Process();
+}
+
+static void test_dropped(void) {
+  uint32_t dropped = 0;
+
+  Event_Init();
+  host_last_log[0] = '\0';
+  // an empty drain reports nothing
+  Event_Process();
+  CHECK(host_last_log[0] == '\0');
+
+  // a burst of twice the queue keeps the first half, and counts the rest
+  for (uint32_t i = 0; i < 2 * EVENT_QUEUE_SIZE; i++) {
+    if (Event_Post(EVENT_DNS, i) == 0)
+      dropped++;
+  }
+  CHECK(dropped == EVENT_QUEUE_SIZE);
+  // refused once-events count as well
+  CHECK(Event_PostOnce(EVENT_COUNT, 0) == 0);
+  dropped++;
+  Event_Process();
+  CHECK(Event_IsEmpty() && host_primask == 0);
+  CHECK(atoi(host_last_log) == (int)dropped &&
+        strstr(host_last_log, "events dropped") != NULL);
+  printf("Burst of %d events: %d queued, %s\n", 2 * EVENT_QUEUE_SIZE + 1,
+         EVENT_QUEUE_SIZE, host_last_log);
+
+  // the count starts over after the report
+  host_last_log[0] = '\0';
+  CHECK(Event_Post(EVENT_NO_SIGNAL, 0));
+  Event_Process();
+  CHECK(strstr(host_last_log, "dropped") == NULL);
+}
+
+static void test_signals(void) {
+  Event_Init();
+  CHECK(Event_TakeSignals() != 0); // EVENT_SIGNAL_LOG of the tests above
+  CHECK(Event_PendingSignals() == 0 && Event_TakeSignals() == 0);
+
+  // bits set apart are taken at once, and only once
+  Event_Signal(EVENT_SIGNAL_NB);
+  Event_Signal(EVENT_SIGNAL_KEY | EVENT_SIGNAL_NB);
+  CHECK(Event_PendingSignals() == (EVENT_SIGNAL_NB | EVENT_SIGNAL_KEY));
+  CHECK(Event_TakeSignals() == (EVENT_SIGNAL_NB | EVENT_SIGNAL_KEY));
+  CHECK(Event_PendingSignals() == 0 && Event_TakeSignals() == 0);
+
+  // a posted event asks for the drain, a dropped one as well
+  CHECK(Event_Post(EVENT_EXTI, 1));
+  CHECK(Event_TakeSignals() == EVENT_SIGNAL_LOG);
+  for (uint32_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    Event_Post(EVENT_EXTI, i);
+  CHECK(Event_TakeSignals() == EVENT_SIGNAL_LOG);
+  // a bit set while the loop handles the others is kept for the next take
+  Event_Signal(EVENT_SIGNAL_UPLINK);
+  Event_Process();
+  CHECK(Event_TakeSignals() == EVENT_SIGNAL_UPLINK);
+  CHECK(host_primask == 0);
+}
+
+int main(void) {
+  test_order();
+  test_once();
+  test_dropped();
+  test_signals();
+  return host_report("event");
+}
@@ -0,0 +1,165 @@
+#include "lidar.h"
+#include "host.h"
+
+/* The LIDAR-Lite v3 readout of lidar.c against a model of the sensor on
+ * I2C1, on a virtual clock. Writing 0x04 to register 0x00 starts a
+ * measurement, busy in bit 0 of register 0x01 until it is done, and the
+ * distance in cm is read from 0x0F and 0x10. A measurement takes about a
+ * ms per 8 acquisitions of register 0x02 and 2 ms more; a bus transaction
+ * takes I2C_TRANSACTION_US, and WFI sleeps until the next SysTick. */
+#define LIDAR_ADDRESS 0xC4
+#define I2C_TRANSACTION_US 400 // a register read at 100 kHz, address phase
+#define ACQ_TIME(count) (2 + (count) / 8)
+
+SYSTEM sys;
+bool tdc_clock_log_flag = 0;
+I2C_HandleTypeDef hi2c1;
+
+static struct {
+  uint8_t present;
+  uint8_t regs[256];
+  uint32_t busyUntil;
+  uint32_t extra; // ms a measurement takes beyond its acquisitions
+} lidar;
+static uint32_t busUs = 0;
+static uint32_t reads = 0;
+static uint32_t statusReads = 0;
+static uint32_t writes = 0;
+static uint32_t wakes = 0;
+static uint32_t inits = 0;
+
+void MX_I2C1_Init(void) { inits++; }
+
+void HAL_Delay(uint32_t Delay) { host_tick += Delay; }
+
+void host_wfi(void) {
+  wakes++;
+  host_tick++;
+}
+
+static HAL_StatusTypeDef transaction(uint16_t address) {
+  busUs += I2C_TRANSACTION_US;
+  host_tick += busUs / 1000;
+  busUs %= 1000;
+  CHECK((address & 0xFE) == LIDAR_ADDRESS);
+  return lidar.present ? HAL_OK : HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c,
+                                    uint16_t DevAddress, uint16_t MemAddress,
+                                    uint16_t MemAddSize, uint8_t *pData,
+                                    uint16_t Size, uint32_t Timeout) {
+  writes++;
+  CHECK(hi2c == &hi2c1 && (DevAddress & 1) == 0 && Size == 1);
+  if (transaction(DevAddress) != HAL_OK)
+    return HAL_ERROR;
+  lidar.regs[MemAddress] = pData[0];
+  if (MemAddress == 0x00 && pData[0] == 0x04) {
+    uint8_t count = lidar.regs[LIDAR_ACQ_COUNT_REG];
+
+    lidar.busyUntil = host_tick + ACQ_TIME(count) + lidar.extra;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c,
+                                   uint16_t DevAddress, uint16_t MemAddress,
+                                   uint16_t MemAddSize, uint8_t *pData,
+                                   uint16_t Size, uint32_t Timeout) {
+  reads++;
+  CHECK(hi2c == &hi2c1 && (DevAddress & 1) == 1 && Size == 1);
+  if (transaction(DevAddress) != HAL_OK)
+    return HAL_ERROR;
+  if (MemAddress == 0x01) {
+    statusReads++;
+    pData[0] = host_tick < lidar.busyUntil;
+  } else {
+    pData[0] = lidar.regs[MemAddress];
+  }
+  return HAL_OK;
+}
+
+// The sensor powered with the 5V rail, a target at cm
+static void power(uint16_t cm) {
+  memset(&lidar, 0, sizeof(lidar));
+  lidar.present = 1;
+  lidar.regs[LIDAR_ACQ_COUNT_REG] = LIDAR_ACQ_COUNT_DEFAULT;
+  lidar.regs[0x0F] = cm >> 8;
+  lidar.regs[0x10] = cm & 0xFF;
+  reads = statusReads = writes = wakes = inits = 0;
+}
+
+// A measurement, and the ms it took after the 100 ms of I2C start-up
+static uint16_t measure(uint32_t *ms) {
+  uint32_t start = host_tick;
+  uint16_t cm = LidarLite();
+
+  *ms = host_tick - start - 100;
+  CHECK(inits == 1);
+  return cm;
+}
+
+static void test_timed(void) {
+  static const uint8_t counts[] = {0, 0x80, 0x20, 0x08, 0xFF};
+  uint32_t ms;
+
+  for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    uint8_t count = counts[i] ? counts[i] : LIDAR_ACQ_COUNT_DEFAULT;
+
+    sys.lidar_acq = counts[i];
+    power(1234);
+    CHECK(measure(&ms) == 1234);
+    // the count is only written when set
+    CHECK(lidar.regs[LIDAR_ACQ_COUNT_REG] == count);
+    CHECK(writes == 1 + (counts[i] != 0));
+    // idle before, done after the sleep, then the distance: 4 reads in all,
+    // and no polling while the sensor measures
+    CHECK(statusReads == 2 && reads == 4);
+    CHECK(ACQ_TIME(count) <= LIDAR_ACQ_TIME(counts[i]));
+    CHECK(wakes == (uint32_t)LIDAR_ACQ_TIME(counts[i]));
+    printf("acquisition count %3u: %u ms, %u reads, %u writes\n", count, ms,
+           reads, writes);
+  }
+  sys.lidar_acq = 0;
+}
+
+static void test_slow(void) {
+  uint32_t ms;
+
+  // a measurement over its time: polled until done, not given up on
+  power(350);
+  lidar.extra = 6;
+  CHECK(measure(&ms) == 350);
+  CHECK(host_tick >= lidar.busyUntil && statusReads > 2);
+  CHECK(statusReads <= 2 + 1 + lidar.extra * 1000 / I2C_TRANSACTION_US);
+
+  // still busy from an earlier measurement: waited for before starting
+  power(350);
+  lidar.busyUntil = host_tick + 100 + 3;
+  CHECK(measure(&ms) == 350 && statusReads > 2);
+}
+
+static void test_range(void) {
+  uint32_t ms;
+
+  // 40 m is the limit, further is out of range
+  power(4000);
+  CHECK(measure(&ms) == 4000);
+  power(4001);
+  CHECK(measure(&ms) == 65535);
+  power(0);
+  CHECK(measure(&ms) == 0);
+
+  // no sensor on the bus: neither a distance nor a hang
+  power(1234);
+  lidar.present = 0;
+  CHECK(measure(&ms) == 4095);
+  CHECK(writes <= 2 && reads <= 1 + 100 + 1000);
+}
+
+int main(void) {
+  test_timed();
+  test_slow();
+  test_range();
+  return host_report("lidar");
+}
@@ -0,0 +1,258 @@
+#include "lowpower.h"
+#include "clock.h"
+#include "count.h"
+#include "energy.h"
+#include "event.h"
+#include "host.h"
+#include "hw.h"
+
+/* The idle loop of lowpower.c over the vetoes of low_power_manager.c, on a
+ * model of the system clock and a virtual RTC of 1024 ticks a second. Stop
+ * wakes up on the clock __HAL_RCC_WAKEUPSTOP_CLK_CONFIG() selected, with
+ * SystemCoreClock left as it was until SystemCoreClockUpdate(), and
+ * HAL_InitTick() restarts SysTick on the clock it is given. Each Stop or
+ * Sleep lasts WAKE_MS, and the main loop work that the wake-up found is
+ * taken from a script of wake levels. */
+#define TICKS(ms) ((uint32_t)((uint64_t)(ms) * 1024 / 1000))
+#define WAKE_MS 250      // between two wake-ups
+#define PLL_LOCK_TICKS 3 // RTC ticks of a SystemClock_Config()
+#define HSI16_HZ 16000000
+#define PLL32_HZ 32000000
+
+uint32_t SystemCoreClock = PLL32_HZ;
+
+static uint32_t rtcNow = 0;
+static struct {
+  uint32_t sysclk;    // RCC_SYSCLKSOURCE_STATUS_
+  uint32_t wakeClock; // RCC_STOP_WAKEUPCLOCK_
+  uint32_t tickHz;    // of SysTick
+  uint8_t counting;   // Count_IsActive()
+  uint8_t edges;      // Count_FastWake() to return 1
+  uint32_t signals;
+  uint32_t stops;
+  uint32_t sleeps;
+  uint32_t plls;
+  uint32_t pllProfiles; // Energy_Clock(CLOCK_PLL32)
+} m;
+static const uint8_t *script = NULL; // wake levels of LPM_WakeWork()
+static size_t scriptLen = 0;
+static size_t scriptNext = 0;
+static char modes[32]; // 'S' for each Stop, 'z' for each Sleep
+static size_t modesLen = 0;
+
+uint32_t HW_RTC_GetTimerValue(void) { return rtcNow; }
+
+TimerTime_t HW_RTC_Tick2ms(uint32_t tick) {
+  return (uint32_t)((uint64_t)tick * 1000 / 1024);
+}
+
+uint8_t Count_IsActive(void) { return m.counting; }
+
+uint8_t Count_FastWake(void) {
+  if (m.edges == 0)
+    return 0;
+  m.edges--;
+  return 1;
+}
+
+void Energy_Mcu(uint8_t stop) {}
+
+void Energy_Clock(uint8_t profile) {
+  CHECK(profile == CLOCK_PLL32);
+  m.pllProfiles++;
+}
+
+uint32_t Event_PendingSignals(void) { return m.signals; }
+
+void host_rcc_stop_wakeup(uint32_t clock) { m.wakeClock = clock; }
+
+uint32_t host_rcc_sysclk(void) { return m.sysclk; }
+
+void HAL_PWREx_EnableUltraLowPower(void) {}
+
+void HAL_PWREx_EnableFastWakeUp(void) {}
+
+static void record(char mode) {
+  CHECK(modesLen < sizeof(modes));
+  if (modesLen < sizeof(modes))
+    modes[modesLen++] = mode;
+  rtcNow += TICKS(WAKE_MS);
+}
+
+// Entered with interrupts masked, so that the wake-up runs nothing before
+// LPM_Stop() has the clocks back
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry) {
+  CHECK(host_primask == 1 && host_tick_suspended);
+  CHECK(m.wakeClock == RCC_STOP_WAKEUPCLOCK_HSI);
+  m.stops++;
+  m.sysclk = RCC_SYSCLKSOURCE_STATUS_HSI;
+  record('S');
+}
+
+void host_wfi(void) {
+  CHECK(host_primask == 1);
+  m.sleeps++;
+  record('z');
+}
+
+void SystemCoreClockUpdate(void) {
+  SystemCoreClock =
+      m.sysclk == RCC_SYSCLKSOURCE_STATUS_PLLCLK ? PLL32_HZ : HSI16_HZ;
+}
+
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority) {
+  m.tickHz = SystemCoreClock;
+  host_tick_suspended = 0;
+  return HAL_OK;
+}
+
+// SystemClock_Config() of main.c
+static void Clock_Config(void) {
+  CHECK(m.sysclk != RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+  m.plls++;
+  m.sysclk = RCC_SYSCLKSOURCE_STATUS_PLLCLK;
+  SystemCoreClock = m.tickHz = PLL32_HZ;
+  rtcNow += PLL_LOCK_TICKS;
+}
+
+// What the main loop found to do after each wake-up, the interrupts having
+// run
+uint8_t LPM_WakeWork(void) {
+  CHECK(host_primask == 0 && scriptNext < scriptLen);
+  if (scriptNext >= scriptLen)
+    return LPM_WAKE_RUN;
+  return script[scriptNext++];
+}
+
+// An idle of the main loop through the wake levels, returning the modes
+// entered
+static const char *idle(const uint8_t *levels, size_t count) {
+  script = levels;
+  scriptLen = count;
+  scriptNext = 0;
+  modesLen = 0;
+  LPM_Idle(Clock_Config);
+  CHECK(scriptNext == count && host_primask == 0);
+  modes[modesLen < sizeof(modes) ? modesLen : sizeof(modes) - 1] = '\0';
+  return modes;
+}
+
+// The clock the core runs on agrees with SysTick, and its time base ticks
+static void clockIs(uint32_t source) {
+  uint32_t hz = source == RCC_SYSCLKSOURCE_STATUS_PLLCLK ? PLL32_HZ : HSI16_HZ;
+
+  CHECK(m.sysclk == source && SystemCoreClock == hz && m.tickHz == hz);
+  CHECK(!host_tick_suspended);
+}
+
+static void test_levels(void) {
+  static const uint8_t housekeeping[] = {LPM_WAKE_SLEEP, LPM_WAKE_SLEEP,
+                                         LPM_WAKE_LIGHT};
+  static const uint8_t run[] = {LPM_WAKE_SLEEP, LPM_WAKE_RUN};
+  static const uint8_t light[] = {LPM_WAKE_LIGHT};
+  static const uint8_t now[] = {LPM_WAKE_RUN};
+
+  // wake-ups that only ran interrupts go back to Stop, and light work runs
+  // on HSI16 without the PLL
+  CHECK(strcmp(idle(housekeeping, 3), "SSS") == 0);
+  CHECK(m.stops == 3 && m.plls == 0);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_HSI);
+
+  // the PLL only for the work that needs it
+  CHECK(strcmp(idle(run, 2), "SS") == 0);
+  CHECK(m.plls == 1 && m.pllProfiles == 1);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+
+  // a signal raised before Stop ends the idle at once, and the PLL is not
+  // restarted when it runs already
+  m.signals = 1;
+  CHECK(strcmp(idle(now, 1), "") == 0);
+  CHECK(m.stops == 5 && m.plls == 1);
+  m.signals = 0;
+
+  // light work after Stop, then run work on a signal: the PLL comes back
+  CHECK(strcmp(idle(light, 1), "S") == 0);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_HSI);
+  m.signals = 1;
+  CHECK(strcmp(idle(now, 1), "") == 0);
+  CHECK(m.plls == 2 && m.pllProfiles == 2);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+  m.signals = 0;
+}
+
+static void test_rx_veto(void) {
+  static const uint8_t levels[] = {LPM_WAKE_SLEEP, LPM_WAKE_SLEEP,
+                                   LPM_WAKE_SLEEP, LPM_WAKE_SLEEP,
+                                   LPM_WAKE_SLEEP, LPM_WAKE_SLEEP,
+                                   LPM_WAKE_SLEEP, LPM_WAKE_LIGHT};
+  uint32_t sleeps = m.sleeps;
+
+  // a partial console line keeps the MCU in Sleep for LPM_RX_VETO_TIME,
+  // then the veto is released and Stop resumes
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
+  CHECK(strcmp(idle(levels, 8), "zzzzzSSS") == 0);
+  CHECK(LPM_GetStopModeVeto() == 0 && m.sleeps == sleeps + 5);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_HSI);
+
+  // the same for the modem, set 500 ms into a console line
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
+  rtcNow += TICKS(500);
+  LPM_SetStopMode(LPM_MODEM_RX_Id, LPM_Disable);
+  CHECK(strcmp(idle(levels, 8), "zzzzzSSS") == 0);
+  CHECK(LPM_GetStopModeVeto() == 0);
+
+  // a line completed within the time releases its own veto
+  LPM_SetStopMode(LPM_MODEM_RX_Id, LPM_Disable);
+  rtcNow += TICKS(LPM_RX_VETO_TIME - WAKE_MS);
+  LPM_SetStopMode(LPM_MODEM_RX_Id, LPM_Enable);
+  CHECK(strcmp(idle(levels, 8), "SSSSSSSS") == 0);
+
+  // other vetoes are never released by the idle
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
+  CHECK(strcmp(idle(levels, 8), "zzzzzzzz") == 0);
+  CHECK(LPM_GetStopModeVeto() == LPM_FLASH_Id);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+}
+
+static uint8_t frameIn(void) { return 1; }
+
+static void test_stop(void) {
+  uint32_t stops = m.stops;
+  uint32_t plls = m.plls;
+
+  // the ultrasonic frame wait: each Stop is left on the PLL
+  LPM_EnterStopMode(Clock_Config, NULL);
+  CHECK(m.stops == stops + 1 && m.plls == plls + 1);
+  clockIs(RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+
+  // and not entered with a frame in already
+  LPM_EnterStopMode(Clock_Config, frameIn);
+  CHECK(m.stops == stops + 1 && m.plls == plls + 1 && host_primask == 0);
+
+  // edges counted in Stop: re-entered on HSI16 with interrupts masked,
+  // the PLL restarted once at the end
+  m.counting = 1;
+  m.edges = 2;
+  LPM_EnterStopMode(Clock_Config, NULL);
+  CHECK(m.stops == stops + 4 && m.plls == plls + 2 && m.edges == 0);
+  m.counting = 0;
+  clockIs(RCC_SYSCLKSOURCE_STATUS_PLLCLK);
+
+  // in Sleep the clock is kept
+  LPM_SetStopMode(LPM_ULT_Id, LPM_Disable);
+  LPM_EnterStopMode(Clock_Config, NULL);
+  CHECK(m.stops == stops + 4 && m.plls == plls + 2);
+  LPM_SetStopMode(LPM_ULT_Id, LPM_Enable);
+  CHECK(host_primask == 0);
+}
+
+int main(void) {
+  m.sysclk = RCC_SYSCLKSOURCE_STATUS_PLLCLK;
+  m.tickHz = PLL32_HZ;
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Disable);
+  test_levels();
+  test_rx_veto();
+  test_stop();
+  LPM_Print();
+  return host_report("lowpower");
+}
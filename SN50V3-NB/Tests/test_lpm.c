@@ -0,0 +1,137 @@
+#include "low_power_manager.h"
+#include "host.h"
+#include "hw.h"
+
+/* The Stop and Off vetoes of low_power_manager.c as the drivers hold them,
+ * overlapping: LPM_GetMode() gives the deepest mode no holder vetoes, and a
+ * veto is a flag of its ID, so the ID that set it releases it whatever the
+ * others do. The time of each veto runs on a virtual RTC of 1024 ticks a
+ * second, from the first time its ID set it, and wraps with the counter.
+ * The waits are multiples of 125 ms, whole numbers of ticks. */
+#define TICKS(ms) ((uint32_t)((uint64_t)(ms) * 1024 / 1000))
+
+static uint32_t rtcNow = 0;
+
+uint32_t HW_RTC_GetTimerValue(void) { return rtcNow; }
+
+TimerTime_t HW_RTC_Tick2ms(uint32_t tick) {
+  return (uint32_t)((uint64_t)tick * 1000 / 1024);
+}
+
+// Moves the RTC on by ms, and checks the calls left the interrupts enabled
+static void wait(uint32_t ms) {
+  CHECK(host_primask == 0);
+  rtcNow += TICKS(ms);
+}
+
+static void test_modes(void) {
+  // nothing held: Off, the deepest
+  CHECK(LPM_GetMode() == LPM_OffMode && LPM_GetStopModeVeto() == 0);
+
+  // Off vetoed by two holders, released one at a time
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Disable);
+  LPM_SetOffMode(LPM_RTC_Id, LPM_Disable);
+  CHECK(LPM_GetMode() == LPM_StopMode);
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_StopMode);
+
+  // a Stop veto over it takes the mode to Sleep, and back to Stop, not
+  // Off, once released
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
+  CHECK(LPM_GetMode() == LPM_SleepMode);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_StopMode);
+  LPM_SetOffMode(LPM_RTC_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_OffMode);
+
+  // a Stop veto alone rules out Off as well
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Disable);
+  CHECK(LPM_GetMode() == LPM_SleepMode);
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_OffMode);
+  wait(0);
+}
+
+static void test_holders(void) {
+  // Off disabled from boot, as main.c does
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Disable);
+
+  // the flash write of a datalog record inside an HX711 read, while the
+  // modem transmits
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Disable);
+  LPM_SetStopMode(LPM_MODEM_TX_Id, LPM_Disable);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
+  CHECK(LPM_GetStopModeVeto() ==
+        (LPM_HX711_Id | LPM_MODEM_TX_Id | LPM_FLASH_Id));
+  LPM_SetStopMode(LPM_MODEM_TX_Id, LPM_Enable);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_SleepMode);
+  CHECK(LPM_GetStopModeVeto() == LPM_HX711_Id);
+
+  // a second veto by the same ID is the same flag: one release ends it
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Disable);
+  LPM_SetStopMode(LPM_HX711_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_StopMode && LPM_GetStopModeVeto() == 0);
+
+  // releasing an ID that holds nothing leaves the others alone
+  LPM_SetStopMode(LPM_ULT_Id, LPM_Disable);
+  LPM_SetStopMode(LPM_1WIRE_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_SleepMode && LPM_GetStopModeVeto() == LPM_ULT_Id);
+
+  // IDs set and released together
+  LPM_SetStopMode((LPM_Id_t)(LPM_UART_RX_Id | LPM_MODEM_RX_Id), LPM_Disable);
+  LPM_SetStopMode(LPM_ULT_Id, LPM_Enable);
+  CHECK(LPM_GetStopModeVeto() == (LPM_UART_RX_Id | LPM_MODEM_RX_Id));
+  LPM_SetStopMode((LPM_Id_t)(LPM_UART_RX_Id | LPM_MODEM_RX_Id), LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_StopMode && LPM_GetStopModeVeto() == 0);
+  LPM_SetOffMode(LPM_APPLI_Id, LPM_Enable);
+  wait(0);
+}
+
+static void test_times(void) {
+  // nothing held is held for no time
+  CHECK(LPM_GetStopModeVetoTime(LPM_UART_RX_Id) == 0);
+
+  // a partial console line, then a partial modem line 250 ms later
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
+  wait(250);
+  LPM_SetStopMode(LPM_MODEM_RX_Id, LPM_Disable);
+  wait(500);
+  // more bytes of the console line do not restart its time
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
+  wait(375);
+  CHECK(LPM_GetStopModeVetoTime(LPM_UART_RX_Id) == 1125);
+  CHECK(LPM_GetStopModeVetoTime(LPM_MODEM_RX_Id) == 875);
+  // several IDs at once give the longest
+  CHECK(LPM_GetStopModeVetoTime((LPM_Id_t)(LPM_UART_RX_Id |
+                                           LPM_MODEM_RX_Id)) == 1125);
+  CHECK(LPM_GetStopModeVetoTime((LPM_Id_t)(LPM_MODEM_RX_Id |
+                                           LPM_FLASH_Id)) == 875);
+
+  // a released veto has no time, and starts over when set again
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Enable);
+  CHECK(LPM_GetStopModeVetoTime(LPM_UART_RX_Id) == 0);
+  wait(125);
+  LPM_SetStopMode(LPM_UART_RX_Id, LPM_Disable);
+  wait(250);
+  CHECK(LPM_GetStopModeVetoTime(LPM_UART_RX_Id) == 250);
+  CHECK(LPM_GetStopModeVetoTime(LPM_MODEM_RX_Id) == 1250);
+  LPM_SetStopMode((LPM_Id_t)(LPM_UART_RX_Id | LPM_MODEM_RX_Id), LPM_Enable);
+
+  // across the wrap of the RTC counter
+  rtcNow = UINT32_MAX - TICKS(125) + 1;
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Disable);
+  wait(625);
+  CHECK(rtcNow == TICKS(500));
+  CHECK(LPM_GetStopModeVetoTime(LPM_FLASH_Id) == 625);
+  LPM_SetStopMode(LPM_FLASH_Id, LPM_Enable);
+  CHECK(LPM_GetMode() == LPM_OffMode && LPM_GetStopModeVeto() == 0);
+  wait(0);
+}
+
+int main(void) {
+  test_modes();
+  test_holders();
+  test_times();
+  return host_report("lpm");
+}
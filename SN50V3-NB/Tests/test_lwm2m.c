@@ -0,0 +1,464 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include "lwm2m_client.h"
+#include "nbInit.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* The messages of the LwM2M client against golden SenML-CBOR, then a whole
+ * exchange over UDP on the loopback with a small CoAP responder standing
+ * for the server: registration, Send, observation and notifications. */
+NB nb = {.imei = "866207053462705"};
+USER user;
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t savedTime) {
+  return host_tick - savedTime;
+}
+
+static uint8_t buf[512];
+static uint16_t mid = 0x100;
+
+static const Lwm2mReading readings[] = {
+    {LWM2M_GENERIC_SENSOR, 0, 0, 3600},
+    {LWM2M_TEMPERATURE, 0, 1, 215},
+    {LWM2M_TEMPERATURE, 3, 1, -52},
+    {LWM2M_HUMIDITY, 0, 1, 456},
+};
+
+// [{-3: 1700000000, 0: "/3300/0/5700", 2: 3600}, {0: "/3303/0/5700",
+//  2: 21.5}, {0: "/3303/3/5700", 2: -5.2}, {0: "/3304/0/5700", 2: 45.6}]
+static const char senmlAll[] =
+    "84"
+    "a3221a6553f100006c2f333330302f302f3537303002190e10"
+    "a2006c2f333330332f302f3537303002fa41ac0000"
+    "a2006c2f333330332f332f3537303002fac0a66666"
+    "a2006c2f333330342f302f3537303002fa42366666";
+
+// [{-3: 1700000000, 0: "/3303/0/5700", 2: 21.5}, {0: "/3303/3/5700", ...}]
+static const char senmlTemperature[] =
+    "82"
+    "a3221a6553f100006c2f333330332f302f3537303002fa41ac0000"
+    "a2006c2f333330332f332f3537303002fac0a66666";
+
+static CoapMessage request(uint8_t type, uint8_t code) {
+  CoapMessage msg = {.type = type, .code = code, .mid = mid++, .tkl = 2};
+
+  msg.token[0] = 0xA0;
+  msg.token[1] = msg.mid & 0xFF;
+  return msg;
+}
+
+// Value of the option, -1 when absent
+static int32_t option(const CoapMessage *msg, uint16_t number) {
+  CoapOption opt = {0};
+
+  while (Coap_OptionNext(msg, &opt)) {
+    if (opt.number == number)
+      return Coap_OptionUintValue(&opt);
+  }
+  return -1;
+}
+
+// Concatenated Uri-Path or Uri-Query options, '/' or '&' before each
+static void options(const CoapMessage *msg, uint16_t number, char *out) {
+  CoapOption opt = {0};
+
+  out[0] = '\0';
+  while (Coap_OptionNext(msg, &opt)) {
+    if (opt.number == number)
+      sprintf(out + strlen(out), "%c%.*s",
+              number == COAP_OPTION_URI_PATH ? '/' : '&', opt.len,
+              opt.value);
+  }
+}
+
+static uint8_t payload(const CoapMessage *msg, const char *hex) {
+  char got[512];
+
+  host_hex(got, msg->payload, msg->payload_len);
+  if (strcmp(got, hex) != 0)
+    printf("payload %s\n     vs %s\n", got, hex);
+  return strcmp(got, hex) == 0;
+}
+
+// A request of the server through Lwm2m_Serve(), parsed back into rsp
+static uint8_t serve(const CoapMessage *in, CoapMessage *rsp) {
+  static uint8_t out[512];
+  uint8_t result;
+  CoapWriter w;
+  size_t len;
+
+  result = Lwm2m_Serve(in, &w, out, sizeof(out));
+  len = Coap_End(&w);
+  CHECK(len != 0);
+  CHECK(Coap_Parse(rsp, out, len));
+  CHECK(rsp->type == COAP_ACK && rsp->mid == in->mid);
+  CHECK(rsp->tkl == in->tkl && memcmp(rsp->token, in->token, in->tkl) == 0);
+  return result;
+}
+
+static void get(CoapMessage *in, uint8_t *msg, const char *path,
+                int32_t observe, uint16_t format, const char *data) {
+  char segments[32];
+  char *segment;
+  CoapWriter w;
+  size_t len;
+
+  strcpy(segments, path);
+  Coap_Begin(&w, msg, 128, in);
+  if (observe >= 0)
+    Coap_OptionUint(&w, COAP_OPTION_OBSERVE, observe);
+  for (segment = strtok(segments, "/"); segment != NULL;
+       segment = strtok(NULL, "/"))
+    Coap_Option(&w, COAP_OPTION_URI_PATH, segment, strlen(segment));
+  if (format != 0)
+    Coap_OptionUint(&w, COAP_OPTION_CONTENT_FORMAT, format);
+  if (data != NULL)
+    Coap_Payload(&w, data, strlen(data));
+  len = Coap_End(&w);
+  CHECK(Coap_Parse(in, msg, len));
+}
+
+// Registers the client, answering 2.01 Created with its location
+static void registered(void) {
+  CoapMessage req = request(COAP_CON, 0), msg, rsp;
+  char text[256];
+  uint8_t out[32];
+  CoapWriter w;
+
+  Lwm2m_NewFrame(readings, 4, 1700000000);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == 0);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.type == COAP_CON && msg.code == COAP_POST);
+  options(&msg, COAP_OPTION_URI_PATH, text);
+  CHECK(strcmp(text, "/rd") == 0);
+  options(&msg, COAP_OPTION_URI_QUERY, text);
+  CHECK(strcmp(text, "&ep=866207053462705&lt=604800&lwm2m=1.1&b=U&Q") == 0);
+  CHECK(option(&msg, COAP_OPTION_CONTENT_FORMAT) == COAP_FORMAT_LINK);
+  sprintf(text, "%.*s", (int)msg.payload_len, msg.payload);
+  CHECK(strcmp(text, "</3300/0>,</3303/0>,</3303/3>,</3304/0>,</19/1>") == 0);
+
+  rsp = req;
+  rsp.type = COAP_ACK;
+  rsp.code = COAP_CREATED;
+  Coap_Begin(&w, out, sizeof(out), &rsp);
+  Coap_Option(&w, COAP_OPTION_LOCATION_PATH, "rd", 2);
+  Coap_Option(&w, COAP_OPTION_LOCATION_PATH, "5a", 2);
+  CHECK(Coap_Parse(&rsp, out, Coap_End(&w)));
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_FOLLOW);
+}
+
+static void test_encoder(void) {
+  CoapMessage req = request(COAP_CON, 0), msg, in, rsp;
+  uint8_t raw[128];
+  CoapWriter w;
+  char text[64];
+
+  registered();
+  // nothing observed, the readings go with Send
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == 0);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.type == COAP_CON && msg.code == COAP_POST);
+  options(&msg, COAP_OPTION_URI_PATH, text);
+  CHECK(strcmp(text, "/dp") == 0);
+  CHECK(option(&msg, COAP_OPTION_CONTENT_FORMAT) == COAP_FORMAT_SENML_CBOR);
+  CHECK(payload(&msg, senmlAll));
+  rsp = (CoapMessage){.type = COAP_ACK, .code = COAP_CHANGED, .mid = req.mid};
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_DELIVERED);
+
+  // reads, the value of a missing object or resource being not found
+  in = request(COAP_CON, COAP_GET);
+  get(&in, raw, "/3303", -1, 0, NULL);
+  CHECK(serve(&in, &rsp) == 0);
+  CHECK(rsp.code == COAP_CONTENT && option(&rsp, COAP_OPTION_OBSERVE) < 0);
+  CHECK(payload(&rsp, senmlTemperature));
+  in = request(COAP_CON, COAP_GET);
+  get(&in, raw, "/3304/0/5700", -1, 0, NULL);
+  serve(&in, &rsp);
+  CHECK(payload(&rsp, "81a3221a6553f100006c2f333330342f302f35373030"
+                      "02fa42366666"));
+  const char *missing[] = {"/3303/1", "/3303/0/5701", "/19/0/0", "/3302",
+                           "/3303/x", "/3303/0/5700/1"};
+  for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+    in = request(COAP_CON, COAP_GET);
+    get(&in, raw, missing[i], -1, 0, NULL);
+    CHECK(serve(&in, &rsp) == 0);
+    CHECK(rsp.code == COAP_NOT_FOUND && rsp.payload_len == 0);
+  }
+  in = request(COAP_CON, COAP_PUT);
+  get(&in, raw, "/3303/0/5700", -1, 0, NULL);
+  serve(&in, &rsp);
+  CHECK(rsp.code == COAP_NOT_ALLOWED);
+
+  // downlinks, opaque to /19/1/0
+  in = request(COAP_CON, COAP_PUT);
+  get(&in, raw, "/19/1/0", -1, COAP_FORMAT_OCTET_STREAM, "\x01\x02");
+  CHECK(serve(&in, &rsp) == LWM2M_DOWNLINK && rsp.code == COAP_CHANGED);
+  in = request(COAP_CON, COAP_PUT);
+  get(&in, raw, "/19/1/0", -1, COAP_FORMAT_SENML_CBOR, "\x01");
+  CHECK(serve(&in, &rsp) == 0 && rsp.code == COAP_UNSUPPORTED_FORMAT);
+}
+
+static void test_observe(void) {
+  CoapMessage req, msg, in, first, second, rsp;
+  uint8_t raw1[128], raw2[128];
+  int32_t seq;
+  CoapWriter w;
+
+  // registered by test_encoder()
+  first = request(COAP_CON, COAP_GET);
+  get(&first, raw1, "/3303", 0, 0, NULL);
+  serve(&first, &rsp);
+  seq = option(&rsp, COAP_OPTION_OBSERVE);
+  CHECK(rsp.code == COAP_CONTENT && seq >= 0);
+  CHECK(payload(&rsp, senmlTemperature));
+  second = request(COAP_CON, COAP_GET);
+  get(&second, raw2, "/3304/0", 0, 0, NULL);
+  serve(&second, &rsp);
+  CHECK(option(&rsp, COAP_OPTION_OBSERVE) > seq);
+
+  // a confirmable notification each, in the order observed
+  Lwm2m_NewFrame(readings, 4, 0);
+  req = request(COAP_CON, 0);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == LWM2M_MORE);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.type == COAP_CON && msg.code == COAP_CONTENT);
+  CHECK(msg.tkl == first.tkl &&
+        memcmp(msg.token, first.token, first.tkl) == 0);
+  CHECK(option(&msg, COAP_OPTION_OBSERVE) > seq);
+  seq = option(&msg, COAP_OPTION_OBSERVE);
+  CHECK(payload(&msg, "82a2006c2f333330332f302f3537303002fa41ac0000"
+                      "a2006c2f333330332f332f3537303002fac0a66666"));
+  rsp = (CoapMessage){.type = COAP_ACK, .code = COAP_EMPTY, .mid = req.mid};
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_FOLLOW);
+  req = request(COAP_CON, 0);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == 0);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(memcmp(msg.token, second.token, second.tkl) == 0);
+  CHECK(option(&msg, COAP_OPTION_OBSERVE) > seq);
+  rsp.mid = req.mid;
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_DELIVERED);
+
+  // non-confirmable ones follow each other without answers
+  Lwm2m_NewFrame(readings, 4, 0);
+  req = request(COAP_NON, 0);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == LWM2M_MORE);
+  req = request(COAP_NON, 0);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == 0);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.type == COAP_NON &&
+        memcmp(msg.token, second.token, second.tkl) == 0);
+
+  // a reset cancels the observation, a GET without Observe too
+  Lwm2m_NewFrame(readings, 4, 0);
+  req = request(COAP_CON, 0);
+  Lwm2m_Uplink(&w, buf, sizeof(buf), &req);
+  rsp = (CoapMessage){.type = COAP_RST, .code = COAP_EMPTY, .mid = req.mid};
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_FOLLOW);
+  req = request(COAP_CON, 0);
+  CHECK(Lwm2m_Uplink(&w, buf, sizeof(buf), &req) == 0);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(memcmp(msg.token, second.token, second.tkl) == 0);
+  in = request(COAP_CON, COAP_GET);
+  get(&in, raw1, "/3304/0", -1, 0, NULL);
+  serve(&in, &rsp);
+  CHECK(option(&rsp, COAP_OPTION_OBSERVE) < 0);
+  Lwm2m_NewFrame(readings, 4, 0);
+  req = request(COAP_CON, 0);
+  Lwm2m_Uplink(&w, buf, sizeof(buf), &req);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.code == COAP_POST);
+
+  // a new registration ends the observations
+  first = request(COAP_CON, COAP_GET);
+  get(&first, raw1, "/3303", 0, 0, NULL);
+  serve(&first, &rsp);
+  host_tick += LWM2M_LIFETIME / 2 * 1000 + 1;
+  req = request(COAP_CON, 0);
+  Lwm2m_Uplink(&w, buf, sizeof(buf), &req);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  rsp = (CoapMessage){.type = COAP_ACK, .code = COAP_NOT_FOUND,
+                      .mid = req.mid, .tkl = req.tkl};
+  memcpy(rsp.token, req.token, req.tkl);
+  CHECK(Lwm2m_Answer(&rsp) == LWM2M_FOLLOW);
+  registered();
+  req = request(COAP_CON, 0);
+  Lwm2m_Uplink(&w, buf, sizeof(buf), &req);
+  CHECK(Coap_Parse(&msg, buf, Coap_End(&w)));
+  CHECK(msg.code == COAP_POST);
+}
+
+/* The server end of the loopback: answers the registration, the Send and
+ * the notifications, and observes /3303 once it has the first readings.
+ * A reset answers the notification numbered resetAt. */
+typedef struct {
+  int fd;
+  struct sockaddr_in client;
+  uint8_t observing;
+  CoapMessage observe;
+  int32_t seq;
+  int notified;
+  int resetAt;
+  int sent;
+  char last[512];
+} Responder;
+
+static void responder_send(Responder *r, CoapWriter *w) {
+  size_t len = Coap_End(w);
+
+  CHECK(len != 0);
+  sendto(r->fd, w->buf, len, 0, (struct sockaddr *)&r->client,
+         sizeof(r->client));
+}
+
+static void responder_step(Responder *r) {
+  static uint8_t in[512], out[512];
+  socklen_t addrLen = sizeof(r->client);
+  CoapMessage msg, rsp;
+  CoapWriter w;
+  char path[32];
+  ssize_t len;
+
+  while ((len = recvfrom(r->fd, in, sizeof(in), MSG_DONTWAIT,
+                         (struct sockaddr *)&r->client, &addrLen)) > 0) {
+    CHECK(Coap_Parse(&msg, in, len));
+    rsp = msg;
+    rsp.type = COAP_ACK;
+    rsp.tkl = 0;
+    options(&msg, COAP_OPTION_URI_PATH, path);
+    if (msg.type == COAP_ACK) {
+      // the answer to the observing GET
+      CHECK(msg.code == COAP_CONTENT && msg.mid == r->observe.mid);
+      r->seq = option(&msg, COAP_OPTION_OBSERVE);
+      CHECK(r->seq >= 0);
+      continue;
+    }
+    if (msg.code == COAP_CONTENT) {
+      // a notification, under the token of the observation
+      int32_t seq = option(&msg, COAP_OPTION_OBSERVE);
+
+      CHECK(msg.tkl == r->observe.tkl &&
+            memcmp(msg.token, r->observe.token, msg.tkl) == 0);
+      CHECK(seq > r->seq);
+      r->seq = seq;
+      host_hex(r->last, msg.payload, msg.payload_len);
+      rsp.code = COAP_EMPTY;
+      if (++r->notified == r->resetAt) {
+        rsp.type = COAP_RST;
+        r->observing = 0;
+      }
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+      responder_send(r, &w);
+      continue;
+    }
+    CHECK(msg.code == COAP_POST);
+    rsp.tkl = msg.tkl;
+    if (strncmp(path, "/rd/", 4) == 0) {
+      // the update of a registration the server has lost
+      rsp.code = COAP_NOT_FOUND;
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+    } else if (strcmp(path, "/rd") == 0) {
+      rsp.code = COAP_CREATED;
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+      Coap_Option(&w, COAP_OPTION_LOCATION_PATH, "rd", 2);
+      Coap_Option(&w, COAP_OPTION_LOCATION_PATH, "0", 1);
+    } else {
+      CHECK(strcmp(path, "/dp") == 0);
+      host_hex(r->last, msg.payload, msg.payload_len);
+      r->sent++;
+      rsp.code = COAP_CHANGED;
+      Coap_Begin(&w, out, sizeof(out), &rsp);
+    }
+    responder_send(r, &w);
+    if (r->sent != 0 && r->observing == 0) {
+      r->observe = request(COAP_CON, COAP_GET);
+      Coap_Begin(&w, out, sizeof(out), &r->observe);
+      Coap_OptionUint(&w, COAP_OPTION_OBSERVE, 0);
+      Coap_Option(&w, COAP_OPTION_URI_PATH, "3303", 4);
+      responder_send(r, &w);
+      r->observing = 1;
+    }
+  }
+}
+
+/* One cycle of the device, as nb_coap.c runs it: each uplink waits for its
+ * answer, serving the requests of the server that come with it. Returns
+ * what Lwm2m_Answer() said last. */
+static uint8_t device_cycle(int fd, Responder *r, int32_t temperature) {
+  Lwm2mReading frame[4];
+  uint8_t answer = LWM2M_FOLLOW;
+  int uplinks = 0;
+
+  memcpy(frame, readings, sizeof(frame));
+  frame[1].value = temperature;
+  Lwm2m_NewFrame(frame, 4, 1700000000);
+  while (answer == LWM2M_FOLLOW && uplinks++ < 4) {
+    CoapMessage req = request(COAP_CON, 0), msg;
+    uint8_t in[512];
+    CoapWriter w;
+    ssize_t len;
+
+    Lwm2m_Uplink(&w, buf, sizeof(buf), &req);
+    CHECK(send(fd, buf, Coap_End(&w), 0) > 0);
+    answer = 0;
+    responder_step(r);
+    while ((len = recv(fd, in, sizeof(in), MSG_DONTWAIT)) > 0) {
+      CHECK(Coap_Parse(&msg, in, len));
+      if (Coap_Matches(&msg, &req)) {
+        answer = Lwm2m_Answer(&msg);
+      } else if (msg.type == COAP_CON) {
+        uint8_t out[512];
+
+        Lwm2m_Serve(&msg, &w, out, sizeof(out));
+        CHECK(send(fd, out, Coap_End(&w), 0) > 0);
+        responder_step(r);
+      }
+    }
+  }
+  return answer;
+}
+
+static void test_loopback(void) {
+  struct sockaddr_in addr = {.sin_family = AF_INET};
+  socklen_t addrLen = sizeof(addr);
+  Responder r = {.resetAt = 2};
+  int fd;
+
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  r.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (r.fd < 0 || fd < 0 || bind(r.fd, (struct sockaddr *)&addr, addrLen) ||
+      getsockname(r.fd, (struct sockaddr *)&addr, &addrLen) ||
+      connect(fd, (struct sockaddr *)&addr, addrLen)) {
+    perror("loopback");
+    host_failures++;
+    return;
+  }
+
+  host_tick += LWM2M_LIFETIME * 1000;
+  // registered again, the readings go with Send, then /3303 is observed
+  CHECK(device_cycle(fd, &r, 215) == LWM2M_DELIVERED);
+  CHECK(r.sent == 1 && r.observing && r.seq >= 0);
+  CHECK(strcmp(r.last, senmlAll) == 0);
+  // the next readings go as a notification of the observation
+  CHECK(device_cycle(fd, &r, 230) == LWM2M_DELIVERED);
+  CHECK(r.notified == 1 && r.sent == 1);
+  CHECK(strcmp(r.last, "82a3221a6553f100006c2f333330332f302f3537303002fa41b80000"
+                       "a2006c2f333330332f332f3537303002fac0a66666") == 0);
+  // reset by the server, the readings fall back to Send
+  CHECK(device_cycle(fd, &r, 215) == LWM2M_DELIVERED);
+  CHECK(r.notified == 2 && r.sent == 2);
+  CHECK(strcmp(r.last, senmlAll) == 0);
+  close(fd);
+  close(r.fd);
+}
+
+int main(void) {
+  test_encoder();
+  test_observe();
+  test_loopback();
+  return host_report("lwm2m");
+}
@@ -0,0 +1,180 @@
+#include "nb_step.h"
+#include "event.h"
+#include "host.h"
+#include "nbInit.h"
+#include "time_server.h"
+
+/* The pacing of the NB task steps by nb_step.c, as the main loop's
+ * NbTaskHandler() runs them, against a scripted modem in place of NBTASK():
+ * it ignores commands for MODEM_BOOT_TIME after a restart, and its steps
+ * can be made to fail or to keep waiting. The timer of nb_step.c fires on
+ * the virtual clock, the step it signals running in the same ms. */
+#define MODEM_BOOT_TIME 2500 // ms, BC660K from AT+QRST=1 to its first reply
+#define RUNS 32
+
+typedef struct {
+  uint32_t ms;
+  uint8_t step;
+} Run;
+
+// The start-up sequence of nbInit.c, then the restarts
+static const uint8_t next[_AT_FLAG_INIT] = {
+    [_AT] = _AT_QRST2,         [_AT_QRST2] = _ATE, [_ATE] = _AT_QCFGEV,
+    [_AT_QCFGEV] = _AT_CGMM,   [_AT_CGMM] = _AT_IMEI,
+    [_AT_IMEI] = _AT_IDLE,     [_AT_QRST] = _AT_IDLE,
+};
+
+static uint8_t task = _AT_IDLE;
+static uint32_t signals = 0;
+static uint32_t errors = 0;
+static TimerEvent_t *timer = NULL;
+static uint32_t bootEnd = 0;
+static uint8_t fails[_AT_FLAG_INIT];
+static uint8_t waits[_AT_FLAG_INIT];
+static uint8_t qrstNoReply = 0;
+static Run runs[RUNS];
+static uint32_t count = 0;
+
+ATCmdNum NBTASK(uint8_t *t) {
+  uint8_t step = *t;
+
+  if (count < RUNS)
+    runs[count++] = (Run){host_tick, step};
+  if (step == _AT_QRST && qrstNoReply) {
+    // pulses RESET_N, then starts over from AT
+    qrstNoReply = 0;
+    bootEnd = host_tick + MODEM_BOOT_TIME;
+    *t = _AT;
+    return _AT_ERROR;
+  }
+  if (host_tick < bootEnd)
+    return _AT_ERROR; // no reply while booting
+  if (fails[step] > 0) {
+    fails[step]--;
+    return _AT_ERROR;
+  }
+  if (waits[step] > 0) {
+    waits[step]--;
+    return _AT_IDLE;
+  }
+  if (step == _AT_QRST || step == _AT_QRST2)
+    bootEnd = host_tick + MODEM_BOOT_TIME;
+  *t = next[step];
+  return _AT_IDLE;
+}
+
+void Event_Signal(uint32_t sig) { signals |= sig; }
+
+void TimerInit(TimerEvent_t *obj, void (*callback)(void)) {
+  obj->Callback = callback;
+  obj->IsRunning = false;
+  timer = obj;
+}
+
+void TimerSetValue(TimerEvent_t *obj, uint32_t value) {
+  obj->ReloadValue = value;
+}
+
+void TimerStart(TimerEvent_t *obj) {
+  obj->Timestamp = host_tick + obj->ReloadValue;
+  obj->IsRunning = true;
+}
+
+void TimerStop(TimerEvent_t *obj) { obj->IsRunning = false; }
+
+// The main loop for ms, from NbTaskStart(first)
+static void play(uint8_t first, uint32_t ms) {
+  uint32_t end = host_tick + ms;
+
+  count = 0;
+  errors = 0;
+  task = first;
+  signals |= EVENT_SIGNAL_NB;
+  while (host_tick < end) {
+    while (signals & EVENT_SIGNAL_NB) {
+      signals &= ~EVENT_SIGNAL_NB;
+      if (NbStep_Run(&task) == _AT_ERROR)
+        errors++;
+    }
+    host_tick++;
+    if (timer->IsRunning && host_tick == timer->Timestamp) {
+      timer->IsRunning = false;
+      timer->Callback();
+    }
+  }
+}
+
+// Time of the nth run of step, or 0
+static uint32_t ran(uint8_t step, uint8_t nth) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (runs[i].step == step && nth-- == 0)
+      return runs[i].ms;
+  }
+  return 0;
+}
+
+static void test_boot(void) {
+  uint32_t start = host_tick;
+
+  CHECK(MODEM_BOOT_TIME < NB_BOOT_TIME);
+  play(_AT, 20000);
+  // every step replied at its first try
+  CHECK(errors == 0 && count == 6 && task == _AT_IDLE);
+  CHECK(ran(_AT, 0) == start && ran(_AT_QRST2, 0) == start);
+  // ATE waits for the boot after AT+QRST=1
+  CHECK(ran(_ATE, 0) == start + NB_BOOT_TIME);
+  // and the steps after it follow at once
+  CHECK(ran(_AT_QCFGEV, 0) == ran(_ATE, 0));
+  CHECK(ran(_AT_CGMM, 0) == ran(_ATE, 0));
+  CHECK(ran(_AT_IMEI, 0) == ran(_ATE, 0));
+  // nothing is left to run once idle
+  CHECK(!timer->IsRunning && signals == 0);
+  printf("Start-up: %u steps in %u ms, %u failed\n", count,
+         ran(_AT_IMEI, 0) - start, errors);
+}
+
+static void test_retry(void) {
+  uint32_t start = host_tick;
+
+  // two failures of AT+CGMM, then AT+CGSN still waiting once
+  fails[_AT_CGMM] = 2;
+  waits[_AT_IMEI] = 1;
+  play(_AT_QCFGEV, 10000);
+  CHECK(errors == 2 && count == 6 && task == _AT_IDLE);
+  CHECK(ran(_AT_CGMM, 0) == start);
+  CHECK(ran(_AT_CGMM, 1) == start + NB_RETRY_TIME);
+  CHECK(ran(_AT_CGMM, 2) == start + 2 * NB_RETRY_TIME);
+  CHECK(ran(_AT_IMEI, 0) == start + 2 * NB_RETRY_TIME);
+  CHECK(ran(_AT_IMEI, 1) == start + 3 * NB_RETRY_TIME);
+  CHECK(!timer->IsRunning);
+
+  // an idle task runs nothing
+  play(_AT_IDLE, 5000);
+  CHECK(count == 0 && !timer->IsRunning);
+}
+
+static void test_restart(void) {
+  uint32_t start = host_tick;
+
+  // the restart of NbTaskHandler() after too many errors
+  play(_AT_QRST, 10000);
+  CHECK(errors == 0 && count == 1 && task == _AT_IDLE);
+  CHECK(!timer->IsRunning);
+
+  // a modem that did not reply is reset through its pin, and the start-up
+  // sequence waits for it as well
+  start = host_tick;
+  qrstNoReply = 1;
+  play(_AT_QRST, 20000);
+  CHECK(errors == 1 && count == 7 && task == _AT_IDLE);
+  CHECK(ran(_AT, 0) == start + NB_BOOT_TIME);
+  CHECK(ran(_ATE, 0) == start + 2 * NB_BOOT_TIME);
+}
+
+int main(void) {
+  NbStep_Init();
+  test_boot();
+  test_retry();
+  test_restart();
+  return host_report("nbstep");
+}
@@ -0,0 +1,159 @@
+#include "sensor_power.h"
+#include "clock.h"
+#include "energy.h"
+#include "host.h"
+#include "time_server.h"
+
+/* The 5V sensor rail of sensor_power.c through an uplink cycle on a
+ * virtual clock: nbInit.c switches it on at _AT_QSCLKOFF, as the modem
+ * leaves sleep, and txSensorSample() reads the sensors at _AT_CFUNSTA once
+ * what is left of the settle time has passed, while the modem attaches.
+ * The cycle is ready to upload when both the attach and the sampling are
+ * done. Sampling times are the fixed waits of the drivers of each model. */
+#define CFUN_TIME 300     // ms, AT+QSCLK=0 twice and AT+CFUN=1 replied
+#define ATTACH_TIME 2500  // ms, from leaving sleep to registered
+#define DS18B20_TIME 750  // conversion of a probe
+#define SHT20_TIME 420    // sht20Data(), and the 20 ms after the I2C DeInit
+#define HX711_TIME 800    // 5 samples of HX711_ReadFiltered(), tare stored
+#define LIDAR_TIME 100    // LidarLite() settle
+
+static uint32_t waits = 0;  // Clock_Wait() calls
+static uint32_t waited = 0; // ms in them
+static int rail = 0;        // Energy_Rail() accounting
+static uint32_t railTime = 0;
+static uint32_t railOnAt = 0;
+
+TimerTime_t TimerGetCurrentTime(void) { return host_tick; }
+
+TimerTime_t TimerGetElapsedTime(TimerTime_t past) { return host_tick - past; }
+
+void Clock_Wait(uint32_t ms) {
+  waits++;
+  waited += ms;
+  host_tick += ms;
+}
+
+void Energy_Rail(uint8_t on) {
+  if (on && rail == 0)
+    railOnAt = host_tick;
+  else if (!on && rail == 1)
+    railTime += host_tick - railOnAt;
+  rail = on ? 1 : 0;
+}
+
+// The rail switch on PB5, on when low, agreeing with the accounting
+static uint8_t railOn(void) {
+  uint8_t on = (host_gpio(GPIOB_BASE)->ODR & Power_5v_Pin) == 0;
+
+  CHECK(on == rail && on == Sensor_PowerIsOn());
+  return on;
+}
+
+static void test_settle(void) {
+  uint32_t start;
+
+  // a settle from off waits for all of it
+  CHECK(!railOn());
+  start = host_tick;
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == SENSOR_SETTLE_TIME);
+  CHECK(railOn() && host_tick - start == SENSOR_SETTLE_TIME);
+  // and a second one, or a longer one, only for what is left
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == 0);
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME + 200) == 200);
+  Sensor_PowerOff();
+  CHECK(!railOn() && railTime == SENSOR_SETTLE_TIME + 200);
+
+  // switched on earlier: the time since counts, and switching it on again
+  // does not restart it
+  Sensor_PowerOn();
+  host_tick += 300;
+  Sensor_PowerOn();
+  host_tick += 100;
+  waits = 0;
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == SENSOR_SETTLE_TIME - 400);
+  CHECK(waits == 1 && railOn());
+  // settled already: no wait at all
+  host_tick += 1000;
+  waits = 0;
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == 0 && waits == 0);
+
+  // switched off, it starts over
+  Sensor_PowerOff();
+  host_tick += 5000;
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == SENSOR_SETTLE_TIME);
+  Sensor_PowerOff();
+
+  // across the wrap of the clock
+  host_tick = UINT32_MAX - 99;
+  Sensor_PowerOn();
+  host_tick += 300;
+  CHECK(host_tick == 200);
+  CHECK(Sensor_PowerSettle(SENSOR_SETTLE_TIME) == SENSOR_SETTLE_TIME - 300);
+  Sensor_PowerOff();
+  CHECK(!railOn() && rail == 0);
+}
+
+// An uplink cycle from leaving sleep to ready to upload, in ms
+static uint32_t cycle(uint32_t settle, uint32_t sample, uint32_t *rail_ms) {
+  uint32_t start = host_tick;
+  uint32_t ready;
+
+  railTime = 0;
+  Sensor_PowerOn(); // _AT_QSCLKOFF
+  host_tick += CFUN_TIME;
+  Sensor_PowerSettle(settle); // _AT_CFUNSTA, txSensorSample()
+  host_tick += sample;
+  Sensor_PowerOff();
+  ready = host_tick - start;
+  CHECK(!railOn());
+  *rail_ms = railTime;
+  return ready > ATTACH_TIME ? ready : ATTACH_TIME;
+}
+
+static void test_cycle(void) {
+  static const struct {
+    char mod;
+    uint32_t sample;
+  } models[] = {
+      {model1, DS18B20_TIME + SHT20_TIME},
+      {model2, DS18B20_TIME + LIDAR_TIME},
+      {model3, SHT20_TIME},
+      {model4, 3 * DS18B20_TIME},
+      {model5, DS18B20_TIME + HX711_TIME},
+      {model6, 0},
+      {model7, SHT20_TIME},
+  };
+  static const uint16_t powerTimes[] = {0, 1000, 3000};
+
+  for (size_t p = 0; p < sizeof(powerTimes) / sizeof(powerTimes[0]); p++) {
+    uint32_t settle = SENSOR_SETTLE_TIME + powerTimes[p];
+
+    printf("power_time %u ms, attach %u ms:\n", powerTimes[p], ATTACH_TIME);
+    for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++) {
+      uint32_t sample = models[i].sample;
+      uint32_t serial = ATTACH_TIME + settle + sample;
+      uint32_t sampled = (settle > CFUN_TIME ? settle : CFUN_TIME) + sample;
+      uint32_t want = sampled > ATTACH_TIME ? sampled : ATTACH_TIME;
+      uint32_t rail_ms, total;
+
+      waited = 0;
+      total = cycle(settle, sample, &rail_ms);
+      // the settle runs under AT+CFUN=1, the sampling under the attach
+      CHECK(total == want && total < serial);
+      CHECK(waited == settle - CFUN_TIME);
+      CHECK(rail_ms == settle + sample);
+      printf("  model%c: settle %u (%u waited) + sample %u, cycle %u ms "
+             "(%u serial)\n",
+             models[i].mod, settle, waited, sample, total, serial);
+      host_tick += 60000;
+    }
+  }
+}
+
+int main(void) {
+  host_tick = 1000;
+  host_gpio(GPIOB_BASE)->ODR = Power_5v_Pin; // off from MX_GPIO_Init()
+  test_settle();
+  test_cycle();
+  return host_report("sensor");
+}
@@ -0,0 +1,396 @@
+#include "time_server.h"
+#include "host.h"
+#include "hw.h"
+
+/* The timer list of time_server.c on a virtual RTC counting in ms, a tick
+ * a ms. The alarm matches once the counter reaches it, while the timer IRQ
+ * runs as well, and may not be set closer than HW_RTC_GetMinimumTimeout()
+ * ticks ahead: one set behind the counter would only match after its wrap.
+ * As HW_RTC_SetAlarm() does for Stop mode, an alarm far enough ahead is
+ * set early by the wake-up time of the MCU, and the IRQ runs that much
+ * after it, or a tick sooner when the wake-up varies.
+ * Every timer is checked to fire no sooner than its deadline, and no later
+ * than its deadline plus slack, or the earliest alarm the RTC could take.
+ * Callbacks restart themselves and other timers inside the IRQ loop, and
+ * take time, as the firmware's do. */
+#define TIMERS 8
+#define MIN_TIMEOUT 3 // ticks, MIN_ALARM_DELAY of hw_rtc.c
+#define WAKE_UP_TIME 2 // ticks, McuWakeUpTimeCal of hw_rtc.c
+
+typedef struct {
+  TimerEvent_t event;
+  uint32_t period;   // ms
+  uint32_t slack;    // ms
+  uint32_t deadline; // time it is due
+  bool running;
+  bool periodic; // restarted by its callback
+  int chain;     // timer its callback restarts, or -1
+  uint32_t cost; // ms its callback takes
+  uint32_t fires;
+  uint32_t firedAt;
+} Timer;
+
+RTC_HandleTypeDef RtcHandle;
+
+static Timer timers[TIMERS];
+static uint32_t rtcNow = 0;
+static uint32_t rtcContext = 0;
+static uint32_t alarmAt = 0;
+static uint32_t armedAt = 0; // when the alarm was set
+static bool armed = false;
+static uint32_t wakeUp = 0; // from the alarm to its IRQ
+static bool jitter = false;  // the wake-up a tick shorter at times
+static bool inIrq = false;
+static uint32_t irqAlarm = 0; // alarm, and when it was set, of the IRQ
+static uint32_t irqArmedAt = 0;
+static uint32_t alarms = 0;
+static uint32_t fires = 0;
+static uint32_t late = 0; // fires past the slack, held by the minimum
+
+uint32_t HW_RTC_SetTimerContext(void) { return rtcContext = rtcNow; }
+
+uint32_t HW_RTC_GetTimerContext(void) { return rtcContext; }
+
+uint32_t HW_RTC_GetTimerElapsedTime(void) { return rtcNow - rtcContext; }
+
+uint32_t HW_RTC_GetTimerValue(void) { return rtcNow; }
+
+uint32_t HW_RTC_GetMinimumTimeout(void) { return MIN_TIMEOUT; }
+
+uint32_t HW_RTC_ms2Tick(TimerTime_t ms) { return ms; }
+
+TimerTime_t HW_RTC_Tick2ms(uint32_t tick) { return tick; }
+
+void HW_RTC_SetAlarm(uint32_t timeout) {
+  alarmAt = rtcContext + timeout;
+  wakeUp = (int32_t)(alarmAt - rtcNow) > MIN_TIMEOUT + WAKE_UP_TIME
+               ? WAKE_UP_TIME
+               : 0;
+  alarmAt -= wakeUp;
+  armedAt = rtcNow;
+  // behind the counter, it would not match before the wrap
+  armed = (int32_t)(alarmAt - rtcNow) > 0;
+  if ((int32_t)(alarmAt - rtcNow) < MIN_TIMEOUT)
+    printf("alarm at %u set at %u\n", alarmAt, rtcNow);
+  CHECK((int32_t)(alarmAt - rtcNow) >= MIN_TIMEOUT);
+}
+
+void HW_RTC_StopAlarm(void) { armed = false; }
+
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef *hrtc,
+                                  RTC_TimeTypeDef *sTime, uint32_t Format) {
+  memset(sTime, 0, sizeof(*sTime));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef *hrtc,
+                                  RTC_DateTypeDef *sDate, uint32_t Format) {
+  memset(sDate, 0, sizeof(*sDate));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef *hrtc,
+                                      RTC_AlarmTypeDef *sAlarm,
+                                      uint32_t Format) {
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_DeactivateAlarm(RTC_HandleTypeDef *hrtc,
+                                          uint32_t Alarm) {
+  return HAL_OK;
+}
+
+void Error_Handler(void) {}
+
+// An alarm at at, set at armed, comes in time for the timer
+static bool inTime(const Timer *t, uint32_t at, uint32_t armed) {
+  return (int32_t)(at - t->deadline) <= (int32_t)t->slack ||
+         at - armed <= MIN_TIMEOUT;
+}
+
+static void start(int i) {
+  Timer *t = &timers[i];
+
+  TimerSetValue(&t->event, t->period);
+  TimerSetSlack(&t->event, t->slack);
+  TimerStart(&t->event);
+  t->deadline = rtcNow + t->period;
+  t->running = true;
+}
+
+static void stop(int i) {
+  TimerStop(&timers[i].event);
+  timers[i].running = false;
+}
+
+static void fired(int i) {
+  Timer *t = &timers[i];
+
+  CHECK(inIrq && t->running && host_primask == 0);
+  // never before its deadline, and in time from the alarm that woke, if
+  // it was not yet due then
+  CHECK((int32_t)(rtcNow - t->deadline) >= 0);
+  if ((int32_t)(irqAlarm - t->deadline) >= 0) {
+    CHECK(inTime(t, irqAlarm, irqArmedAt));
+    if (irqAlarm - t->deadline > t->slack)
+      late++;
+  }
+  t->running = false;
+  t->fires++;
+  t->firedAt = rtcNow;
+  fires++;
+  if (t->periodic)
+    start(i);
+  if (t->chain >= 0)
+    start(t->chain);
+  rtcNow += t->cost;
+}
+
+#define CALLBACK(i)                                                            \
+  static void onTimer##i(void) { fired(i); }
+CALLBACK(0)
+CALLBACK(1)
+CALLBACK(2)
+CALLBACK(3)
+CALLBACK(4)
+CALLBACK(5)
+CALLBACK(6)
+CALLBACK(7)
+
+static void (*const callbacks[TIMERS])(void) = {
+    onTimer0, onTimer1, onTimer2, onTimer3,
+    onTimer4, onTimer5, onTimer6, onTimer7,
+};
+
+// Every running timer is listed, and the alarm armed for it in time
+static void check(void) {
+  for (int i = 0; i < TIMERS; i++) {
+    Timer *t = &timers[i];
+
+    CHECK(TimerIsStarted(&t->event) == t->running);
+    if (t->running) {
+      CHECK(armed && inTime(t, alarmAt, armedAt));
+      if (!armed || !inTime(t, alarmAt, armedAt))
+        printf("timer %d due at %u+%u, alarm %s at %u\n", i, t->deadline,
+               t->slack, armed ? "armed" : "stopped", alarmAt);
+    }
+  }
+  CHECK(host_primask == 0);
+}
+
+// The main loop until the counter reaches end, the alarms firing on the way
+static void run(uint32_t end) {
+  while (armed && (int32_t)(alarmAt - end) <= 0) {
+    // the IRQ is taken once the MCU is awake, or the one before returns
+    if (wakeUp > 0 && jitter && rand() % 2)
+      wakeUp--;
+    if ((int32_t)(alarmAt + wakeUp - rtcNow) > 0)
+      rtcNow = alarmAt + wakeUp;
+    armed = false;
+    irqAlarm = alarmAt + wakeUp;
+    irqArmedAt = armedAt;
+    alarms++;
+    inIrq = true;
+    TimerIrqHandler();
+    inIrq = false;
+    check();
+  }
+  if ((int32_t)(end - rtcNow) > 0)
+    rtcNow = end;
+}
+
+static void setup(void) {
+  for (int i = 0; i < TIMERS; i++) {
+    if (timers[i].running)
+      stop(i);
+    memset(&timers[i], 0, sizeof(timers[i]));
+    TimerInit(&timers[i].event, callbacks[i]);
+    timers[i].chain = -1;
+  }
+  alarms = fires = late = 0;
+}
+
+static void test_coalesce(void) {
+  uint32_t now;
+
+  setup();
+  now = rtcNow;
+  // the second deadline falls within the first one's slack: one alarm at
+  // the second
+  timers[0].period = 1000;
+  timers[0].slack = 200;
+  timers[1].period = 1100;
+  start(0);
+  start(1);
+  check();
+  run(now + 2000);
+  CHECK(alarms == 1 && fires == 2);
+  CHECK(timers[0].firedAt == now + 1100 && timers[1].firedAt == now + 1100);
+
+  // one past it is taken at the first one's slack, and the tight one after
+  // it by its own alarm
+  now = rtcNow;
+  timers[1].period = 1300;
+  timers[2].period = 1150;
+  start(0);
+  start(1);
+  start(2);
+  run(now + 2000);
+  CHECK(alarms == 3 && fires == 5);
+  CHECK(timers[0].firedAt == now + 1150 && timers[2].firedAt == now + 1150);
+  CHECK(timers[1].firedAt == now + 1300);
+
+  // a tight timer started after the alarm is armed brings it forward
+  now = rtcNow;
+  timers[0].slack = 5000;
+  start(0);
+  run(now + 500);
+  start(2);
+  check();
+  run(now + 2000);
+  CHECK(timers[0].firedAt == now + 1650 && timers[2].firedAt == now + 1650);
+  CHECK(!timers[0].running && !armed);
+}
+
+static void test_restart(void) {
+  uint32_t now;
+
+  setup();
+  now = rtcNow;
+  // a periodic timer restarted by its own callback keeps its period, with
+  // a longer timer listed behind it
+  timers[0].period = 1000;
+  timers[0].periodic = true;
+  timers[1].period = 10500;
+  start(0);
+  start(1);
+  run(now + 10000);
+  CHECK(timers[0].fires == 10 && timers[0].firedAt == now + 10000);
+  run(now + 10500);
+  CHECK(timers[1].fires == 1 && timers[1].firedAt == now + 10500);
+  stop(0);
+
+  // a callback starting a timer due before everything listed: the new
+  // head is armed from inside the IRQ loop
+  now = rtcNow;
+  timers[1].period = 100;
+  timers[1].chain = 2;
+  timers[2].period = 20;
+  timers[3].period = 5000;
+  start(1);
+  start(3);
+  run(now + 100);
+  CHECK(timers[2].running && armed && alarmAt + wakeUp == now + 120);
+  run(now + 200);
+  CHECK(timers[2].fires == 1 && timers[2].firedAt == now + 120);
+
+  // a callback restarting a timer due on the same alarm: it is pushed back,
+  // not fired, and the timers after it still are
+  now = rtcNow;
+  timers[1].chain = 4;
+  timers[4].period = 100;
+  timers[4].slack = 50;
+  timers[5].period = 120;
+  timers[5].slack = 0;
+  start(1);
+  start(4);
+  start(5);
+  run(now + 120);
+  CHECK(timers[4].fires == 0 && timers[4].running);
+  CHECK(timers[4].deadline == now + 200 && timers[5].fires == 1);
+  run(now + 400);
+  CHECK(timers[4].fires == 1 && timers[4].firedAt == now + 250);
+
+  // a callback that outlasts the next deadline: it runs in the same IRQ
+  now = rtcNow;
+  timers[1].chain = -1;
+  timers[1].cost = 15;
+  timers[6].period = 105;
+  start(1);
+  start(6);
+  run(now + 100);
+  CHECK(timers[6].fires == 1 && timers[6].firedAt == now + 115);
+  run(now + 1000);
+  check();
+  stop(3);
+  run(now + 10000);
+  CHECK(!armed);
+}
+
+// Deadlines a tick or two apart, closer than the RTC can be armed
+static void test_close(void) {
+  uint32_t now;
+
+  setup();
+  now = rtcNow;
+  timers[0].period = 10;
+  timers[0].chain = 1;
+  timers[1].period = 11;
+  timers[2].period = 22;
+  timers[3].period = 23;
+  start(0);
+  start(2);
+  start(3);
+  run(now + 100);
+  check();
+  CHECK(timers[1].fires == 1 && timers[1].firedAt == now + 21);
+  // the two after it on the earliest alarm the RTC takes, in order
+  CHECK(timers[2].fires == 1 && timers[2].firedAt == now + 21 + MIN_TIMEOUT);
+  CHECK(timers[3].fires == 1 && timers[3].firedAt == now + 21 + MIN_TIMEOUT);
+  CHECK(!armed);
+}
+
+// Timers of the firmware's periods started, stopped and restarted at random
+// from the main loop and from each other's callbacks, for simulated days
+static void test_random(void) {
+  static const uint32_t periods[] = {
+      10, 25, 100, 500, 1000, 3000, 12000, 60000, 1200000, 86400000,
+  };
+  uint32_t begin = rtcNow;
+
+  setup();
+  srand(33);
+  jitter = true;
+  for (int i = 0; i < TIMERS; i++) {
+    Timer *t = &timers[i];
+
+    t->period = periods[rand() % (sizeof(periods) / sizeof(periods[0]))];
+    t->period += rand() % 7;
+    t->slack = rand() % 3 ? TIMER_PERIOD_SLACK(t->period) : 0;
+    // the firmware's short timers are one-shot
+    t->periodic = t->period >= 1000 && rand() % 2;
+    t->chain = rand() % 3 ? -1 : rand() % TIMERS;
+    t->cost = rand() % 4 == 0 ? rand() % 5 : 0;
+    start(i);
+  }
+  for (int step = 0; step < 100000; step++) {
+    int i = rand() % TIMERS;
+
+    run(rtcNow + (rand() % 4 ? rand() % 50 : rand() % 100000));
+    switch (rand() % 4) {
+    case 0:
+      start(i);
+      break;
+    case 1:
+      stop(i);
+      break;
+    default:
+      if (!timers[i].running)
+        start(i);
+      break;
+    }
+    check();
+  }
+  CHECK(fires > 0 && host_primask == 0);
+  printf("%u timer fires on %u alarms over %u days, %u held by the minimum "
+         "timeout\n",
+         fires, alarms, (rtcNow - begin) / 86400000, late);
+}
+
+int main(void) {
+  test_coalesce();
+  test_restart();
+  test_close();
+  test_random();
+  return host_report("timer");
+}
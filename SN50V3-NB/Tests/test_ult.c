@@ -0,0 +1,220 @@
+#include "ult.h"
+#include "host.h"
+#include "lowpower.h"
+#include "time_server.h"
+
+/* The ultrasonic sensor readout of ult.c, mode2_flag 3, fed with recorded
+ * USART1 captures on a virtual clock. The sensor sends a frame of 0xFF,
+ * DATA_H, DATA_L and SUM every 100 ms at 9600 baud, a byte a ms; the
+ * receive callback of main.c keeps the first 40 bytes. Stop lasts until
+ * the next byte or the timeout alarm, and is only entered when ready() of
+ * ULT_WaitFrame() says nothing came in since the buffer was looked at. */
+#define FRAME_TIME 100 // ms between two frames
+#define BYTES_MAX 64
+
+uint8_t rxbuf_u1 = 0;
+uint8_t rxDATA_u1[100] = {0};
+uint8_t rxlen_u1 = 0;
+bool tdc_clock_log_flag = 0;
+UART_HandleTypeDef huart1;
+
+static struct {
+  uint32_t at;
+  uint8_t byte;
+} line[BYTES_MAX];
+static size_t lineLen = 0;
+static size_t lineNext = 0;
+static TimerEvent_t *timer = NULL;
+static uint8_t vetoed = 0;
+static uint8_t listening = 0; // USART1 wake-up from Stop enabled
+static uint32_t stops = 0;
+static uint32_t badVetoes = 0; // Stop allowed with a frame half received
+
+void SystemClock_Config(void) {}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart,
+                                      uint8_t *pData, uint16_t Size) {
+  return HAL_OK;
+}
+
+void My_UARTEx_StopModeWakeUp(UART_HandleTypeDef *uartHandle) {
+  listening = 1;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_DisableStopMode(UART_HandleTypeDef *huart) {
+  listening = 0;
+  return HAL_OK;
+}
+
+void TimerInit(TimerEvent_t *obj, void (*callback)(void)) {
+  obj->Callback = callback;
+  obj->IsRunning = false;
+  timer = obj;
+}
+
+void TimerSetValue(TimerEvent_t *obj, uint32_t value) {
+  obj->ReloadValue = value;
+}
+
+void TimerStart(TimerEvent_t *obj) {
+  obj->Timestamp = host_tick + obj->ReloadValue;
+  obj->IsRunning = true;
+}
+
+void TimerStop(TimerEvent_t *obj) { obj->IsRunning = false; }
+
+void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode) {
+  CHECK(id == LPM_ULT_Id);
+  vetoed = mode == LPM_Disable;
+}
+
+// HAL_UART_RxCpltCallback() of main.c for USART1
+static void receive(void) {
+  rxbuf_u1 = line[lineNext++].byte;
+  if (rxlen_u1 < 40)
+    rxDATA_u1[rxlen_u1++] = rxbuf_u1;
+}
+
+void LPM_EnterStopMode(void (*Clock_Config)(void), uint8_t (*ready)(void)) {
+  // the bytes that came in while the buffer was looked at
+  while (lineNext < lineLen && line[lineNext].at <= host_tick)
+    receive();
+  if (ready())
+    return;
+  stops++;
+  if (!vetoed && rxlen_u1 % ULT_FRAME_SIZE != 0)
+    badVetoes++;
+  CHECK(listening && timer->IsRunning);
+  if (lineNext < lineLen && line[lineNext].at < timer->Timestamp) {
+    host_tick = line[lineNext].at;
+    receive();
+  } else {
+    host_tick = timer->Timestamp;
+    timer->IsRunning = false;
+    timer->Callback();
+  }
+}
+
+/* A capture of frames in hex, one every FRAME_TIME from now; a frame may
+ * be cut short or hold anything the line carried */
+static void capture(const char *const *frames, size_t count) {
+  uint32_t start = host_tick + 1;
+
+  lineLen = lineNext = 0;
+  for (size_t f = 0; f < count; f++) {
+    uint8_t bytes[BYTES_MAX];
+    size_t n = host_unhex(bytes, frames[f]);
+
+    for (size_t i = 0; i < n; i++) {
+      CHECK(lineLen < BYTES_MAX);
+      line[lineLen].at = start + f * FRAME_TIME + i;
+      line[lineLen++].byte = bytes[i];
+    }
+  }
+}
+
+// A reading of txSensorSample(), returning its distance
+static int reading(uint32_t *ms) {
+  uint32_t start = host_tick;
+
+  ULT_Rest();
+  ULT_getData();
+  *ms = host_tick - start;
+  CHECK(!listening && !timer->IsRunning && !vetoed);
+  return ULT_Data_processing();
+}
+
+static void test_frames(void) {
+  static const struct {
+    const char *frames[8];
+    size_t count;
+    int distance; // mm
+    uint32_t ms;  // to read it
+  } cases[] = {
+      // two frames, 1953 and 1955 mm
+      {{"FF07A1A7", "FF07A3A9"}, 2, 1954, FRAME_TIME + 4},
+      // joined in the middle of a frame
+      {{"A1A7", "FF07A1A7", "FF07A3A9"}, 3, 1954, 2 * FRAME_TIME + 4},
+      // a bad checksum, and a frame of no distance, are skipped
+      {{"FF07A100", "FF0000FF", "FF07A1A7", "FF07A3A9"}, 4, 1954,
+       3 * FRAME_TIME + 4},
+      // 0xFF in the data, and a SUM that could start a frame
+      {{"FFFF02", "FF01FFFF", "FF030002"}, 3, (0x1FF + 0x300) / 2,
+       2 * FRAME_TIME + 4},
+      // line noise filling most of the buffer before the frames
+      {{"00000000000000000000000000000000000000000000000000000000000000",
+        "FF07A1A7", "FF07A3A9"},
+       3, 1954, 2 * FRAME_TIME + 4},
+      // the second frame cut short: the first alone, after the timeout
+      {{"FF07A1A7", "FF07"}, 2, 1953, ULT_DATA_TIMEOUT},
+      // a frame of no distance alone is no reading
+      {{"FF0000FF", "FF0000FF", "FF00"}, 3, 0, ULT_DATA_TIMEOUT},
+      // nothing at all
+      {{""}, 1, 0, ULT_DATA_TIMEOUT},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    uint32_t ms;
+    int distance;
+
+    badVetoes = 0;
+    capture(cases[i].frames, cases[i].count);
+    distance = reading(&ms);
+    if (distance != cases[i].distance || ms != cases[i].ms)
+      printf("case %d: %d mm in %u ms\n", (int)i, distance, ms);
+    CHECK(distance == cases[i].distance && ms == cases[i].ms);
+    CHECK(badVetoes == 0);
+    host_tick += 1000;
+  }
+}
+
+static void test_wake(void) {
+  static const char *const frames[] = {"FF07A1A7", "FF07A3A9"};
+  uint32_t ms;
+
+  // Stop entered once per byte, and left by it
+  stops = 0;
+  capture(frames, 2);
+  CHECK(reading(&ms) == 1954 && stops == 2 * ULT_FRAME_SIZE);
+
+  // the end of the last frame coming in as the buffer was looked at is
+  // taken without entering Stop, and without waiting for the timeout
+  stops = 0;
+  capture(frames, 2);
+  line[5].at = line[6].at = line[7].at = line[4].at;
+  CHECK(reading(&ms) == 1954 && stops == ULT_FRAME_SIZE + 1);
+  CHECK(ms == FRAME_TIME + 1);
+  host_tick += 1000;
+}
+
+static void test_connection(void) {
+  static const char *const one[] = {"FF07A1A7"};
+  static const char *const noise[] = {"00FF"};
+  uint32_t start;
+
+  // a frame, and the test ends on it
+  ULT_Rest();
+  capture(one, 1);
+  start = host_tick;
+  CHECK(ULT_Connection_Test() == 1 && host_tick - start == 4);
+
+  // a sensor sending a start byte without a valid frame is still there
+  ULT_Rest();
+  capture(noise, 1);
+  start = host_tick;
+  CHECK(ULT_Connection_Test() == 1);
+  CHECK(host_tick - start == ULT_TEST_TIMEOUT);
+
+  // and one sending nothing is not
+  ULT_Rest();
+  capture(NULL, 0);
+  CHECK(ULT_Connection_Test() == 0);
+  CHECK(!listening && !timer->IsRunning && !vetoed);
+}
+
+int main(void) {
+  test_frames();
+  test_wake();
+  test_connection();
+  return host_report("ult");
+}
@@ -0,0 +1,327 @@
+#include "weight.h"
+#include "energy.h"
+#include "flash_eraseprogram.h"
+#include "host.h"
+#include "low_power_manager.h"
+#include "time_server.h"
+
+/* The HX711 reads of weight.c against a model of the chip on PB6 (PD_SCK)
+ * and PB7 (DOUT), on a virtual clock. The chip converts every HX711_RATE
+ * ms, the first conversion HX711_SETTLE ms after power-up, and powers down
+ * when SCK stays high; a conversion is shifted out MSB first on the rising
+ * edges of SCK. WFI sleeps until the next DOUT edge or timer alarm when
+ * SysTick is suspended, and for 1 ms otherwise. The filtered readings are
+ * checked against the median-of-3 of the samples the chip returned. */
+#define HX711_RATE 100   // ms per conversion, RATE pin low
+#define HX711_SETTLE 400 // ms from power-up to the first conversion
+#define SCK WEIGHT_SCK_PIN
+#define DOUT WEIGHT_DOUT_PIN
+#define SAMPLES_MAX 16
+
+// Reading of a signed conversion, in offset binary
+#define OFFSET(s) ((uint32_t)((s) + 0x800000))
+
+SENSOR sensor;
+extern uint32_t Weight_Maopi;
+
+static struct {
+  uint8_t present;
+  uint8_t ready; // DOUT low, a conversion to shift out
+  uint8_t bits;  // of it shifted out
+  uint32_t readyAt;
+  uint32_t sckHighAt;
+  int32_t samples[SAMPLES_MAX];
+  size_t count;
+  size_t next;
+  uint32_t powerUps;
+  uint32_t unmasked; // SCK pulses with interrupts enabled
+} hx;
+
+static TimerEvent_t *timer = NULL;
+static uint8_t extiPending = 0;
+static uint8_t alarmPending = 0;
+static uint32_t wakes = 0;
+static uint32_t tickWakes = 0;
+static uint32_t others = 0; // wake-ups by other interrupts to come
+static int vetoes = 0;
+static int flashOn = 0;
+
+static void dout(uint8_t level) {
+  GPIO_TypeDef *port = host_gpio(GPIOB_BASE);
+
+  port->IDR = level ? port->IDR | DOUT : port->IDR & ~DOUT;
+}
+
+static uint8_t sckHigh(void) {
+  return (host_gpio(GPIOB_BASE)->ODR & SCK) != 0;
+}
+
+// DOUT falls once the conversion is done, and the alarm comes due
+static void update(void) {
+  if (hx.present && !hx.ready && !sckHigh() && host_tick >= hx.readyAt) {
+    hx.ready = 1;
+    dout(0);
+    extiPending = host_exti[7] == GPIOB_BASE;
+  }
+  if (timer != NULL && timer->IsRunning && host_tick >= timer->Timestamp)
+    alarmPending = 1;
+}
+
+static void advance(uint32_t to) {
+  host_gpio_sync();
+  host_tick = to;
+  update();
+}
+
+void host_gpio_output(uint32_t base, uint32_t before, uint32_t after) {
+  if (base != GPIOB_BASE || ((before ^ after) & SCK) == 0 || !hx.present)
+    return;
+  if (after & SCK) {
+    hx.sckHighAt = host_tick;
+    if (!hx.ready)
+      return;
+    if (host_primask == 0)
+      hx.unmasked++;
+    if (hx.bits < 24) {
+      int32_t s = hx.samples[hx.next % hx.count];
+
+      dout(((uint32_t)s & 0xFFFFFF) >> (23 - hx.bits++) & 1);
+    } else {
+      // the 25th pulse ends the readout, gain 128 on channel A
+      dout(1);
+      hx.ready = 0;
+      hx.bits = 0;
+      hx.next++;
+      hx.readyAt = host_tick + HX711_RATE;
+    }
+  } else if (host_tick - hx.sckHighAt >= 1) {
+    // high for more than 60 us: the chip was powered down, and restarts
+    dout(1);
+    hx.ready = 0;
+    hx.bits = 0;
+    hx.readyAt = host_tick + HX711_SETTLE;
+    hx.powerUps++;
+  }
+}
+
+void host_wfi(void) {
+  uint32_t next = UINT32_MAX;
+
+  CHECK(host_primask == 1);
+  wakes++;
+  if (extiPending || alarmPending)
+    return;
+  if (others > 0) {
+    others--;
+    return;
+  }
+  if (!host_tick_suspended) {
+    tickWakes++;
+    advance(host_tick + 1);
+    return;
+  }
+  if (hx.present && !hx.ready && !sckHigh())
+    next = hx.readyAt;
+  if (timer != NULL && timer->IsRunning && timer->Timestamp < next)
+    next = timer->Timestamp;
+  if (next == UINT32_MAX) {
+    printf("WFI with no wake-up source\n");
+    exit(host_report("weight"));
+  }
+  advance(next);
+}
+
+// HAL_GPIO_EXTI_Callback() of main.c for line 7, and the timer alarm
+void host_irq(void) {
+  if (extiPending) {
+    extiPending = 0;
+    if (HX711_IsWaiting())
+      HX711_DoutReady();
+  }
+  if (alarmPending) {
+    alarmPending = 0;
+    timer->IsRunning = false;
+    timer->Callback();
+  }
+}
+
+void TimerInit(TimerEvent_t *obj, void (*callback)(void)) {
+  obj->Callback = callback;
+  obj->IsRunning = false;
+  timer = obj;
+}
+
+void TimerSetValue(TimerEvent_t *obj, uint32_t value) {
+  obj->ReloadValue = value;
+}
+
+void TimerStart(TimerEvent_t *obj) {
+  obj->Timestamp = host_tick + obj->ReloadValue;
+  obj->IsRunning = true;
+}
+
+void TimerStop(TimerEvent_t *obj) { obj->IsRunning = false; }
+
+void LPM_SetStopMode(LPM_Id_t id, LPM_SetMode_t mode) {
+  CHECK(id == LPM_HX711_Id || id == LPM_FLASH_Id);
+  vetoes += mode == LPM_Disable ? 1 : -1;
+}
+
+void Energy_Flash(uint8_t on) { flashOn += on ? 1 : -1; }
+
+static void samples(const int32_t *s, size_t count) {
+  memcpy(hx.samples, s, count * sizeof(s[0]));
+  hx.count = count;
+  hx.next = 0;
+}
+
+// The pins as common.c leaves them between two readings
+static void idle(uint32_t ms) {
+  advance(host_tick + ms);
+  CHECK(sckHigh() && host_exti[7] == GPIOA_BASE && !HX711_IsWaiting());
+  CHECK(vetoes == 0 && host_primask == 0 && !host_tick_suspended);
+  CHECK(timer == NULL || !timer->IsRunning);
+  CHECK(hx.unmasked == 0);
+}
+
+static void test_timing(void) {
+  static const int32_t flat[] = {1000};
+  uint32_t start, value;
+
+  // the chip powered with the sensor rail
+  hx.present = 1;
+  hx.readyAt = host_tick + HX711_SETTLE;
+  dout(1);
+  WEIGHT_SCK_Init();
+  WEIGHT_DOUT_Init();
+  samples(flat, 1);
+
+  start = host_tick;
+  wakes = tickWakes = 0;
+  value = HX711_ReadFiltered(HX711_SAMPLES);
+  CHECK(value == OFFSET(1000));
+  // a wake-up per conversion, none from SysTick
+  CHECK(host_tick - start == HX711_SETTLE + (HX711_SAMPLES - 1) * HX711_RATE);
+  CHECK(wakes == HX711_SAMPLES && tickWakes == 0);
+  printf("%d samples in %u ms, %u wake-ups\n", HX711_SAMPLES,
+         host_tick - start, wakes);
+  idle(10000);
+
+  // the next reading starts from power-down; other interrupts wake the
+  // core meanwhile, and it goes back to sleep
+  start = host_tick;
+  hx.powerUps = 0;
+  wakes = 0;
+  others = 3;
+  HX711_ReadFiltered(HX711_SAMPLES);
+  CHECK(hx.powerUps == 1 && wakes == HX711_SAMPLES + 3);
+  CHECK(host_tick - start == HX711_SETTLE + (HX711_SAMPLES - 1) * HX711_RATE);
+  idle(10000);
+
+  // a conversion done before the read is taken without sleeping
+  CHECK(HX711_Read() == OFFSET(1000));
+  advance(host_tick + HX711_RATE + 50);
+  wakes = 0;
+  start = host_tick;
+  CHECK(HX711_Read() == OFFSET(1000) && wakes == 0 && host_tick == start);
+  HX711_PowerDown();
+  idle(10000);
+}
+
+static void test_timeout(void) {
+  uint32_t start = host_tick;
+  uint32_t writes = host_eeprom_writes;
+
+  // no chip on the pins: DOUT never falls
+  hx.present = 0;
+  dout(1);
+  Weight_Maopi = 1234;
+  wakes = tickWakes = 0;
+  CHECK(HX711_ReadFiltered(HX711_SAMPLES) == 1234);
+  CHECK(host_tick - start == HX711_READY_TIMEOUT);
+  CHECK(wakes == 1 && tickWakes == 0);
+  idle(1000);
+
+  // and no tare is stored
+  Get_Maopi();
+  CHECK(Weight_Maopi == 1234 && host_eeprom_writes == writes);
+  idle(1000);
+  hx.present = 1;
+}
+
+static void test_filter(void) {
+  static const struct {
+    int32_t raw[SAMPLES_MAX];
+    uint8_t n;
+    int32_t want;
+  } cases[] = {
+      // a spike anywhere is taken out, the ends included
+      {{100, 100, 9000, 100, 100}, 5, 100},
+      {{9000, 100, 100, 100, 100}, 5, 100},
+      {{100, 100, 100, 100, 9000}, 5, 100},
+      {{9000, 100, 100, 100, 9000}, 5, 100},
+      // a slope keeps its inner samples, each end takes its neighbour's
+      {{100, 200, 300, 400, 500}, 5, (200 + 200 + 300 + 400 + 400) / 5},
+      // below zero, and the bottom of the range
+      {{-5, -5, -5, -5, -5}, 5, -5},
+      {{-0x800000, -0x800000, -0x800000}, 3, -0x800000},
+      // too few for a median: the mean
+      {{100, 9000}, 2, 4550},
+      {{7}, 1, 7},
+      {{3, 1, 2}, 3, 2},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    uint32_t value;
+
+    samples(cases[i].raw, cases[i].n);
+    value = HX711_ReadFiltered(cases[i].n);
+    if (value != OFFSET(cases[i].want))
+      printf("case %d: %d, expected %d\n", (int)i, (int)(value - 0x800000),
+             cases[i].want);
+    CHECK(value == OFFSET(cases[i].want));
+    CHECK(hx.next == cases[i].n);
+    idle(10000);
+  }
+}
+
+static void test_tare(void) {
+  static const int32_t empty[] = {5000, 5003, 4998};
+  static const int32_t loaded[] = {5000 + 400 * 250};
+  uint32_t writes;
+
+  host_eeprom_clear();
+  samples(empty, 3);
+  Get_Maopi();
+  CHECK(Weight_Maopi == OFFSET(5000));
+  // the tare and its flag, written with the flash veto and accounting
+  CHECK(host_eeprom_writes == 2 && vetoes == 0 && flashOn == 0);
+  CHECK(*(volatile uint32_t *)EEPROM_USER_WEIGHT_TARE == OFFSET(5000));
+  CHECK(*(volatile uint32_t *)EEPROM_USER_WEIGHT_TARE_FLAG ==
+        HX711_TARE_VALID);
+  idle(10000);
+
+  // a new tare rewrites the value only
+  writes = host_eeprom_writes;
+  Get_Maopi();
+  CHECK(host_eeprom_writes - writes == 1);
+  idle(10000);
+
+  // and is loaded after a reset
+  Weight_Maopi = 0;
+  CHECK(Weight_Tare_Load() && Weight_Maopi == OFFSET(5000));
+
+  sensor.GapValue = 400;
+  samples(loaded, 1);
+  CHECK(Get_Weight() == 250);
+  idle(10000);
+}
+
+int main(void) {
+  host_eeprom_clear();
+  test_timing();
+  test_timeout();
+  test_filter();
+  test_tare();
+  return host_report("weight");
+}